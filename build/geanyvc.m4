@@ -24,6 +24,27 @@ AC_DEFUN([GP_CHECK_GEANYVC],
 
     GP_STATUS_FEATURE_ADD([GeanyVC GtkSpell support], [$enable_gtkspell])
 
+    AC_ARG_ENABLE(geanyvc-libgit2,
+        AC_HELP_STRING([--enable-geanyvc-libgit2=ARG],
+            [Run git commands of GeanyVC through libgit2. [[default=auto]]]),,
+        enable_geanyvc_libgit2=auto)
+
+    if [[ x"$enable_geanyvc_libgit2" = "xauto" ]]; then
+        PKG_CHECK_MODULES(LIBGIT2, [libgit2 >= 0.21],
+            enable_geanyvc_libgit2=yes, enable_geanyvc_libgit2=no)
+    elif [[ x"$enable_geanyvc_libgit2" = "xyes" ]]; then
+        PKG_CHECK_MODULES(LIBGIT2, [libgit2 >= 0.21])
+    fi
+    if [[ x"$enable_geanyvc_libgit2" = "xyes" ]]; then
+        AC_DEFINE(USE_LIBGIT2, 1, [libgit2 support in GeanyVC])
+    fi
+
+    if [[ "$enable_geanyvc_libgit2" = yes -a "$enable_geanyvc" = no ]]; then
+       AC_MSG_WARN([libgit2 support for GeanyVC enabled, but GeanyVC itself not enabled.])
+    fi
+
+    GP_STATUS_FEATURE_ADD([GeanyVC libgit2 support], [$enable_geanyvc_libgit2])
+
     AC_CONFIG_FILES([
         geanyvc/Makefile
         geanyvc/src/Makefile
@@ -38,6 +38,7 @@ extern GeanyData		*geany_data;
 
 #include "breakpoint.h"
 #include "debug_module.h"
+#include "gdb_mi.h"
 
 /* module features */
 #define MODULE_FEATURES MF_ASYNC_BREAKS
@@ -50,6 +51,11 @@ extern GeanyData		*geany_data;
 /* GDB prompt */
 #define GDB_PROMPT "(gdb) \n"
 
+/* maximum number of commands written to GDB whose results are not read yet,
+the others wait in a queue. Keeps GDB input pipe from filling up
+while GDB is blocked writing output nobody reads yet */
+#define MAX_COMMANDS_IN_FLIGHT 64
+
 /* enumeration for GDB command execution status */
 typedef enum _result_class {
 	RC_DONE,
@@ -57,12 +63,37 @@ typedef enum _result_class {
 	RC_ERROR
 } result_class;
 
+/* callback called with the result record of a command, takes the ownership
+of the record, which is NULL if GDB has exited before the result */
+typedef void (*command_callback)(result_class rc, mi_record *record, gpointer data);
+
+/* structure to keep a command, tagged with a token GDB puts before its result record */
+typedef struct _command_request {
+	guint token;
+	gchar *command;
+	command_callback callback;
+	gpointer data;
+} command_request;
+
+/* structure to keep a result of a command executed syncronously */
+typedef struct _command_result {
+	result_class rc;
+	mi_record *record;
+} command_result;
+
+/* structure to keep a record read while waiting for results, with its line */
+typedef struct _deferred_record {
+	gchar *line;
+	mi_record *record;
+} deferred_record;
+
 /* structure to keep async command data (command line, messages) */
 typedef struct _queue_item {
 	GString *message;
 	GString *command;
 	GString *error_message;
 	gboolean format_error_message;
+	gboolean last;
 } queue_item;
 
 /* enumeration for stop reason */
@@ -99,6 +130,27 @@ static GIOChannel *gdb_ch_out;
 /* GDB output event source id */
 static guint gdb_id_out;
 
+/* last token a command was tagged with */
+static guint last_token = 0;
+
+/* commands waiting to be written to GDB */
+static GQueue *commands_waiting = NULL;
+
+/* commands written to GDB, waiting for their results, oldest first */
+static GQueue *commands_in_flight = NULL;
+
+/* records read while waiting for results, handled when the outermost wait is over */
+static GQueue *deferred_records = NULL;
+
+/* idle source handling the deferred records */
+static guint deferred_src_id = 0;
+
+/* number of nested wait_for_results() calls */
+static guint wait_depth = 0;
+
+/* set if one of startup commands failed */
+static gboolean startup_failed = FALSE;
+
 /* buffer for the error message */
 char err_message[1000];
 
@@ -111,8 +163,12 @@ static GList *autos = NULL;
 /* watches list */
 static GList *watches = NULL;
 
-/* loaded files list */
-static GList *files = NULL;
+/* changes of the children objects reported by the last update,
+internal name -> variable_change */
+static GHashTable *changed_children = NULL;
+
+/* loaded files set, full name -> full name */
+static GHashTable *files = NULL;
 
 /* set to true if library was loaded/unloaded
 and it's nessesary to refresh files list */
@@ -121,12 +177,16 @@ static gboolean file_refresh_needed = FALSE;
 /* current frame number */
 static int active_frame = 0;
 
+/* the thread program was stopped in last time */
+static int stopped_thread_id = 0;
+
 /* forward declarations */
 static void stop(void);
 static variable* add_watch(gchar* expression);
-static void update_watches(void);
-static void update_autos(void);
+static void update_variables(void);
 static void update_files(void);
+static void cancel_commands(void);
+static void drop_deferred_records(void);
 
 /*
  * print message using color, based on message type
@@ -174,23 +234,44 @@ static void on_gdb_exit(GPid pid, gint status, gpointer data)
 {
 	gdb_pid = target_pid = 0;
 	g_spawn_close_pid(pid);
+
+	/* stop reading GDB output */
+	if (gdb_id_out)
+	{
+		g_source_remove(gdb_id_out);
+		gdb_id_out = 0;
+	}
+
 	shutdown_channel(&gdb_ch_in);
 	shutdown_channel(&gdb_ch_out);
 	
+	/* commands left without results */
+	cancel_commands();
+	drop_deferred_records();
+	
 	/* delete autos */
-	g_list_foreach(autos, (GFunc)g_free, NULL);
+	g_list_foreach(autos, (GFunc)variable_free, NULL);
 	g_list_free(autos);
 	autos = NULL;
 	
 	/* delete watches */
-	g_list_foreach(watches, (GFunc)g_free, NULL);
+	g_list_foreach(watches, (GFunc)variable_free, NULL);
 	g_list_free(watches);
 	watches = NULL;
 	
 	/* delete files */
-	g_list_foreach(files, (GFunc)g_free, NULL);
-	g_list_free(files);
-	files = NULL;
+	if (files)
+	{
+		g_hash_table_destroy(files);
+		files = NULL;
+	}
+
+	/* delete children changes */
+	if (changed_children)
+	{
+		g_hash_table_destroy(changed_children);
+		changed_children = NULL;
+	}
 	
 	g_source_remove(gdb_src_id);
 	
@@ -212,10 +293,10 @@ static GList* read_until_prompt(void)
 			break;
 
 		line[terminator] = '\0';
-		lines = g_list_append (lines, line);
+		lines = g_list_prepend (lines, line);
 	}
 	
-	return lines;
+	return g_list_reverse(lines);
 }
 
 /*
@@ -227,277 +308,192 @@ static void gdb_input_write_line(const gchar *line)
 	GError *err = NULL;
 	gsize count;
 	
-	char command[1000];
-	sprintf(command, "%s\n", line);
+	gchar *command = g_strconcat(line, "\n", NULL);
+	gchar *pos = command;
+	gsize left = strlen(command);
 	
-	while (strlen(command))
+	while (left)
 	{
-		st = g_io_channel_write_chars(gdb_ch_in, command, strlen(command), &count, &err);
-		strcpy(command, command + count);
+		st = g_io_channel_write_chars(gdb_ch_in, pos, left, &count, &err);
+		pos += count;
+		left -= count;
 		if (err || (st == G_IO_STATUS_ERROR) || (st == G_IO_STATUS_EOF))
 		{
 #ifdef DEBUG_OUTPUT
-			dbg_cbs->send_message(err->message, "red");
+			if (err)
+				dbg_cbs->send_message(err->message, "red");
 #endif
 			break;
 		}
 	}
+	g_free(command);
+	if (err)
+	{
+		g_error_free(err);
+		return;
+	}
 
 	st = g_io_channel_flush(gdb_ch_in, &err);
 	if (err || (st == G_IO_STATUS_ERROR) || (st == G_IO_STATUS_EOF))
 	{
 #ifdef DEBUG_OUTPUT
-		dbg_cbs->send_message(err->message, "red");
+		if (err)
+			dbg_cbs->send_message(err->message, "red");
 #endif
 	}
+	if (err)
+		g_error_free(err);
 }
 
 /*
- * free memory occupied by a queue item 
+ * writes waiting commands to GDB, as much as the in flight limit allows
  */
-static void free_queue_item(queue_item *item)
+static void flush_commands(void)
 {
-	g_string_free(item->message, TRUE);
-	g_string_free(item->command, TRUE);
-	g_string_free(item->error_message, TRUE);
-	g_free(item);
+	while (!g_queue_is_empty(commands_waiting) && g_queue_get_length(commands_in_flight) < MAX_COMMANDS_IN_FLIGHT)
+	{
+		command_request *request = (command_request*)g_queue_pop_head(commands_waiting);
+		gchar *line = g_strdup_printf("%u%s", request->token, request->command);
+
+#ifdef DEBUG_OUTPUT
+		dbg_cbs->send_message(line, "red");
+#endif
+
+		gdb_input_write_line(line);
+		g_free(line);
+
+		g_free(request->command);
+		request->command = NULL;
+
+		g_queue_push_tail(commands_in_flight, request);
+	}
 }
 
 /*
- * free a list of "queue_item" structures 
+ * tags "command" with a new token and sends it to GDB,
+ * "callback" is called with the command result record when it arrives
+ * returns the token
  */
-static void free_commands_queue(GList *queue)
+static guint send_command(const gchar *command, command_callback callback, gpointer data)
 {
-	/* all commands completed */
-	queue = g_list_first(queue);
-	g_list_foreach(queue, (GFunc)free_queue_item, NULL);
-	g_list_free(queue);
+	command_request *request = (command_request*)g_malloc(sizeof(command_request));
+
+	request->token = ++last_token;
+	request->command = g_strdup(command);
+	request->callback = callback;
+	request->data = data;
+
+	g_queue_push_tail(commands_waiting, request);
+	flush_commands();
+
+	return request->token;
 }
 
 /*
- * add a new command ("queue_item" structure) to a list 
+ * calls the callbacks of all commands sent but not completed with RC_EXIT
+ * and forgets them
  */
-static GList* add_to_queue(GList* queue, const gchar *message, const gchar *command, const gchar *error_message, gboolean format_error_message)
+static void cancel_commands(void)
 {
-	queue_item *item = (queue_item*)g_malloc(sizeof(queue_item));
+	command_request *request;
 
-	memset((void*)item, 0, sizeof(queue_item));
+	if (!commands_in_flight)
+		return;
 
-	if (message)
+	while ( (request = (command_request*)g_queue_pop_head(commands_in_flight)) || (request = (command_request*)g_queue_pop_head(commands_waiting)) )
 	{
-		item->message = g_string_new(message);
+		if (request->callback)
+			request->callback(RC_EXIT, NULL, request->data);
+		g_free(request->command);
+		g_free(request);
 	}
-	item->command = g_string_new(command);
-	if (error_message)
-	{
-		item->error_message = g_string_new(error_message);
-	}
-	item->format_error_message = format_error_message;
-
-	return g_list_append(queue, (gpointer)item);
-} 
+}
 
 /*
- * asyncronous output reader
- * reads from startup async commands.
- * looks for a command completion (normal or abnormal), if noraml - executes next command
+ * passes result record to the callback of a command with the token given
  */
-static void exec_async_command(const gchar* command);
-static gboolean on_read_async_output(GIOChannel * src, GIOCondition cond, gpointer data)
+static void dispatch_result(result_class rc, mi_record *record)
 {
-	gchar *line;
-	gsize length;
-	
-	if (G_IO_STATUS_NORMAL != g_io_channel_read_line(src, &line, NULL, &length, NULL))
-		return TRUE;		
-
-	*(line + length) = '\0';
+	command_request *request;
+	GList *link;
 
-	if ('^' == line[0])
+	/* GDB executes commands in order, so it's usually the first one */
+	for (link = commands_in_flight->head; link; link = link->next)
 	{
-		/* got some result */
-
-		GList *lines;
-		GList *commands = (GList*)data;
-		gchar *coma;
-
-		g_source_remove(gdb_id_out);
-
-		lines = read_until_prompt();
-		g_list_foreach(lines, (GFunc)g_free, NULL);
-		g_list_free (lines);
-
-		coma = strchr(line, ',');
-		if (coma)
-		{
-			*coma = '\0';
-			coma++;
-		}
-		else
-			coma = line + strlen(line);
-		
-		if (!strcmp(line, "^done"))
-		{
-			/* command completed succesfully - run next command if exists */
-			if (commands->next)
-			{
-				/* if there are commads left */
-				queue_item *item;
-
-				commands = commands->next;
-				item = (queue_item*)commands->data;
-
-				/* send message to debugger messages window */
-				if (item->message)
-				{
-					dbg_cbs->send_message(item->message->str, "grey");
-				}
-
-				gdb_input_write_line(item->command->str);
-
-				gdb_id_out = g_io_add_watch(gdb_ch_out, G_IO_IN, on_read_async_output, commands);
-			}
-			else
-			{
-				/* all commands completed */
-				free_commands_queue(commands);
-
-				/* removing read callback */
-				g_source_remove(gdb_id_out);
-
-				/* update source files list */
-				update_files();
-
-				/* -exec-run */
-				exec_async_command("-exec-run");
-			}
-		}
-		else
-		{
-			queue_item *item = (queue_item*)commands->data;
-			if(item->error_message)
-			{
-				if (item->format_error_message)
-				{
-					gchar* gdb_msg = g_strcompress(strstr(coma, "msg=\"") + strlen("msg=\""));
-
-					GString *msg = g_string_new("");
-					g_string_printf(msg, item->error_message->str, gdb_msg);
-					dbg_cbs->report_error(msg->str);
-
-					g_free(gdb_msg);
-					g_string_free(msg, FALSE);
-				}
-				else
-				{
-					dbg_cbs->report_error(item->error_message->str);
-				}
-			}
-			
-			/* free commands queue */
-			free_commands_queue(commands);
-
-			stop();
-		}
+		if (((command_request*)link->data)->token == record->token)
+			break;
+	}
+	if (!link)
+	{
+		mi_record_free(record);
+		return;
 	}
 
-	g_free(line);
+	request = (command_request*)link->data;
+	g_queue_delete_link(commands_in_flight, link);
 
-	return TRUE;
+	/* there is a room for more commands now */
+	flush_commands();
+
+	if (request->callback)
+		request->callback(rc, record, request->data);
+	else
+		mi_record_free(record);
+	g_free(request);
 }
 
 /*
- * asyncronous gdb output reader
- * looks for a stopped event, then notifies "debug" module and removes async handler
+ * handles an asyncronous or stream record
+ * looks for a stopped event, then notifies "debug" module
  */
 enum dbs debug_get_state(void);
-static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer data)
+static void on_gdb_record(gchar *line, mi_record *record)
 {
-	gchar *line;
-	gsize length;
-	gboolean prompt;
-	
-	if (G_IO_STATUS_NORMAL != g_io_channel_read_line(src, &line, NULL, &length, NULL))
-		return TRUE;		
-
-	prompt = !strcmp(line, GDB_PROMPT);
-	
-	*(line + length) = '\0';
-
-	if (!prompt)
-	{
-		if ('~' == line[0])
-		{
-			colorize_message(line);
-		}
-		else
-		{
-			gchar *compressed = g_strcompress(line);
-			colorize_message(compressed);
-			g_free(compressed);
-		}
-	}
-		
-	if (!target_pid && g_str_has_prefix(line, "=thread-group-created"))
+	if ('~' == line[0])
 	{
-		*(strrchr(line, '\"')) = '\0';
-		target_pid = atoi(line + strlen("=thread-group-created,id=\""));
-	}
-	else if (!target_pid && g_str_has_prefix(line, "=thread-group-started"))
-	{
-		*(strrchr(line, '\"')) = '\0';
-		target_pid = atoi(strrchr(line, '\"') + 1);
-	}
-	else if (g_str_has_prefix(line, "=thread-created"))
-	{
-		int thread_id;
-
-		*(strrchr(line, ',') - 1) = '\0';
-		thread_id = atoi(line + strlen("=thread-created,id=\""));
-		dbg_cbs->add_thread(thread_id);
+		colorize_message(line);
 	}
-	else if (g_str_has_prefix(line, "=thread-exited"))
+	else
 	{
-		int thread_id;
-
-		*(strrchr(line, ',') - 1) = '\0';
-		thread_id = atoi(line + strlen("=thread-exited,id=\""));
-		dbg_cbs->remove_thread(thread_id);
+		gchar *compressed = g_strcompress(line);
+		colorize_message(compressed);
+		g_free(compressed);
 	}
-	else if (g_str_has_prefix(line, "=library-loaded") || g_str_has_prefix(line, "=library-unloaded"))
+		
+	if ('=' == record->type)
 	{
-		file_refresh_needed = TRUE;
+		if (!target_pid && !strcmp(record->klass, "thread-group-created"))
+		{
+			target_pid = mi_result_get_int(record->first, "pid", mi_result_get_int(record->first, "id", 0));
+		}
+		else if (!target_pid && !strcmp(record->klass, "thread-group-started"))
+		{
+			target_pid = mi_result_get_int(record->first, "pid", 0);
+		}
+		else if (!strcmp(record->klass, "thread-created"))
+		{
+			dbg_cbs->add_thread(mi_result_get_int(record->first, "id", 0));
+		}
+		else if (!strcmp(record->klass, "thread-exited"))
+		{
+			dbg_cbs->remove_thread(mi_result_get_int(record->first, "id", 0));
+		}
+		else if (!strcmp(record->klass, "library-loaded") || !strcmp(record->klass, "library-unloaded"))
+		{
+			file_refresh_needed = TRUE;
+		}
 	}
-	else if (*line == '*')
+	else if ('*' == record->type)
 	{
 		/* asyncronous record found */
-		char *record = NULL;
-		if ( (record = strchr(line, ',')) )
-		{
-			*record = '\0';
-			record++;
-		}
-		else
-			record = line + strlen(line);
-		
-		if (!strcmp(line, "*running"))
+		if (!strcmp(record->klass, "running"))
 			dbg_cbs->set_run();
-		else if (!strcmp(line, "*stopped"))
+		else if (!strcmp(record->klass, "stopped"))
 		{
-			char *reason;
-
-			/* removing read callback (will pulling all output left manually) */
-			g_source_remove(gdb_id_out);
-
 			/* looking for a reason to stop */
-			reason = strstr(record, "reason=\"");
+			const gchar *reason = mi_result_get_string(record->first, "reason");
 			if (reason)
 			{
-				char *next;
-
-				reason += strlen("reason=\"");
-				next = strstr(reason, "\"") + 1;
-				*(next - 1) = '\0';
 				if (!strcmp(reason, "breakpoint-hit"))
 					stop_reason = SR_BREAKPOINT_HIT;
 				else if (!strcmp(reason, "end-stepping-range"))
@@ -519,18 +515,14 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 			
 			if (SR_BREAKPOINT_HIT == stop_reason || SR_END_STEPPING_RANGE == stop_reason || SR_SIGNAL_RECIEVED == stop_reason)
 			{
-				gchar *thread_id = strstr(reason + strlen(reason) + 1,"thread-id=\"") + strlen("thread-id=\"");
-				*(strchr(thread_id, '\"')) = '\0'; 
+				stopped_thread_id = mi_result_get_int(record->first, "thread-id", 0);
 				
 				active_frame = 0;
 
 				if (SR_BREAKPOINT_HIT == stop_reason || SR_END_STEPPING_RANGE == stop_reason)
 				{
-					/* update autos */
-					update_autos();
-			
-					/* update watches */
-					update_watches();
+					/* update autos and watches */
+					update_variables();
 			
 					/* update files */
 					if (file_refresh_needed)
@@ -539,7 +531,7 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 						file_refresh_needed = FALSE;
 					}
 
-					dbg_cbs->set_stopped(atoi(thread_id));
+					dbg_cbs->set_stopped(stopped_thread_id);
 				}
 				else
 				{
@@ -548,19 +540,15 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 					else
 						requested_interrupt = FALSE;
 						
-					dbg_cbs->set_stopped(atoi(thread_id));
+					dbg_cbs->set_stopped(stopped_thread_id);
 				}
 			}
 			else if (stop_reason == SR_EXITED_NORMALLY || stop_reason == SR_EXITED_SIGNALLED || stop_reason == SR_EXITED_WITH_CODE)
 			{
 				if (stop_reason == SR_EXITED_WITH_CODE)
 				{
-					gchar *code;
-					gchar *message;
-
-					code = strstr(reason + strlen(reason) + 1,"exit-code=\"") + strlen("exit-code=\"");
-					*(strchr(code, '\"')) = '\0';
-					message = g_strdup_printf(_("Program exited with code \"%i\""), (int)(char)strtol(code, NULL, 8));
+					const gchar *code = mi_result_get_string(record->first, "exit-code");
+					gchar *message = g_strdup_printf(_("Program exited with code \"%i\""), code ? (int)(char)strtol(code, NULL, 8) : 0);
 					dbg_cbs->report_error(message);
 
 					g_free(message);
@@ -570,43 +558,123 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 			}
 		}
 	}
-	else if (g_str_has_prefix (line, "^error"))
+}
+
+/*
+ * handles a line of GDB output
+ * result records are passed to the callback of their command,
+ * the others to on_gdb_record()
+ */
+static void on_gdb_line(gchar *line)
+{
+	mi_record *record = mi_record_parse(line);
+
+	if ('^' == record->type)
 	{
-		GList *lines, *iter;
-		char *msg;
+		result_class rc;
 
-		/* removing read callback (will pulling all output left manually) */
-		g_source_remove(gdb_id_out);
+#ifdef DEBUG_OUTPUT
+		dbg_cbs->send_message(line, "red");
+#endif
 
-		/* set debugger stopped if is running */
-		if (DBS_STOPPED != debug_get_state())
+		if (!strcmp(record->klass, "done") || !strcmp(record->klass, "running") || !strcmp(record->klass, "connected"))
+			rc = RC_DONE;
+		else if (!strcmp(record->klass, "exit"))
+			rc = RC_EXIT;
+		else
 		{
-			gchar *thread_id = strstr(line + strlen(line) + 1,"thread-id=\"");
-			*(strchr(thread_id, '\"')) = '\0'; 
-
-			dbg_cbs->set_stopped(atoi(thread_id));
+			/* save error message */
+			const gchar *msg = mi_result_get_string(record->first, "msg");
+			if (msg)
+				g_strlcpy(err_message, msg, sizeof(err_message));
+			
+			rc = RC_ERROR;
 		}
 
-		/* get message */
-		msg = strstr(line, "msg=\"") + strlen("msg=\"");
-		*strrchr(msg, '\"') = '\0';
-		msg = g_strcompress(msg);
-		
-		/* reading until prompt */
-		lines = read_until_prompt();
-		for (iter = lines; iter; iter = iter->next)
+		dispatch_result(rc, record);
+	}
+	else
+	{
+		/* skip the token */
+		while (isdigit(*line))
+			line++;
+
+		/* a stop must not change the state under a synchronous command,
+		and the records must keep their order */
+		if (wait_depth || !g_queue_is_empty(deferred_records))
 		{
-			gchar *l = (gchar*)iter->data;
-			if (strcmp(l, GDB_PROMPT))
-				colorize_message(l);
-			g_free(l);
+			deferred_record *deferred = (deferred_record*)g_malloc(sizeof(deferred_record));
+			deferred->line = g_strdup(line);
+			deferred->record = record;
+			g_queue_push_tail(deferred_records, deferred);
 		}
-		g_list_free (lines);
+		else
+		{
+			on_gdb_record(line, record);
+			mi_record_free(record);
+		}
+	}
+}
+
+/*
+ * handles the records read while waiting for results
+ */
+static gboolean on_deferred_records(gpointer data)
+{
+	deferred_record *deferred;
+
+	deferred_src_id = 0;
+	/* on_gdb_record() may wait for results itself, which defers more records */
+	while ( (deferred = (deferred_record*)g_queue_pop_head(deferred_records)) )
+	{
+		on_gdb_record(deferred->line, deferred->record);
+		mi_record_free(deferred->record);
+		g_free(deferred->line);
+		g_free(deferred);
+	}
+
+	return FALSE;
+}
 
-		/* send error message */
-		dbg_cbs->report_error(msg);
+/*
+ * forgets the records read while waiting for results
+ */
+static void drop_deferred_records(void)
+{
+	deferred_record *deferred;
+
+	if (deferred_src_id)
+	{
+		g_source_remove(deferred_src_id);
+		deferred_src_id = 0;
+	}
+	if (!deferred_records)
+		return;
+
+	while ( (deferred = (deferred_record*)g_queue_pop_head(deferred_records)) )
+	{
+		mi_record_free(deferred->record);
+		g_free(deferred->line);
+		g_free(deferred);
+	}
+}
+
+/*
+ * asyncronous gdb output reader
+ * passes every line but prompts to on_gdb_line()
+ */
+static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer data)
+{
+	gchar *line;
+	gsize length;
+	
+	if (G_IO_STATUS_NORMAL != g_io_channel_read_line(src, &line, NULL, &length, NULL))
+		return TRUE;		
 
-		g_free(msg);
+	if (strcmp(line, GDB_PROMPT))
+	{
+		*(line + length) = '\0';
+		on_gdb_line(line);
 	}
 
 	g_free(line);
@@ -615,103 +683,209 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 }
 
 /*
- * execute "command" asyncronously
- * after writing command to an input channel
- * connects reader to output channel and exits
- * after execution
- */ 
-static void exec_async_command(const gchar* command)
+ * reads and handles GDB output until results for all
+ * the commands up to the one tagged with "token" arrive,
+ * the other records are handled from an idle callback after the outermost wait
+ */
+static void wait_for_results(guint token)
 {
-#ifdef DEBUG_OUTPUT
-	dbg_cbs->send_message(command, "red");
-#endif
+	command_request *oldest;
 
-	gdb_input_write_line(command);
+	wait_depth++;
+	while ( (oldest = (command_request*)g_queue_peek_head(commands_in_flight)) && oldest->token <= token )
+	{
+		gchar *line;
+		gsize terminator;
 
-	/* connect read callback to the output chanel */
-	gdb_id_out = g_io_add_watch(gdb_ch_out, G_IO_IN, on_read_from_gdb, NULL);
+		if (G_IO_STATUS_NORMAL != g_io_channel_read_line(gdb_ch_out, &line, NULL, &terminator, NULL))
+		{
+			/* GDB has gone */
+			cancel_commands();
+			break;
+		}
+
+		if (strcmp(line, GDB_PROMPT))
+		{
+			line[terminator] = '\0';
+			on_gdb_line(line);
+		}
+
+		g_free(line);
+	}
+	wait_depth--;
+
+	if (!wait_depth && !g_queue_is_empty(deferred_records) && !deferred_src_id)
+		deferred_src_id = g_idle_add(on_deferred_records, NULL);
 }
 
 /*
- * execute "command" syncronously
- * i.e. reading output right
- * after execution
- */ 
-static result_class exec_sync_command(const gchar* command, gboolean wait4prompt, gchar** command_record)
+ * stores the result of a command
+ * into a "command_result" structure
+ */
+static void on_command_result(result_class rc, mi_record *record, gpointer data)
 {
-	GList *lines, *iter;
-	result_class rc;
+	command_result *result = (command_result*)data;
 
-#ifdef DEBUG_OUTPUT
-	dbg_cbs->send_message(command, "red");
-#endif
+	result->rc = rc;
+	result->record = record;
+}
 
-	/* write command to gdb input channel */
-	gdb_input_write_line(command);
-	
-	if (!wait4prompt)
-		return RC_DONE;
-	
-	lines = read_until_prompt();
+/*
+ * sends "command", its result will be stored into "result"
+ * the result is available after wait_for_results() for the returned token
+ */
+static guint send_sync_command(const gchar *command, command_result *result)
+{
+	result->rc = RC_ERROR;
+	result->record = NULL;
 
-#ifdef DEBUG_OUTPUT
-	for (iter = lines; iter; iter = iter->next)
+	return send_command(command, on_command_result, result);
+}
+
+/*
+ * free memory occupied by a queue item 
+ */
+static void free_queue_item(queue_item *item)
+{
+	if (item->message)
+		g_string_free(item->message, TRUE);
+	g_string_free(item->command, TRUE);
+	if (item->error_message)
+		g_string_free(item->error_message, TRUE);
+	g_free(item);
+}
+
+/*
+ * add a new command ("queue_item" structure) to a list 
+ */
+static GList* add_to_queue(GList* queue, const gchar *message, const gchar *command, const gchar *error_message, gboolean format_error_message)
+{
+	queue_item *item = (queue_item*)g_malloc(sizeof(queue_item));
+
+	memset((void*)item, 0, sizeof(queue_item));
+
+	if (message)
 	{
-		dbg_cbs->send_message((gchar*)iter->data, "red");
+		item->message = g_string_new(message);
 	}
-#endif
+	item->command = g_string_new(command);
+	if (error_message)
+	{
+		item->error_message = g_string_new(error_message);
+	}
+	item->format_error_message = format_error_message;
 
-	rc = RC_ERROR;
+	return g_list_append(queue, (gpointer)item);
+} 
 
-	for (iter = lines; iter; iter = iter->next)
-	{
-		gchar *line = (gchar*)iter->data;
+/*
+ * startup command completion callback
+ * on error reports it and stops GDB, after the last one starts the program
+ */
+static void exec_async_command(const gchar* command);
+static void on_startup_result(result_class rc, mi_record *record, gpointer data)
+{
+	queue_item *item = (queue_item*)data;
 
-		if ('^' == line[0])
+	if (RC_EXIT == rc || startup_failed)
+	{
+		/* GDB is exiting or the startup has already failed */
+	}
+	else if (RC_DONE != rc)
+	{
+		if(item->error_message)
 		{
-			gchar* coma = strchr(line, ',');
-			if (coma)
+			if (item->format_error_message)
 			{
-				*coma = '\0';
-				coma++;
+				GString *msg = g_string_new("");
+				g_string_printf(msg, item->error_message->str, err_message);
+				dbg_cbs->report_error(msg->str);
+
+				g_string_free(msg, TRUE);
 			}
 			else
-				coma = line + strlen(line);
-			
-			if (command_record)
 			{
-				*command_record = (gchar*)g_malloc(strlen(coma) + 1);
-				strcpy(*command_record, coma);
+				dbg_cbs->report_error(item->error_message->str);
 			}
-			
-			if (!strcmp(line, "^done"))
-				rc = RC_DONE;
-			else if (!strcmp(line, "^error"))
-			{
-				/* save error message */
-				gchar* msg = g_strcompress(strstr(coma, "msg=\"") + strlen("msg=\""));
-				strcpy(err_message, msg);
-				g_free(msg);
-				
-				rc = RC_ERROR;
-			}
-			else if (!strcmp(line, "^exit"))
-				rc = RC_EXIT;
-		}
-		else if ('&' != line[0])
-		{
-			colorize_message (line);
 		}
+
+		/* commands left will be ignored */
+		startup_failed = TRUE;
+
+		stop();
 	}
+	else if (item->last)
+	{
+		/* all commands completed */
+
+		/* update source files list */
+		update_files();
+
+		/* -exec-run */
+		exec_async_command("-exec-run");
+	}
+
+	free_queue_item(item);
+	mi_record_free(record);
+}
+
+/*
+ * execution command completion callback
+ * on error sets debugger stopped and reports the error
+ */
+static void on_exec_result(result_class rc, mi_record *record, gpointer data)
+{
+	mi_record_free(record);
+	if (RC_ERROR != rc)
+		return;
+
+	/* set debugger stopped if is running */
+	if (DBS_STOPPED != debug_get_state())
+		dbg_cbs->set_stopped(stopped_thread_id);
+
+	/* send error message */
+	dbg_cbs->report_error(err_message);
+}
+
+/*
+ * execute "command" asyncronously
+ * the result is handled by the output channel reader
+ * after execution
+ */ 
+static void exec_async_command(const gchar* command)
+{
+	send_command(command, on_exec_result, NULL);
+}
+
+/*
+ * execute "command" syncronously
+ * i.e. reading output right
+ * after execution
+ * "command_record" is set to the result record, NULL if GDB has exited,
+ * and has to be freed with mi_record_free()
+ */ 
+static result_class exec_sync_command(const gchar* command, gboolean wait4prompt, mi_record** command_record)
+{
+	command_result result;
+
+	if (!wait4prompt)
+	{
+		send_command(command, NULL, NULL);
+		return RC_DONE;
+	}
+
+	wait_for_results(send_sync_command(command, &result));
+
+	if (command_record)
+		*command_record = result.record;
+	else
+		mi_record_free(result.record);
 	
-	g_list_foreach(lines, (GFunc)g_free, NULL);
-	g_list_free(lines);
-	
-	return rc;
+	return result.rc;
 }
 
 /*
- * starts gdb, collects commands and start the first one
+ * starts gdb, collects commands and sends them
  */
 static gboolean run(const gchar* file, const gchar* commandline, GList* env, GList *witer, GList *biter, const gchar* terminal_device, dbg_callbacks* callbacks)
 {
@@ -723,7 +897,6 @@ static gboolean run(const gchar* file, const gchar* commandline, GList* env, GLi
 	GList *commands = NULL;
 	GString *command;
 	int bp_index;
-	queue_item *item;
 
 	dbg_cbs = callbacks;
 
@@ -750,6 +923,15 @@ static gboolean run(const gchar* file, const gchar* commandline, GList* env, GLi
 	gdb_ch_in = g_io_channel_unix_new(gdb_in);
 	gdb_ch_out = g_io_channel_unix_new(gdb_out);
 
+	/* create commands queues */
+	if (!commands_in_flight)
+	{
+		commands_waiting = g_queue_new();
+		commands_in_flight = g_queue_new();
+		deferred_records = g_queue_new();
+	}
+	startup_failed = FALSE;
+
 	/* reading starting gdb messages */
 	lines = read_until_prompt();
 	for (iter = lines; iter; iter = iter->next)
@@ -759,6 +941,7 @@ static gboolean run(const gchar* file, const gchar* commandline, GList* env, GLi
 		{
 			colorize_message((gchar*)iter->data);
 		}
+		g_free(unescaped);
 	}
 	g_list_foreach(lines, (GFunc)g_free, NULL);
 	g_list_free(lines);
@@ -872,19 +1055,25 @@ static gboolean run(const gchar* file, const gchar* commandline, GList* env, GLi
 	commands = add_to_queue(commands, NULL, command->str, NULL, FALSE);
 	g_string_free(command, TRUE);
 
-	/* connect read callback to the output chanel */
-	gdb_id_out = g_io_add_watch(gdb_ch_out, G_IO_IN, on_read_async_output, commands);
+	/* send all the commands at once, their results
+	are handled by on_startup_result() as they arrive */
+	((queue_item*)g_list_last(commands)->data)->last = TRUE;
+	for (iter = commands; iter; iter = iter->next)
+	{
+		queue_item *item = (queue_item*)iter->data;
 
-	item = (queue_item*)commands->data;
+		/* send message to debugger messages window */
+		if (item->message)
+		{
+			dbg_cbs->send_message(item->message->str, "grey");
+		}
 
-	/* send message to debugger messages window */
-	if (item->message)
-	{
-		dbg_cbs->send_message(item->message->str, "grey");
+		send_command(item->command->str, on_startup_result, item);
 	}
+	g_list_free(commands);
 
-	/* send first command */
-	gdb_input_write_line(item->command->str);
+	/* connect read callback to the output chanel */
+	gdb_id_out = g_io_add_watch(gdb_ch_out, G_IO_IN, on_read_from_gdb, NULL);
 
 	return TRUE;
 }
@@ -953,45 +1142,34 @@ static void execute_until(const gchar *file, int line)
  */
 static int get_break_number(char* file, int line)
 {
-	gchar *record, *bstart;
+	mi_record *record = NULL;
+	const mi_result *bkpt;
+	gchar *location = g_strdup_printf("\"%s\":%i", file, line);
+	int number = -1;
 
-	exec_sync_command("-break-list", TRUE, &record);
-	bstart = record;
-
-	while ( (bstart = strstr(bstart, "bkpt=")) )
+	if (RC_DONE == exec_sync_command("-break-list", TRUE, &record))
 	{
-		gchar *fname, *file_quoted;
-		int num, bline;
-		gboolean break_found;
+		bkpt = mi_result_get_list(mi_result_get_list(record->first, "BreakpointTable"), "body");
+		for (; bkpt; bkpt = bkpt->next)
+		{
+			const gchar *original;
 
-		bstart += strlen("bkpt={number=\"");
-		*strchr(bstart, '\"') = '\0';
-		num = atoi(bstart);
-		
-		bstart += strlen(bstart) + 1;
-		bstart = strstr(bstart, "original-location=\"") + strlen("original-location=\"");
-		*strchr(bstart, ':') = '\0';
-		fname = bstart;
-		
-		bstart += strlen(bstart) + 1;
-		*strchr(bstart, '\"') = '\0';
-		bline = atoi(bstart);
-		
-		file_quoted = g_strdup_printf("\\\"%s\\\"", file);
-		break_found = !strcmp(fname, file_quoted) && bline == line;
-		g_free(file_quoted);
+			if (MI_VAL_TUPLE != bkpt->val.type)
+				continue;
 
-		if (break_found)
-		{
-			return num;
+			original = mi_result_get_string(bkpt->val.v.list, "original-location");
+			if (original && !strcmp(original, location))
+			{
+				number = mi_result_get_int(bkpt->val.v.list, "number", -1);
+				break;
+			}
 		}
-		
-		bstart += strlen(bstart) + 1;
-	} 
-	
-	free(record);
+	}
+
+	mi_record_free(record);
+	g_free(location);
 	
-	return -1;
+	return number;
 }
 
 /*
@@ -1004,27 +1182,24 @@ static gboolean set_break(breakpoint* bp, break_set_activity bsa)
 	{
 		/* new breakpoint */
 
-		char *pos;
 		int number;
-		gchar *record = NULL;
+		mi_record *record = NULL;
 
 		/* 1. insert breakpoint */
 		sprintf (command, "-break-insert \"\\\"%s\\\":%i\"", bp->file, bp->line);
 		if (RC_DONE != exec_sync_command(command, TRUE, &record))
 		{
-			g_free(record);
+			mi_record_free(record);
 			sprintf (command, "-break-insert -f \"\\\"%s\\\":%i\"", bp->file, bp->line);
 			if (RC_DONE != exec_sync_command(command, TRUE, &record))
 			{
-				g_free(record);
+				mi_record_free(record);
 				return FALSE;
 			}
 		}
 		/* lookup break-number */
-		pos = strstr(record, "number=\"") + strlen("number=\"");
-		*strchr(pos, '\"') = '\0';
-		number = atoi(pos);
-		g_free(record);
+		number = mi_result_get_int(mi_result_get_list(record->first, "bkpt"), "number", 0);
+		mi_record_free(record);
 		/* 2. set hits count if differs from 0 */
 		if (bp->hitscount)
 		{
@@ -1104,8 +1279,7 @@ static void set_active_frame(int frame_number)
 	if (RC_DONE == exec_sync_command(command, TRUE, NULL))
 	{
 		active_frame = frame_number;
-		update_autos();
-		update_watches();
+		update_variables();
 	}
 	g_free(command);
 }
@@ -1115,93 +1289,57 @@ static void set_active_frame(int frame_number)
  */
 static GList* get_stack(void)
 {
-	gchar* record = NULL;
+	mi_record *record = NULL;
 	GList *stack = NULL;
-	gchar **frames, **next;
-	result_class rc;
+	const mi_result *frames;
 
-	rc = exec_sync_command("-stack-list-frames", TRUE, &record);
-	if (RC_DONE != rc)
+	if (RC_DONE != exec_sync_command("-stack-list-frames", TRUE, &record))
+	{
+		mi_record_free(record);
 		return NULL;
+	}
 
-	frames = g_strsplit(record, "frame=", 0);
-	next = frames + 1;
-	while (*next)
+	for (frames = mi_result_get_list(record->first, "stack"); frames; frames = frames->next)
 	{
-		frame *f = frame_new();
-		int line;
-		gchar *pos, *fullname, *file, *from;
-		
+		frame *f;
+		const mi_result *fields;
+		const gchar *address, *function, *fullname, *file;
+
+		if (MI_VAL_TUPLE != frames->val.type)
+			continue;
+		fields = frames->val.v.list;
+
+		f = frame_new();
+
 		/* adresss */
-		pos = strstr(*next, "addr=\"") + strlen("addr=\"");
-		*strchr(pos, '\"') = '\0';
-		f->address = g_strdup(pos);
-		pos += strlen(pos) + 1;
+		address = mi_result_get_string(fields, "addr");
+		f->address = g_strdup(address ? address : "");
 
 		/* function */
-		pos = strstr(pos, "func=\"") + strlen("func=\"");
-		*strchr(pos, '\"') = '\0';
-		f->function = g_strdup(pos);
-		pos += strlen(pos) + 1;
+		function = mi_result_get_string(fields, "func");
+		f->function = g_strdup(function ? function : "");
 
 		/* file: fullname | file | from */
-		fullname = strstr(pos, "fullname=\"");
-		file = strstr(pos, "file=\"");
-		from = strstr(pos, "from=\"");
-		
-		if (fullname)
-		{
-			fullname += strlen("fullname=\"");
-			pos = fullname;
-			*strchr(pos, '\"') = '\0';
-			f->file = g_strdup(pos);
-			pos += strlen(pos) + 1;
-		}
-		else if (file)
-		{
-			file += strlen("file=\"");
-			pos = file;
-			*strchr(pos, '\"') = '\0';
-			f->file = g_strdup(pos);
-			pos += strlen(pos) + 1;
-		}
-		else if (from)
-		{
-			from += strlen("from=\"");
-			pos = from;
-			*strchr(pos, '\"') = '\0';
-			f->file = g_strdup(pos);
-			pos += strlen(pos) + 1;
-		}
-		else
-		{
-			f->file = g_strdup("");
-		}
+		fullname = mi_result_get_string(fields, "fullname");
+		file = fullname;
+		if (!file)
+			file = mi_result_get_string(fields, "file");
+		if (!file)
+			file = mi_result_get_string(fields, "from");
+		f->file = g_strdup(file ? file : "");
 		
 		/* whether source is available */
 		f->have_source = fullname ? TRUE : FALSE;
 
 		/* line */
-		line = 0;
-		pos = strstr(pos, "line=\"");
-		if (pos)
-		{
-			pos += strlen("line=\"");
-			*strchr(pos, '\"') = '\0';
-			line = atoi(pos);
-			pos += strlen(pos) + 1;
-		}
-		f->line = line;
+		f->line = mi_result_get_int(fields, "line", 0);
 
-		stack = g_list_append(stack, f);
-
-		next++;
+		stack = g_list_prepend(stack, f);
 	}
-	g_strfreev(frames);	
 	
-	free(record);
+	mi_record_free(record);
 	
-	return stack;
+	return g_list_reverse(stack);
 }
 
 /*
@@ -1320,279 +1458,443 @@ static gchar* unescape_octal_values(gchar *text)
 
 /*
  * unescapes value string, handles hexidecimal and octal characters representations
+ * (MI escaping is already removed by the parser)
+ */
+static gchar *unescape(const gchar *text)
+{
+	if (strstr(text, "\\x"))
+		return unescape_hex_values((gchar*)text);
+	else
+		return unescape_octal_values((gchar*)text);
+}
+
+/*
+ * creates a floating GDB variable object for "expression",
+ * it is evaluated in the selected frame on every update
  */
-static gchar *unescape(gchar *text)
+static guint send_var_create(const gchar *expression, command_result *result)
 {
-	gchar *retval = NULL;
+	gchar *escaped = g_strescape(expression, NULL);
+	gchar *command = g_strdup_printf("-var-create - @ \"%s\"", escaped);
+	guint token = send_sync_command(command, result);
 
-	/* create string copy */
-	gchar *value = g_strdup(text);
+	g_free(command);
+	g_free(escaped);
 
-	/* make first unescaping */
-	gchar *tmp = g_strcompress(value);
+	return token;
+}
 
-	/* make first unescaping */
-	if (strstr(tmp, "\\x"))
-		retval = unescape_hex_values(tmp);
-	else
-		retval = unescape_octal_values(tmp);
+/*
+ * evaluates "expression" in the selected frame
+ */
+static guint send_evaluate(const gchar *expression, command_result *result)
+{
+	gchar *escaped = g_strescape(expression, NULL);
+	gchar *command = g_strdup_printf("-data-evaluate-expression \"%s\"", escaped);
+	guint token = send_sync_command(command, result);
 
-	g_free(tmp);
-	g_free(value);
+	g_free(command);
+	g_free(escaped);
 
-	return retval;
+	return token;
 }
 
 /*
- * updates variables from vars list 
+ * sets variable value from a "value" field
+ * the variable is marked as unevaluated if there is no one
  */
-static void get_variables (GList *vars)
+static void set_variable_value(variable *var, const mi_result *fields)
 {
-	while (vars)
+	const gchar *value = mi_result_get_string(fields, "value");
+	if (value)
 	{
-		gchar command[1000];
-		
-		variable *var = (variable*)vars->data;
-
-		gchar *varname = var->internal->str;
-		gchar *record = NULL;
-		gchar *pos;
-		gchar *expression;
-		int numchild;
-		gchar *value;
-
-		/* path expression */
-		sprintf(command, "-var-info-path-expression \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		pos = strstr(record, "path_expr=\"") + strlen("path_expr=\"");
-		*(strrchr(pos, '\"')) = '\0';
-		expression = unescape(pos);
-		g_string_assign(var->expression, expression);
-		g_free(expression);
-		g_free(record);
-		
-		/* children number */
-		sprintf(command, "-var-info-num-children \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		pos = strstr(record, "numchild=\"") + strlen("numchild=\"");
-		*(strchr(pos, '\"')) = '\0';
-		numchild = atoi(pos);
-		var->has_children = numchild > 0;
-		g_free(record);
-
-		/* value */
-		sprintf(command, "-data-evaluate-expression \"%s\"", var->expression->str);
-		exec_sync_command(command, TRUE, &record);
-		pos = strstr(record, "value=\"");
-		if (!pos)
+		gchar *unescaped = unescape(value);
+		g_string_assign(var->value, unescaped);
+		g_free(unescaped);
+	}
+	var->evaluated = value != NULL;
+}
+
+/*
+ * sets children flag from "numchild" and "has_more" (pretty printed variables) fields
+ */
+static void set_variable_children(variable *var, const mi_result *fields, const gchar *numchild_field)
+{
+	var->has_children = mi_result_get_int(fields, numchild_field, 0) > 0 || mi_result_get_int(fields, "has_more", 0) > 0;
+}
+
+/*
+ * takes internal name, type and children flag of a variable
+ * from -var-create result, returns FALSE if creation failed
+ */
+static gboolean set_created_variable(variable *var, command_result *result)
+{
+	const gchar *name, *type;
+
+	if (RC_DONE != result->rc || !(name = mi_result_get_string(result->record->first, "name")))
+	{
+		g_string_assign(var->internal, "");
+		var->has_children = FALSE;
+		return FALSE;
+	}
+
+	g_string_assign(var->internal, name);
+	if ( (type = mi_result_get_string(result->record->first, "type")) )
+		g_string_assign(var->type, type);
+	set_variable_children(var, result->record->first, "numchild");
+
+	return TRUE;
+}
+
+/*
+ * sets the values of the variables that have children from their expressions
+ * (variable objects show them as "{...}")
+ */
+static void evaluate_variables (GList *vars)
+{
+	int count = g_list_length(vars);
+	command_result *results;
+	GList *iter;
+	guint token = 0;
+	int i;
+
+	if (!count)
+		return;
+
+	results = g_new(command_result, count);
+	for (iter = vars, i = 0; iter; iter = iter->next, i++)
+	{
+		variable *var = (variable*)iter->data;
+
+		results[i].record = NULL;
+		results[i].rc = RC_ERROR;
+		if (var->has_children && var->expression->len)
+			token = send_evaluate(var->expression->str, results + i);
+	}
+	wait_for_results(token);
+
+	for (iter = vars, i = 0; iter; iter = iter->next, i++)
+	{
+		variable *var = (variable*)iter->data;
+
+		if (RC_DONE == results[i].rc)
+			set_variable_value(var, results[i].record->first);
+		mi_record_free(results[i].record);
+	}
+	g_free(results);
+}
+
+/*
+ * gets path expressions for the children variables
+ * and full values for the ones that have children themselves
+ * (variable objects show them as "{...}")
+ */
+static void get_expressions (GList *vars)
+{
+	int count = g_list_length(vars);
+	command_result *results;
+	GList *iter;
+	guint token = 0;
+	int i;
+
+	if (!count)
+		return;
+
+	/* path expressions */
+	results = g_new(command_result, count);
+	for (iter = vars, i = 0; iter; iter = iter->next, i++)
+	{
+		variable *var = (variable*)iter->data;
+		gchar *command = g_strdup_printf("-var-info-path-expression \"%s\"", var->internal->str);
+
+		token = send_sync_command(command, results + i);
+		g_free(command);
+	}
+	wait_for_results(token);
+
+	for (iter = vars, i = 0; iter; iter = iter->next, i++)
+	{
+		variable *var = (variable*)iter->data;
+		mi_record *record = results[i].record;
+		const gchar *path;
+
+		if (record && (path = mi_result_get_string(record->first, "path_expr")))
 		{
-			g_free(record);
-			sprintf(command, "-var-evaluate-expression \"%s\"", varname);
-			exec_sync_command(command, TRUE, &record);
-			pos = strstr(record, "value=\"");
+			gchar *expression = unescape(path);
+			g_string_assign(var->expression, expression);
+			g_free(expression);
 		}
-		pos +=  + strlen("value=\"");
-		*(strrchr(pos, '\"')) = '\0';
-		value = unescape(pos);
-		g_string_assign(var->value, value);
-		g_free(value);
-		g_free(record);
-
-		/* type */
-		sprintf(command, "-var-info-type \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		pos = strstr(record, "type=\"") + strlen("type=\"");
-		*(strchr(pos, '\"')) = '\0';
-		g_string_assign(var->type, pos);
-		g_free(record);
-
-		vars = vars->next;
+		mi_record_free(record);
 	}
+	g_free(results);
+
+	/* values of the aggregates */
+	evaluate_variables(vars);
 }
 
 /*
- * updates files list
+ * updates files set, called on startup and when
+ * a library was loaded/unloaded, not on every stop
  */
 static void update_files(void)
 {
-	GHashTable *ht = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, NULL);
-	gchar *record = NULL;
-	gchar *pos;
+	mi_record *record = NULL;
+	const mi_result *source;
 
 	if (files)
-	{
-		/* free previous list */
-		g_list_foreach(files, (GFunc)g_free, NULL);
-		g_list_free(files);
-		files = NULL;
-	}
+		g_hash_table_remove_all(files);
+	else
+		files = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
 
-	exec_sync_command("-file-list-exec-source-files", TRUE, &record);
-	pos = record;
-	while ( (pos = strstr(pos, "fullname=\"")) )
+	if (RC_DONE == exec_sync_command("-file-list-exec-source-files", TRUE, &record))
 	{
-		pos += strlen("fullname=\"");
-		*(strchr(pos, '\"')) = '\0';
-		if (!g_hash_table_lookup(ht, pos))
+		for (source = mi_result_get_list(record->first, "files"); source; source = source->next)
 		{
-			g_hash_table_insert(ht, (gpointer)pos, (gpointer)1);
-			files = g_list_append(files, g_strdup(pos));
+			const gchar *fullname;
+
+			if (MI_VAL_TUPLE != source->val.type)
+				continue;
+
+			fullname = mi_result_get_string(source->val.v.list, "fullname");
+			if (fullname && !g_hash_table_lookup(files, fullname))
+			{
+				gchar *copy = g_strdup(fullname);
+				g_hash_table_insert(files, copy, copy);
+			}
 		}
-			
-		pos += strlen(pos) + 1;
 	}
 
-	g_hash_table_destroy(ht);
-	g_free(record);
+	mi_record_free(record);
 }
 
 /*
- * updates watches list 
+ * frees a change of a child variable
  */
-static void update_watches(void)
+static void variable_change_free(variable_change *change)
 {
-	gchar command[1000];
-	GList *updating = NULL;
-	GList *iter;
+	g_free(change->value);
+	g_free(change->type);
+	g_free(change);
+}
 
-	/* delete all GDB variables */
-	for (iter = watches; iter; iter = iter->next)
+/*
+ * stores the change of a child object from a "-var-update" changelist item,
+ * its children have to be listed again if its type or their number has changed
+ */
+static void add_child_change(const gchar *name, const mi_result *fields, gboolean type_changed)
+{
+	variable_change *change = g_new0(variable_change, 1);
+	const gchar *value = mi_result_get_string(fields, "value");
+	const gchar *type = mi_result_get_string(fields, "new_type");
+
+	if (value)
+		change->value = unescape(value);
+	if (type_changed || mi_result_get_string(fields, "new_num_children"))
+	{
+		change->children_changed = TRUE;
+		change->type = g_strdup(type);
+		change->has_children = mi_result_get_int(fields, "new_num_children", 0) > 0 || mi_result_get_int(fields, "has_more", 0) > 0;
+	}
+
+	g_hash_table_insert(changed_children, g_strdup(name), change);
+}
+
+/*
+ * refreshes autos and watches on a stop or a frame change
+ * GDB variable objects are kept between stops, so a single batch updates
+ * them all, lists the frame variables and evaluates watches.
+ * The objects are created only for the new autos and for the watches
+ * that could not be created before.
+ */
+static void update_variables(void)
+{
+	command_result update_result, list_result;
+	command_result *watch_values, *watch_creates;
+	GHashTable *by_internal, *by_name, *kept;
+	GList *iter, *riter, *new_autos = NULL, *created = NULL, *created_results = NULL;
+	const mi_result *item;
+	int nwatches = g_list_length(watches);
+	guint token;
+	int i;
+
+	/* 1. the batch */
+	send_sync_command("-var-update --all-values *", &update_result);
+	token = send_sync_command("-stack-list-variables --all-values", &list_result);
+	watch_values = g_new(command_result, nwatches);
+	watch_creates = g_new(command_result, nwatches);
+	for (iter = watches, i = 0; iter; iter = iter->next, i++)
+	{
+		variable *var = (variable*)iter->data;
+
+		/* the record stays NULL if no object has to be created */
+		watch_creates[i].rc = RC_ERROR;
+		watch_creates[i].record = NULL;
+		if (!var->internal->len)
+			send_var_create(var->name->str, watch_creates + i);
+
+		token = send_evaluate(var->name->str, watch_values + i);
+	}
+	wait_for_results(token);
+
+	/* 2. apply type changes reported for the kept objects */
+	by_internal = g_hash_table_new(g_str_hash, g_str_equal);
+	for (iter = autos; iter; iter = iter->next)
 	{
 		variable *var = (variable*)iter->data;
-		
 		if (var->internal->len)
-		{
-			sprintf(command, "-var-delete %s", var->internal->str);
-			exec_sync_command(command, TRUE, NULL);
-		}
-		
-		/* reset all variables fields */
-		variable_reset(var);
+			g_hash_table_insert(by_internal, var->internal->str, var);
 	}
-	
-	/* create GDB variables, adding successfully created
-	variables to the list then passed for updatind */
 	for (iter = watches; iter; iter = iter->next)
 	{
 		variable *var = (variable*)iter->data;
-		gchar *record = NULL;
-		gchar *pos;
-		gchar *escaped;
+		if (var->internal->len)
+			g_hash_table_insert(by_internal, var->internal->str, var);
+	}
+	if (changed_children)
+		g_hash_table_remove_all(changed_children);
+	else
+		changed_children = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)variable_change_free);
+	item = RC_DONE == update_result.rc ? mi_result_get_list(update_result.record->first, "changelist") : NULL;
+	for (; item; item = item->next)
+	{
+		const gchar *name, *in_scope, *type_changed;
+		variable *var;
 
-		/* try to create variable */
-		escaped = g_strescape(var->name->str, NULL);
-		sprintf(command, "-var-create - * \"%s\"", escaped);
-		g_free(escaped);
+		if (MI_VAL_TUPLE != item->val.type || !(name = mi_result_get_string(item->val.v.list, "name")))
+			continue;
 
-		if (RC_DONE != exec_sync_command(command, TRUE, &record))
+		in_scope = mi_result_get_string(item->val.v.list, "in_scope");
+		type_changed = mi_result_get_string(item->val.v.list, "type_changed");
+		if ( !(var = (variable*)g_hash_table_lookup(by_internal, name)) )
 		{
-			/* do not include to updating list, move to next watch */
-			var->evaluated = FALSE;
-			g_string_assign(var->internal, "");
-			g_free(record);
-			
+			/* children objects are refreshed by the watch trees from their changes,
+			the ones out of scope belong to a root that is */
+			if (!in_scope || !strcmp(in_scope, "true"))
+				add_child_change(name, item->val.v.list, type_changed && !strcmp(type_changed, "true"));
 			continue;
 		}
-		
-		/* find and assign internal name */
-		pos = strstr(record, "name=\"") + strlen("name=\"");
-		*strchr(pos, '\"') = '\0'; 
-		g_string_assign(var->internal, pos);
-		g_free(record);			
-		
-		var->evaluated = TRUE;
 
-		/* add to updating list */
-		updating = g_list_append(updating, var);
+		if (in_scope && !strcmp(in_scope, "invalid"))
+		{
+			/* object can't be used anymore, it will be created anew */
+			gchar *command = g_strdup_printf("-var-delete %s", var->internal->str);
+			send_command(command, NULL, NULL);
+			g_free(command);
+
+			g_hash_table_remove(by_internal, var->internal->str);
+			g_string_assign(var->internal, "");
+			var->has_children = FALSE;
+		}
+		else if (type_changed && !strcmp(type_changed, "true"))
+		{
+			const gchar *type = mi_result_get_string(item->val.v.list, "new_type");
+			g_string_assign(var->type, type ? type : "");
+			set_variable_children(var, item->val.v.list, "new_num_children");
+		}
 	}
-	
-	/* update watches */
-	get_variables(updating);
+	g_hash_table_destroy(by_internal);
+	mi_record_free(update_result.record);
 
-	/* free updating list */
-	g_list_free(updating);
-}
+	/* 3. watches */
+	for (iter = watches, i = 0; iter; iter = iter->next, i++)
+	{
+		variable *var = (variable*)iter->data;
 
-/*
- * updates autos list 
- */
-static void update_autos(void)
-{
-	gchar command[1000];
-	GList *unevaluated = NULL, *iter;
-	const char *gdb_commands[2];
-	int i;
+		if (watch_creates[i].record)
+		{
+			g_string_assign(var->expression, var->name->str);
+			set_created_variable(var, watch_creates + i);
+		}
+		mi_record_free(watch_creates[i].record);
 
-	/* remove all previous GDB variables for autos */
+		if (RC_DONE == watch_values[i].rc)
+			set_variable_value(var, watch_values[i].record->first);
+		else
+			var->evaluated = FALSE;
+		mi_record_free(watch_values[i].record);
+	}
+	g_free(watch_creates);
+	g_free(watch_values);
+
+	/* 4. autos: keep objects of the variables still listed, create the others */
+	by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	kept = g_hash_table_new(NULL, NULL);
 	for (iter = autos; iter; iter = iter->next)
 	{
 		variable *var = (variable*)iter->data;
-		
-		sprintf(command, "-var-delete %s", var->internal->str);
-		exec_sync_command(command, TRUE, NULL);
+		if (var->internal->len && !g_hash_table_lookup(by_name, var->name->str))
+			g_hash_table_insert(by_name, var->name->str, var);
 	}
 
-	g_list_foreach(autos, (GFunc)variable_free, NULL);
-	g_list_free(autos);
-	autos = NULL;
-	
-	/* add current autos to the list */
-	
-	gdb_commands[0] = g_strdup_printf("-stack-list-arguments 0 %i %i", active_frame, active_frame);
-	gdb_commands[1] = "-stack-list-locals 0";
-	for (i = 0; i < sizeof (gdb_commands) / sizeof(*gdb_commands); i++)
+	/* variables=[{name="a",arg="1",value="1"},{name="b",value="2"},...] */
+	item = RC_DONE == list_result.rc ? mi_result_get_list(list_result.record->first, "variables") : NULL;
+	for (; item; item = item->next)
 	{
-		gchar *record = NULL, *pos;
+		const gchar *name;
+		variable_type vt;
+		variable *var;
 
-		result_class rc = exec_sync_command(gdb_commands[i], TRUE, &record);
-		if (RC_DONE != rc)
-			break;
+		if (MI_VAL_TUPLE != item->val.type || !(name = mi_result_get_string(item->val.v.list, "name")))
+			continue;
 
-		pos = record;
-		while ((pos = strstr(pos, "name=\"")))
+		vt = mi_result_get_int(item->val.v.list, "arg", 0) ? VT_ARGUMENT : VT_LOCAL;
+		if ( (var = (variable*)g_hash_table_lookup(by_name, name)) )
 		{
-			variable *var;
-			gchar *create_record = NULL, *escaped;
+			/* same name may appear twice for shadowed variables */
+			g_hash_table_remove(by_name, name);
+			g_hash_table_insert(kept, var, var);
+			var->vt = vt;
+		}
+		else
+		{
+			command_result *result = g_new(command_result, 1);
 
-			pos += strlen("name=\"");
-			*(strchr(pos, '\"')) = '\0';
+			var = variable_new((gchar*)name, vt);
+			g_string_assign(var->expression, name);
+			token = send_var_create(name, result);
 
-			var = variable_new(pos, i ? VT_LOCAL : VT_ARGUMENT);
+			created = g_list_prepend(created, var);
+			created_results = g_list_prepend(created_results, result);
+		}
 
-			/* create new gdb variable */
-			escaped = g_strescape(pos, NULL);
-			sprintf(command, "-var-create - * \"%s\"", escaped);
-			g_free(escaped);
+		set_variable_value(var, item->val.v.list);
+		new_autos = g_list_prepend(new_autos, var);
+	}
+	mi_record_free(list_result.record);
+	wait_for_results(token);
 
-			/* form new variable */
-			if (RC_DONE == exec_sync_command(command, TRUE, &create_record))
-			{
-				gchar *intname = strstr(create_record, "name=\"") + strlen ("name=\"");
-				*strchr(intname, '\"') = '\0';
-				var->evaluated = TRUE;
-				g_string_assign(var->internal, intname);
-				autos = g_list_append(autos, var);
+	for (iter = created, riter = created_results; iter; iter = iter->next, riter = riter->next)
+	{
+		command_result *result = (command_result*)riter->data;
 
-				g_free(create_record);
-			}
-			else
-			{
-				var->evaluated = FALSE;
-				g_string_assign(var->internal, "");
-				unevaluated = g_list_append(unevaluated, var);
-			}
-			
-			pos += strlen(pos) + 1;
+		set_created_variable((variable*)iter->data, result);
+
+		mi_record_free(result->record);
+		g_free(result);
+	}
+	g_list_free(created);
+	g_list_free(created_results);
+
+	/* delete objects of the variables gone */
+	for (iter = autos; iter; iter = iter->next)
+	{
+		variable *var = (variable*)iter->data;
+		if (g_hash_table_lookup(kept, var))
+			continue;
+
+		if (var->internal->len)
+		{
+			gchar *command = g_strdup_printf("-var-delete %s", var->internal->str);
+			send_command(command, NULL, NULL);
+			g_free(command);
 		}
-		g_free(record);
+		variable_free(var);
 	}
-	g_free((void*)gdb_commands[0]);
-	
-	/* get values for the autos (without incorrect variables) */
-	get_variables(autos);
-	
-	/* add incorrect variables */
-	autos = g_list_concat(autos, unevaluated);
+	g_list_free(autos);
+	autos = g_list_reverse(new_autos);
+
+	g_hash_table_destroy(kept);
+	g_hash_table_destroy(by_name);
 }
 
 /*
@@ -1612,74 +1914,73 @@ static GList* get_watches (void)
 }
 
 /*
- * get files list 
+ * get files set, owned by the module
  */
-static GList* get_files (void)
+static GHashTable* get_files (void)
 {
-	return g_list_copy(files);
+	return files;
 }
 
 /*
- * get list of children 
+ * get changes of the children objects, owned by the module
  */
-static GList* get_children (gchar* path)
+static GHashTable* get_changed_children (void)
+{
+	return changed_children;
+}
+
+/*
+ * get list of "count" children starting from "from",
+ * one more is asked to know whether there are more children
+ */
+static GList* get_children (gchar* path, int from, int count, gboolean *more)
 {
 	GList *children = NULL;
+	int received = 0;
 	
-	gchar command[1000];
-	result_class rc;
-	gchar *record = NULL;
-	gchar *pos = NULL;
-	int numchild;
+	gchar *command;
+	mi_record *record = NULL;
+	const mi_result *child;
 
-	/* children number */
-	sprintf(command, "-var-info-num-children \"%s\"", path);
-	rc = exec_sync_command(command, TRUE, &record);
-	if (RC_DONE != rc)
-		return NULL;
-	pos = strstr(record, "numchild=\"") + strlen("numchild=\"");
-	*(strchr(pos, '\"')) = '\0';
-	numchild = atoi(pos);
-	g_free(record);
-	if (!numchild)
-		return NULL;
-	
-	/* recursive get children and put into list */
-	sprintf(command, "-var-list-children \"%s\"", path);
-	rc = exec_sync_command(command, TRUE, &record);
-	if (RC_DONE == rc)
+	*more = FALSE;
+
+	/* children with their values, types and children numbers */
+	command = g_strdup_printf("-var-list-children --all-values \"%s\" %i %i", path, from, from + count + 1);
+	if (RC_DONE == exec_sync_command(command, TRUE, &record))
 	{
-		pos = record;
-		while ( (pos = strstr(pos, "child={")) )
+		for (child = mi_result_get_list(record->first, "children"); child; child = child->next)
 		{
-			gchar *name, *internal;
+			const gchar *name, *internal, *type;
 			variable *var;
+
+			if (MI_VAL_TUPLE != child->val.type)
+				continue;
 			
-			/* name */
-			pos = strstr(pos, "name=\"") + strlen("name=\"");
-			*(strstr(pos, "\",exp=\"")) = '\0';
-			internal = pos;
-			pos += strlen(pos) + 1;
-
-			/* exp */
-			pos = strstr(pos, "exp=\"") + strlen("exp=\"");
-			*(strstr(pos, "\",numchild=\"")) = '\0';
-			
-			name = g_strcompress(pos);
-			
-			var = variable_new2(name, internal, VT_CHILD);
-			var->evaluated = TRUE;
+			internal = mi_result_get_string(child->val.v.list, "name");
+			name = mi_result_get_string(child->val.v.list, "exp");
+			if (!internal || !name)
+				continue;
+
+			if (++received > count)
+			{
+				*more = TRUE;
+				break;
+			}
 			
-			pos += strlen(pos) + 1;
+			var = variable_new2((gchar*)name, (gchar*)internal, VT_CHILD);
+			if ( (type = mi_result_get_string(child->val.v.list, "type")) )
+				g_string_assign(var->type, type);
+			set_variable_children(var, child->val.v.list, "numchild");
+			set_variable_value(var, child->val.v.list);
 
-			children = g_list_append(children, var);
-		
-			g_free(name);
+			children = g_list_prepend(children, var);
 		}
 	}
-	g_free(record);
-	
-	get_variables(children);
+	mi_record_free(record);
+	g_free(command);
+
+	children = g_list_reverse(children);
+	get_expressions(children);
 
 	return children;
 }
@@ -1689,34 +1990,21 @@ static GList* get_children (gchar* path)
  */
 static variable* add_watch(gchar* expression)
 {
-	gchar command[1000];
-	gchar *record = NULL, *escaped, *pos;
-	GList *vars = NULL;
+	command_result create_result, value_result;
 	variable *var = variable_new(expression, VT_WATCH);
 
 	watches = g_list_append(watches, var);
 
-	/* try to create a variable */
-	escaped = g_strescape(expression, NULL);
-	sprintf(command, "-var-create - * \"%s\"", escaped);
-	g_free(escaped);
-
-	if (RC_DONE != exec_sync_command(command, TRUE, &record))
-	{
-		g_free(record);
-		return var;
-	}
-	
-	pos = strstr(record, "name=\"") + strlen("name=\"");
-	*strchr(pos, '\"') = '\0'; 
-	g_string_assign(var->internal, pos);
-	var->evaluated = TRUE;
+	/* try to create a variable and evaluate it at once */
+	send_var_create(expression, &create_result);
+	wait_for_results(send_evaluate(expression, &value_result));
 
-	vars = g_list_append(NULL, var);
-	get_variables(vars);
+	g_string_assign(var->expression, expression);
+	if (set_created_variable(var, &create_result) && RC_DONE == value_result.rc)
+		set_variable_value(var, value_result.record->first);
 
-	g_free(record);
-	g_list_free(vars);
+	mi_record_free(create_result.record);
+	mi_record_free(value_result.record);
 
 	return var;	
 }
@@ -1747,23 +2035,21 @@ static void remove_watch(gchar* internal)
  */
 static gchar *evaluate_expression(gchar *expression)
 {
-	gchar *record = NULL, *pos;
+	mi_record *record = NULL;
+	const gchar *value;
+	gchar *unescaped = NULL;
 	char command[1000];
 	result_class rc;
 
 	sprintf (command, "-data-evaluate-expression \"%s\"", expression);
 	rc = exec_sync_command(command, TRUE, &record);
 	
-	if (RC_DONE != rc)
-	{
-		g_free(record);
-		return NULL;
-	}
+	if (RC_DONE == rc && (value = mi_result_get_string(record->first, "value")))
+		unescaped = unescape(value);
 
-	pos = strstr(record, "value=\"") + strlen("value=\"");
-	*(strrchr(pos, '\"')) = '\0';
+	mi_record_free(record);
 
-	return unescape(pos);
+	return unescaped;
 }
 
 /*
@@ -146,9 +146,10 @@ static GtkWidget **sensitive_widget[] = {&stree, &wtree, &atree, NULL};
 static GList* stack = NULL;
 
 /*
- * pages which are loaded in debugger and therefore, are set readonly
+ * real paths of the pages which are loaded in debugger
+ * and therefore, are set readonly (path -> path)
  */
-static GList *read_only_pages = NULL;
+static GHashTable *read_only_pages = NULL;
 
 /* available modules */
 static module_description modules[] = 
@@ -580,31 +581,14 @@ static void on_watch_expanded_callback(GtkTreeView *tree, GtkTreeIter *iter, Gtk
 	
 	if (only_stub)
 	{
-		GList *children;
-		gchar *internal;
-
-		/* if item has not been expanded before */
-		gtk_tree_model_get (
-			model,
-			iter,
-			W_INTERNAL, &internal,
-			-1);
-		
-		/* get children list */
-		children = active_module->get_children(internal);
-		
-		/* remove stub and add children */
-		expand_stub(tree, iter, children);
-		
-		/* free children list */
-		free_variables_list(children);
+		/* if item has not been expanded before -
+		 * remove stub and add the first children */
+		expand_stub(tree, iter);
 
 		/* unset W_STUB flag */
 		gtk_tree_store_set (store, iter,
 			W_STUB, FALSE,
 			-1);
-
-		g_free(internal);	
 	}
 }
 
@@ -655,12 +639,49 @@ static void on_debugger_run (void)
 }
 
 
+/*
+ * makes open documents that are debugged source files readonly
+ * and the ones that are not anymore writable, only the documents
+ * whose state changes are touched
+ */
+static void update_read_only_pages(void)
+{
+	GHashTable *files = active_module->get_files();
+	guint i;
+
+	if (!read_only_pages)
+		read_only_pages = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+
+	foreach_document(i)
+	{
+		GeanyDocument *doc = documents[i];
+		gboolean debugged, readonly;
+
+		if (!doc->real_path)
+			continue;
+
+		debugged = files && g_hash_table_lookup(files, doc->real_path);
+		readonly = NULL != g_hash_table_lookup(read_only_pages, doc->real_path);
+		if (debugged == readonly)
+			continue;
+
+		scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, debugged, 0);
+		if (debugged)
+		{
+			gchar *path = g_strdup(doc->real_path);
+			g_hash_table_insert(read_only_pages, path, path);
+		}
+		else
+			g_hash_table_remove(read_only_pages, doc->real_path);
+	}
+}
+
 /* 
  * called from debug module when debugger is being stopped 
  */
 static void on_debugger_stopped (int thread_id)
 {
-	GList *iter, *files, *autos, *watches;
+	GList *iter, *autos, *watches;
 
 	/* update debug state */
 	debug_state = DBS_STOPPED;
@@ -707,53 +728,7 @@ static void on_debugger_stopped (int thread_id)
 	stree_select_first_frame(TRUE);
 
 	/* files */
-	files = active_module->get_files();
-	/* remove from list and make writable those files,
-	that are not in the current list */
-	iter = read_only_pages;
-	while (iter)
-	{
-		if (!g_list_find_custom(files, iter->data, (GCompareFunc)g_strcmp0))
-		{
-			GList *next;
-
-			/* set document writable */
-			GeanyDocument *doc = document_find_by_real_path((const gchar*)iter->data);
-			if (doc)
-				scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, 0, 0);
-
-			/* free file name */
-			g_free(iter->data);
-			/* save next item pointer */
-			next = iter->next;
-			/* remove current item */
-			read_only_pages = g_list_delete_link(read_only_pages, iter);
-
-			/* set next item and continue */
-			iter = next;
-			continue;
-		}
-
-		iter = iter->next;
-	}
-	/* add to the list and make readonly those files
-	from the current list that are new */
-	iter = files;
-	while (iter)
-	{
-		if (!g_list_find_custom(read_only_pages, iter->data, (GCompareFunc)g_strcmp0))
-		{
-			/* set document readonly */
-			GeanyDocument *doc = document_find_by_real_path((const gchar*)iter->data);
-			if (doc)
-				scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, 1, 0);
-
-			/* add new file to the list */
-			read_only_pages = g_list_append(read_only_pages, g_strdup((gchar*)iter->data));
-		}
-		iter = iter->next;
-	}
-	g_list_free(files);
+	update_read_only_pages();
 
 	/* autos */
 	autos = active_module->get_autos();
@@ -792,7 +767,6 @@ static void on_debugger_exited (int code)
 {
 	GtkTextIter start, end;
 	GtkTextBuffer *buffer;
-	GList *iter;
 
 	/* remove marker for current instruction if was set */
 	if (stack)
@@ -828,17 +802,21 @@ static void on_debugger_exited (int code)
 		bptree_set_readonly(FALSE);
 	
 	/* set files that was readonly during debug writable */
-	for (iter = read_only_pages; iter; iter = iter->next)
+	if (read_only_pages)
 	{
-		GeanyDocument *doc = document_find_by_real_path((const gchar*)iter->data);
-		if (doc)
-			scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, 0, 0);
+		GHashTableIter iter;
+		gpointer path;
 
-		/* free file name */
-		g_free(iter->data);
+		g_hash_table_iter_init(&iter, read_only_pages);
+		while (g_hash_table_iter_next(&iter, &path, NULL))
+		{
+			GeanyDocument *doc = document_find_by_real_path((const gchar*)path);
+			if (doc)
+				scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, 0, 0);
+		}
+		g_hash_table_destroy(read_only_pages);
+		read_only_pages = NULL;
 	}
-	g_list_free(read_only_pages);
-	read_only_pages = NULL;
 
 	/* clear and destroy calltips cache */
 	g_hash_table_destroy(calltips);
@@ -1338,10 +1316,10 @@ gchar* debug_get_calltip_for_expression(gchar* expression)
 			calltip_str = get_calltip_line(var, TRUE);
 			if (var->has_children)
 			{
-				int lines_left = MAX_CALLTIP_HEIGHT - 1;
-				GList* children = active_module->get_children(var->internal->str); 
+				gboolean more;
+				GList* children = active_module->get_children(var->internal->str, 0, MAX_CALLTIP_HEIGHT - 1, &more); 
 				GList* child = children;
-				while(child && lines_left)
+				while(child)
 				{
 					variable *varchild = (variable*)child->data;
 					GString *child_string = get_calltip_line(varchild, FALSE);
@@ -1349,9 +1327,8 @@ gchar* debug_get_calltip_for_expression(gchar* expression)
 					g_string_free(child_string, TRUE);
 
 					child = child->next;
-					lines_left--;
 				}
-				if (!lines_left && child)
+				if (more)
 				{
 					g_string_append(calltip_str, "\n\t\t........");
 				}
@@ -1399,9 +1376,19 @@ void debug_jump_to_current_instruction(void)
  */
 void debug_on_file_open(GeanyDocument *doc)
 {
-	const gchar *file = DOC_FILENAME(doc);
-	if (g_list_find_custom(read_only_pages, (gpointer)file, (GCompareFunc)g_strcmp0))
+	GHashTable *files;
+
+	/* read_only_pages exists since the first stop of the debug session */
+	if (!read_only_pages || !doc->real_path)
+		return;
+
+	files = active_module->get_files();
+	if (files && g_hash_table_lookup(files, doc->real_path))
+	{
+		gchar *path = g_strdup(doc->real_path);
+		g_hash_table_replace(read_only_pages, path, path);
 		scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, 1, 0);
+	}
 }
 
 /*
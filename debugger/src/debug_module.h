@@ -77,6 +77,19 @@ typedef struct _variable {
 	variable_type vt;
 } variable;
 
+/* type to hold a change of a child variable reported on a stop */
+typedef struct _variable_change {
+	/* new value, NULL if it's unknown */
+	gchar *value;
+	/* flag indicating whether the type or the number of children has changed,
+	 * the children have to be listed again then */
+	gboolean children_changed;
+	/* new type, NULL if it's the same, and children flag,
+	 * both set only if children_changed is */
+	gchar *type;
+	gboolean has_children;
+} variable_change;
+
 /* type to hold information about a stack frame */
 typedef struct _frame {
 	gchar *address;
@@ -124,9 +137,16 @@ typedef struct _dbg_module {
 	GList* (*get_autos) (void);
 	GList* (*get_watches) (void);
 	
-	GList* (*get_files) (void);
-
-	GList* (*get_children) (gchar* path);
+	/* set of the source files full names, owned by the module, may be NULL */
+	GHashTable* (*get_files) (void);
+
+	/* "count" children starting from "from", "more" is set if there are more after them */
+	GList* (*get_children) (gchar* path, int from, int count, gboolean *more);
+	/* changes of the children got before, internal name -> variable_change,
+	 * owned by the module, may be NULL if they are unknown */
+	GHashTable* (*get_changed_children) (void);
+	/* sets the values of the "vars" with children from their expressions */
+	void (*evaluate_variables) (GList *vars);
 	variable* (*add_watch)(gchar* expression);
 	void (*remove_watch)(gchar* path);
 
@@ -158,6 +178,8 @@ typedef struct _dbg_module {
 	get_watches, \
 	get_files, \
 	get_children, \
+	get_changed_children, \
+	evaluate_variables, \
 	add_watch, \
 	remove_watch, \
 	evaluate_expression, \
@@ -0,0 +1,311 @@
+/*
+ *      gdb_mi.c
+ *      
+ *      Copyright 2010 Alexander Petukhov <devel(at)apetukhov.ru>
+ *      
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *      
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * 		GDB/MI output records parser
+ * 		A line is parsed in one pass: it is copied once, strings
+ * 		are unescaped in place and results point into the copy
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "gdb_mi.h"
+
+/* nesting limit for tuples and lists, deeper values are ignored */
+#define MI_MAX_DEPTH 1024
+
+static gboolean parse_value(gchar **p, mi_value *val, int depth);
+
+/*
+ * frees a list of results
+ */
+static void free_results(mi_result *result)
+{
+	while (result)
+	{
+		mi_result *next = result->next;
+		if (MI_VAL_STRING != result->val.type)
+			free_results(result->val.v.list);
+		g_slice_free(mi_result, result);
+		result = next;
+	}
+}
+
+/*
+ * parses a c-string starting at *p, unescaping it in place
+ * returns the string, *p is moved after the closing quote
+ */
+static gchar* parse_cstring(gchar **p)
+{
+	gchar *start = *p + 1;
+	gchar *in = start;
+	gchar *out = start;
+
+	while (*in && '\"' != *in)
+	{
+		gchar c = *in++;
+		if ('\\' == c && *in)
+		{
+			c = *in++;
+			switch (c)
+			{
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case 'r': c = '\r'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'v': c = '\v'; break;
+				case 'a': c = '\a'; break;
+				case 'e': c = '\033'; break;
+				default:
+					if (c >= '0' && c <= '7')
+					{
+						/* up to three octal digits */
+						int code = c - '0';
+						if (*in >= '0' && *in <= '7')
+						{
+							code = code * 8 + *in++ - '0';
+							if (*in >= '0' && *in <= '7')
+								code = code * 8 + *in++ - '0';
+						}
+						c = (gchar)code;
+					}
+					/* '\\', '\"' and unknown escapes stand for themselves */
+			}
+		}
+		*out++ = c;
+	}
+
+	*p = *in ? in + 1 : in;
+	*out = '\0';
+
+	return start;
+}
+
+/*
+ * parses "variable=value" at *p
+ */
+static mi_result* parse_result(gchar **p, int depth)
+{
+	mi_result *result;
+	gchar *var = *p;
+
+	while (isalnum(**p) || '_' == **p || '-' == **p)
+		(*p)++;
+	if ('=' != **p)
+		return NULL;
+	*(*p)++ = '\0';
+
+	result = g_slice_new0(mi_result);
+	result->var = var;
+	if (!parse_value(p, &result->val, depth))
+	{
+		free_results(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+/*
+ * parses comma separated tuple or list elements at *p until "end" character
+ * list elements can be either values or results
+ */
+static mi_result* parse_elements(gchar **p, gchar end, gboolean values, int depth)
+{
+	mi_result *first = NULL, *last = NULL;
+
+	while (**p && end != **p)
+	{
+		mi_result *element;
+
+		if (values && ('\"' == **p || '{' == **p || '[' == **p))
+		{
+			element = g_slice_new0(mi_result);
+			if (!parse_value(p, &element->val, depth))
+			{
+				free_results(element);
+				element = NULL;
+			}
+		}
+		else
+			element = parse_result(p, depth);
+
+		if (!element)
+			break;
+
+		if (last)
+			last->next = element;
+		else
+			first = element;
+		last = element;
+
+		if (',' == **p)
+			(*p)++;
+		else
+			break;
+	}
+
+	if (end == **p)
+		(*p)++;
+
+	return first;
+}
+
+/*
+ * parses a value (c-string, tuple or list) at *p
+ */
+static gboolean parse_value(gchar **p, mi_value *val, int depth)
+{
+	if ('\"' == **p)
+	{
+		val->type = MI_VAL_STRING;
+		val->v.string = parse_cstring(p);
+	}
+	else if (('{' == **p || '[' == **p) && depth < MI_MAX_DEPTH)
+	{
+		gboolean tuple = '{' == **p;
+		val->type = tuple ? MI_VAL_TUPLE : MI_VAL_LIST;
+		(*p)++;
+		val->v.list = parse_elements(p, tuple ? '}' : ']', !tuple, depth + 1);
+	}
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+/*
+ * parses a line of GDB/MI output (without a line terminator)
+ * never fails, parsing stops at the first malformed result
+ */
+mi_record* mi_record_parse(const gchar *line)
+{
+	mi_record *record = g_new0(mi_record, 1);
+	gchar *p;
+
+	record->buffer = g_strdup(line);
+	p = record->buffer;
+
+	/* token */
+	while (isdigit(*p))
+		record->token = record->token * 10 + (*p++ - '0');
+
+	switch (*p)
+	{
+		case '^':
+		case '*':
+		case '+':
+		case '=':
+			record->type = *p++;
+
+			/* class */
+			record->klass = p;
+			while (isalnum(*p) || '-' == *p || '_' == *p)
+				p++;
+			if (',' == *p)
+			{
+				*p++ = '\0';
+				record->first = parse_elements(&p, '\0', FALSE, 0);
+			}
+			else
+				*p = '\0';
+			break;
+		case '~':
+		case '@':
+		case '&':
+			record->type = *p++;
+			if ('\"' == *p)
+				record->klass = parse_cstring(&p);
+			else
+				record->klass = p;
+			break;
+		default:
+			record->type = '\0';
+			record->klass = p;
+	}
+
+	return record;
+}
+
+/*
+ * frees a record
+ */
+void mi_record_free(mi_record *record)
+{
+	if (!record)
+		return;
+
+	free_results(record->first);
+	g_free(record->buffer);
+	g_free(record);
+}
+
+/*
+ * finds the first result named "var" with a value of the type given
+ */
+const mi_result* mi_result_find(const mi_result *result, const gchar *var, mi_value_type type)
+{
+	for (; result; result = result->next)
+	{
+		if (result->var && type == result->val.type && !strcmp(result->var, var))
+			return result;
+	}
+
+	return NULL;
+}
+
+/*
+ * gets a string value of a result named "var", NULL if there is not one
+ */
+const gchar* mi_result_get_string(const mi_result *result, const gchar *var)
+{
+	result = mi_result_find(result, var, MI_VAL_STRING);
+
+	return result ? result->val.v.string : NULL;
+}
+
+/*
+ * gets the first element of a tuple or a list value
+ * of a result named "var", NULL if there is not one or it is empty
+ */
+const mi_result* mi_result_get_list(const mi_result *result, const gchar *var)
+{
+	for (; result; result = result->next)
+	{
+		if (result->var && MI_VAL_STRING != result->val.type && !strcmp(result->var, var))
+			return result->val.v.list;
+	}
+
+	return NULL;
+}
+
+/*
+ * gets an integer value of a result named "var", "default_value" if there is not one
+ */
+gint mi_result_get_int(const mi_result *result, const gchar *var, gint default_value)
+{
+	const gchar *value = mi_result_get_string(result, var);
+
+	return value ? atoi(value) : default_value;
+}
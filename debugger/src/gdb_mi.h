@@ -0,0 +1,78 @@
+/*
+ *      gdb_mi.h
+ *      
+ *      Copyright 2010 Alexander Petukhov <devel(at)apetukhov.ru>
+ *      
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *      
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef GDB_MI_H
+#define GDB_MI_H
+
+#include <glib.h>
+
+/* GDB/MI value types */
+typedef enum _mi_value_type {
+	MI_VAL_STRING,
+	MI_VAL_TUPLE,
+	MI_VAL_LIST
+} mi_value_type;
+
+struct _mi_result;
+
+/* GDB/MI value: a string, a tuple of results or a list of results or values */
+typedef struct _mi_value {
+	mi_value_type type;
+	union {
+		gchar *string;
+		/* first element of a tuple or a list */
+		struct _mi_result *list;
+	} v;
+} mi_value;
+
+/* GDB/MI result - "variable=value", or a list element */
+typedef struct _mi_result {
+	/* NULL for the elements of a list of values */
+	gchar *var;
+	mi_value val;
+	struct _mi_result *next;
+} mi_result;
+
+/* GDB/MI output record */
+typedef struct _mi_record {
+	/* '^' result, '*' exec async, '+' status async, '=' notify async,
+	 * '~' console stream, '@' target stream, '&' log stream,
+	 * '\0' for anything else */
+	gchar type;
+	/* token the command was tagged with, 0 if none */
+	guint token;
+	/* result or async class ("done", "stopped"...), text for stream records */
+	gchar *klass;
+	/* results */
+	mi_result *first;
+	/* copy of the line all the strings point to */
+	gchar *buffer;
+} mi_record;
+
+mi_record*		mi_record_parse(const gchar *line);
+void			mi_record_free(mi_record *record);
+
+const mi_result*	mi_result_find(const mi_result *result, const gchar *var, mi_value_type type);
+const gchar*		mi_result_get_string(const mi_result *result, const gchar *var);
+const mi_result*	mi_result_get_list(const mi_result *result, const gchar *var);
+gint				mi_result_get_int(const mi_result *result, const gchar *var, gint default_value);
+
+#endif /* guard */
@@ -0,0 +1,432 @@
+/*
+ *      gdb_mi_test.c
+ *
+ *      Copyright 2010 Alexander Petukhov <devel(at)apetukhov.ru>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * 		GDB/MI parser test and benchmark
+ * 		Checks the records of a hand-written transcript in the output
+ * 		format of gdb 7 (gdb_mi_test.mi, with escaped quotes and lines
+ * 		cut by a short read, not captured from gdb), parses every
+ * 		prefix and random mutations of its lines, then times the parsing
+ * 		of a 5,000 frames backtrace and a 20,000 files list built in the
+ * 		format of gdb 7. The number of timed runs can be given as the
+ * 		first argument. Fails on any unexpected result, so it also runs
+ * 		under "make check", under valgrind it finds memory errors too.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "gdb_mi.h"
+
+#ifndef GDB_MI_TEST_TRANSCRIPT
+#define GDB_MI_TEST_TRANSCRIPT "gdb_mi_test.mi"
+#endif
+
+#define BACKTRACE_FRAMES 5000
+#define FILE_LIST_FILES 20000
+#define MUTATIONS_PER_LINE 2000
+#define NESTING 100000
+
+/* an expected value of a record in the transcript */
+typedef struct _transcript_check {
+	/* line in the transcript, counting from 1 */
+	guint line;
+	gchar type;
+	guint token;
+	/* class or stream text, NULL if not checked */
+	const gchar *klass;
+	/* "/" separated path of a string value, numbers index lists, NULL if none */
+	const gchar *path;
+	/* the value, NULL if the path must not be found */
+	const gchar *value;
+} transcript_check;
+
+static const transcript_check checks[] = {
+	{ 1, '=', 0, "thread-group-added", "id", "i1" },
+	{ 2, '~', 0, "GNU gdb (GDB) 7.2\n", NULL, NULL },
+	{ 4, '\0', 0, "(gdb) ", NULL, NULL },
+	{ 5, '^', 1, "done", "bkpt", NULL },
+	{ 6, '^', 2, "done", "bkpt/original-location", "/home/user/quote.c:9" },
+	{ 10, '*', 0, "stopped", "frame/args/1/value", "0x7fffffffe5c8" },
+	{ 10, '*', 0, "stopped", "frame/args/2/value", NULL },
+	{ 10, '*', 0, "stopped", "core", "0" },
+	{ 11, '^', 3, "done", "stack/0/fullname", "/home/user/quote.c" },
+	{ 12, '^', 4, "done", "value", "0x400700 \"say \\\"hi\\\"\\n\"" },
+	{ 12, '^', 4, "done", "type", "const char *" },
+	{ 13, '~', 0, "$1 = \"tab\\there\"\n", NULL, NULL },
+	{ 14, '&', 0, "print \"x\n", NULL, NULL },
+	{ 15, '^', 5, "error", "msg", "No symbol \"x\" in current context." },
+	{ 16, '^', 6, "done", "changelist/0/value", "0x400708 \"\\\\\"" },
+	{ 16, '^', 6, "done", "changelist/0/has_more", "0" },
+	{ 17, '^', 7, "done", "files/1/fullname", "/usr/include/stdio.h" },
+	{ 18, '@', 0, "octal AB\303\251 end", NULL, NULL },
+	/* lines cut in the middle of a string keep what was read */
+	{ 19, '^', 8, "done", "stack/0/func", "main" },
+	{ 19, '^', 8, "done", "stack/0/fullname", "/home/user/quo" },
+	{ 20, '*', 0, "stopped", "reason", "exited-normally" },
+	{ 21, '=', 0, "library-loaded", "thread-group", "i1" },
+	{ 22, '^', 9, "done", "BreakpointTable/body/0/times", "1" },
+	{ 22, '^', 9, "done", "BreakpointTable/hdr/0/colhdr", "Num" },
+	{ 23, '^', 10, "done", "variables/0/value", "0x400700 \"a,b=[c]\"" },
+	{ 23, '^', 10, "done", "variables/1/value", "3" },
+	{ 24, '*', 0, "stopped", "exit-code", "01" }
+};
+
+/*
+ * finds the string at "path" in a list of results, NULL if there is not one
+ */
+static const gchar* find_path(const mi_result *result, const gchar *path)
+{
+	gchar **names = g_strsplit(path, "/", -1);
+	const gchar *value = NULL;
+	gint i;
+
+	for (i = 0; names[i] && result; i++)
+	{
+		if (g_ascii_isdigit(names[i][0]))
+		{
+			gint n = atoi(names[i]);
+			while (result && n--)
+				result = result->next;
+		}
+		else
+		{
+			while (result && !(result->var && !strcmp(result->var, names[i])))
+				result = result->next;
+		}
+		if (!result)
+			break;
+
+		if (!names[i + 1])
+			value = MI_VAL_STRING == result->val.type ? result->val.v.string : "";
+		else if (MI_VAL_STRING == result->val.type)
+			break;
+		else
+			result = result->val.v.list;
+	}
+
+	g_strfreev(names);
+	return value;
+}
+
+/*
+ * counts the results and values of a list of results,
+ * checking that each of them is complete
+ */
+static guint count_nodes(const mi_result *result, gboolean values)
+{
+	guint count = 0;
+
+	for (; result; result = result->next)
+	{
+		if (!values && !result->var)
+			g_error("result without a name");
+		if (MI_VAL_STRING == result->val.type)
+		{
+			if (!result->val.v.string)
+				g_error("string without a value");
+		}
+		else if (MI_VAL_TUPLE == result->val.type || MI_VAL_LIST == result->val.type)
+			count += count_nodes(result->val.v.list, MI_VAL_LIST == result->val.type);
+		else
+			g_error("unknown value type %d", result->val.type);
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * parses a line, checking the record, returns its number of results and values
+ */
+static guint parse_line(const gchar *line)
+{
+	mi_record *record = mi_record_parse(line);
+	guint count;
+
+	if (!record->klass)
+		g_error("no class for \"%s\"", line);
+	count = count_nodes(record->first, FALSE);
+	mi_record_free(record);
+
+	return count;
+}
+
+/*
+ * checks the records of the transcript against the table
+ */
+static guint check_transcript(gchar **lines)
+{
+	guint failures = 0;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(checks); i++)
+	{
+		const transcript_check *check = &checks[i];
+		mi_record *record;
+		const gchar *value = NULL;
+
+		if (check->line > g_strv_length(lines))
+		{
+			g_printerr("line %u: missing from the transcript\n", check->line);
+			failures++;
+			continue;
+		}
+
+		record = mi_record_parse(lines[check->line - 1]);
+		if (record->type != check->type || record->token != check->token ||
+			(check->klass && g_strcmp0(record->klass, check->klass)))
+		{
+			g_printerr("line %u: record '%c' %u \"%s\", expected '%c' %u \"%s\"\n", check->line,
+				record->type ? record->type : ' ', record->token, record->klass,
+				check->type ? check->type : ' ', check->token, check->klass);
+			failures++;
+		}
+		else if (check->path && g_strcmp0(value = find_path(record->first, check->path), check->value))
+		{
+			g_printerr("line %u: %s is \"%s\", expected \"%s\"\n", check->line, check->path,
+				value ? value : "(none)", check->value ? check->value : "(none)");
+			failures++;
+		}
+		mi_record_free(record);
+	}
+
+	return failures;
+}
+
+/*
+ * parses every prefix of the line, as gdb output cut by a short read,
+ * and mutations of it, none of them may crash or read past the line
+ */
+static guint fuzz_line(const gchar *line, GRand *rand)
+{
+	static const gchar special[] = "\"\\{}[],=^*~0";
+	gsize len = strlen(line);
+	guint full = parse_line(line);
+	guint failures = 0;
+	gchar *copy;
+	gsize i;
+
+	for (i = 0; i < len; i++)
+	{
+		/* a prefix is parsed like the start of the line, so it cannot have more results */
+		gchar *prefix = g_strndup(line, i);
+		guint count = parse_line(prefix);
+		if (count > full)
+		{
+			g_printerr("%" G_GSIZE_FORMAT " bytes of \"%s\": %u results, %u for the whole line\n",
+				i, line, count, full);
+			failures++;
+		}
+		g_free(prefix);
+	}
+
+	if (!len)
+		return failures;
+
+	copy = g_strdup(line);
+	for (i = 0; i < MUTATIONS_PER_LINE; i++)
+	{
+		gsize pos = g_rand_int_range(rand, 0, len);
+		gchar old = copy[pos];
+
+		if (g_rand_boolean(rand))
+			copy[pos] = special[g_rand_int_range(rand, 0, sizeof(special) - 1)];
+		else
+			copy[pos] = (gchar)g_rand_int_range(rand, 1, 256);
+		parse_line(copy);
+		/* keep some of the mutations to combine them */
+		if (g_rand_int_range(rand, 0, 4))
+			copy[pos] = old;
+	}
+	g_free(copy);
+
+	return failures;
+}
+
+/*
+ * builds "-stack-list-frames" output of gdb stopped in a deep recursion
+ */
+static gchar* build_backtrace(void)
+{
+	GString *line = g_string_new("42^done,stack=[");
+	guint i;
+
+	for (i = 0; i < BACKTRACE_FRAMES; i++)
+	{
+		if (i)
+			g_string_append_c(line, ',');
+		if (i < BACKTRACE_FRAMES - 2)
+			g_string_append_printf(line, "frame={level=\"%u\",addr=\"0x%016x\",func=\"walk_tree\","
+				"file=\"tree.c\",fullname=\"/home/user/src/project/lib/tree.c\",line=\"%u\"}",
+				i, 0x4005b8 + i % 7 * 0x21, 120 + i % 7);
+		else
+			g_string_append_printf(line, "frame={level=\"%u\",addr=\"0x00007ffff7a3ec4%u\",func=\"%s\","
+				"from=\"/lib/libc.so.6\"}", i, i % 2, i % 2 ? "_start" : "__libc_start_main");
+	}
+	g_string_append_c(line, ']');
+
+	return g_string_free(line, FALSE);
+}
+
+/*
+ * builds "-file-list-exec-source-files" output of a large program
+ */
+static gchar* build_file_list(void)
+{
+	GString *line = g_string_new("43^done,files=[");
+	guint i;
+
+	for (i = 0; i < FILE_LIST_FILES; i++)
+	{
+		if (i)
+			g_string_append_c(line, ',');
+		g_string_append_printf(line, "{file=\"src/module%u/file%u.c\","
+			"fullname=\"/home/user/src/project/src/module%u/file%u.c\"}",
+			i / 100, i, i / 100, i);
+	}
+	g_string_append(line, "]");
+
+	return g_string_free(line, FALSE);
+}
+
+/*
+ * checks the records the benchmark parses, like dbm_gdb.c reads them
+ */
+static guint check_large_records(const gchar *backtrace, const gchar *file_list)
+{
+	mi_record *record;
+	const mi_result *item;
+	guint failures = 0;
+	guint n;
+
+	record = mi_record_parse(backtrace);
+	for (n = 0, item = mi_result_get_list(record->first, "stack"); item; item = item->next, n++)
+	{
+		if (mi_result_get_int(item->val.v.list, "level", -1) != (gint)n ||
+			!mi_result_get_string(item->val.v.list, "func") ||
+			!(mi_result_get_string(item->val.v.list, "fullname") || mi_result_get_string(item->val.v.list, "from")))
+		{
+			g_printerr("frame %u is not complete\n", n);
+			failures++;
+			break;
+		}
+	}
+	if (n != BACKTRACE_FRAMES)
+	{
+		g_printerr("%u frames, expected %u\n", n, BACKTRACE_FRAMES);
+		failures++;
+	}
+	mi_record_free(record);
+
+	record = mi_record_parse(file_list);
+	for (n = 0, item = mi_result_get_list(record->first, "files"); item; item = item->next)
+	{
+		if (mi_result_get_string(item->val.v.list, "fullname"))
+			n++;
+	}
+	if (n != FILE_LIST_FILES)
+	{
+		g_printerr("%u files, expected %u\n", n, FILE_LIST_FILES);
+		failures++;
+	}
+	mi_record_free(record);
+
+	return failures;
+}
+
+/*
+ * parses the line "runs" times, returns the seconds it took
+ */
+static gdouble time_parsing(const gchar *line, guint runs)
+{
+	GTimer *timer = g_timer_new();
+	gdouble elapsed;
+	guint i;
+
+	for (i = 0; i < runs; i++)
+		mi_record_free(mi_record_parse(line));
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	guint runs = argc > 1 ? (guint)strtoul(argv[1], NULL, 10) : 50;
+	GError *err = NULL;
+	gchar *contents;
+	gchar **lines;
+	gchar *backtrace, *file_list, *nested;
+	GRand *rand;
+	guint failures = 0;
+	gdouble elapsed;
+	guint i;
+
+	if (!g_file_get_contents(GDB_MI_TEST_TRANSCRIPT, &contents, NULL, &err))
+	{
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		return 1;
+	}
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	failures += check_transcript(lines);
+
+	rand = g_rand_new_with_seed(4242);
+	for (i = 0; lines[i]; i++)
+		failures += fuzz_line(lines[i], rand);
+	g_rand_free(rand);
+	g_strfreev(lines);
+
+	/* values nested deeper than the parser follows must not exhaust the stack */
+	nested = g_strnfill(8 + NESTING, '[');
+	memcpy(nested, "^done,a=", 8);
+	parse_line(nested);
+	memset(nested + 8, '{', NESTING);
+	parse_line(nested);
+	g_free(nested);
+
+	backtrace = build_backtrace();
+	file_list = build_file_list();
+	failures += check_large_records(backtrace, file_list);
+
+	if (runs)
+	{
+		elapsed = time_parsing(backtrace, runs);
+		g_print("%u frames backtrace (%.1f KiB): %.3f ms per record\n", BACKTRACE_FRAMES,
+			strlen(backtrace) / 1024.0, elapsed * 1000 / runs);
+		elapsed = time_parsing(file_list, runs);
+		g_print("%u files list (%.1f KiB): %.3f ms per record\n", FILE_LIST_FILES,
+			strlen(file_list) / 1024.0, elapsed * 1000 / runs);
+	}
+	g_free(backtrace);
+	g_free(file_list);
+
+	if (failures > 0)
+	{
+		g_printerr("%u failures\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -44,6 +44,9 @@
 /* columns minumum width in characters */
 #define MIN_COLUMN_CHARS 20
 
+/* tree data key set while loading of the visible children is scheduled */
+#define LOAD_PENDING "load-pending"
+
 /*
  * key pressed event
  */
@@ -73,6 +76,34 @@ static gboolean on_key_pressed(GtkWidget *widget, GdkEvent *event, gpointer user
 }
 
 
+/*
+ * idle function loading children for the "more" rows that became visible
+ */
+static gboolean on_load_visible(gpointer data)
+{
+	GtkTreeView *tree = GTK_TREE_VIEW(data);
+
+	g_object_set_data(G_OBJECT(tree), LOAD_PENDING, NULL);
+	load_visible_children(tree);
+
+	return FALSE;
+}
+
+/*
+ * tree has been redrawn - visible rows may have changed,
+ * check them when idle not to change the model while painting
+ */
+static gboolean on_expose(GtkWidget *widget, GdkEventExpose *event, gpointer user_data)
+{
+	if (!g_object_get_data(G_OBJECT(widget), LOAD_PENDING))
+	{
+		g_object_set_data(G_OBJECT(widget), LOAD_PENDING, GINT_TO_POINTER(TRUE));
+		g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, on_load_visible, g_object_ref(widget), g_object_unref);
+	}
+
+	return FALSE;
+}
+
 /*
  * value rendere function
  */
@@ -151,6 +182,7 @@ GtkWidget* vtree_create(watch_render_name on_render_name, watch_expression_chang
 		G_TYPE_STRING,
 		G_TYPE_INT,
 		G_TYPE_INT,
+		G_TYPE_INT,
 		G_TYPE_INT);
 	GtkWidget* tree = gtk_tree_view_new_with_model (GTK_TREE_MODEL(store));
 	g_object_unref(store);
@@ -165,6 +197,7 @@ GtkWidget* vtree_create(watch_render_name on_render_name, watch_expression_chang
 	{
 		g_signal_connect(G_OBJECT(tree), "key-press-event", G_CALLBACK (on_key_pressed), NULL);
 	}
+	g_signal_connect(G_OBJECT(tree), "expose-event", G_CALLBACK (on_expose), NULL);
 
 	/* create columns */
 	
@@ -35,10 +35,15 @@
 #include "watch_model.h"
 #include "breakpoint.h"
 #include "debug_module.h"
+#include "debug.h"
 
 /* text for the stub item */
 #define WATCH_CHILDREN_STUB "..."
 
+/* number of children loaded at once, the next ones are loaded
+when the "more" row following them becomes visible */
+#define WATCH_CHILDREN_PAGE 100
+
 extern dbg_module *active_module;
 
 /*
@@ -81,6 +86,65 @@ inline static void add_stub(GtkTreeStore *store, GtkTreeIter *parent)
 		-1);
 }
 
+/*
+ * gets the "more" row standing for the children of "parent" that
+ * haven't been loaded yet, it is always the last child
+ */
+static gboolean get_more_row(GtkTreeModel *model, GtkTreeIter *parent, GtkTreeIter *more)
+{
+	gboolean is_more = FALSE;
+	int count = gtk_tree_model_iter_n_children(model, parent);
+
+	if (count && gtk_tree_model_iter_nth_child(model, more, parent, count - 1))
+		gtk_tree_model_get(model, more, W_MORE, &is_more, -1);
+
+	return is_more;
+}
+
+/*
+ * adds or removes the "more" row of "parent"
+ */
+static void set_more_row(GtkTreeStore *store, GtkTreeIter *parent, gboolean more)
+{
+	GtkTreeIter row;
+	gboolean has_more = get_more_row(GTK_TREE_MODEL(store), parent, &row);
+
+	if (more && !has_more)
+	{
+		gtk_tree_store_append (store, &row, parent);
+		gtk_tree_store_set (store, &row,
+			W_NAME, WATCH_CHILDREN_STUB,
+			W_VALUE, "",
+			W_TYPE, "",
+			W_INTERNAL, "",
+			W_EXPRESSION, "",
+			W_STUB, FALSE,
+			W_CHANGED, FALSE,
+			W_VT, VT_NONE,
+			W_MORE, TRUE,
+			-1);
+	}
+	else if (!more && has_more)
+		gtk_tree_store_remove(store, &row);
+}
+
+/*
+ * sets a new row "iter" as described in "v"
+ */
+static void set_new_row(GtkTreeStore *store, GtkTreeIter *iter, variable *v, gboolean mark_changed)
+{
+	gtk_tree_store_set (store, iter,
+		W_NAME, v->name->str,
+		W_VALUE, v->value->str,
+		W_TYPE, v->type->str,
+		W_INTERNAL, v->internal->str,
+		W_EXPRESSION, v->expression->str,
+		W_STUB, v->has_children,
+		W_CHANGED, mark_changed,
+		W_VT, v->vt,
+		-1);
+}
+
 /*
  * insert all "vars" members to "parent" iterator in the "tree" as new children
  * mark_changed specifies whether to mark new items as beed changed
@@ -106,13 +170,16 @@ inline static void append_variables(GtkTreeView *tree, GtkTreeIter *parent, GLis
 		do
 		{
 			gchar *name = NULL;
-			gtk_tree_model_get(model, &child, W_NAME, &name, -1);
-			if (name && strlen(name))
+			gboolean more = FALSE;
+			gtk_tree_model_get(model, &child, W_NAME, &name, W_MORE, &more, -1);
+			if (name && strlen(name) && !more)
 			{
 				GtkTreePath *path = gtk_tree_model_get_path(model, &child);
 				g_hash_table_insert(ht, name, gtk_tree_row_reference_new(model, path));
 				gtk_tree_path_free(path);
 			}
+			else
+				g_free(name);
 		}
 		while(gtk_tree_model_iter_next(model, &child));
 	}
@@ -125,7 +192,7 @@ inline static void append_variables(GtkTreeView *tree, GtkTreeIter *parent, GLis
 		if (ht && (reference = g_hash_table_lookup (ht, v->name->str)))
 		{
 			GtkTreePath *path = gtk_tree_row_reference_get_path(reference);
-			if (current_position != gtk_tree_path_get_indices(path)[0])
+			if (current_position != gtk_tree_path_get_indices(path)[gtk_tree_path_get_depth(path) - 1])
 			{
 				/* move a row if not at it's place */
 				GtkTreeIter iter;
@@ -147,16 +214,7 @@ inline static void append_variables(GtkTreeView *tree, GtkTreeIter *parent, GLis
 		else
 		{
 			gtk_tree_store_insert(store, &child, parent, current_position);
-			gtk_tree_store_set (store, &child,
-				W_NAME, v->name->str,
-				W_VALUE, v->value->str,
-				W_TYPE, v->type->str,
-				W_INTERNAL, v->internal->str,
-				W_EXPRESSION, v->expression->str,
-				W_STUB, v->has_children,
-				W_CHANGED, mark_changed,
-				W_VT, v->vt,
-				-1);
+			set_new_row(store, &child, v, mark_changed);
 			
 			/* expand to row if we were asked to */
 			if (expand)
@@ -182,23 +240,6 @@ inline static void append_variables(GtkTreeView *tree, GtkTreeIter *parent, GLis
 	}
 }
 
-/*
- * looks up a variable with corresponding name in the list
- */
-inline static GList *lookup_variable(GList *vars, gchar *name)
-{
-	GList *var = vars;
-	while (var)
-	{
-		variable *v = (variable*)var->data; 
-		if (!strcmp(v->name->str, name))
-			break;
-		var = var->next;
-	}
-	
-	return var;
-}
-
 /*
  * frees variable list: removes all data and destroys list
  * used for the lists returned by get_children call
@@ -211,45 +252,202 @@ void free_variables_list(GList *vars)
 }
 
 /*
- * updates iterator according to variable
+ * updates iterator according to variable,
+ * the row is set only if it differs not to make the view redraw it
  */
-static void update_variable(GtkTreeStore *store, GtkTreeIter *iter, variable *var, gboolean changed)
+static void update_variable(GtkTreeStore *store, GtkTreeIter *iter, variable *var, gboolean changed, gboolean stub)
 {
-	gtk_tree_store_set (store, iter,
-		W_NAME, var->name->str,
-		W_VALUE, var->evaluated ? var->value->str : _("Can't evaluate expression"),
-		W_TYPE, var->type->str,
-		W_INTERNAL, var->internal->str,
-		W_EXPRESSION, var->expression->str,
-		W_STUB, FALSE,
-		W_CHANGED, changed,
-		W_VT, var->vt,
+	const gchar *value = var->evaluated ? var->value->str : _("Can't evaluate expression");
+	gchar *old_name, *old_value, *old_type, *old_internal, *old_expression;
+	gboolean old_stub, old_changed;
+	variable_type old_vt;
+
+	gtk_tree_model_get (GTK_TREE_MODEL(store), iter,
+		W_NAME, &old_name,
+		W_VALUE, &old_value,
+		W_TYPE, &old_type,
+		W_INTERNAL, &old_internal,
+		W_EXPRESSION, &old_expression,
+		W_STUB, &old_stub,
+		W_CHANGED, &old_changed,
+		W_VT, &old_vt,
 		-1);
+
+	if (strcmp(old_name, var->name->str) || strcmp(old_value, value) ||
+		strcmp(old_type, var->type->str) || strcmp(old_internal, var->internal->str) ||
+		strcmp(old_expression, var->expression->str) ||
+		!old_stub != !stub || !old_changed != !changed || old_vt != var->vt)
+	{
+		gtk_tree_store_set (store, iter,
+			W_NAME, var->name->str,
+			W_VALUE, value,
+			W_TYPE, var->type->str,
+			W_INTERNAL, var->internal->str,
+			W_EXPRESSION, var->expression->str,
+			W_STUB, stub,
+			W_CHANGED, changed,
+			W_VT, var->vt,
+			-1);
+	}
+
+	g_free(old_name);
+	g_free(old_value);
+	g_free(old_type);
+	g_free(old_internal);
+	g_free(old_expression);
 } 
 
 /*
- * remove stub item and add vars to parent iterator
+ * remove stub item and add the first page of children to parent iterator
  */
-void expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
+void expand_stub(GtkTreeView *tree, GtkTreeIter *parent)
 {
 	GtkTreeModel *model = gtk_tree_view_get_model(tree);
 	GtkTreeStore *store = GTK_TREE_STORE(model);
 	GtkTreeIter stub;
-	gboolean changed;
+	gboolean changed, more;
+	gchar *internal;
+	GList *children;
 
 	/* remember stub iterator */
 	gtk_tree_model_iter_children(model, &stub, parent);
 
 	/* check whether arent has been changed */
 	gtk_tree_model_get(model, parent,
+		W_INTERNAL, &internal,
 		W_CHANGED, &changed,
 		-1);
 	
-	/* add all stuff from "vars" */
-	append_variables(tree, parent, vars, changed, TRUE);
+	/* add the first children, the rest are loaded when scrolled to */
+	children = active_module->get_children(internal, 0, WATCH_CHILDREN_PAGE, &more);
+	append_variables(tree, parent, children, changed, TRUE);
 	
 	/* remove stub item */
 	gtk_tree_store_remove(store, &stub);
+
+	set_more_row(store, parent, more);
+
+	free_variables_list(children);
+	g_free(internal);
+}
+
+/*
+ * replaces the "more" row with the next page of children
+ */
+static void load_more_children(GtkTreeView *tree, GtkTreeIter *more)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeStore *store = GTK_TREE_STORE(model);
+	GtkTreeIter parent, child;
+	gboolean changed, has_more;
+	gchar *internal;
+	GList *children, *iter;
+
+	gtk_tree_model_iter_parent(model, &parent, more);
+	gtk_tree_model_get(model, &parent,
+		W_INTERNAL, &internal,
+		W_CHANGED, &changed,
+		-1);
+
+	/* all rows before the "more" one are loaded children */
+	children = active_module->get_children(internal,
+		gtk_tree_model_iter_n_children(model, &parent) - 1, WATCH_CHILDREN_PAGE, &has_more);
+
+	for (iter = children; iter; iter = iter->next)
+	{
+		variable *v = (variable*)iter->data;
+
+		gtk_tree_store_insert_before(store, &child, &parent, more);
+		set_new_row(store, &child, v, changed);
+		if (v->has_children)
+			add_stub(store, &child);
+	}
+
+	if (!has_more)
+		gtk_tree_store_remove(store, more);
+
+	free_variables_list(children);
+	g_free(internal);
+}
+
+/*
+ * moves "iter" to the next row shown in the "tree"
+ */
+static gboolean next_visible_row(GtkTreeView *tree, GtkTreeModel *model, GtkTreeIter *iter)
+{
+	GtkTreeIter next, parent;
+	GtkTreePath *path = gtk_tree_model_get_path(model, iter);
+	gboolean expanded = gtk_tree_view_row_expanded(tree, path);
+	gtk_tree_path_free(path);
+
+	if (expanded && gtk_tree_model_iter_children(model, &next, iter))
+	{
+		*iter = next;
+		return TRUE;
+	}
+
+	while (TRUE)
+	{
+		next = *iter;
+		if (gtk_tree_model_iter_next(model, &next))
+		{
+			*iter = next;
+			return TRUE;
+		}
+		if (!gtk_tree_model_iter_parent(model, &parent, iter))
+			return FALSE;
+		*iter = parent;
+	}
+}
+
+/*
+ * loads the next pages of children for the "more" rows
+ * which are in the visible part of the "tree"
+ */
+void load_visible_children(GtkTreeView *tree)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreePath *start, *end;
+	GtkTreeIter iter;
+	GList *rows = NULL, *row;
+
+	if (!model || DBS_STOPPED != debug_get_state() || !gtk_tree_view_get_visible_range(tree, &start, &end))
+		return;
+
+	/* collect "more" rows first not to change the model while walking it */
+	if (gtk_tree_model_get_iter(model, &iter, start))
+	{
+		do
+		{
+			gboolean more = FALSE;
+			GtkTreePath *path = gtk_tree_model_get_path(model, &iter);
+			gboolean last = !gtk_tree_path_compare(path, end);
+
+			gtk_tree_model_get(model, &iter, W_MORE, &more, -1);
+			if (more)
+				rows = g_list_prepend(rows, gtk_tree_row_reference_new(model, path));
+			gtk_tree_path_free(path);
+
+			if (last)
+				break;
+		}
+		while (next_visible_row(tree, model, &iter));
+	}
+	gtk_tree_path_free(start);
+	gtk_tree_path_free(end);
+
+	for (row = rows; row; row = row->next)
+	{
+		GtkTreeRowReference *reference = (GtkTreeRowReference*)row->data;
+		GtkTreePath *path = gtk_tree_row_reference_get_path(reference);
+
+		if (path && gtk_tree_model_get_iter(model, &iter, path))
+			load_more_children(tree, &iter);
+
+		gtk_tree_path_free(path);
+		gtk_tree_row_reference_free(reference);
+	}
+	g_list_free(rows);
 }
 
 /*
@@ -263,7 +461,7 @@ void change_watch(GtkTreeView *tree, GtkTreeIter *iter, gpointer var)
 	variable *v = (variable*)var;
 
 	/* update variable */
-	update_variable(store, iter, v, FALSE);
+	update_variable(store, iter, v, FALSE, FALSE);
 
 	/* if item have children - remove them */ 		
 	if (gtk_tree_model_iter_has_child(model, iter))
@@ -274,11 +472,198 @@ void change_watch(GtkTreeView *tree, GtkTreeIter *iter, gpointer var)
 		add_stub(store, iter);
 }
 
+static void update_rows(GtkTreeView *tree, GtkTreeIter *parent, GList *vars, GHashTable *changes, GList **aggregates);
+static void update_children(GtkTreeView *tree, GtkTreeIter *parent, GHashTable *changes, GList **aggregates);
+
 /*
- * update root variables in "tree" according to the "vars" list
- * if root variables have expanded children - walk through them also 
+ * lists the loaded children of the expanded "row" again, a page at least
  */
-void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
+static void relist_children(GtkTreeView *tree, GtkTreeIter *row, gchar *internal, GHashTable *changes, GList **aggregates)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeIter more_row;
+	int loaded = gtk_tree_model_iter_n_children(model, row);
+	gboolean more;
+	GList *children;
+
+	if (get_more_row(model, row, &more_row))
+		loaded--;
+	children = active_module->get_children(internal, 0, MAX(loaded, WATCH_CHILDREN_PAGE), &more);
+
+	/* update children */
+	update_rows(tree, row, g_list_copy(children), changes, aggregates);
+	set_more_row(GTK_TREE_STORE(model), row, more);
+
+	/* frees children list */
+	free_variables_list(children);
+}
+
+/*
+ * updates the loaded children of the expanded "parent" from the "changes" of the
+ * variable objects, only the ones whose type or number of children has changed
+ * are listed again, rows with children are added to "aggregates"
+ */
+static void update_children(GtkTreeView *tree, GtkTreeIter *parent, GHashTable *changes, GList **aggregates)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeStore *store = GTK_TREE_STORE(model);
+	GtkTreeIter child;
+	gboolean parent_changed;
+
+	gtk_tree_model_get (model, parent,
+		W_CHANGED, &parent_changed,
+		-1);
+	if (!gtk_tree_model_iter_children(model, &child, parent))
+		return;
+
+	do
+	{
+		gchar *internal, *value;
+		gboolean old_changed, changed, more, expanded;
+		variable_change *change;
+		GtkTreePath *path;
+
+		gtk_tree_model_get (
+			model,
+			&child,
+			W_INTERNAL, &internal,
+			W_VALUE, &value,
+			W_CHANGED, &old_changed,
+			W_MORE, &more,
+			-1);
+
+		/* miss the stub and "more" rows */
+		if (!strlen(internal) || more)
+		{
+			g_free(internal);
+			g_free(value);
+			continue;
+		}
+
+		path = gtk_tree_model_get_path(model, &child);
+		expanded = gtk_tree_view_row_expanded(tree, path);
+
+		/* the row is set only if it differs not to make the view redraw it */
+		change = (variable_change*)g_hash_table_lookup(changes, internal);
+		changed = parent_changed || (change && change->value && strcmp(change->value, value));
+		if (change && change->value && strcmp(change->value, value))
+			gtk_tree_store_set (store, &child, W_VALUE, change->value, -1);
+		if (!old_changed != !changed)
+			gtk_tree_store_set (store, &child, W_CHANGED, changed, -1);
+
+		if (change && change->children_changed)
+		{
+			if (change->type)
+				gtk_tree_store_set (store, &child, W_TYPE, change->type, -1);
+
+			if (expanded && change->has_children)
+				relist_children(tree, &child, internal, changes, aggregates);
+			else
+			{
+				/* collapsed row gets a stub standing for its new children */
+				remove_children(model, &child);
+				if (change->has_children)
+					add_stub(store, &child);
+				else
+					gtk_tree_store_set (store, &child, W_STUB, FALSE, -1);
+			}
+		}
+		else if (expanded)
+			update_children(tree, &child, changes, aggregates);
+
+		/* the values of the rows with children are whole expressions,
+		the variable objects don't report their changes */
+		if (gtk_tree_model_iter_has_child(model, &child))
+			*aggregates = g_list_prepend(*aggregates, gtk_tree_row_reference_new(model, path));
+
+		gtk_tree_path_free(path);
+		g_free(internal);
+		g_free(value);
+	}
+	while (gtk_tree_model_iter_next(model, &child));
+}
+
+/*
+ * evaluates the values of the rows with children referenced in "aggregates"
+ * at once, the ones that have changed are marked so
+ */
+static void update_aggregates(GtkTreeView *tree, GList *aggregates)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeStore *store = GTK_TREE_STORE(model);
+	GList *vars = NULL, *rows = NULL, *var, *row;
+
+	for (row = aggregates; row; row = row->next)
+	{
+		GtkTreeRowReference *reference = (GtkTreeRowReference*)row->data;
+		GtkTreePath *path = gtk_tree_row_reference_get_path(reference);
+		GtkTreeIter iter;
+
+		if (path && gtk_tree_model_get_iter(model, &iter, path))
+		{
+			gchar *name, *internal, *expression;
+			variable *v;
+
+			gtk_tree_model_get (model, &iter,
+				W_NAME, &name,
+				W_INTERNAL, &internal,
+				W_EXPRESSION, &expression,
+				-1);
+
+			v = variable_new2(name, internal, VT_CHILD);
+			g_string_assign(v->expression, expression);
+			v->has_children = TRUE;
+
+			vars = g_list_prepend(vars, v);
+			rows = g_list_prepend(rows, gtk_tree_row_reference_copy(reference));
+
+			g_free(name);
+			g_free(internal);
+			g_free(expression);
+		}
+
+		gtk_tree_path_free(path);
+	}
+
+	active_module->evaluate_variables(vars);
+
+	for (var = vars, row = rows; var; var = var->next, row = row->next)
+	{
+		variable *v = (variable*)var->data;
+		GtkTreePath *path = gtk_tree_row_reference_get_path((GtkTreeRowReference*)row->data);
+		GtkTreeIter iter;
+
+		if (v->evaluated && path && gtk_tree_model_get_iter(model, &iter, path))
+		{
+			gchar *value;
+
+			gtk_tree_model_get (model, &iter,
+				W_VALUE, &value,
+				-1);
+			if (strcmp(value, v->value->str))
+			{
+				gtk_tree_store_set (store, &iter,
+					W_VALUE, v->value->str,
+					W_CHANGED, TRUE,
+					-1);
+			}
+			g_free(value);
+		}
+
+		gtk_tree_path_free(path);
+		gtk_tree_row_reference_free((GtkTreeRowReference*)row->data);
+	}
+	g_list_free(rows);
+	free_variables_list(vars);
+}
+
+/*
+ * update variables under "parent" according to the "vars" list
+ * if the variables have expanded children - walk through them also,
+ * only the children loaded before are refreshed, from the "changes"
+ * of the variable objects if there are
+ */
+static void update_rows(GtkTreeView *tree, GtkTreeIter *parent, GList *vars, GHashTable *changes, GList **aggregates)
 {
 	/* tree model and store for the given tree */
 	GtkTreeModel *model = gtk_tree_view_get_model(tree);
@@ -289,6 +674,9 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 	GtkTreeIter child;
 	gboolean haschildren = FALSE;
 	gboolean parent_changed = FALSE;
+	GHashTable *index;
+	GList *var;
+
 	if (parent)
 	{
 		gtk_tree_model_get (model, parent,
@@ -299,6 +687,15 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 	else
 		haschildren = gtk_tree_model_get_iter_first(model, &child);
 
+	/* index variables by name, the first one wins if names repeat */
+	index = g_hash_table_new(g_str_hash, g_str_equal);
+	for (var = vars; var; var = var->next)
+	{
+		variable *v = (variable*)var->data;
+		if (!g_hash_table_lookup(index, v->name->str))
+			g_hash_table_insert(index, v->name->str, v);
+	}
+
 	/* walk through all children of "parent" iterator */
 	if (haschildren)
 	{
@@ -306,11 +703,12 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 		while (TRUE)
 		{
 			gchar *name;
-			gchar *internal;
 			gchar *value;
-			GList *var;
+			gchar *internal;
+			gchar *type;
 			variable *v;
-			gboolean changed;
+			gboolean changed, stub, more, expanded, relist;
+			GtkTreePath *path;
 
 			/* set variable value
 			1. get the variable params */
@@ -319,20 +717,35 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 				model,
 				&child,
 				W_NAME, &name,
-				W_INTERNAL, &internal,
 				W_VALUE, &value,
+				W_INTERNAL, &internal,
+				W_TYPE, &type,
+				W_STUB, &stub,
+				W_MORE, &more,
 				-1);
 				
-			/* miss empty row in watch tree */
-			if (!strlen(name))
+			/* miss empty row in watch tree and "more" row,
+			both are the last ones */
+			if (!strlen(name) || more)
+			{
+				g_free(name);
+				g_free(value);
+				g_free(internal);
+				g_free(type);
 				break;
+			}
 			
 			/* 2. find this path is "vars" list */
-			var = lookup_variable(vars, name);
+			v = (variable*)g_hash_table_lookup(index, name);
+			g_free(name);
 
 			/* 3. check if we have found currect iterator */
-			if (!var)
+			if (!v)
 			{
+				g_free(value);
+				g_free(internal);
+				g_free(type);
+
 				/* if we haven't - remove current and try to move to the next one
 				in the same level */
 				
@@ -344,60 +757,50 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 					break;
 			}
 			
-			/* 4. update variable (type, value) */
-			v = (variable*)var->data;
+			/* 4. update variable (type, value),
+			collapsed row keeps its stub if it has one */
+			path = gtk_tree_model_get_path(model, &child);
+			expanded = gtk_tree_view_row_expanded(tree, path);
+			gtk_tree_path_free(path);
+
+			/* children of another object or type can't be updated from the changes */
+			relist = !changes || strcmp(internal, v->internal->str) || strcmp(type, v->type->str);
+			g_free(internal);
+			g_free(type);
+
 			changed = parent_changed || strcmp(value, v->value->str);
-			update_variable(store, &child, v, changed && v->evaluated);
+			stub = stub && v->has_children && !expanded;
+			update_variable(store, &child, v, changed && v->evaluated, stub);
+			g_free(value);
 			
-			/* 5. if item have children - process them */ 		
-			if (gtk_tree_model_iter_has_child(model, &child))
+			/* 5. process children */ 		
+			if (!v->has_children)
 			{
-				if (!v->has_children)
-				{
-					/* if children are left from previous variable value - remove all children */
-					remove_children(model, &child);
-				}
+				/* if children are left from previous variable value - remove all children */
+				remove_children(model, &child);
+			}
+			else if (expanded)
+			{
+				/* update the loaded children, listing them again only if needed */
+				if (relist)
+					relist_children(tree, &child, v->internal->str, changes, aggregates);
 				else
-				{
-					/* if row isn't expanded - add "..." item
-					else - process all children */
-					GtkTreePath *path = gtk_tree_model_get_path(model, &child);
-					if (!gtk_tree_view_row_expanded(tree, path))
-					{
-						/* remove all children */
-						remove_children(model, &child);
-						/* add stub item */
-						add_stub(store, &child); 
-					}
-					else
-					{
-						/* get children for "parent" item */
-						GList *children = active_module->get_children(v->internal->str);
-						/* update children */
-						update_variables(tree, &child, g_list_copy(children));
-						/* frees children list */
-						free_variables_list(children);
-					}
-					gtk_tree_path_free(path);
-				}
+					update_children(tree, &child, changes, aggregates);
 			}
-			else if (v->has_children)
+			else if (!stub)
 			{
-				/* if tree item doesn't have children, but variable has
-				(variable type has changed) - add stub */
+				/* if row isn't expanded - replace children with "..." item */
+				remove_children(model, &child);
 				add_stub(store, &child); 
 			}
-			
-			/* 6. free name, expression */ 
-			g_free(name);
-			g_free(internal);
-			g_free(value);
 
 			if (!gtk_tree_model_iter_next(model, &child))
 				break;
 		}
 	}
 
+	g_hash_table_destroy(index);
+
 	/* insert items that are left in "vars" list */
 	append_variables(tree, parent, vars, !parent || parent_changed, TRUE);
 	
@@ -405,6 +808,25 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 	g_list_free(vars);
 }
 
+/*
+ * update root variables in "tree" according to the "vars" list
+ * if root variables have expanded children - walk through them also,
+ * only the children loaded before are refreshed
+ */
+void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
+{
+	GList *aggregates = NULL;
+
+	update_rows(tree, parent, vars, active_module->get_changed_children(), &aggregates);
+
+	if (aggregates)
+	{
+		update_aggregates(tree, aggregates);
+		g_list_foreach(aggregates, (GFunc)gtk_tree_row_reference_free, NULL);
+		g_list_free(aggregates);
+	}
+}
+
 /*
  * clear all root variables in "tree" removing their children if available
  */
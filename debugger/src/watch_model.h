@@ -37,6 +37,7 @@ enum
    W_STUB,
    W_CHANGED,
    W_VT,
+   W_MORE,
    W_N_COLUMNS
 };
 
@@ -54,6 +55,7 @@ GList*	get_root_items(GtkTreeView *tree);
 void	change_watch(GtkTreeView *tree, GtkTreeIter *iter, gpointer var);
 void	free_variables_list(GList *vars);
 void	variable_set_name_only(GtkTreeStore *store, GtkTreeIter *iter, gchar *name);
-void	expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars);
+void	expand_stub(GtkTreeView *tree, GtkTreeIter *parent);
+void	load_visible_children(GtkTreeView *tree);
 
 #endif /* guard */
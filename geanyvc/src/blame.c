@@ -0,0 +1,417 @@
+/*
+ *      blame.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Blame shown in a text margin of the document. The output of the blame command
+ * is parsed into a table of one commit index per line, which follows the lines
+ * inserted and deleted in the editor, so the command only runs again once the
+ * document is saved. */
+
+#include <string.h>
+#include <stdlib.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+extern GeanyData *geany_data;
+extern GeanyFunctions *geany_functions;
+
+#define BLAME_KEY "geanyvc-blame"
+#define BLAME_MARGIN 3
+#define BLAME_ID_LENGTH 40
+#define BLAME_SHORT_ID_LENGTH 8
+
+typedef struct _VCBlameCommit
+{
+	gchar *id;
+	gchar *author;
+	gint64 time;
+	gchar *label;
+} VCBlameCommit;
+
+/* Output of a blame command, parsed while it arrives */
+typedef struct _VCBlameResult
+{
+	GPtrArray *commits;	/* VCBlameCommit, the first one stands for changed lines */
+	GArray *lines;		/* guint index of the commit of each line */
+	GHashTable *ids;	/* id -> index + 1 */
+	guint current;		/* commit of the next line of content */
+	guint line;		/* 0-based number of the next line of content */
+} VCBlameResult;
+
+typedef struct _VCBlame
+{
+	ScintillaObject *sci;
+	VCBlameResult *shown;
+	VCBlameResult *next;	/* being read */
+	VCJob *job;
+	gboolean modified;	/* the document changed while the command ran */
+} VCBlame;
+
+
+static void
+commit_free(gpointer data)
+{
+	VCBlameCommit *commit = data;
+
+	g_free(commit->id);
+	g_free(commit->author);
+	g_free(commit->label);
+	g_free(commit);
+}
+
+static VCBlameResult *
+result_new(void)
+{
+	VCBlameResult *result = g_new0(VCBlameResult, 1);
+
+	result->commits = g_ptr_array_new_with_free_func(commit_free);
+	g_ptr_array_add(result->commits, g_new0(VCBlameCommit, 1));
+	result->lines = g_array_new(FALSE, TRUE, sizeof(guint));
+	result->ids = g_hash_table_new(g_str_hash, g_str_equal);
+	return result;
+}
+
+static void
+result_free(VCBlameResult * result)
+{
+	if (!result)
+		return;
+	if (result->ids)
+		g_hash_table_destroy(result->ids);
+	g_array_free(result->lines, TRUE);
+	g_ptr_array_free(result->commits, TRUE);
+	g_free(result);
+}
+
+static gboolean
+is_commit_header(const gchar * line)
+{
+	gint i;
+
+	for (i = 0; i < BLAME_ID_LENGTH; i++)
+	{
+		if (!g_ascii_isxdigit(line[i]))
+			return FALSE;
+	}
+	return line[BLAME_ID_LENGTH] == ' ';
+}
+
+/* Parse one line of the porcelain format of git blame. */
+static void
+parse_line(VCBlameResult * result, const gchar * line)
+{
+	VCBlameCommit *commit;
+	const gchar *p;
+	gchar *id;
+	gpointer index;
+	glong final_line;
+
+	if (line[0] == '\t')
+	{
+		if (result->line >= result->lines->len)
+			g_array_set_size(result->lines, result->line + 1);
+		g_array_index(result->lines, guint, result->line) = result->current;
+		result->line++;
+	}
+	else if (is_commit_header(line))
+	{
+		/* "<id> <original line> <final line> [<lines in group>]" */
+		p = strchr(line + BLAME_ID_LENGTH + 1, ' ');
+		final_line = p ? strtol(p + 1, NULL, 10) : 0;
+		if (final_line > 0)
+			result->line = final_line - 1;
+
+		id = g_strndup(line, BLAME_ID_LENGTH);
+		index = g_hash_table_lookup(result->ids, id);
+		if (!index)
+		{
+			commit = g_new0(VCBlameCommit, 1);
+			commit->id = id;
+			g_ptr_array_add(result->commits, commit);
+			index = GUINT_TO_POINTER(result->commits->len);
+			g_hash_table_insert(result->ids, commit->id, index);
+		}
+		else
+			g_free(id);
+		result->current = GPOINTER_TO_UINT(index) - 1;
+	}
+	else
+	{
+		commit = g_ptr_array_index(result->commits, result->current);
+		if (g_str_has_prefix(line, "author ") && !commit->author)
+			commit->author = g_strdup(line + strlen("author "));
+		else if (g_str_has_prefix(line, "author-time "))
+			commit->time = g_ascii_strtoll(line + strlen("author-time "), NULL, 10);
+	}
+}
+
+static void
+make_labels(VCBlameResult * result)
+{
+	VCBlameCommit *commit;
+	GDateTime *dt;
+	gchar *date;
+	guint i;
+
+	for (i = 1; i < result->commits->len; i++)
+	{
+		commit = g_ptr_array_index(result->commits, i);
+		/* lines which are not committed yet have an id of zeros */
+		if (strspn(commit->id, "0") == BLAME_ID_LENGTH)
+		{
+			commit->label = g_strdup("");
+			continue;
+		}
+		dt = g_date_time_new_from_unix_local(commit->time);
+		date = g_date_time_format(dt, "%Y-%m-%d");
+		commit->label = g_strdup_printf("%.*s %s %s", BLAME_SHORT_ID_LENGTH, commit->id, date,
+						commit->author ? commit->author : "");
+		g_free(date);
+		g_date_time_unref(dt);
+	}
+	g_hash_table_destroy(result->ids);
+	result->ids = NULL;
+}
+
+static const gchar *
+get_label(VCBlameResult * result, guint line)
+{
+	VCBlameCommit *commit;
+
+	if (line >= result->lines->len)
+		return "";
+	commit = g_ptr_array_index(result->commits, g_array_index(result->lines, guint, line));
+	return commit->label ? commit->label : "";
+}
+
+static void
+render(VCBlame * blame)
+{
+	ScintillaObject *sci = blame->sci;
+	VCBlameResult *result = blame->shown;
+	VCBlameCommit *commit;
+	const gchar *widest = "";
+	gint line_count = sci_get_line_count(sci);
+	gint line;
+	guint i;
+
+	for (i = 1; i < result->commits->len; i++)
+	{
+		commit = g_ptr_array_index(result->commits, i);
+		if (strlen(commit->label) > strlen(widest))
+			widest = commit->label;
+	}
+
+	scintilla_send_message(sci, SCI_MARGINTEXTCLEARALL, 0, 0);
+	scintilla_send_message(sci, SCI_SETMARGINTYPEN, BLAME_MARGIN, SC_MARGIN_TEXT);
+	scintilla_send_message(sci, SCI_SETMARGINWIDTHN, BLAME_MARGIN,
+			       scintilla_send_message(sci, SCI_TEXTWIDTH, STYLE_LINENUMBER,
+						      (sptr_t) widest) + 8);
+	for (line = 0; line < line_count; line++)
+	{
+		scintilla_send_message(sci, SCI_MARGINSETTEXT, line, (sptr_t) get_label(result, line));
+		scintilla_send_message(sci, SCI_MARGINSETSTYLE, line, STYLE_LINENUMBER);
+	}
+}
+
+static void
+on_blame_output(G_GNUC_UNUSED VCJob * job, const gchar * text, gsize len, gpointer data)
+{
+	VCBlame *blame = data;
+	gchar *lines = g_strndup(text, len);
+	gchar *line;
+	gchar *next;
+
+	for (line = lines; *line; line = next)
+	{
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		parse_line(blame->next, line);
+	}
+	g_free(lines);
+}
+
+static void
+blame_free(gpointer data)
+{
+	VCBlame *blame = data;
+
+	if (blame->job)
+		vc_job_cancel(blame->job);
+	result_free(blame->shown);
+	result_free(blame->next);
+	g_free(blame);
+}
+
+/* Remove the blame, and with it the data of @sci. */
+static void
+remove_blame(ScintillaObject * sci)
+{
+	g_object_set_data(G_OBJECT(sci), BLAME_KEY, NULL);
+	scintilla_send_message(sci, SCI_MARGINTEXTCLEARALL, 0, 0);
+	scintilla_send_message(sci, SCI_SETMARGINWIDTHN, BLAME_MARGIN, 0);
+}
+
+static void
+on_blame_done(G_GNUC_UNUSED VCJob * job, gint exit_code, gboolean cancelled, gpointer data)
+{
+	VCBlame *blame = data;
+
+	blame->job = NULL;
+	if (cancelled)
+		return;
+
+	/* a blame of an older version of the document would not fit its lines */
+	if (exit_code != 0 || blame->modified)
+	{
+		result_free(blame->next);
+		blame->next = NULL;
+		if (exit_code != 0 && !blame->shown)
+		{
+			ui_set_statusbar(FALSE, _("No history available"));
+			remove_blame(blame->sci);
+		}
+		return;
+	}
+
+	make_labels(blame->next);
+	result_free(blame->shown);
+	blame->shown = blame->next;
+	blame->next = NULL;
+	render(blame);
+}
+
+static VCBlame *
+get_blame(GeanyDocument * doc)
+{
+	return g_object_get_data(G_OBJECT(doc->editor->sci), BLAME_KEY);
+}
+
+gboolean
+blame_is_shown(GeanyDocument * doc)
+{
+	return get_blame(doc) != NULL;
+}
+
+/*
+ * Show the blame of the file of @doc in its margin, replacing the one shown once
+ * it has been read. The document should not have been changed since it was saved.
+ *
+ * @doc - document
+ * @dir - start directory of the commands
+ * @argvs - list of commands producing the porcelain format of git blame, the
+ *  blame takes ownership of it
+ * @env - environment of the commands
+ */
+void
+blame_start(GeanyDocument * doc, const gchar * dir, GSList * argvs, const gchar ** env)
+{
+	VCBlame *blame = get_blame(doc);
+
+	if (!blame)
+	{
+		blame = g_new0(VCBlame, 1);
+		blame->sci = doc->editor->sci;
+		g_object_set_data_full(G_OBJECT(blame->sci), BLAME_KEY, blame, blame_free);
+	}
+	if (blame->job)
+		vc_job_cancel(blame->job);
+	result_free(blame->next);
+
+	blame->next = result_new();
+	blame->modified = FALSE;
+	blame->job = vc_job_start(dir, argvs, env, 0, on_blame_output, on_blame_done, blame, NULL);
+	if (!blame->job)
+	{
+		result_free(blame->next);
+		blame->next = NULL;
+		if (!blame->shown)
+			remove_blame(blame->sci);
+	}
+}
+
+void
+blame_hide(GeanyDocument * doc)
+{
+	if (get_blame(doc))
+		remove_blame(doc->editor->sci);
+}
+
+/* Keep the table in line with the text, lines inserted or changed in the editor
+ * get no annotation. Scintilla moves the margin texts itself. */
+void
+blame_editor_notify(GeanyEditor * editor, SCNotification * nt)
+{
+	VCBlame *blame;
+	GArray *lines;
+	guint line;
+	guint count;
+
+	if (nt->nmhdr.code != SCN_MODIFIED ||
+	    !(nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+		return;
+	blame = g_object_get_data(G_OBJECT(editor->sci), BLAME_KEY);
+	if (!blame)
+		return;
+
+	blame->modified = TRUE;
+	if (!blame->shown)
+		return;
+
+	lines = blame->shown->lines;
+	line = sci_get_line_from_position(editor->sci, nt->position);
+	if (nt->linesAdded > 0 && line + 1 <= lines->len)
+	{
+		count = nt->linesAdded;
+		g_array_set_size(lines, lines->len + count);
+		memmove(&g_array_index(lines, guint, line + 1 + count),
+			&g_array_index(lines, guint, line + 1),
+			(lines->len - line - 1 - count) * sizeof(guint));
+		memset(&g_array_index(lines, guint, line + 1), 0, count * sizeof(guint));
+	}
+	else if (nt->linesAdded < 0 && line + 1 < lines->len)
+	{
+		count = MIN((guint) - nt->linesAdded, lines->len - line - 1);
+		g_array_remove_range(lines, line + 1, count);
+	}
+
+	if (line < lines->len && g_array_index(lines, guint, line) != 0)
+	{
+		g_array_index(lines, guint, line) = 0;
+		scintilla_send_message(editor->sci, SCI_MARGINSETTEXT, line, (sptr_t) "");
+	}
+}
+
+/* Remove the blame of all documents. */
+void
+blame_cleanup(void)
+{
+	guint i;
+
+	foreach_document(i)
+	{
+		blame_hide(documents[i]);
+	}
+}
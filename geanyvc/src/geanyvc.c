@@ -35,6 +35,7 @@
 #include <geanyplugin.h>
 
 #include "geanyvc.h"
+#include "patch.h"
 #include "SciLexer.h"
 
 #ifdef USE_GTKSPELL
@@ -62,6 +63,7 @@ static gboolean set_maximize_commit_dialog;
 static gboolean set_external_diff;
 static gboolean set_editor_menu_entries;
 static gboolean set_menubar_entry;
+static gboolean set_status_in_tabs;
 
 static gchar *config_file;
 
@@ -116,6 +118,7 @@ static GtkWidget *menu_entry = NULL;
 static void registrate(void);
 static void add_menuitems_to_editor_menu(void);
 static void remove_menuitems_from_editor_menu(void);
+static void commit_dialog_status_changed(const VC_RECORD * vc, const gchar * base_dir);
 
 
 /* Doing some basic keybinding stuff */
@@ -130,15 +133,11 @@ enum
 	VC_REVERT_FILE,
 	VC_REVERT_DIR,
 	VC_REVERT_BASEDIR,
+	VC_CANCEL,
 	COUNT_KB
 };
 
 
-GSList *get_commit_files_null(G_GNUC_UNUSED const gchar * dir)
-{
-	return NULL;
-}
-
 static void
 free_text_list(GSList * lst)
 {
@@ -245,16 +244,7 @@ find_dir(const gchar * filename, const char *find, gboolean recursive)
 static const VC_RECORD *
 find_vc(const char *filename)
 {
-	GSList *tmp;
-
-	for (tmp = VC; tmp != NULL; tmp = g_slist_next(tmp))
-	{
-		if (((VC_RECORD *) tmp->data)->in_vc(filename))
-		{
-			return (VC_RECORD *) tmp->data;
-		}
-	}
-	return NULL;
+	return resolver_find_vc(filename);
 }
 
 static void *
@@ -521,11 +511,64 @@ execute_custom_command(const gchar * dir, const gchar ** argv, const gchar ** en
 	return exit_code;
 }
 
+static gboolean
+cmd_changes_tracked_files(gint cmd)
+{
+	switch (cmd)
+	{
+		case VC_COMMAND_REVERT_FILE:
+		case VC_COMMAND_REVERT_DIR:
+		case VC_COMMAND_ADD:
+		case VC_COMMAND_REMOVE:
+		case VC_COMMAND_COMMIT:
+		case VC_COMMAND_UPDATE:
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* Forget what is known about the working copy of @filename after a command changed it */
+static void
+tracked_files_changed(const VC_RECORD * vc, const gchar * filename)
+{
+	gchar *base_dir;
+
+	resolver_invalidate();
+	base_dir = resolver_get_base_dir(vc, filename);
+	if (base_dir)
+		status_refresh(vc, base_dir);
+	g_free(base_dir);
+}
+
+/* Get the start directory of command @cmd for @filename */
+static gchar *
+get_command_dir(const VC_RECORD * vc, const gchar * filename, gint cmd)
+{
+	gchar *dir = NULL;
+
+	if (vc->commands[cmd].startdir == VC_COMMAND_STARTDIR_FILE)
+	{
+		if (g_file_test(filename, G_FILE_TEST_IS_DIR))
+			dir = g_strdup(filename);
+		else
+			dir = g_path_get_dirname(filename);
+	}
+	else if (vc->commands[cmd].startdir == VC_COMMAND_STARTDIR_BASE)
+	{
+		dir = resolver_get_base_dir(vc, filename);
+	}
+	else
+	{
+		g_warning("geanyvc: unknown startdir type: %d", vc->commands[cmd].startdir);
+	}
+	return dir;
+}
+
 static gint
 execute_command(const VC_RECORD * vc, gchar ** std_out, gchar ** std_err, const gchar * filename,
 		gint cmd, GSList * list, const gchar * message)
 {
-	gchar *dir = NULL;
+	gchar *dir;
 	gint ret;
 	const gint action_command_cell = 1;
 
@@ -536,33 +579,368 @@ execute_command(const VC_RECORD * vc, gchar ** std_out, gchar ** std_err, const
 
 	if (vc->commands[cmd].function)
 	{
-		return vc->commands[cmd].function(std_out, std_err, filename, list, message);
+		ret = vc->commands[cmd].function(std_out, std_err, filename, list, message);
+		if (ret != VC_COMMAND_FALLBACK || !vc->commands[cmd].command)
+		{
+			if (cmd_changes_tracked_files(cmd))
+				tracked_files_changed(vc, filename);
+			return ret;
+		}
 	}
 
-	if (vc->commands[cmd].startdir == VC_COMMAND_STARTDIR_FILE)
+	dir = get_command_dir(vc, filename, cmd);
+	ret = execute_custom_command(dir, vc->commands[cmd].command, vc->commands[cmd].env, std_out,
+				     std_err, filename, list, message);
+
+	ui_set_statusbar(TRUE, _("File %s: action %s executed via %s."),
+			 filename, vc->commands[cmd].command[action_command_cell], vc->program);
+
+	if (cmd_changes_tracked_files(cmd))
+		tracked_files_changed(vc, filename);
+
+	g_free(dir);
+	return ret;
+}
+
+/* Output of a command which is shown in a document while the command is running */
+typedef struct _VCOutput
+{
+	VCJob *job;
+	gchar *name;
+	gchar *force_encoding;
+	GeanyFiletype *ftype;
+	gint line;		/* line to go to once it has been received, 1-based */
+	gchar *empty_message;
+	GeanyDocument *cur_doc;
+	GeanyDocument *doc;	/* NULL until the first output arrived */
+} VCOutput;
+
+static GSList *outputs = NULL;
+
+static void
+output_free(gpointer data)
+{
+	VCOutput *out = data;
+
+	outputs = g_slist_remove(outputs, out);
+	g_free(out->name);
+	g_free(out->force_encoding);
+	g_free(out->empty_message);
+	g_free(out);
+}
+
+static void
+output_goto_line(VCOutput * out, gboolean force)
+{
+	if (out->line < 1)
+		return;
+	if (force || sci_get_line_count(out->doc->editor->sci) > out->line)
 	{
-		if (g_file_test(filename, G_FILE_TEST_IS_DIR))
-			dir = g_strdup(filename);
+		navqueue_goto_line(out->cur_doc, out->doc, out->line);
+		out->line = 0;
+	}
+}
+
+static void
+on_output_chunk(G_GNUC_UNUSED VCJob * job, const gchar * text, gsize len, gpointer data)
+{
+	VCOutput *out = data;
+	gint page;
+	GtkNotebook *book;
+	gchar *first;
+
+	if (out->doc)
+	{
+		scintilla_send_message(out->doc->editor->sci, SCI_APPENDTEXT, len, (sptr_t) text);
+	}
+	else
+	{
+		first = g_strndup(text, len);
+		out->doc = document_find_by_filename(out->name);
+		if (out->doc == NULL)
+		{
+			out->doc = document_new_file(out->name, out->ftype, first);
+		}
 		else
-			dir = g_path_get_dirname(filename);
+		{
+			sci_set_text(out->doc->editor->sci, first);
+			if (out->ftype)
+				document_set_filetype(out->doc, out->ftype);
+			book = GTK_NOTEBOOK(geany->main_widgets->notebook);
+			page = gtk_notebook_page_num(book, GTK_WIDGET(out->doc->editor->sci));
+			gtk_notebook_set_current_page(book, page);
+		}
+		g_free(first);
+		/* nobody wants to undo the arrival of the output chunk by chunk */
+		scintilla_send_message(out->doc->editor->sci, SCI_SETUNDOCOLLECTION, 0, 0);
 	}
-	else if (vc->commands[cmd].startdir == VC_COMMAND_STARTDIR_BASE)
+	output_goto_line(out, FALSE);
+}
+
+static void
+on_output_done(G_GNUC_UNUSED VCJob * job, G_GNUC_UNUSED gint exit_code, gboolean cancelled,
+	       gpointer data)
+{
+	VCOutput *out = data;
+
+	if (out->doc == NULL)
 	{
-		dir = vc->get_base_dir(filename);
+		if (!cancelled && out->empty_message)
+			ui_set_statusbar(FALSE, "%s", out->empty_message);
+		return;
 	}
+
+	scintilla_send_message(out->doc->editor->sci, SCI_SETUNDOCOLLECTION, 1, 0);
+	scintilla_send_message(out->doc->editor->sci, SCI_EMPTYUNDOBUFFER, 0, 0);
+	document_set_text_changed(out->doc, set_changed_flag);
+	document_set_encoding(out->doc, (out->force_encoding ? out->force_encoding : "UTF-8"));
+	output_goto_line(out, TRUE);
+}
+
+static void
+on_document_close(G_GNUC_UNUSED GObject * obj, GeanyDocument * doc, G_GNUC_UNUSED gpointer data)
+{
+	GSList *tmp;
+	GSList *next;
+	VCOutput *out;
+
+	for (tmp = outputs; tmp != NULL; tmp = next)
+	{
+		next = g_slist_next(tmp);
+		out = tmp->data;
+		if (out->cur_doc == doc)
+			out->cur_doc = NULL;
+		if (out->doc == doc)
+		{
+			out->doc = NULL;
+			vc_job_cancel(out->job);
+		}
+	}
+}
+
+#define TAB_STATUS_KEY "geanyvc-tab-status"
+
+/* Show the cached status of @doc next to its name in the notebook tab. */
+static void
+update_tab_status(GeanyDocument * doc)
+{
+	GtkWidget *sci = GTK_WIDGET(doc->editor->sci);
+	GtkWidget *label = g_object_get_data(G_OBJECT(sci), TAB_STATUS_KEY);
+	GtkWidget *tab;
+	const VC_RECORD *vc;
+	const gchar *status = NULL;
+	const gchar *text;
+	gboolean known;
+	gchar *dir;
+	gchar *base_dir;
+
+	if (set_status_in_tabs && doc->file_name && g_path_is_absolute(doc->file_name))
+	{
+		dir = g_path_get_dirname(doc->file_name);
+		vc = resolver_find_vc(dir);
+		if (vc)
+		{
+			base_dir = resolver_get_base_dir(vc, dir);
+			if (base_dir)
+				status = status_get(vc, base_dir, doc->file_name, &known);
+			g_free(base_dir);
+		}
+		g_free(dir);
+	}
+
+	if (status == FILE_STATUS_MODIFIED)
+		text = "M";
+	else if (status == FILE_STATUS_ADDED)
+		text = "A";
+	else if (status == FILE_STATUS_DELETED)
+		text = "D";
+	else if (status == FILE_STATUS_UNKNOWN)
+		text = "?";
 	else
 	{
-		g_warning("geanyvc: unknown startdir type: %d", vc->commands[cmd].startdir);
+		if (label)
+			gtk_widget_hide(label);
+		return;
 	}
 
-	ret = execute_custom_command(dir, vc->commands[cmd].command, vc->commands[cmd].env, std_out,
-				     std_err, filename, list, message);
+	if (!label)
+	{
+		/* the tab label is a box holding the file name and the close button */
+		tab = gtk_notebook_get_tab_label(GTK_NOTEBOOK(geany->main_widgets->notebook), sci);
+		if (!tab || !GTK_IS_BOX(tab))
+			return;
+		label = gtk_label_new(NULL);
+		gtk_box_pack_start(GTK_BOX(tab), label, FALSE, FALSE, 0);
+		gtk_box_reorder_child(GTK_BOX(tab), label, 0);
+		g_object_set_data(G_OBJECT(sci), TAB_STATUS_KEY, label);
+	}
+	gtk_label_set_text(GTK_LABEL(label), text);
+	ui_widget_set_tooltip_text(label, status);
+	gtk_widget_show(label);
+}
 
-	ui_set_statusbar(TRUE, _("File %s: action %s executed via %s."),
-			 filename, vc->commands[cmd].command[action_command_cell], vc->program);
+static void
+update_all_tab_status(void)
+{
+	guint i;
+
+	foreach_document(i)
+	{
+		update_tab_status(documents[i]);
+	}
+}
+
+static void
+remove_all_tab_status(void)
+{
+	GtkWidget *label;
+	guint i;
+
+	foreach_document(i)
+	{
+		label = g_object_get_data(G_OBJECT(documents[i]->editor->sci), TAB_STATUS_KEY);
+		if (label)
+		{
+			gtk_widget_destroy(label);
+			g_object_set_data(G_OBJECT(documents[i]->editor->sci), TAB_STATUS_KEY, NULL);
+		}
+	}
+}
+
+static void
+on_status_changed(const VC_RECORD * vc, const gchar * base_dir)
+{
+	update_all_tab_status();
+	status_service_changed(base_dir);
+	commit_dialog_status_changed(vc, base_dir);
+}
+
+static void
+on_document_open(G_GNUC_UNUSED GObject * obj, GeanyDocument * doc, G_GNUC_UNUSED gpointer data)
+{
+	update_tab_status(doc);
+}
+
+/* Show the blame of @doc in its margin. Returns FALSE if the backend cannot do that. */
+static gboolean
+annotate_document(const VC_RECORD * vc, GeanyDocument * doc)
+{
+	gchar *dir;
+
+	if (!vc->annotate_command)
+		return FALSE;
+	dir = resolver_get_base_dir(vc, doc->file_name);
+	if (!dir)
+		return FALSE;
 
+	blame_start(doc, dir, get_cmd(vc->annotate_command, dir, doc->file_name, NULL, NULL),
+		    vc->annotate_env);
+	g_free(dir);
+	return TRUE;
+}
+
+static gboolean
+on_editor_notify(G_GNUC_UNUSED GObject * obj, GeanyEditor * editor, SCNotification * nt,
+		 G_GNUC_UNUSED gpointer data)
+{
+	blame_editor_notify(editor, nt);
+	return FALSE;
+}
+
+static void
+on_document_save(G_GNUC_UNUSED GObject * obj, GeanyDocument * doc, G_GNUC_UNUSED gpointer data)
+{
+	const VC_RECORD *vc;
+	gchar *base_dir;
+
+	/* the blame is read again for the saved lines */
+	if (blame_is_shown(doc))
+	{
+		vc = find_vc(doc->file_name);
+		if (!vc || !annotate_document(vc, doc))
+			blame_hide(doc);
+	}
+
+	if (!doc->file_name)
+		return;
+
+	/* saving many documents at once only refreshes each working copy once. If
+	 * nobody shows the status, it is only read again when asked for */
+	vc = find_vc(doc->file_name);
+	if (vc)
+	{
+		base_dir = resolver_get_base_dir(vc, doc->file_name);
+		if (base_dir && (set_status_in_tabs || status_service_is_used()))
+			status_refresh(vc, base_dir);
+		else if (base_dir)
+			status_invalidate(vc, base_dir);
+		g_free(base_dir);
+	}
+	else if (set_status_in_tabs || status_service_is_used())
+		update_tab_status(doc);
+}
+
+/*
+ * Execute command @cmd like execute_command() but without waiting for it. Its output
+ * is shown in the document @name while it arrives, the arguments after @name are
+ * the same as for show_output(). @empty_message is shown in the status bar if the
+ * command has no output.
+ */
+static void
+execute_command_to_document(const VC_RECORD * vc, const gchar * filename, gint cmd,
+			    const gchar * name, const gchar * force_encoding,
+			    GeanyFiletype * ftype, gint line, const gchar * empty_message)
+{
+	VCOutput *out;
+	VCJob *job;
+	GSList *tmp;
+	gchar *dir;
+	gchar *text = NULL;
+	const gint action_command_cell = 1;
+
+	if (vc->commands[cmd].function &&
+	    (vc->commands[cmd].function(&text, NULL, filename, NULL, NULL) != VC_COMMAND_FALLBACK ||
+	     !vc->commands[cmd].command))
+	{
+		if (text)
+			show_output(text, name, force_encoding, ftype, line);
+		else if (empty_message)
+			ui_set_statusbar(FALSE, "%s", empty_message);
+		g_free(text);
+		return;
+	}
+
+	/* the output of a previous run would end up in the same document */
+	for (tmp = outputs; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		if (utils_str_equal(((VCOutput *) tmp->data)->name, name))
+		{
+			vc_job_cancel(((VCOutput *) tmp->data)->job);
+			break;
+		}
+	}
+
+	out = g_new0(VCOutput, 1);
+	out->name = g_strdup(name);
+	out->force_encoding = g_strdup(force_encoding);
+	out->ftype = ftype;
+	out->line = MAX(line + 1, 1);
+	out->empty_message = g_strdup(empty_message);
+	out->cur_doc = document_get_current();
+	outputs = g_slist_prepend(outputs, out);
+
+	dir = get_command_dir(vc, filename, cmd);
+	job = vc_job_start(dir, get_cmd(vc->commands[cmd].command, dir, filename, NULL, NULL),
+			   vc->commands[cmd].env, 0, on_output_chunk, on_output_done, out,
+			   output_free);
+	/* out is already freed if the command could not be started */
+	if (job)
+	{
+		out->job = job;
+		ui_set_statusbar(TRUE, _("File %s: action %s executed via %s."),
+				 filename, vc->commands[cmd].command[action_command_cell], vc->program);
+	}
 	g_free(dir);
-	return ret;
 }
 
 /* Callback if menu item for a single file was activated */
@@ -587,64 +965,61 @@ vcdiff_file_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpoint
 	vc = find_vc(doc->file_name);
 	g_return_if_fail(vc);
 
+	if (!set_external_diff || !get_external_diff_viewer())
+	{
+		name = g_strconcat(doc->file_name, ".vc.diff", NULL);
+		execute_command_to_document(vc, doc->file_name, VC_COMMAND_DIFF_FILE, name,
+					    doc->encoding, NULL, 0, _("No changes were made."));
+		g_free(name);
+		return;
+	}
+
 	execute_command(vc, &text, NULL, doc->file_name, VC_COMMAND_DIFF_FILE, NULL, NULL);
 	if (text)
 	{
-		if (set_external_diff && get_external_diff_viewer())
-		{
-			g_free(text);
-
-			/*  1) rename file to file.geany.~NEW~
-			   2) revert file
-			   3) rename file to file.geanyvc.~BASE~
-			   4) rename file.geany.~NEW~ to origin file
-			   5) show diff
-			 */
-			localename = utils_get_locale_from_utf8(doc->file_name);
+		g_free(text);
 
-			new = g_strconcat(doc->file_name, ".geanyvc.~NEW~", NULL);
-			setptr(new, utils_get_locale_from_utf8(new));
+		/*  1) rename file to file.geany.~NEW~
+		   2) revert file
+		   3) rename file to file.geanyvc.~BASE~
+		   4) rename file.geany.~NEW~ to origin file
+		   5) show diff
+		 */
+		localename = utils_get_locale_from_utf8(doc->file_name);
 
-			old = g_strconcat(doc->file_name, ".geanyvc.~BASE~", NULL);
-			setptr(old, utils_get_locale_from_utf8(old));
+		new = g_strconcat(doc->file_name, ".geanyvc.~NEW~", NULL);
+		setptr(new, utils_get_locale_from_utf8(new));
 
-			if (g_rename(localename, new) != 0)
-			{
-				g_warning(_
-					  ("geanyvc: vcdiff_file_activated: Unable to rename '%s' to '%s'"),
-					  localename, new);
-				goto end;
-			}
+		old = g_strconcat(doc->file_name, ".geanyvc.~BASE~", NULL);
+		setptr(old, utils_get_locale_from_utf8(old));
 
-			execute_command(vc, NULL, NULL, doc->file_name,
-					VC_COMMAND_REVERT_FILE, NULL, NULL);
+		if (g_rename(localename, new) != 0)
+		{
+			g_warning(_
+				  ("geanyvc: vcdiff_file_activated: Unable to rename '%s' to '%s'"),
+				  localename, new);
+			goto end;
+		}
 
-			if (g_rename(localename, old) != 0)
-			{
-				g_warning(_
-					  ("geanyvc: vcdiff_file_activated: Unable to rename '%s' to '%s'"),
-					  localename, old);
-				g_rename(new, localename);
-				goto end;
-			}
-			g_rename(new, localename);
+		execute_command(vc, NULL, NULL, doc->file_name,
+				VC_COMMAND_REVERT_FILE, NULL, NULL);
 
-			vc_external_diff(old, localename);
-			g_unlink(old);
-		      end:
-			g_free(old);
-			g_free(new);
-			g_free(localename);
-			return;
-		}
-		else
+		if (g_rename(localename, old) != 0)
 		{
-			name = g_strconcat(doc->file_name, ".vc.diff", NULL);
-			show_output(text, name, doc->encoding, NULL, 0);
-			g_free(text);
-			g_free(name);
+			g_warning(_
+				  ("geanyvc: vcdiff_file_activated: Unable to rename '%s' to '%s'"),
+				  localename, old);
+			g_rename(new, localename);
+			goto end;
 		}
+		g_rename(new, localename);
 
+		vc_external_diff(old, localename);
+		g_unlink(old);
+	      end:
+		g_free(old);
+		g_free(new);
+		g_free(localename);
 	}
 	else
 	{
@@ -658,7 +1033,7 @@ vcdiff_file_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpoint
 static void
 vcdiff_dir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, gpointer data)
 {
-	gchar *text = NULL;
+	gchar *name;
 	gchar *dir;
 	gint flags = GPOINTER_TO_INT(data);
 	const VC_RECORD *vc;
@@ -677,7 +1052,7 @@ vcdiff_dir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, gpointer data)
 
 	if (flags & FLAG_BASEDIR)
 	{
-		dir = vc->get_base_dir(doc->file_name);
+		dir = resolver_get_base_dir(vc, doc->file_name);
 	}
 	else if (flags & FLAG_DIR)
 	{
@@ -687,53 +1062,66 @@ vcdiff_dir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, gpointer data)
 		return;
 	g_return_if_fail(dir);
 
-	execute_command(vc, &text, NULL, dir, VC_COMMAND_DIFF_DIR, NULL, NULL);
-	if (text)
-	{
-		gchar *name;
-		name = g_strconcat(dir, ".vc.diff", NULL);
-		show_output(text, name, doc->encoding, NULL, 0);
-		g_free(text);
-		g_free(name);
-	}
-	else
-	{
-		ui_set_statusbar(FALSE, _("No changes were made."));
-	}
+	name = g_strconcat(dir, ".vc.diff", NULL);
+	execute_command_to_document(vc, dir, VC_COMMAND_DIFF_DIR, name, doc->encoding, NULL, 0,
+				    _("No changes were made."));
+	g_free(name);
 	g_free(dir);
 }
 
 static void
 vcblame_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
-	gchar *text = NULL;
 	const VC_RECORD *vc;
 	GeanyDocument *doc;
 
 	doc = document_get_current();
 	g_return_if_fail(doc != NULL && doc->file_name != NULL);
 
+	if (blame_is_shown(doc))
+	{
+		blame_hide(doc);
+		return;
+	}
+
 	vc = find_vc(doc->file_name);
 	g_return_if_fail(vc);
 
-	execute_command(vc, &text, NULL, doc->file_name, VC_COMMAND_BLAME, NULL, NULL);
-	if (text)
-	{
-		show_output(text, "*VC-BLAME*", NULL,
-			doc->file_type, sci_get_current_line(doc->editor->sci));
-		g_free(text);
-	}
-	else
-	{
-		ui_set_statusbar(FALSE, _("No history available"));
-	}
+	/* the blame of a changed document would not fit its lines */
+	if (!doc->changed && annotate_document(vc, doc))
+		return;
+	execute_command_to_document(vc, doc->file_name, VC_COMMAND_BLAME, "*VC-BLAME*", NULL,
+				    doc->file_type, sci_get_current_line(doc->editor->sci),
+				    _("No history available"));
 }
 
 
+/* Show the history of @filename in the log browser, of the whole working copy if
+ * @filename is its base directory. Returns FALSE if the backend has no log browser. */
+static gboolean
+show_log_browser(const VC_RECORD * vc, const gchar * filename)
+{
+	gchar *base_dir;
+	gchar *path;
+
+	if (!vc->log)
+		return FALSE;
+	base_dir = resolver_get_base_dir(vc, filename);
+	if (!base_dir)
+		return FALSE;
+
+	path = get_relative_path(base_dir, filename);
+	if (utils_str_equal(path, "."))
+		setptr(path, NULL);
+	logview_show(vc, base_dir, path);
+	g_free(path);
+	g_free(base_dir);
+	return TRUE;
+}
+
 static void
 vclog_file_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
-	gchar *output = NULL;
 	const VC_RECORD *vc;
 	GeanyDocument *doc;
 
@@ -743,19 +1131,15 @@ vclog_file_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointe
 	vc = find_vc(doc->file_name);
 	g_return_if_fail(vc);
 
-	execute_command(vc, &output, NULL, doc->file_name, VC_COMMAND_LOG_FILE, NULL, NULL);
-	if (output)
-	{
-		show_output(output, "*VC-LOG*", NULL, NULL, 0);
-		g_free(output);
-	}
+	if (!show_log_browser(vc, doc->file_name))
+		execute_command_to_document(vc, doc->file_name, VC_COMMAND_LOG_FILE, "*VC-LOG*",
+					    NULL, NULL, 0, NULL);
 }
 
 static void
 vclog_dir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
 	gchar *base_name = NULL;
-	gchar *text = NULL;
 	const VC_RECORD *vc;
 	GeanyDocument *doc;
 
@@ -767,12 +1151,9 @@ vclog_dir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 	vc = find_vc(base_name);
 	g_return_if_fail(vc);
 
-	execute_command(vc, &text, NULL, base_name, VC_COMMAND_LOG_DIR, NULL, NULL);
-	if (text)
-	{
-		show_output(text, "*VC-LOG*", NULL, NULL, 0);
-		g_free(text);
-	}
+	if (!show_log_browser(vc, base_name))
+		execute_command_to_document(vc, base_name, VC_COMMAND_LOG_DIR, "*VC-LOG*", NULL,
+					    NULL, 0, NULL);
 
 	g_free(base_name);
 }
@@ -780,7 +1161,6 @@ vclog_dir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 static void
 vclog_basedir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
-	gchar *text = NULL;
 	const VC_RECORD *vc;
 	GeanyDocument *doc;
 	gchar *basedir;
@@ -791,15 +1171,12 @@ vclog_basedir_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpoi
 	vc = find_vc(doc->file_name);
 	g_return_if_fail(vc);
 
-	basedir = vc->get_base_dir(doc->file_name);
+	basedir = resolver_get_base_dir(vc, doc->file_name);
 	g_return_if_fail(basedir);
 
-	execute_command(vc, &text, NULL, basedir, VC_COMMAND_LOG_DIR, NULL, NULL);
-	if (text)
-	{
-		show_output(text, "*VC-LOG*", NULL, NULL, 0);
-		g_free(text);
-	}
+	if (!show_log_browser(vc, basedir))
+		execute_command_to_document(vc, basedir, VC_COMMAND_LOG_DIR, "*VC-LOG*", NULL,
+					    NULL, 0, NULL);
 	g_free(basedir);
 }
 
@@ -808,7 +1185,6 @@ static void
 vcstatus_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
 	gchar *base_name = NULL;
-	gchar *text = NULL;
 	const VC_RECORD *vc;
 	GeanyDocument *doc;
 
@@ -825,12 +1201,8 @@ vcstatus_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 	vc = find_vc(base_name);
 	g_return_if_fail(vc);
 
-	execute_command(vc, &text, NULL, base_name, VC_COMMAND_STATUS, NULL, NULL);
-	if (text)
-	{
-		show_output(text, "*VC-STATUS*", NULL, NULL, 0);
-		g_free(text);
-	}
+	execute_command_to_document(vc, base_name, VC_COMMAND_STATUS, "*VC-STATUS*", NULL, NULL, 0,
+				    NULL);
 
 	g_free(base_name);
 }
@@ -877,7 +1249,7 @@ command_with_question_activated(gchar ** text, gint cmd, const gchar * question,
 
 	if (flags & FLAG_BASEDIR)
 	{
-		dir = vc->get_base_dir(dir);
+		setptr(dir, resolver_get_base_dir(vc, dir));
 	}
 
 	if (doc->changed)
@@ -949,6 +1321,17 @@ vcremove_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 	}
 }
 
+static void
+vccancel_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
+{
+	if (outputs)
+	{
+		while (outputs)
+			vc_job_cancel(((VCOutput *) outputs->data)->job);
+		ui_set_statusbar(FALSE, _("Running version control commands were cancelled."));
+	}
+}
+
 static void
 vcupdate_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
@@ -1006,6 +1389,42 @@ create_commit_model(const GSList * commit)
 	return GTK_TREE_MODEL(store);
 }
 
+/* Put the files of @commit into @store, keeping the choice of the files which
+ * were listed before */
+static void
+update_commit_model(GtkListStore * store, const GSList * commit)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(store);
+	GHashTable *skipped = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	GtkTreeIter iter;
+	gboolean valid;
+	gboolean chosen;
+	gchar *path;
+	const GSList *cur;
+
+	for (valid = gtk_tree_model_get_iter_first(model, &iter); valid;
+	     valid = gtk_tree_model_iter_next(model, &iter))
+	{
+		gtk_tree_model_get(model, &iter, COLUMN_COMMIT, &chosen, COLUMN_PATH, &path, -1);
+		if (!chosen)
+			g_hash_table_insert(skipped, path, path);
+		else
+			g_free(path);
+	}
+
+	gtk_list_store_clear(store);
+	for (cur = commit; cur != NULL; cur = g_slist_next(cur))
+	{
+		path = ((CommitItem *) (cur->data))->path;
+		gtk_list_store_append(store, &iter);
+		gtk_list_store_set(store, &iter,
+				   COLUMN_COMMIT, !g_hash_table_lookup(skipped, path),
+				   COLUMN_STATUS, ((CommitItem *) (cur->data))->status,
+				   COLUMN_PATH, path, -1);
+	}
+	g_hash_table_destroy(skipped);
+}
+
 static gboolean
 get_commit_files_foreach(GtkTreeModel * model, G_GNUC_UNUSED GtkTreePath * path, GtkTreeIter * iter,
 			 gpointer data)
@@ -1023,155 +1442,391 @@ get_commit_files_foreach(GtkTreeModel * model, G_GNUC_UNUSED GtkTreePath * path,
 	return FALSE;
 }
 
-static gboolean
-get_commit_diff_foreach(GtkTreeModel * model, G_GNUC_UNUSED GtkTreePath * path, GtkTreeIter * iter,
-			gpointer data)
+/* Number of rendered diffs the commit dialog keeps */
+#define COMMIT_DIFF_CACHE_SIZE 32
+/* Number of files below the selected one whose diffs are fetched in advance */
+#define COMMIT_DIFF_PREFETCH 3
+
+typedef struct _CommitDiffs CommitDiffs;
+
+/* Diff of a file in the commit dialog */
+typedef struct _CommitDiff
 {
-	GString *diff = data;
-	gboolean commit;
-	gchar *filename;
-	gchar *tmp = NULL;
-	gchar *status;
-	const VC_RECORD *vc;
+	CommitDiffs *diffs;
+	gchar *path;
+	VCJob *job;		/* diff command, while it is running */
+	GString *text;		/* its output so far */
+	gboolean raw;		/* the output is the unconverted diff */
+	GtkTextBuffer *buffer;	/* rendered diff, NULL until the command finished */
+	VCDiffHunks *hunks;	/* NULL unless the hunks can be committed separately */
+	GPtrArray *anchors;	/* the place of the check box of each shown hunk */
+	GList *lru_link;	/* NULL once hunks were toggled, they are kept until the commit */
+} CommitDiff;
+
+/* Diffs of the commit dialog, which are only fetched when a file is selected,
+ * so that the dialog opens at once even for lots of changed files */
+struct _CommitDiffs
+{
+	GtkTextView *view;
+	GtkTextTagTable *tags;
+	GHashTable *files;	/* path -> CommitDiff */
+	GQueue *lru;		/* rendered diffs, most recently used first */
+	CommitDiff *selected;
+};
 
-	gtk_tree_model_get(model, iter, COLUMN_COMMIT, &commit, -1);
-	if (!commit)
-		return FALSE;
+static void
+commit_diff_free(gpointer data)
+{
+	CommitDiff *cd = data;
+
+	if (cd->job)
+		vc_job_cancel(cd->job);
+	if (cd->buffer)
+		g_object_unref(cd->buffer);
+	if (cd->anchors)
+		g_ptr_array_free(cd->anchors, TRUE);
+	diff_hunks_free(cd->hunks);
+	g_string_free(cd->text, TRUE);
+	g_free(cd->path);
+	g_free(cd);
+}
 
-	gtk_tree_model_get(model, iter, COLUMN_STATUS, &status, -1);
+static CommitDiffs *
+commit_diffs_new(GtkTextView * view)
+{
+	CommitDiffs *diffs = g_new0(CommitDiffs, 1);
+
+	diffs->view = view;
+	diffs->tags = g_object_ref(gtk_text_buffer_get_tag_table(gtk_text_view_get_buffer(view)));
+	diffs->files = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, commit_diff_free);
+	diffs->lru = g_queue_new();
+	return diffs;
+}
+
+static void
+commit_diffs_free(CommitDiffs * diffs)
+{
+	g_hash_table_destroy(diffs->files);
+	g_queue_free(diffs->lru);
+	g_object_unref(diffs->tags);
+	g_free(diffs);
+}
+
+/* Append the output @txt of a diff command to @buffer, converting it like
+ * execute_custom_command() does if it is raw */
+static void
+insert_diff_text(GtkTextBuffer * buffer, const gchar * txt, gsize len)
+{
+	GtkTextIter end;
+	GString *tmp;
+	gchar *utf8;
 
-	if (! utils_str_equal(status, FILE_STATUS_MODIFIED))
+	if (g_utf8_validate(txt, len, NULL))
+		tmp = g_string_new_len(txt, len);
+	else
 	{
-		g_free(status);
-		return FALSE;
+		utf8 = encodings_convert_to_utf8(txt, len, NULL);
+		if (!utf8)
+			utf8 = g_convert(txt, len, "UTF-8", "ISO-8859-1", NULL, NULL, NULL);
+		tmp = g_string_new(utf8);
+		g_free(utf8);
 	}
+	utils_string_replace_all(tmp, "\r\n", "\n");
+	utils_string_replace_all(tmp, "\r", "\n");
 
-	gtk_tree_model_get(model, iter, COLUMN_PATH, &filename, -1);
-
-	vc = find_vc(filename);
-	g_return_val_if_fail(vc, FALSE);
+	gtk_text_buffer_get_end_iter(buffer, &end);
+	gtk_text_buffer_insert(buffer, &end, tmp->str, tmp->len);
+	g_string_free(tmp, TRUE);
+}
 
-	execute_command(vc, &tmp, NULL, filename, VC_COMMAND_DIFF_FILE, NULL, NULL);
-	if (tmp)
+/* Create a buffer showing the diff @txt in the colours of the diff filetype,
+ * with an anchor added to @anchors before each of @hunks if it is not NULL.
+ * Only about @limit bytes are shown, ending at a hunk or line boundary: the
+ * hunks that are left out have no anchor and keep their selection */
+static GtkTextBuffer *
+render_diff(GtkTextTagTable * tags, const gchar * txt, gsize len, const VCDiffHunks * hunks,
+	    GPtrArray * anchors, gsize limit)
+{
+	GtkTextBuffer *buffer = gtk_text_buffer_new(tags);
+	GtkTextIter start, end;
+	const gchar *tagname;
+	const VCDiffHunk *hunk;
+	const gchar *nl;
+	gsize shown;
+	gboolean truncated = FALSE;
+	guint i;
+
+	if (hunks)
+	{
+		insert_diff_text(buffer, hunks->text, hunks->header_end);
+		shown = hunks->header_end;
+		for (i = 0; i < hunks->hunks->len; i++)
+		{
+			hunk = &g_array_index(hunks->hunks, VCDiffHunk, i);
+			/* always show the first hunk, the others only as long as they fit */
+			if (i > 0 && shown + hunk->end - hunk->start > limit)
+			{
+				truncated = TRUE;
+				break;
+			}
+			gtk_text_buffer_get_end_iter(buffer, &end);
+			g_ptr_array_add(anchors, gtk_text_buffer_create_child_anchor(buffer, &end));
+			insert_diff_text(buffer, hunks->text + hunk->start, hunk->end - hunk->start);
+			shown += hunk->end - hunk->start;
+		}
+	}
+	else if (len > limit)
 	{
-		/* We temporarily add the filename to the diff output for parsing the diff output later,
-		 * after we have finished parsing, we apply the tag "invisible" which hides the text. */
-		g_string_append_printf(diff, "VC_DIFF%s\n", filename);
-		g_string_append(diff, tmp);
-		g_free(tmp);
+		nl = g_strrstr_len(txt, limit, "\n");
+		insert_diff_text(buffer, txt, nl ? (gsize) (nl - txt + 1) : limit);
+		truncated = TRUE;
 	}
 	else
+		insert_diff_text(buffer, txt, len);
+
+	if (truncated)
 	{
-		g_warning("error: geanyvc: get_commit_diff_foreach: empty diff output");
+		gtk_text_buffer_get_end_iter(buffer, &end);
+		if (!gtk_text_iter_starts_line(&end))
+			gtk_text_buffer_insert(buffer, &end, "\n", 1);
+		gtk_text_buffer_insert(buffer, &end,
+			hunks ? _("[The rest of the differences is too big to display here. "
+				  "Its hunks are committed as they are.]\n")
+			      : _("[The rest of the differences is too big to display here. "
+				  "To view it, open the differences in Geany by using the "
+				  "GeanyVC menu.]\n"), -1);
 	}
-	g_free(filename);
-	return FALSE;
+
+	gtk_text_buffer_get_start_iter(buffer, &start);
+	while (!gtk_text_iter_is_end(&start))
+	{
+		switch (gtk_text_iter_get_char(&start))
+		{
+			case '-':
+				tagname = "deleted";
+				break;
+			case '+':
+				tagname = "added";
+				break;
+			case ' ':
+			case '\n':
+				tagname = NULL;
+				break;
+			default:
+				tagname = "default";
+		}
+		end = start;
+		gtk_text_iter_forward_line(&end);
+		if (tagname)
+			gtk_text_buffer_apply_tag_by_name(buffer, tagname, &start, &end);
+		start = end;
+	}
+	return buffer;
 }
 
-static gchar *
-get_commit_diff(GtkTreeView * treeview)
+static void
+show_diff_message(CommitDiffs * diffs, const gchar * text)
 {
-	GtkTreeModel *model = gtk_tree_view_get_model(treeview);
-	GString *ret = g_string_new(NULL);
+	GtkTextBuffer *buffer = gtk_text_buffer_new(diffs->tags);
+
+	gtk_text_buffer_set_text(buffer, text, -1);
+	gtk_text_view_set_buffer(diffs->view, buffer);
+	gtk_text_view_set_wrap_mode(diffs->view, GTK_WRAP_WORD);
+	g_object_unref(buffer);
+}
 
-	gtk_tree_model_foreach(model, get_commit_diff_foreach, ret);
+static void
+on_hunk_toggled(GtkToggleButton * button, gpointer data)
+{
+	CommitDiff *cd = data;
+	VCDiffHunk *hunk = g_object_get_data(G_OBJECT(button), "hunk");
 
-	return g_string_free(ret, FALSE);
+	hunk->selected = gtk_toggle_button_get_active(button);
+	/* the cache must not forget the selection */
+	if (cd->lru_link)
+	{
+		g_queue_delete_link(cd->diffs->lru, cd->lru_link);
+		cd->lru_link = NULL;
+	}
 }
 
 static void
-set_diff_buff(GtkWidget * textview, GtkTextBuffer * buffer, const gchar * txt)
+show_commit_diff(CommitDiffs * diffs, CommitDiff * cd)
 {
-	GtkTextIter start, end;
-	GtkTextMark *mark;
-	gchar *filename;
-	const gchar *tagname = "";
-	const gchar *c, *p = txt;
-
-	if (strlen(txt) > COMMIT_DIFF_MAXLENGTH)
-	{
-		gtk_text_buffer_set_text(buffer,
-			_("The resulting differences cannot be displayed because "
-			  "the changes are too big to display here and would slow down the UI significantly."
-			  "\n\n"
-			  "To view the differences, cancel this dialog and open the differences "
-			  "in Geany directly by using the GeanyVC menu (Base Directory -> Diff)."), -1);
-		gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(textview), GTK_WRAP_WORD);
+	GtkWidget *check;
+	VCDiffHunk *hunk;
+	guint i;
+
+	if (gtk_text_view_get_buffer(diffs->view) == cd->buffer)
 		return;
-	}
-	gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(textview), GTK_WRAP_NONE);
+	gtk_text_view_set_buffer(diffs->view, cd->buffer);
+	gtk_text_view_set_wrap_mode(diffs->view, GTK_WRAP_NONE);
 
-	gtk_text_buffer_set_text(buffer, txt, -1);
+	/* the view destroys the check boxes when its buffer changes */
+	for (i = 0; cd->anchors && i < cd->anchors->len; i++)
+	{
+		hunk = &g_array_index(cd->hunks->hunks, VCDiffHunk, i);
+		check = gtk_check_button_new();
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), hunk->selected);
+		gtk_widget_set_tooltip_text(check, _("Commit this hunk"));
+		g_object_set_data(G_OBJECT(check), "hunk", hunk);
+		g_signal_connect(check, "toggled", G_CALLBACK(on_hunk_toggled), cd);
+		gtk_widget_show(check);
+		gtk_text_view_add_child_at_anchor(diffs->view, check,
+						  g_ptr_array_index(cd->anchors, i));
+	}
+}
 
-	gtk_text_buffer_get_start_iter(buffer, &start);
-	gtk_text_buffer_get_end_iter(buffer, &end);
+static void
+commit_diff_loaded(CommitDiff * cd, const gchar * text, gsize len)
+{
+	CommitDiffs *diffs = cd->diffs;
+	CommitDiff *last;
 
-	gtk_text_buffer_remove_all_tags(buffer, &start, &end);
+	/* hunks can only be chosen in files with several of them, even the ones
+	 * of a diff too big to be shown entirely are parsed */
+	if (cd->raw)
+		cd->hunks = diff_hunks_parse(text, len);
+	if (cd->hunks && cd->hunks->hunks->len < 2)
+	{
+		diff_hunks_free(cd->hunks);
+		cd->hunks = NULL;
+	}
+	if (cd->hunks)
+		cd->anchors = g_ptr_array_new();
+	cd->buffer = render_diff(diffs->tags, text, len, cd->hunks, cd->anchors,
+				 COMMIT_DIFF_MAXLENGTH);
 
-	while (p)
+	g_queue_push_head(diffs->lru, cd);
+	cd->lru_link = diffs->lru->head;
+	while (g_queue_get_length(diffs->lru) > COMMIT_DIFF_CACHE_SIZE)
 	{
-		c = NULL;
-		if (*p == '-')
-		{
-			tagname = "deleted";
-		}
-		else if (*p == '+')
-		{
-			tagname = "added";
-		}
-		else if (*p == ' ')
-		{
-			tagname = "";
-		}
-		else if (strncmp(p, "VC_DIFF", 7) == 0)
-		{	/* Lines starting with VC_DIFF are special and were added by our code to tell about
-			 * filename to which the following diff lines belong. We use this file to create
-			 * text marks which we then later use to scroll to if the corresponding file has been
-			 * selected in the commit dialog's files list. */
-			tagname = "invisible";
-			c = strchr(p + 7, '\n');
-		}
-		else
-		{
-			tagname = "default";
-		}
-		gtk_text_buffer_get_iter_at_offset(buffer, &start,
-						   g_utf8_pointer_to_offset(txt, p));
-
-		if (c)
-		{	/* create the mark *after* the start iter has been updated */
-			filename = g_strndup(p + 7, c - p - 7);
-			/* delete old text marks */
-			mark = gtk_text_buffer_get_mark(buffer, filename);
-			if (mark)
-				gtk_text_buffer_delete_mark(buffer, mark);
-			/* create a new one */
-			gtk_text_buffer_create_mark(buffer, filename, &start, TRUE);
-			g_free(filename);
-		}
+		last = g_queue_peek_tail(diffs->lru);
+		if (last == diffs->selected)
+			break;
+		g_queue_pop_tail(diffs->lru);
+		g_hash_table_remove(diffs->files, last->path);
+	}
+
+	if (cd == diffs->selected)
+		show_commit_diff(diffs, cd);
+}
+
+static void
+on_commit_diff_output(G_GNUC_UNUSED VCJob * job, const gchar * text, gsize len, gpointer data)
+{
+	CommitDiff *cd = data;
+
+	g_string_append_len(cd->text, text, len);
+}
+
+static void
+on_commit_diff_done(G_GNUC_UNUSED VCJob * job, G_GNUC_UNUSED gint exit_code, gboolean cancelled,
+		    gpointer data)
+{
+	CommitDiff *cd = data;
+
+	cd->job = NULL;
+	if (cancelled)
+		return;
+	commit_diff_loaded(cd, cd->text->str, cd->text->len);
+	g_string_free(cd->text, TRUE);
+	cd->text = g_string_new(NULL);
+}
+
+/* Get the diff of @path, starting the diff command if it is not known yet. */
+static CommitDiff *
+get_commit_diff(CommitDiffs * diffs, const gchar * path)
+{
+	CommitDiff *cd = g_hash_table_lookup(diffs->files, path);
+	const VC_RECORD *vc;
+	gchar *dir;
+	gchar *text = NULL;
+	gint ret = VC_COMMAND_FALLBACK;
 
-		p = strchr(p, '\n');
-		if (p)
+	if (cd)
+	{
+		if (cd->lru_link)
 		{
-			if (*tagname)
-			{
-				gtk_text_buffer_get_iter_at_offset(buffer, &end,
-						g_utf8_pointer_to_offset(txt, p + 1));
-				gtk_text_buffer_apply_tag_by_name(buffer, tagname, &start, &end);
-			}
-			p++;
+			g_queue_unlink(diffs->lru, cd->lru_link);
+			g_queue_push_head_link(diffs->lru, cd->lru_link);
 		}
+		return cd;
+	}
+
+	cd = g_new0(CommitDiff, 1);
+	cd->diffs = diffs;
+	cd->path = g_strdup(path);
+	cd->text = g_string_new(NULL);
+	g_hash_table_insert(diffs->files, cd->path, cd);
+
+	/* a patch of some hunks must be made from the exact output of the command */
+	vc = find_vc(path);
+	cd->raw = vc && vc->commit_patch && vc->commands[VC_COMMAND_DIFF_FILE].command;
+	if (vc && !cd->raw && vc->commands[VC_COMMAND_DIFF_FILE].function)
+		ret = vc->commands[VC_COMMAND_DIFF_FILE].function(&text, NULL, path, NULL, NULL);
+	if (vc && ret == VC_COMMAND_FALLBACK && vc->commands[VC_COMMAND_DIFF_FILE].command)
+	{
+		dir = get_command_dir(vc, path, VC_COMMAND_DIFF_FILE);
+		cd->job = vc_job_start(dir, get_cmd(vc->commands[VC_COMMAND_DIFF_FILE].command, dir,
+						    path, NULL, NULL),
+				       vc->commands[VC_COMMAND_DIFF_FILE].env,
+				       cd->raw ? VC_JOB_RAW_OUTPUT : 0,
+				       on_commit_diff_output, on_commit_diff_done, cd, NULL);
+		g_free(dir);
+		if (cd->job)
+			return cd;
 	}
+
+	cd->raw = FALSE;
+	commit_diff_loaded(cd, text ? text : "", text ? strlen(text) : 0);
+	g_free(text);
+	return cd;
+}
+
+static gboolean
+is_unwanted_diff(G_GNUC_UNUSED gpointer key, gpointer value, gpointer wanted)
+{
+	CommitDiff *cd = value;
+
+	return cd->job && !g_slist_find(wanted, cd);
 }
 
+/* Show the diff of the file at @iter and fetch the diffs of the next files, but
+ * stop fetching diffs which were prefetched for a previous selection. */
 static void
-refresh_diff_view(GtkTreeView *treeview)
+select_commit_diff(CommitDiffs * diffs, GtkTreeModel * model, GtkTreeIter * iter)
 {
-	gchar *diff;
-	GtkWidget *diffView = ui_lookup_widget(GTK_WIDGET(treeview), "textDiff");
-	diff = get_commit_diff(GTK_TREE_VIEW(treeview));
-	set_diff_buff(diffView, gtk_text_view_get_buffer(GTK_TEXT_VIEW(diffView)), diff);
-	g_free(diff);
+	GtkTreeIter next = *iter;
+	GSList *wanted = NULL;
+	gchar *status;
+	gchar *path;
+	gint i;
+
+	diffs->selected = NULL;
+	for (i = 0; i <= COMMIT_DIFF_PREFETCH; i++)
+	{
+		gtk_tree_model_get(model, &next, COLUMN_STATUS, &status, COLUMN_PATH, &path, -1);
+		if (utils_str_equal(status, FILE_STATUS_MODIFIED))
+		{
+			wanted = g_slist_prepend(wanted, get_commit_diff(diffs, path));
+			if (i == 0)
+				diffs->selected = wanted->data;
+		}
+		g_free(status);
+		g_free(path);
+		if (!gtk_tree_model_iter_next(model, &next))
+			break;
+	}
+	g_hash_table_foreach_remove(diffs->files, is_unwanted_diff, wanted);
+	g_slist_free(wanted);
+
+	if (!diffs->selected)
+		show_diff_message(diffs, _("Differences are only shown for modified files."));
+	else if (!diffs->selected->buffer)
+		show_diff_message(diffs, _("Loading differences..."));
+	else
+		show_commit_diff(diffs, diffs->selected);
 }
 
 static void
@@ -1182,13 +1837,10 @@ commit_toggled(G_GNUC_UNUSED GtkCellRendererToggle * cell, gchar * path_str, gpo
 	GtkTreeIter iter;
 	GtkTreePath *path = gtk_tree_path_new_from_string(path_str);
 	gboolean fixed;
-	gchar *filename;
-	GtkTextView *diffView = GTK_TEXT_VIEW(ui_lookup_widget(GTK_WIDGET(treeview), "textDiff"));
-	GtkTextMark *mark;
 
 	/* get toggled iter */
 	gtk_tree_model_get_iter(model, &iter, path);
-	gtk_tree_model_get(model, &iter, COLUMN_COMMIT, &fixed, COLUMN_PATH, &filename, -1);
+	gtk_tree_model_get(model, &iter, COLUMN_COMMIT, &fixed, -1);
 
 	/* do something with the value */
 	fixed ^= 1;
@@ -1196,18 +1848,8 @@ commit_toggled(G_GNUC_UNUSED GtkCellRendererToggle * cell, gchar * path_str, gpo
 	/* set new value */
 	gtk_list_store_set(GTK_LIST_STORE(model), &iter, COLUMN_COMMIT, fixed, -1);
 
-	if (! fixed)
-	{
-		mark = gtk_text_buffer_get_mark(gtk_text_view_get_buffer(diffView), filename);
-		if (mark)
-			gtk_text_buffer_delete_mark(gtk_text_view_get_buffer(diffView), mark);
-	}
-
-	refresh_diff_view(treeview);
-
 	/* clean up */
 	gtk_tree_path_free(path);
-	g_free(filename);
 }
 
 static gboolean
@@ -1226,8 +1868,6 @@ commit_all_toggled_cb(GtkToggleButton *check_box, gpointer treeview)
 	gint toggled = gtk_toggle_button_get_active(check_box);
 
 	gtk_tree_model_foreach(model, toggle_all_commit_files, &toggled);
-
-	refresh_diff_view(treeview);
 }
 
 static void
@@ -1286,24 +1926,12 @@ get_diff_color(G_GNUC_UNUSED GeanyDocument * doc, gint style)
 
 static void commit_tree_selection_changed_cb(GtkTreeSelection *sel, GtkTextView *textview)
 {
+	CommitDiffs *diffs = g_object_get_data(G_OBJECT(textview), "commit_diffs");
 	GtkTreeModel *model;
 	GtkTreeIter iter;
-	GtkTextMark *mark;
-	gchar *path;
-	gboolean set;
-
-	if (! gtk_tree_selection_get_selected(sel, &model, &iter))
-		return;
-
-	gtk_tree_model_get(model, &iter, COLUMN_COMMIT, &set, COLUMN_PATH, &path, -1);
 
-	if (set)
-	{
-		mark = gtk_text_buffer_get_mark(gtk_text_view_get_buffer(textview), path);
-		if (mark)
-			gtk_text_view_scroll_to_mark(textview, mark, 0.0, TRUE, 0.0, 0.0);
-	}
-	g_free(path);
+	if (diffs && gtk_tree_selection_get_selected(sel, &model, &iter))
+		select_commit_diff(diffs, model, &iter);
 }
 
 static gboolean commit_text_line_number_update_cb(GtkWidget *widget, GdkEvent *event,
@@ -1509,13 +2137,124 @@ create_commitDialog(void)
 	return commitDialog;
 }
 
+/* Commit @files, or only the selected hunks of those whose diff was shown */
+static void
+commit_files(const VC_RECORD * vc, const gchar * dir, CommitDiffs * diffs, GSList * files,
+	     const gchar * message)
+{
+	GSList *whole = NULL;
+	GSList *patched = NULL;
+	GSList *tmp;
+	GString *patch;
+	CommitDiff *cd;
+	gchar *std_err = NULL;
+	guint selected;
+
+	patch = g_string_new(NULL);
+	for (tmp = files; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		cd = g_hash_table_lookup(diffs->files, tmp->data);
+		selected = cd && cd->hunks ? diff_hunks_count_selected(cd->hunks) : 1;
+		if (selected == 0)
+			continue;
+		if (vc->commit_patch && cd && cd->hunks && selected < cd->hunks->hunks->len)
+		{
+			diff_hunks_append_patch(cd->hunks, patch);
+			patched = g_slist_prepend(patched, tmp->data);
+		}
+		else
+			whole = g_slist_prepend(whole, tmp->data);
+	}
+	whole = g_slist_reverse(whole);
+
+	if (!whole && !patched)
+		ui_set_statusbar(FALSE, _("Nothing to commit."));
+	else if (!patched)
+		execute_command(vc, NULL, NULL, dir, VC_COMMAND_COMMIT, whole, message);
+	else
+	{
+		if (vc->commit_patch(dir, whole, patched, patch, message, &std_err) != 0)
+			dialogs_show_msgbox(GTK_MESSAGE_ERROR, _("Commit failed:\n%s"),
+					    std_err ? std_err : "");
+		tracked_files_changed(vc, dir);
+	}
+	g_free(std_err);
+	g_string_free(patch, TRUE);
+	g_slist_free(whole);
+	g_slist_free(patched);
+}
+
+/* The commit dialog while it is open, its files are updated when the status of
+ * its working copy arrives */
+typedef struct _CommitDialog
+{
+	const VC_RECORD *vc;
+	const gchar *dir;
+	GtkWidget *dialog;
+	GtkTreeView *treeview;
+	CommitDiffs *diffs;
+} CommitDialog;
+
+static CommitDialog *commit_dialog = NULL;
+
+/* List the files to commit from the cached status, telling whether it is being read */
+static void
+commit_dialog_update(CommitDialog * cd)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(cd->treeview);
+	GtkTreeSelection *sel = gtk_tree_view_get_selection(cd->treeview);
+	GtkTreeIter iter;
+	gboolean reading;
+	gboolean valid;
+	gchar *selected = NULL;
+	gchar *path;
+	GSList *lst;
+
+	lst = status_get_commit_files(cd->vc, cd->dir, &reading);
+	gtk_window_set_title(GTK_WINDOW(cd->dialog),
+			     reading ? _("Commit (reading the status...)") : _("Commit"));
+
+	if (gtk_tree_selection_get_selected(sel, NULL, &iter))
+		gtk_tree_model_get(model, &iter, COLUMN_PATH, &selected, -1);
+	update_commit_model(GTK_LIST_STORE(model), lst);
+	free_commit_list(lst);
+
+	/* keep the selected file selected if it is still listed */
+	for (valid = gtk_tree_model_get_iter_first(model, &iter); valid;
+	     valid = gtk_tree_model_iter_next(model, &iter))
+	{
+		gtk_tree_model_get(model, &iter, COLUMN_PATH, &path, -1);
+		if (!selected || utils_str_equal(path, selected))
+		{
+			g_free(path);
+			break;
+		}
+		g_free(path);
+	}
+	if (!valid)
+		valid = gtk_tree_model_get_iter_first(model, &iter);
+	g_free(selected);
+
+	if (valid)
+		gtk_tree_selection_select_iter(sel, &iter);
+	else
+		show_diff_message(cd->diffs,
+				  reading ? _("Reading the status...") : _("Nothing to commit."));
+}
+
+static void
+commit_dialog_status_changed(const VC_RECORD * vc, const gchar * base_dir)
+{
+	if (commit_dialog && commit_dialog->vc == vc && utils_str_equal(commit_dialog->dir, base_dir))
+		commit_dialog_update(commit_dialog);
+}
+
 static void
 vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer gdata)
 {
 	GeanyDocument *doc;
 	gint result;
 	const VC_RECORD *vc;
-	GSList *lst;
 	GtkTreeModel *model;
 	GtkWidget *commit = create_commitDialog();
 	GtkWidget *treeview = ui_lookup_widget(commit, "treeSelect");
@@ -1526,6 +2265,8 @@ vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 
 	GtkTextBuffer *mbuf;
 	GtkTextBuffer *diffbuf;
+	CommitDiffs *diffs;
+	CommitDialog dialog;
 
 	GtkTextIter begin;
 	GtkTextIter end;
@@ -1533,7 +2274,6 @@ vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 
 	gchar *dir;
 	gchar *message;
-	gchar *diff;
 
 	gint height;
 
@@ -1547,24 +2287,18 @@ vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 	g_return_if_fail(doc->file_name);
 	vc = find_vc(doc->file_name);
 	g_return_if_fail(vc);
-	dir = vc->get_base_dir(doc->file_name);
+	dir = resolver_get_base_dir(vc, doc->file_name);
 
-	lst = vc->get_commit_files(dir);
-	if (!lst)
-	{
-		g_free(dir);
-		ui_set_statusbar(FALSE, _("Nothing to commit."));
-		return;
-	}
+	/* the dialog opens with the cached status, the files are updated when it was read */
+	status_read(vc, dir);
 
-	model = create_commit_model(lst);
+	model = create_commit_model(NULL);
 	gtk_tree_view_set_model(GTK_TREE_VIEW(treeview), model);
 	g_object_unref(model);
 
 	/* add columns to the tree view */
 	add_commit_columns(GTK_TREE_VIEW(treeview));
 
-	diff = get_commit_diff(GTK_TREE_VIEW(treeview));
 	diffbuf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(diffView));
 
 	gtk_text_buffer_create_tag(diffbuf, "deleted", "foreground-gdk",
@@ -1576,10 +2310,16 @@ vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 	gtk_text_buffer_create_tag(diffbuf, "default", "foreground-gdk",
 				   get_diff_color(doc, SCE_DIFF_POSITION), NULL);
 
-	gtk_text_buffer_create_tag(diffbuf, "invisible", "invisible",
-				   TRUE, NULL);
-
-	set_diff_buff(diffView, diffbuf, diff);
+	/* the diffs are fetched when their file is selected */
+	diffs = commit_diffs_new(GTK_TEXT_VIEW(diffView));
+	g_object_set_data(G_OBJECT(diffView), "commit_diffs", diffs);
+	dialog.vc = vc;
+	dialog.dir = dir;
+	dialog.dialog = commit;
+	dialog.treeview = GTK_TREE_VIEW(treeview);
+	dialog.diffs = diffs;
+	commit_dialog_update(&dialog);
+	commit_dialog = &dialog;
 
 	if (set_maximize_commit_dialog)
 	{
@@ -1623,6 +2363,7 @@ vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 	gtk_widget_grab_focus(messageView);
 
 	result = gtk_dialog_run(GTK_DIALOG(commit));
+	commit_dialog = NULL;
 	if (result == GTK_RESPONSE_APPLY)
 	{
 		mbuf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(messageView));
@@ -1632,17 +2373,16 @@ vccommit_activated(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer
 		gtk_tree_model_foreach(model, get_commit_files_foreach, &selected_files);
 		if (!EMPTY(message) && selected_files)
 		{
-			execute_command(vc, NULL, NULL, dir, VC_COMMAND_COMMIT, selected_files,
-					message);
+			commit_files(vc, dir, diffs, selected_files, message);
 			free_text_list(selected_files);
 		}
 		g_free(message);
 	}
 
+	g_object_set_data(G_OBJECT(diffView), "commit_diffs", NULL);
+	commit_diffs_free(diffs);
 	gtk_widget_destroy(commit);
-	free_commit_list(lst);
 	g_free(dir);
-	g_free(diff);
 }
 
 static GtkWidget *menu_vc_diff_file = NULL;
@@ -1661,6 +2401,7 @@ static GtkWidget *menu_vc_remove_file = NULL;
 static GtkWidget *menu_vc_update = NULL;
 static GtkWidget *menu_vc_commit = NULL;
 static GtkWidget *menu_vc_show_file = NULL;
+static GtkWidget *menu_vc_cancel = NULL;
 
 static void
 update_menu_items(void)
@@ -1670,8 +2411,12 @@ update_menu_items(void)
 	gboolean have_file;
 	gboolean d_have_vc = FALSE;
 	gboolean f_have_vc = FALSE;
+	gboolean known = FALSE;
 
+	const VC_RECORD *vc;
+	const gchar *status = NULL;
 	gchar *dir;
+	gchar *base_dir;
 
 	doc = document_get_current();
 	have_file = doc && doc->file_name && g_path_is_absolute(doc->file_name);
@@ -1679,10 +2424,22 @@ update_menu_items(void)
 	if (have_file)
 	{
 		dir = g_path_get_dirname(doc->file_name);
-		if (find_cmd_env(VC_COMMAND_DIFF_FILE, TRUE, dir))
+		vc = find_vc(dir);
+		if (vc && vc->commands[VC_COMMAND_DIFF_FILE].command)
+		{
 			d_have_vc = TRUE;
 
-		if (find_cmd_env(VC_COMMAND_DIFF_FILE, TRUE, doc->file_name))
+			/* the status cache knows changed and untracked files without
+			 * asking the backend */
+			base_dir = resolver_get_base_dir(vc, dir);
+			if (base_dir)
+				status = status_get(vc, base_dir, doc->file_name, &known);
+			g_free(base_dir);
+		}
+
+		if (known && status)
+			f_have_vc = status != FILE_STATUS_UNKNOWN;
+		else if (find_cmd_env(VC_COMMAND_DIFF_FILE, TRUE, doc->file_name))
 			f_have_vc = TRUE;
 		g_free(dir);
 	}
@@ -1710,6 +2467,8 @@ update_menu_items(void)
 	gtk_widget_set_sensitive(menu_vc_commit, d_have_vc);
 
 	gtk_widget_set_sensitive(menu_vc_show_file, f_have_vc);
+
+	gtk_widget_set_sensitive(menu_vc_cancel, outputs != NULL);
 }
 
 
@@ -1767,6 +2526,12 @@ kbupdate(G_GNUC_UNUSED guint key_id)
 	vcupdate_activated(NULL, NULL);
 }
 
+static void
+kbcancel(G_GNUC_UNUSED guint key_id)
+{
+	vccancel_activated(NULL, NULL);
+}
+
 
 static struct
 {
@@ -1776,6 +2541,7 @@ static struct
 	GtkWidget *cb_external_diff;
 	GtkWidget *cb_editor_menu_entries;
 	GtkWidget *cb_attach_to_menubar;
+	GtkWidget *cb_status_in_tabs;
 	GtkWidget *cb_cvs;
 	GtkWidget *cb_git;
 	GtkWidget *cb_svn;
@@ -1812,6 +2578,8 @@ on_configure_response(G_GNUC_UNUSED GtkDialog * dialog, gint response,
 			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widgets.cb_editor_menu_entries));
 		set_menubar_entry =
 			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widgets.cb_attach_to_menubar));
+		set_status_in_tabs =
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widgets.cb_status_in_tabs));
 
 		enable_cvs = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widgets.cb_cvs));
 		enable_git = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widgets.cb_git));
@@ -1834,6 +2602,7 @@ on_configure_response(G_GNUC_UNUSED GtkDialog * dialog, gint response,
 				       set_maximize_commit_dialog);
 		g_key_file_set_boolean(config, "VC", "set_editor_menu_entries", set_editor_menu_entries);
 		g_key_file_set_boolean(config, "VC", "attach_to_menubar", set_menubar_entry);
+		g_key_file_set_boolean(config, "VC", "set_status_in_tabs", set_status_in_tabs);
 
 		g_key_file_set_boolean(config, "VC", "enable_cvs", enable_cvs);
 		g_key_file_set_boolean(config, "VC", "enable_git", enable_git);
@@ -1871,6 +2640,7 @@ on_configure_response(G_GNUC_UNUSED GtkDialog * dialog, gint response,
 		g_key_file_free(config);
 
 		registrate();
+		update_all_tab_status();
 	}
 }
 
@@ -1939,6 +2709,17 @@ plugin_configure(GtkDialog * dialog)
 		set_menubar_entry);
 	gtk_box_pack_start(GTK_BOX(vbox), widgets.cb_attach_to_menubar, TRUE, FALSE, 2);
 
+	widgets.cb_status_in_tabs =
+		gtk_check_button_new_with_label(_("Show status of files in document tabs"));
+	ui_widget_set_tooltip_text(widgets.cb_status_in_tabs,
+			     _("Mark modified, added, deleted and untracked files in their "
+			       "document tabs. The status of a working copy is read in the "
+			       "background whenever it changes."));
+	gtk_button_set_focus_on_click(GTK_BUTTON(widgets.cb_status_in_tabs), FALSE);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(widgets.cb_status_in_tabs),
+				     set_status_in_tabs);
+	gtk_box_pack_start(GTK_BOX(vbox), widgets.cb_status_in_tabs, TRUE, FALSE, 2);
+
 	widgets.cb_cvs = gtk_check_button_new_with_label(_("Enable CVS"));
 	gtk_button_set_focus_on_click(GTK_BUTTON(widgets.cb_cvs), FALSE);
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(widgets.cb_cvs), enable_cvs);
@@ -2021,6 +2802,8 @@ load_config(void)
 		TRUE);
 	set_menubar_entry = utils_get_setting_boolean(config, "VC", "attach_to_menubar",
 		FALSE);
+	set_status_in_tabs = utils_get_setting_boolean(config, "VC", "set_status_in_tabs",
+		TRUE);
 
 #ifdef USE_GTKSPELL
 	lang = g_key_file_get_string(config, "VC", "spellchecking_language", &error);
@@ -2051,6 +2834,9 @@ registrate(void)
 	REGISTER_VC(SVK, enable_svk);
 	REGISTER_VC(BZR, enable_bzr);
 	REGISTER_VC(HG, enable_hg);
+	resolver_set_backends(VC);
+	status_clear();
+	status_service_changed(NULL);
 }
 
 static void
@@ -2286,6 +3072,8 @@ init_keybindings(void)
 			     "vc_revert_basedir", _("Revert base directory"), menu_vc_revert_basedir);
 	keybindings_set_item(plugin_key_group, VC_UPDATE, kbupdate, 0, 0, "vc_update",
 			     _("Update file"), menu_vc_update);
+	keybindings_set_item(plugin_key_group, VC_CANCEL, kbcancel, 0, 0, "vc_cancel",
+			     _("Cancel running commands"), menu_vc_cancel);
 }
 
 /* Called by Geany to initialize the plugin */
@@ -2302,8 +3090,14 @@ plugin_init(G_GNUC_UNUSED GeanyData * data)
 		g_strconcat(geany->app->configdir, G_DIR_SEPARATOR_S, "plugins", G_DIR_SEPARATOR_S,
 			    "VC", G_DIR_SEPARATOR_S, "VC.conf", NULL);
 
+	/* the type of the log browser model cannot be unregistered */
+	plugin_module_make_resident(geany_plugin);
+
 	load_config();
+	resolver_init();
+	status_init(on_status_changed);
 	registrate();
+	status_service_init();
 
 	external_diff_viewer_init();
 
@@ -2362,6 +3156,25 @@ plugin_init(G_GNUC_UNUSED GeanyData * data)
 
 	g_signal_connect(menu_vc_commit, "activate", G_CALLBACK(vccommit_activated), NULL);
 
+	gtk_container_add(GTK_CONTAINER(menu_vc_menu), gtk_separator_menu_item_new());
+
+	/* Cancel commands whose output is still arriving */
+	menu_vc_cancel = gtk_menu_item_new_with_mnemonic(_("C_ancel Running Commands"));
+	gtk_container_add(GTK_CONTAINER(menu_vc_menu), menu_vc_cancel);
+	ui_widget_set_tooltip_text(menu_vc_cancel,
+			     _("Stop the commands whose output is still being shown."));
+
+	g_signal_connect(menu_vc_cancel, "activate", G_CALLBACK(vccancel_activated), NULL);
+
+	plugin_signal_connect(geany_plugin, NULL, "document-close", FALSE,
+			      G_CALLBACK(on_document_close), NULL);
+	plugin_signal_connect(geany_plugin, NULL, "document-open", FALSE,
+			      G_CALLBACK(on_document_open), NULL);
+	plugin_signal_connect(geany_plugin, NULL, "document-save", FALSE,
+			      G_CALLBACK(on_document_save), NULL);
+	plugin_signal_connect(geany_plugin, NULL, "editor-notify", FALSE,
+			      G_CALLBACK(on_editor_notify), NULL);
+
 	gtk_widget_show_all(menu_vc);
 
 	/* initialize keybindings */
@@ -2372,6 +3185,9 @@ plugin_init(G_GNUC_UNUSED GeanyData * data)
 
 	ui_add_document_sensitive(menu_vc);
 	menu_entry = menu_vc;
+
+	/* documents opened before the plugin was loaded */
+	update_all_tab_status();
 }
 
 
@@ -2379,9 +3195,19 @@ plugin_init(G_GNUC_UNUSED GeanyData * data)
 void
 plugin_cleanup(void)
 {
+	vc_jobs_cleanup();
 	external_diff_viewer_deinit();
 	remove_menuitems_from_editor_menu();
 	gtk_widget_destroy(menu_entry);
+	remove_all_tab_status();
+	blame_cleanup();
+	logview_cleanup();
+	status_service_cleanup();
+	status_cleanup();
+	resolver_cleanup();
+#ifdef USE_LIBGIT2
+	git2_cleanup();
+#endif
 	g_slist_free(VC);
 	VC = NULL;
 	g_free(config_file);
@@ -52,7 +52,7 @@ enum
 	VC_COMMAND_STARTDIR_FILE
 };
 
-#define COMMIT_DIFF_MAXLENGTH  16384
+#define COMMIT_DIFF_MAXLENGTH  262144
 
 #define FLAG_RELOAD         (1<<0)
 #define FLAG_FORCE_ASK      (1<<1)
@@ -103,14 +103,33 @@ execute_custom_command(const gchar * dir, const gchar ** argv, const gchar ** en
 gboolean find_dir(const gchar * filename, const char *find, gboolean recursive);
 gchar *find_subdir_path(const gchar * filename, const gchar * subdir);
 
+/* returned by the function of a command to have the command run instead */
+#define VC_COMMAND_FALLBACK (-2)
+
 typedef struct _VC_COMMAND
 {
 	gint startdir;
 	const gchar **command;
 	const gchar **env;
+	/* used instead of command, unless it returns VC_COMMAND_FALLBACK without
+	 * touching its output arguments */
 	  gint(*function) (gchar **, gchar **, const gchar *, GSList *, const gchar *);
 } VC_COMMAND;
 
+/* Log browser support of a backend. The commands are run in the base directory,
+ * @path is relative to it and NULL for the whole working copy, the argvs are
+ * in the locale encoding. */
+typedef struct _VC_LOG
+{
+	/* lists at most @count commits touching @path after skipping the @skip
+	 * newest ones, newest first, one line "id TAB date TAB author TAB subject"
+	 * per commit */
+	gchar **(*get_page_argv) (const gchar * path, gint skip, gint count);
+	/* shows commit @id and its changes to @path */
+	gchar **(*get_show_argv) (const gchar * id, const gchar * path);
+	const gchar **env;
+} VC_LOG;
+
 typedef struct _VC_RECORD
 {
 	const VC_COMMAND *commands;
@@ -118,7 +137,26 @@ typedef struct _VC_RECORD
 	gchar *(*get_base_dir) (const gchar * path);
 	/* check if file in VC */
 	gboolean(*in_vc) (const gchar * path);
-	GSList *(*get_commit_files) (const gchar * dir);
+	/* command listing the status of all changed files of a working copy, run in
+	 * its base directory, and the parser storing its output in a table of
+	 * file name -> FILE_STATUS_*, untracked files included */
+	const gchar **status_command;
+	const gchar **status_env;
+	void (*parse_status) (GHashTable * table, const gchar * base_dir, const gchar * txt);
+	/* metadata directories, relative to the directory containing the first one,
+	 * whose changes may change the result of in_vc or get_base_dir */
+	const gchar **meta_dirs;
+	/* NULL if the backend has no log browser */
+	const VC_LOG *log;
+	/* command blaming BASE_FILENAME in the porcelain format of git blame, run in
+	 * the base directory; NULL if the backend cannot annotate documents */
+	const gchar **annotate_command;
+	const gchar **annotate_env;
+	/* commits the whole @files and the hunks of the other @patched files in
+	 * @patch, a diff in the format of VC_COMMAND_DIFF_FILE relative to the base
+	 * directory; NULL if the backend cannot commit parts of files */
+	gint(*commit_patch) (const gchar * base_dir, GSList * files, GSList * patched,
+			     const GString * patch, const gchar * message, gchar ** std_err);
 } VC_RECORD;
 
 typedef struct _CommitItem
@@ -131,7 +169,6 @@ typedef struct _CommitItem
 							if (path) { g_free(path); VC = g_slist_append(VC, &VC_##vc);} }}
 
 /* Blank functions and values */
-GSList *get_commit_files_null(const gchar * dir);
 extern const gchar *NO_ENV[];
 
 /* External diff viewer */
@@ -140,6 +177,80 @@ void external_diff_viewer_deinit(void);
 const gchar *get_external_diff_viewer(void);
 void vc_external_diff(const gchar * src, const gchar * dest);
 
+/* Resolver cache */
+void resolver_init(void);
+void resolver_cleanup(void);
+void resolver_set_backends(GSList * list);
+void resolver_invalidate(void);
+const VC_RECORD *resolver_find_vc(const gchar * path);
+gchar *resolver_get_base_dir(const VC_RECORD * vc, const gchar * path);
+
+/* File status cache */
+typedef void (*VCStatusChangedFunc) (const VC_RECORD * vc, const gchar * base_dir);
+
+void status_init(VCStatusChangedFunc func);
+void status_cleanup(void);
+void status_clear(void);
+void status_refresh(const VC_RECORD * vc, const gchar * base_dir);
+void status_invalidate(const VC_RECORD * vc, const gchar * base_dir);
+void status_metadata_changed(const gchar * root);
+const gchar *status_get(const VC_RECORD * vc, const gchar * base_dir, const gchar * filename,
+			gboolean * known);
+const gchar *status_get_below(const VC_RECORD * vc, const gchar * base_dir, const gchar * dir,
+			      gboolean * known);
+void status_read(const VC_RECORD * vc, const gchar * base_dir);
+GSList *status_get_commit_files(const VC_RECORD * vc, const gchar * base_dir, gboolean * reading);
+
+/* Status service for other plugins */
+#define VC_STATUS_SERVICE_KEY "geanyvc-status-service"
+
+void status_service_init(void);
+void status_service_cleanup(void);
+gboolean status_service_is_used(void);
+void status_service_changed(const gchar * base_dir);
+
+/* Log browser */
+void logview_show(const VC_RECORD * vc, const gchar * base_dir, const gchar * path);
+void logview_cleanup(void);
+
+/* In-editor blame */
+gboolean blame_is_shown(GeanyDocument * doc);
+void blame_start(GeanyDocument * doc, const gchar * dir, GSList * argvs, const gchar ** env);
+void blame_hide(GeanyDocument * doc);
+void blame_editor_notify(GeanyEditor * editor, SCNotification * nt);
+void blame_cleanup(void);
+
+/* Asynchronous commands */
+#define VC_JOB_RAW_OUTPUT   (1<<0)	/* no line ending or encoding conversion */
+
+typedef struct _VCJob VCJob;
+typedef void (*VCJobOutputFunc) (VCJob * job, const gchar * text, gsize len, gpointer user_data);
+typedef void (*VCJobDoneFunc) (VCJob * job, gint exit_code, gboolean cancelled, gpointer user_data);
+
+VCJob *vc_job_start(const gchar * dir, GSList * argvs, const gchar ** env, gint flags,
+		    VCJobOutputFunc output, VCJobDoneFunc done, gpointer user_data,
+		    GDestroyNotify notify);
+void vc_job_cancel(VCJob * job);
+void vc_jobs_cancel_all(void);
+gboolean vc_jobs_running(void);
+void vc_jobs_cleanup(void);
+
+#ifdef USE_LIBGIT2
+/* Git commands through libgit2 */
+gint git2_revert_file(gchar ** std_out, gchar ** std_err, const gchar * filename, GSList * list,
+		      const gchar * message);
+gint git2_revert_dir(gchar ** std_out, gchar ** std_err, const gchar * filename, GSList * list,
+		     const gchar * message);
+gint git2_status(gchar ** std_out, gchar ** std_err, const gchar * filename, GSList * list,
+		 const gchar * message);
+gint git2_add(gchar ** std_out, gchar ** std_err, const gchar * filename, GSList * list,
+	      const gchar * message);
+gint git2_remove(gchar ** std_out, gchar ** std_err, const gchar * filename, GSList * list,
+		 const gchar * message);
+gint git2_show(gchar ** std_out, const gchar * filename);
+void git2_cleanup(void);
+#endif
+
 /* utils.c */
 gchar *normpath(const gchar * filename);
 gchar *get_full_path(const gchar * location, const gchar * path);
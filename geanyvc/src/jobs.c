@@ -0,0 +1,430 @@
+/*
+ *      jobs.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Asynchronous commands. The output of the last command of a spec is read from
+ * the main loop and handed out in chunks of whole lines, with line endings
+ * normalized and converted to UTF-8, while the command is still running. */
+
+#include <string.h>
+#include <glib.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+#ifdef G_OS_WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <signal.h>
+#endif
+
+extern GeanyFunctions *geany_functions;
+
+#define JOB_READ_SIZE 65536
+
+struct _VCJob
+{
+	gchar *dir;
+	GSList *argvs;		/* commands still to run */
+	gchar **env;
+	gint flags;
+
+	GPid pid;
+	gboolean running;
+	guint child_source;
+	GIOChannel *channel;
+	guint out_source;
+	gint exit_code;
+
+	GString *pending;	/* output after the last complete line */
+	gchar *charset;		/* charset of the output if it is not UTF-8 */
+	gboolean cancelled;
+	gboolean dispatching;	/* inside output_func */
+
+	VCJobOutputFunc output_func;
+	VCJobDoneFunc done_func;
+	gpointer user_data;
+	GDestroyNotify notify;
+};
+
+static GSList *jobs = NULL;
+
+static gboolean spawn_next(VCJob * job);
+
+
+static void
+job_free(VCJob * job)
+{
+	GSList *tmp;
+
+	for (tmp = job->argvs; tmp != NULL; tmp = g_slist_next(tmp))
+		g_strfreev(tmp->data);
+	g_slist_free(job->argvs);
+	g_free(job->dir);
+	g_strfreev(job->env);
+	g_string_free(job->pending, TRUE);
+	g_free(job->charset);
+	g_free(job);
+}
+
+static void
+close_output(VCJob * job)
+{
+	if (job->out_source)
+		g_source_remove(job->out_source);
+	job->out_source = 0;
+	if (job->channel)
+		g_io_channel_unref(job->channel);
+	job->channel = NULL;
+}
+
+/* Called once the job is over, whether it finished or was cancelled. */
+static void
+job_done(VCJob * job)
+{
+	jobs = g_slist_remove(jobs, job);
+
+	if (job->done_func)
+		job->done_func(job, job->exit_code, job->cancelled, job->user_data);
+	if (job->notify)
+		job->notify(job->user_data);
+	job->done_func = NULL;
+	job->output_func = NULL;
+	job->notify = NULL;
+
+	/* a cancelled job waits for its process to exit */
+	if (!job->running && !job->dispatching)
+		job_free(job);
+}
+
+/* Replace bytes which are not valid UTF-8 by '?' so that the output can still
+ * be shown if its encoding cannot be guessed. */
+static gchar *
+make_valid_utf8(const gchar * text, gsize len)
+{
+	GString *str = g_string_sized_new(len);
+	const gchar *end;
+
+	while (len > 0)
+	{
+		g_utf8_validate(text, len, &end);
+		g_string_append_len(str, text, end - text);
+		len -= end - text;
+		text = end;
+		if (len > 0)
+		{
+			g_string_append_c(str, '?');
+			text++;
+			len--;
+		}
+	}
+	return g_string_free(str, FALSE);
+}
+
+/* Normalize the line endings of @text and convert it to UTF-8. */
+static gchar *
+convert_output(VCJob * job, const gchar * text, gsize len, gsize * out_len)
+{
+	GString *str;
+	const gchar *p;
+	const gchar *end = text + len;
+	gchar *ret = NULL;
+
+	if (job->flags & VC_JOB_RAW_OUTPUT)
+	{
+		*out_len = len;
+		return g_strndup(text, len);
+	}
+
+	str = g_string_sized_new(len);
+	for (p = text; p < end; p++)
+	{
+		if (*p == '\r')
+		{
+			g_string_append_c(str, '\n');
+			if (p + 1 < end && p[1] == '\n')
+				p++;
+		}
+		else
+			g_string_append_c(str, *p);
+	}
+
+	if (!job->charset && g_utf8_validate(str->str, str->len, NULL))
+	{
+		*out_len = str->len;
+		return g_string_free(str, FALSE);
+	}
+
+	/* keep the encoding guessed for the first chunk which is not UTF-8,
+	 * guessing it again for every chunk could give different results */
+	if (job->charset)
+		ret = encodings_convert_to_utf8_from_charset(str->str, str->len, job->charset, FALSE);
+	if (!ret)
+	{
+		g_free(job->charset);
+		job->charset = NULL;
+		ret = encodings_convert_to_utf8(str->str, str->len, &job->charset);
+	}
+	if (!ret)
+		ret = make_valid_utf8(str->str, str->len);
+	g_string_free(str, TRUE);
+	*out_len = strlen(ret);
+	return ret;
+}
+
+static void
+emit_output(VCJob * job, gboolean flush)
+{
+	gchar *text;
+	gsize len;
+	gchar *nl = NULL;
+
+	if (!job->pending->len)
+		return;
+
+	if (flush)
+		len = job->pending->len;
+	else
+	{
+		nl = g_strrstr_len(job->pending->str, job->pending->len, "\n");
+		if (!nl)
+			return;
+		len = nl - job->pending->str + 1;
+	}
+
+	text = convert_output(job, job->pending->str, len, &len);
+	g_string_erase(job->pending, 0, nl ? (gssize) (nl - job->pending->str + 1) : -1);
+	if (len > 0 && job->output_func)
+		job->output_func(job, text, len, job->user_data);
+	g_free(text);
+}
+
+static gboolean
+on_output(GIOChannel * channel, GIOCondition cond, gpointer data)
+{
+	VCJob *job = data;
+	gchar buf[JOB_READ_SIZE];
+	gsize len = 0;
+	GIOStatus status = G_IO_STATUS_NORMAL;
+	gboolean eof;
+
+	if (cond & (G_IO_IN | G_IO_PRI))
+	{
+		status = g_io_channel_read_chars(channel, buf, sizeof(buf), &len, NULL);
+		g_string_append_len(job->pending, buf, len);
+	}
+	eof = status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR ||
+		(len == 0 && (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)));
+
+	/* the output function may cancel the job */
+	job->dispatching = TRUE;
+	emit_output(job, eof);
+	job->dispatching = FALSE;
+
+	if (job->cancelled)
+	{
+		if (!job->running)
+			job_free(job);
+		return FALSE;
+	}
+	if (eof)
+	{
+		job->out_source = 0;
+		close_output(job);
+		if (!job->running)
+			job_done(job);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+on_child_exit(GPid pid, gint status, gpointer data)
+{
+	VCJob *job = data;
+
+	g_spawn_close_pid(pid);
+	job->running = FALSE;
+	job->child_source = 0;
+
+	if (job->cancelled)
+	{
+		job_free(job);
+		return;
+	}
+
+	job->exit_code = status;
+	if (job->argvs)
+	{
+		if (!spawn_next(job))
+			job_done(job);
+	}
+	else if (!job->channel)
+		job_done(job);
+}
+
+/* Start the next command of the spec. Only the output of the last one is read. */
+static gboolean
+spawn_next(VCJob * job)
+{
+	gchar **argv = job->argvs->data;
+	gboolean last = job->argvs->next == NULL;
+	gint out_fd = -1;
+	GError *error = NULL;
+	gboolean ok;
+
+	job->argvs = g_slist_delete_link(job->argvs, job->argvs);
+
+	ok = g_spawn_async_with_pipes(job->dir, argv, job->env,
+				      G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD |
+				      (last ? 0 : G_SPAWN_STDOUT_TO_DEV_NULL) |
+				      G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL, &job->pid, NULL,
+				      last ? &out_fd : NULL, NULL, &error);
+	g_strfreev(argv);
+	if (!ok)
+	{
+		g_warning("geanyvc: s_spawn_async error: %s", error->message);
+		ui_set_statusbar(FALSE, _("geanyvc: s_spawn_async error: %s"), error->message);
+		g_error_free(error);
+		job->exit_code = -1;
+		return FALSE;
+	}
+
+	job->running = TRUE;
+	job->child_source = g_child_watch_add(job->pid, on_child_exit, job);
+
+	if (last)
+	{
+		job->channel = g_io_channel_unix_new(out_fd);
+		g_io_channel_set_encoding(job->channel, NULL, NULL);
+		g_io_channel_set_buffered(job->channel, FALSE);
+		g_io_channel_set_close_on_unref(job->channel, TRUE);
+		/* below redrawing and input so that the UI stays responsive while
+		 * a command produces lots of output */
+		job->out_source = g_io_add_watch_full(job->channel, G_PRIORITY_DEFAULT_IDLE,
+						      G_IO_IN | G_IO_PRI | G_IO_HUP | G_IO_ERR |
+						      G_IO_NVAL, on_output, job, NULL);
+	}
+	return TRUE;
+}
+
+/*
+ * Run the commands of a spec asynchronously, one after the other
+ *
+ * @dir - start directory of the commands
+ * @argvs - list of commands as returned by get_cmd(), the job takes ownership of it
+ * @env - environment
+ * @flags - VC_JOB_* flags
+ * @output - called with UTF-8 chunks of whole lines of the standard output of the last command
+ * @done - called when the last command exited or the job was cancelled
+ * @user_data - passed to @output and @done
+ * @notify - called on @user_data after @done
+ *
+ * @return - the job, valid until @done was called, or NULL if the first command could not be started
+ */
+VCJob *
+vc_job_start(const gchar * dir, GSList * argvs, const gchar ** env, gint flags,
+	     VCJobOutputFunc output, VCJobDoneFunc done, gpointer user_data, GDestroyNotify notify)
+{
+	VCJob *job;
+
+	g_return_val_if_fail(argvs, NULL);
+
+	job = g_new0(VCJob, 1);
+	job->dir = g_strdup(dir);
+	job->argvs = argvs;
+	job->env = g_strdupv((gchar **) env);
+	job->flags = flags;
+	job->pending = g_string_new(NULL);
+	job->output_func = output;
+	job->done_func = done;
+	job->user_data = user_data;
+	job->notify = notify;
+
+	if (!spawn_next(job))
+	{
+		if (notify)
+			notify(user_data);
+		job_free(job);
+		return NULL;
+	}
+	jobs = g_slist_prepend(jobs, job);
+	return job;
+}
+
+void
+vc_job_cancel(VCJob * job)
+{
+	if (job->cancelled)
+		return;
+
+	job->cancelled = TRUE;
+	close_output(job);
+	if (job->running)
+	{
+#ifdef G_OS_WIN32
+		TerminateProcess(job->pid, 1);
+#else
+		kill(job->pid, SIGTERM);
+#endif
+	}
+	job->exit_code = -1;
+	job_done(job);
+}
+
+void
+vc_jobs_cancel_all(void)
+{
+	while (jobs)
+		vc_job_cancel(jobs->data);
+}
+
+gboolean
+vc_jobs_running(void)
+{
+	return jobs != NULL;
+}
+
+/* Cancel all jobs without waiting for their processes, the plugin is going away. */
+void
+vc_jobs_cleanup(void)
+{
+	VCJob *job;
+	GSList *tmp;
+	GSList *cancelled = NULL;
+
+	while (jobs)
+	{
+		job = jobs->data;
+		if (job->running)
+			cancelled = g_slist_prepend(cancelled, job);
+		vc_job_cancel(job);
+	}
+	for (tmp = cancelled; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		job = tmp->data;
+		g_source_remove(job->child_source);
+		g_spawn_close_pid(job->pid);
+		job_free(job);
+	}
+	g_slist_free(cancelled);
+}
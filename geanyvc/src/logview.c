@@ -0,0 +1,739 @@
+/*
+ *      logview.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Log browser in the message window. The history is read in pages of
+ * LOG_PAGE_SIZE commits in the background, when the rows of a page are shown for
+ * the first time, and only the LOG_MAX_PAGES pages shown last are kept, so that
+ * the memory used does not depend on the length of the history. The changes of
+ * a commit are read when it is selected. */
+
+#include <string.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+extern GeanyData *geany_data;
+extern GeanyFunctions *geany_functions;
+
+#define LOG_PAGE_SIZE 500
+#define LOG_MAX_PAGES 8
+#define LOG_SHORT_ID_LENGTH 8
+
+enum
+{
+	LOG_COLUMN_ID,
+	LOG_COLUMN_SHORT_ID,
+	LOG_COLUMN_DATE,
+	LOG_COLUMN_AUTHOR,
+	LOG_COLUMN_SUBJECT,
+	LOG_N_COLUMNS
+};
+
+typedef struct _VCLogCommit
+{
+	/* pointing into the text of the page */
+	const gchar *id;
+	const gchar *date;
+	const gchar *author;
+	const gchar *subject;
+} VCLogCommit;
+
+typedef struct _VCLogPage
+{
+	gint index;
+	gchar *text;
+	VCLogCommit *commits;
+	gint count;
+	GList *lru_link;
+} VCLogPage;
+
+#define VC_TYPE_LOG_MODEL (vc_log_model_get_type())
+#define VC_LOG_MODEL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), VC_TYPE_LOG_MODEL, VCLogModel))
+
+typedef struct _VCLogModel
+{
+	GObject parent;
+
+	gint stamp;
+	const VC_RECORD *vc;
+	gchar *base_dir;
+	gchar *path;		/* relative to base_dir, NULL for the whole working copy */
+
+	gint n_rows;		/* commits known to exist */
+	gboolean complete;	/* the end of the history has been read */
+	GHashTable *pages;	/* page index -> VCLogPage */
+	GQueue *lru;		/* pages, shown last first */
+	GSList *wanted;		/* indexes of the pages to read, wanted last first */
+
+	VCJob *job;
+	gint job_page;
+	GString *output;
+} VCLogModel;
+
+typedef struct _VCLogModelClass
+{
+	GObjectClass parent_class;
+} VCLogModelClass;
+
+typedef struct _VCLogView
+{
+	GtkWidget *page;
+	GtkWidget *label;
+	GtkWidget *tree;
+	GtkWidget *diff_view;
+	VCLogModel *model;
+
+	VCJob *diff_job;
+	gchar *diff_id;
+	gsize diff_len;
+} VCLogView;
+
+static VCLogView *view = NULL;
+
+static void vc_log_model_tree_model_init(GtkTreeModelIface * iface);
+
+G_DEFINE_TYPE_WITH_CODE(VCLogModel, vc_log_model, G_TYPE_OBJECT,
+			G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, vc_log_model_tree_model_init))
+
+
+static void
+page_free(gpointer data)
+{
+	VCLogPage *page = data;
+
+	g_free(page->commits);
+	g_free(page->text);
+	g_free(page);
+}
+
+/* Parse the lines "id TAB date TAB author TAB subject" of @text in place. */
+static VCLogPage *
+page_new(gint index, gchar * text)
+{
+	VCLogPage *page = g_new0(VCLogPage, 1);
+	VCLogCommit *commit;
+	gchar *line;
+	gchar *next;
+	gchar *fields[3];
+	gint lines = 0;
+	gint i;
+
+	page->index = index;
+	page->text = text;
+	for (line = text; *line; line++)
+	{
+		if (*line == '\n')
+			lines++;
+	}
+	page->commits = g_new(VCLogCommit, lines + 1);
+
+	for (line = text; *line; line = next)
+	{
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		fields[0] = strchr(line, '\t');
+		for (i = 1; i < 3 && fields[i - 1]; i++)
+			fields[i] = strchr(fields[i - 1] + 1, '\t');
+		if (i < 3 || !fields[2])
+			continue;
+
+		commit = &page->commits[page->count++];
+		commit->id = line;
+		for (i = 0; i < 3; i++)
+			*fields[i]++ = '\0';
+		commit->date = fields[0];
+		commit->author = fields[1];
+		commit->subject = fields[2];
+	}
+	return page;
+}
+
+static void fetch_next_page(VCLogModel * model);
+
+static void
+on_page_output(G_GNUC_UNUSED VCJob * job, const gchar * text, gsize len, gpointer data)
+{
+	VCLogModel *model = data;
+
+	g_string_append_len(model->output, text, len);
+}
+
+static void
+add_page(VCLogModel * model, VCLogPage * page)
+{
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	VCLogPage *old;
+	gint first = page->index * LOG_PAGE_SIZE;
+	gint row;
+
+	g_hash_table_insert(model->pages, GINT_TO_POINTER(page->index), page);
+	g_queue_push_head(model->lru, page);
+	page->lru_link = g_queue_peek_head_link(model->lru);
+
+	while (g_queue_get_length(model->lru) > LOG_MAX_PAGES)
+	{
+		old = g_queue_pop_tail(model->lru);
+		g_hash_table_remove(model->pages, GINT_TO_POINTER(old->index));
+	}
+
+	if (first + page->count >= model->n_rows && page->count < LOG_PAGE_SIZE)
+		model->complete = TRUE;
+
+	/* rows shown before their page was read */
+	for (row = first; row < MIN(model->n_rows, first + page->count); row++)
+	{
+		iter.stamp = model->stamp;
+		iter.user_data = GINT_TO_POINTER(row);
+		path = gtk_tree_path_new_from_indices(row, -1);
+		gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+		gtk_tree_path_free(path);
+	}
+	/* rows which were not known yet */
+	while (model->n_rows < first + page->count)
+	{
+		iter.stamp = model->stamp;
+		iter.user_data = GINT_TO_POINTER(model->n_rows);
+		path = gtk_tree_path_new_from_indices(model->n_rows, -1);
+		model->n_rows++;
+		gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+		gtk_tree_path_free(path);
+	}
+}
+
+static void
+on_page_done(G_GNUC_UNUSED VCJob * job, gint exit_code, gboolean cancelled, gpointer data)
+{
+	VCLogModel *model = data;
+	gchar *text;
+
+	model->job = NULL;
+	if (cancelled)
+	{
+		g_string_truncate(model->output, 0);
+		return;
+	}
+
+	text = g_strndup(model->output->str, model->output->len);
+	g_string_truncate(model->output, 0);
+	if (exit_code == 0)
+		add_page(model, page_new(model->job_page, text));
+	else
+	{
+		/* do not read further than a page which could not be read */
+		g_free(text);
+		model->complete = TRUE;
+	}
+	fetch_next_page(model);
+}
+
+static void
+fetch_next_page(VCLogModel * model)
+{
+	gchar **argv;
+	gint index;
+
+	while (!model->job && model->wanted)
+	{
+		index = GPOINTER_TO_INT(model->wanted->data);
+		model->wanted = g_slist_delete_link(model->wanted, model->wanted);
+		if (g_hash_table_lookup(model->pages, GINT_TO_POINTER(index)))
+			continue;
+		if (model->complete && index * LOG_PAGE_SIZE >= model->n_rows)
+			continue;
+
+		argv = model->vc->log->get_page_argv(model->path, index * LOG_PAGE_SIZE, LOG_PAGE_SIZE);
+		model->job_page = index;
+		model->job = vc_job_start(model->base_dir, g_slist_prepend(NULL, argv),
+					  model->vc->log->env, 0, on_page_output, on_page_done, model,
+					  NULL);
+		if (!model->job)
+		{
+			g_slist_free(model->wanted);
+			model->wanted = NULL;
+			model->complete = TRUE;
+		}
+	}
+}
+
+static void
+request_page(VCLogModel * model, gint index)
+{
+	GSList *last;
+
+	if ((model->job && model->job_page == index) ||
+	    g_slist_find(model->wanted, GINT_TO_POINTER(index)))
+		return;
+
+	/* pages which were scrolled past are not needed anymore */
+	model->wanted = g_slist_prepend(model->wanted, GINT_TO_POINTER(index));
+	last = g_slist_nth(model->wanted, LOG_MAX_PAGES - 1);
+	if (last)
+	{
+		g_slist_free(last->next);
+		last->next = NULL;
+	}
+	fetch_next_page(model);
+}
+
+/* Get the page containing @row, reading it if it is not known. */
+static VCLogPage *
+get_page(VCLogModel * model, gint row)
+{
+	VCLogPage *page;
+	gint index = row / LOG_PAGE_SIZE;
+
+	/* the rows after the last one known are read once it is shown */
+	if (!model->complete && index == (model->n_rows - 1) / LOG_PAGE_SIZE)
+		request_page(model, index + 1);
+
+	page = g_hash_table_lookup(model->pages, GINT_TO_POINTER(index));
+	if (!page)
+	{
+		request_page(model, index);
+		return NULL;
+	}
+	g_queue_unlink(model->lru, page->lru_link);
+	g_queue_push_head_link(model->lru, page->lru_link);
+	return page;
+}
+
+static GtkTreeModelFlags
+log_model_get_flags(G_GNUC_UNUSED GtkTreeModel * tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+log_model_get_n_columns(G_GNUC_UNUSED GtkTreeModel * tree_model)
+{
+	return LOG_N_COLUMNS;
+}
+
+static GType
+log_model_get_column_type(G_GNUC_UNUSED GtkTreeModel * tree_model, G_GNUC_UNUSED gint index)
+{
+	return G_TYPE_STRING;
+}
+
+static gboolean
+set_iter(VCLogModel * model, GtkTreeIter * iter, gint row)
+{
+	if (row < 0 || row >= model->n_rows)
+		return FALSE;
+	iter->stamp = model->stamp;
+	iter->user_data = GINT_TO_POINTER(row);
+	return TRUE;
+}
+
+static gboolean
+log_model_get_iter(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreePath * path)
+{
+	if (gtk_tree_path_get_depth(path) != 1)
+		return FALSE;
+	return set_iter(VC_LOG_MODEL(tree_model), iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *
+log_model_get_path(G_GNUC_UNUSED GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+static void
+log_model_get_value(GtkTreeModel * tree_model, GtkTreeIter * iter, gint column, GValue * value)
+{
+	VCLogModel *model = VC_LOG_MODEL(tree_model);
+	gint row = GPOINTER_TO_INT(iter->user_data);
+	VCLogPage *page = get_page(model, row);
+	VCLogCommit *commit;
+
+	g_value_init(value, G_TYPE_STRING);
+	if (!page || row % LOG_PAGE_SIZE >= page->count)
+	{
+		if (!page && column == LOG_COLUMN_SUBJECT)
+			g_value_set_static_string(value, _("Loading..."));
+		return;
+	}
+
+	commit = &page->commits[row % LOG_PAGE_SIZE];
+	switch (column)
+	{
+		case LOG_COLUMN_ID:
+			g_value_set_string(value, commit->id);
+			break;
+		case LOG_COLUMN_SHORT_ID:
+			g_value_take_string(value, g_strndup(commit->id, LOG_SHORT_ID_LENGTH));
+			break;
+		case LOG_COLUMN_DATE:
+			g_value_set_string(value, commit->date);
+			break;
+		case LOG_COLUMN_AUTHOR:
+			g_value_set_string(value, commit->author);
+			break;
+		case LOG_COLUMN_SUBJECT:
+			g_value_set_string(value, commit->subject);
+			break;
+	}
+}
+
+static gboolean
+log_model_iter_next(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	return set_iter(VC_LOG_MODEL(tree_model), iter, GPOINTER_TO_INT(iter->user_data) + 1);
+}
+
+static gboolean
+log_model_iter_nth_child(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreeIter * parent,
+			 gint n)
+{
+	if (parent)
+		return FALSE;
+	return set_iter(VC_LOG_MODEL(tree_model), iter, n);
+}
+
+static gboolean
+log_model_iter_children(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreeIter * parent)
+{
+	return log_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean
+log_model_iter_has_child(G_GNUC_UNUSED GtkTreeModel * tree_model, G_GNUC_UNUSED GtkTreeIter * iter)
+{
+	return FALSE;
+}
+
+static gint
+log_model_iter_n_children(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	return iter ? 0 : VC_LOG_MODEL(tree_model)->n_rows;
+}
+
+static gboolean
+log_model_iter_parent(G_GNUC_UNUSED GtkTreeModel * tree_model, G_GNUC_UNUSED GtkTreeIter * iter,
+		      G_GNUC_UNUSED GtkTreeIter * child)
+{
+	return FALSE;
+}
+
+static void
+vc_log_model_tree_model_init(GtkTreeModelIface * iface)
+{
+	iface->get_flags = log_model_get_flags;
+	iface->get_n_columns = log_model_get_n_columns;
+	iface->get_column_type = log_model_get_column_type;
+	iface->get_iter = log_model_get_iter;
+	iface->get_path = log_model_get_path;
+	iface->get_value = log_model_get_value;
+	iface->iter_next = log_model_iter_next;
+	iface->iter_children = log_model_iter_children;
+	iface->iter_has_child = log_model_iter_has_child;
+	iface->iter_n_children = log_model_iter_n_children;
+	iface->iter_nth_child = log_model_iter_nth_child;
+	iface->iter_parent = log_model_iter_parent;
+}
+
+static void
+vc_log_model_finalize(GObject * object)
+{
+	VCLogModel *model = VC_LOG_MODEL(object);
+
+	if (model->job)
+		vc_job_cancel(model->job);
+	g_slist_free(model->wanted);
+	g_queue_free(model->lru);
+	g_hash_table_destroy(model->pages);
+	g_string_free(model->output, TRUE);
+	g_free(model->base_dir);
+	g_free(model->path);
+
+	G_OBJECT_CLASS(vc_log_model_parent_class)->finalize(object);
+}
+
+static void
+vc_log_model_class_init(VCLogModelClass * klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = vc_log_model_finalize;
+}
+
+static void
+vc_log_model_init(VCLogModel * model)
+{
+	do
+	{
+		model->stamp = g_random_int();
+	}
+	while (model->stamp == 0);
+	model->pages = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, page_free);
+	model->lru = g_queue_new();
+	model->output = g_string_new(NULL);
+}
+
+static VCLogModel *
+log_model_new(const VC_RECORD * vc, const gchar * base_dir, const gchar * path)
+{
+	VCLogModel *model = g_object_new(VC_TYPE_LOG_MODEL, NULL);
+
+	model->vc = vc;
+	model->base_dir = g_strdup(base_dir);
+	model->path = g_strdup(path);
+	request_page(model, 0);
+	return model;
+}
+
+
+static void
+set_diff_text(const gchar * text)
+{
+	gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(view->diff_view)), text, -1);
+}
+
+static void
+on_diff_output(VCJob * job, const gchar * text, gsize len, G_GNUC_UNUSED gpointer data)
+{
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(view->diff_view));
+	GtkTextIter end;
+
+	if (view->diff_len == 0)
+		set_diff_text("");
+	gtk_text_buffer_get_end_iter(buffer, &end);
+	if (view->diff_len + len > COMMIT_DIFF_MAXLENGTH)
+	{
+		gtk_text_buffer_insert(buffer, &end,
+				       _("\n[The rest of the changes is too big to be shown.]\n"), -1);
+		vc_job_cancel(job);
+		return;
+	}
+	gtk_text_buffer_insert(buffer, &end, text, len);
+	view->diff_len += len;
+}
+
+static void
+on_diff_done(G_GNUC_UNUSED VCJob * job, gint exit_code, gboolean cancelled,
+	     G_GNUC_UNUSED gpointer data)
+{
+	view->diff_job = NULL;
+	if (!cancelled && view->diff_len == 0)
+		set_diff_text(exit_code == 0 ? _("No changes.") : "");
+}
+
+static void
+cancel_diff(void)
+{
+	if (view->diff_job)
+		vc_job_cancel(view->diff_job);
+	view->diff_len = 0;
+	setptr(view->diff_id, NULL);
+}
+
+static void
+show_commit(gchar * id)
+{
+	VCLogModel *model = view->model;
+	gchar **argv;
+
+	cancel_diff();
+	view->diff_id = id;
+	set_diff_text(_("Loading..."));
+
+	argv = model->vc->log->get_show_argv(id, model->path);
+	view->diff_job = vc_job_start(model->base_dir, g_slist_prepend(NULL, argv),
+				      model->vc->log->env, 0, on_diff_output, on_diff_done, NULL,
+				      NULL);
+	if (!view->diff_job)
+		set_diff_text("");
+}
+
+static void
+on_selection_changed(GtkTreeSelection * selection, G_GNUC_UNUSED gpointer data)
+{
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	gchar *id = NULL;
+
+	if (gtk_tree_selection_get_selected(selection, &model, &iter))
+		gtk_tree_model_get(model, &iter, LOG_COLUMN_ID, &id, -1);
+
+	/* a row whose page has not been read yet is selected again once it is */
+	if (EMPTY(id) || utils_str_equal(id, view->diff_id))
+	{
+		g_free(id);
+		return;
+	}
+	show_commit(id);
+}
+
+static void
+on_row_changed(GtkTreeModel * model, G_GNUC_UNUSED GtkTreePath * path, GtkTreeIter * iter,
+	       G_GNUC_UNUSED gpointer data)
+{
+	GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(view->tree));
+
+	if (gtk_tree_selection_iter_is_selected(selection, iter) && !view->diff_id &&
+	    model == GTK_TREE_MODEL(view->model))
+		on_selection_changed(selection, NULL);
+}
+
+static void
+set_model(const VC_RECORD * vc, const gchar * base_dir, const gchar * path)
+{
+	VCLogModel *model = log_model_new(vc, base_dir, path);
+	gchar *title;
+
+	cancel_diff();
+	set_diff_text("");
+
+	title = g_strdup_printf(_("History of %s"), path ? path : base_dir);
+	gtk_label_set_text(GTK_LABEL(view->label), title);
+	g_free(title);
+
+	g_signal_connect(model, "row-changed", G_CALLBACK(on_row_changed), NULL);
+	gtk_tree_view_set_model(GTK_TREE_VIEW(view->tree), GTK_TREE_MODEL(model));
+	if (view->model)
+		g_object_unref(view->model);
+	view->model = model;
+}
+
+static void
+on_refresh_clicked(G_GNUC_UNUSED GtkButton * button, G_GNUC_UNUSED gpointer data)
+{
+	gchar *base_dir = g_strdup(view->model->base_dir);
+	gchar *path = g_strdup(view->model->path);
+
+	set_model(view->model->vc, base_dir, path);
+	g_free(base_dir);
+	g_free(path);
+}
+
+static void
+add_column(const gchar * title, gint column, gint width, gboolean expand)
+{
+	GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+	GtkTreeViewColumn *col;
+
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+	col = gtk_tree_view_column_new_with_attributes(title, renderer, "text", column, NULL);
+	/* fixed sizes, otherwise the view asks for every row and so reads the
+	 * whole history */
+	gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width(col, width);
+	gtk_tree_view_column_set_resizable(col, TRUE);
+	gtk_tree_view_column_set_expand(col, expand);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(view->tree), col);
+}
+
+static void
+create_view(void)
+{
+	GtkWidget *hbox;
+	GtkWidget *button;
+	GtkWidget *paned;
+	GtkWidget *scrolled;
+	PangoFontDescription *font;
+
+	view = g_new0(VCLogView, 1);
+	view->page = gtk_vbox_new(FALSE, 0);
+
+	hbox = gtk_hbox_new(FALSE, 6);
+	view->label = gtk_label_new(NULL);
+	gtk_misc_set_alignment(GTK_MISC(view->label), 0, 0.5);
+	gtk_label_set_ellipsize(GTK_LABEL(view->label), PANGO_ELLIPSIZE_START);
+	gtk_box_pack_start(GTK_BOX(hbox), view->label, TRUE, TRUE, 0);
+	button = gtk_button_new_from_stock(GTK_STOCK_REFRESH);
+	gtk_button_set_relief(GTK_BUTTON(button), GTK_RELIEF_NONE);
+	g_signal_connect(button, "clicked", G_CALLBACK(on_refresh_clicked), NULL);
+	gtk_box_pack_start(GTK_BOX(hbox), button, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(view->page), hbox, FALSE, FALSE, 0);
+
+	paned = gtk_hpaned_new();
+	gtk_box_pack_start(GTK_BOX(view->page), paned, TRUE, TRUE, 0);
+
+	view->tree = gtk_tree_view_new();
+	gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(view->tree), TRUE);
+	add_column(_("Commit"), LOG_COLUMN_SHORT_ID, 80, FALSE);
+	add_column(_("Date"), LOG_COLUMN_DATE, 150, FALSE);
+	add_column(_("Author"), LOG_COLUMN_AUTHOR, 150, FALSE);
+	add_column(_("Subject"), LOG_COLUMN_SUBJECT, 300, TRUE);
+	g_signal_connect(gtk_tree_view_get_selection(GTK_TREE_VIEW(view->tree)), "changed",
+			 G_CALLBACK(on_selection_changed), NULL);
+
+	scrolled = gtk_scrolled_window_new(NULL, NULL);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC,
+				       GTK_POLICY_AUTOMATIC);
+	gtk_container_add(GTK_CONTAINER(scrolled), view->tree);
+	gtk_paned_pack1(GTK_PANED(paned), scrolled, TRUE, FALSE);
+
+	view->diff_view = gtk_text_view_new();
+	gtk_text_view_set_editable(GTK_TEXT_VIEW(view->diff_view), FALSE);
+	font = pango_font_description_from_string(geany->interface_prefs->editor_font);
+	gtk_widget_modify_font(view->diff_view, font);
+	pango_font_description_free(font);
+
+	scrolled = gtk_scrolled_window_new(NULL, NULL);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC,
+				       GTK_POLICY_AUTOMATIC);
+	gtk_container_add(GTK_CONTAINER(scrolled), view->diff_view);
+	gtk_paned_pack2(GTK_PANED(paned), scrolled, TRUE, FALSE);
+
+	gtk_widget_show_all(view->page);
+	gtk_notebook_append_page(GTK_NOTEBOOK(geany->main_widgets->message_window_notebook),
+				 view->page, gtk_label_new(_("VC Log")));
+}
+
+/*
+ * Show the history in the log browser
+ *
+ * @vc - backend of the working copy, with log browser support
+ * @base_dir - base directory of the working copy
+ * @path - file or directory relative to @base_dir, NULL for the whole working copy
+ */
+void
+logview_show(const VC_RECORD * vc, const gchar * base_dir, const gchar * path)
+{
+	GtkNotebook *notebook = GTK_NOTEBOOK(geany->main_widgets->message_window_notebook);
+
+	g_return_if_fail(vc->log && base_dir);
+
+	if (!view)
+		create_view();
+	set_model(vc, base_dir, path);
+	gtk_notebook_set_current_page(notebook, gtk_notebook_page_num(notebook, view->page));
+}
+
+void
+logview_cleanup(void)
+{
+	if (!view)
+		return;
+
+	cancel_diff();
+	gtk_widget_destroy(view->page);
+	if (view->model)
+		g_object_unref(view->model);
+	g_free(view);
+	view = NULL;
+}
@@ -0,0 +1,303 @@
+/*
+ *
+ *  Copyright 2008 Yura Siamashka <yurand2@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Splits the unified diff of one file into hunks and builds the patch of the
+ * selected ones, for the partial commits of the commit dialog. It works on the
+ * raw bytes of the diff so the patch applies whatever the line endings and the
+ * encoding of the file. */
+
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "patch.h"
+
+
+/* parses "@@ -a[,b] +c[,d] @@" at @p, returns the offset of the text following it */
+static const gchar *
+parse_hunk_header(const gchar * p, VCDiffHunk * hunk)
+{
+	gchar *end;
+
+	if (strncmp(p, "@@ -", 4) != 0)
+		return NULL;
+	p += 4;
+	hunk->old_start = strtol(p, &end, 10);
+	if (end == p)
+		return NULL;
+	hunk->old_count = 1;
+	if (*end == ',')
+		hunk->old_count = strtol(end + 1, &end, 10);
+	if (strncmp(end, " +", 2) != 0)
+		return NULL;
+	p = end + 2;
+	hunk->new_start = strtol(p, &end, 10);
+	if (end == p)
+		return NULL;
+	hunk->new_count = 1;
+	if (*end == ',')
+		hunk->new_count = strtol(end + 1, &end, 10);
+	if (strncmp(end, " @@", 3) != 0 || hunk->old_count < 0 || hunk->new_count < 0)
+		return NULL;
+	return end + 3;
+}
+
+
+static gsize
+next_line(const gchar * text, gsize len, gsize pos)
+{
+	const gchar *nl = memchr(text + pos, '\n', len - pos);
+	return nl ? (gsize) (nl - text) + 1 : len;
+}
+
+
+/*
+ * Parses the unified diff of a single file.
+ * @param text - the diff, as output by the VC
+ * @param len - its length
+ * Returns NULL if it has no hunks, e.g. binary files, or if it changes more than
+ * one file. Free it with diff_hunks_free().
+ */
+VCDiffHunks *
+diff_hunks_parse(const gchar * text, gsize len)
+{
+	VCDiffHunks *hunks;
+	VCDiffHunk hunk;
+	gsize pos = 0;
+	gboolean in_header = TRUE;
+
+	g_return_val_if_fail(text != NULL, NULL);
+
+	hunks = g_new0(VCDiffHunks, 1);
+	hunks->text = g_strndup(text, len);
+	hunks->len = len;
+	hunks->hunks = g_array_new(FALSE, FALSE, sizeof(VCDiffHunk));
+	text = hunks->text;
+
+	while (pos < len)
+	{
+		gint old_left, new_left;
+
+		if (!parse_hunk_header(text + pos, &hunk))
+		{
+			/* only a new file header can follow the last hunk */
+			if (!in_header)
+				goto fail;
+			pos = next_line(text, len, pos);
+			continue;
+		}
+		if (in_header)
+		{
+			hunks->header_end = pos;
+			in_header = FALSE;
+		}
+
+		hunk.start = pos;
+		hunk.selected = TRUE;
+		pos = next_line(text, len, pos);
+		hunk.body = pos;
+
+		/* the counts tell where the hunk ends, "\ No newline" markers included */
+		old_left = hunk.old_count;
+		new_left = hunk.new_count;
+		while (pos < len && (old_left > 0 || new_left > 0 || text[pos] == '\\'))
+		{
+			switch (text[pos])
+			{
+				case ' ':
+				case '\r':
+				case '\n':
+					old_left--;
+					new_left--;
+					break;
+				case '-':
+					old_left--;
+					break;
+				case '+':
+					new_left--;
+					break;
+				case '\\':
+					break;
+				default:
+					goto fail;
+			}
+			pos = next_line(text, len, pos);
+		}
+		if (old_left != 0 || new_left != 0)
+			goto fail;
+		hunk.end = pos;
+		g_array_append_val(hunks->hunks, hunk);
+	}
+
+	if (hunks->hunks->len > 0)
+		return hunks;
+      fail:
+	diff_hunks_free(hunks);
+	return NULL;
+}
+
+
+void
+diff_hunks_free(VCDiffHunks * hunks)
+{
+	if (!hunks)
+		return;
+	g_array_free(hunks->hunks, TRUE);
+	g_free(hunks->text);
+	g_free(hunks);
+}
+
+
+guint
+diff_hunks_count_selected(const VCDiffHunks * hunks)
+{
+	guint i, selected = 0;
+
+	for (i = 0; i < hunks->hunks->len; i++)
+	{
+		if (g_array_index(hunks->hunks, VCDiffHunk, i).selected)
+			selected++;
+	}
+	return selected;
+}
+
+
+/*
+ * Appends the patch of the selected hunks to @patch. The new line numbers of
+ * the hunks following unselected ones are shifted back by the lines those would
+ * have added, so the patch applies cleanly to the old file.
+ * Returns FALSE if no hunk is selected.
+ */
+gboolean
+diff_hunks_append_patch(const VCDiffHunks * hunks, GString * patch)
+{
+	guint i;
+	gint shift = 0;
+	gboolean found = FALSE;
+
+	for (i = 0; i < hunks->hunks->len; i++)
+	{
+		VCDiffHunk *hunk = &g_array_index(hunks->hunks, VCDiffHunk, i);
+		VCDiffHunk tmp;
+		const gchar *rest;
+
+		if (!hunk->selected)
+		{
+			shift += hunk->new_count - hunk->old_count;
+			continue;
+		}
+		if (!found)
+		{
+			g_string_append_len(patch, hunks->text, hunks->header_end);
+			found = TRUE;
+		}
+		/* keep the function context after the line numbers */
+		rest = parse_hunk_header(hunks->text + hunk->start, &tmp);
+		g_string_append_printf(patch, "@@ -%d,%d +%d,%d @@", hunk->old_start,
+				       hunk->old_count, hunk->new_start - shift, hunk->new_count);
+		g_string_append_len(patch, rest, hunks->text + hunk->end - rest);
+	}
+	return found;
+}
+
+#ifdef UNITTESTS
+#include <check.h>
+
+static const gchar test_diff[] =
+	"diff --git a/f.c b/f.c\n"
+	"--- a/f.c\n"
+	"+++ b/f.c\n"
+	"@@ -1,3 +1,4 @@\n"
+	" a\n"
+	"+b\n"
+	" c\n"
+	" d\n"
+	"@@ -10,2 +11,2 @@ main\n"
+	"-x\r\n"
+	"+y\r\n"
+	" z\n"
+	"\\ No newline at end of file\n";
+
+START_TEST(test_diff_hunks_parse)
+{
+	VCDiffHunks *hunks = diff_hunks_parse(test_diff, strlen(test_diff));
+	VCDiffHunk *hunk;
+
+	fail_unless(hunks != NULL, "the diff has hunks\n");
+	fail_unless(hunks->hunks->len == 2, "expected: 2 hunks, get %u\n", hunks->hunks->len);
+	hunk = &g_array_index(hunks->hunks, VCDiffHunk, 1);
+	fail_unless(hunk->start == (gsize) (strstr(test_diff, "@@ -10") - test_diff), "wrong hunk start\n");
+	fail_unless(hunk->old_start == 10 && hunk->new_start == 11, "wrong hunk header\n");
+	fail_unless(hunk->end == strlen(test_diff), "the marker belongs to the last hunk\n");
+	fail_unless(diff_hunks_count_selected(hunks) == 2, "all hunks are selected at first\n");
+	diff_hunks_free(hunks);
+
+	fail_unless(diff_hunks_parse("Binary files differ\n", 20) == NULL, "no hunks\n");
+}
+
+END_TEST;
+
+START_TEST(test_diff_hunks_append_patch)
+{
+	VCDiffHunks *hunks = diff_hunks_parse(test_diff, strlen(test_diff));
+	GString *patch = g_string_new(NULL);
+
+	g_array_index(hunks->hunks, VCDiffHunk, 0).selected = FALSE;
+	fail_unless(diff_hunks_count_selected(hunks) == 1, "one hunk is unselected\n");
+	fail_unless(diff_hunks_append_patch(hunks, patch), "one hunk is selected\n");
+	fail_unless(strcmp(patch->str,
+			   "diff --git a/f.c b/f.c\n"
+			   "--- a/f.c\n"
+			   "+++ b/f.c\n"
+			   "@@ -10,2 +10,2 @@ main\n"
+			   "-x\r\n"
+			   "+y\r\n"
+			   " z\n" "\\ No newline at end of file\n") == 0, "get \"%s\"\n", patch->str);
+
+	g_array_index(hunks->hunks, VCDiffHunk, 1).selected = FALSE;
+	fail_unless(!diff_hunks_append_patch(hunks, patch), "no hunk is selected\n");
+	g_string_free(patch, TRUE);
+	diff_hunks_free(hunks);
+}
+
+END_TEST;
+
+START_TEST(test_diff_hunks_parse_several_files)
+{
+	static const gchar diff[] =
+		"--- a/f.c\n+++ b/f.c\n@@ -1 +1 @@\n-a\n+b\n"
+		"--- a/g.c\n+++ b/g.c\n@@ -1 +1 @@\n-a\n+b\n";
+
+	fail_unless(diff_hunks_parse(diff, strlen(diff)) == NULL, "the diff changes two files\n");
+}
+
+END_TEST;
+
+
+TCase *
+patch_test_case_create(void)
+{
+	TCase *tc_patch = tcase_create("patch");
+	tcase_add_test(tc_patch, test_diff_hunks_parse);
+	tcase_add_test(tc_patch, test_diff_hunks_append_patch);
+	tcase_add_test(tc_patch, test_diff_hunks_parse_several_files);
+	return tc_patch;
+}
+
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ *
+ *  Copyright 2008 Yura Siamashka <yurand2@gmail.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEANYVC_PATCH__
+#define __GEANYVC_PATCH__
+
+/* Hunk of the unified diff of a file */
+typedef struct _VCDiffHunk
+{
+	gsize start;		/* offset of the header */
+	gsize body;		/* offset of the line after the header */
+	gsize end;		/* offset after its last line */
+	gint old_start;
+	gint old_count;
+	gint new_start;
+	gint new_count;
+	gboolean selected;
+} VCDiffHunk;
+
+typedef struct _VCDiffHunks
+{
+	gchar *text;
+	gsize len;
+	gsize header_end;	/* the lines before the first hunk */
+	GArray *hunks;		/* VCDiffHunk, all selected at first */
+} VCDiffHunks;
+
+VCDiffHunks *diff_hunks_parse(const gchar * text, gsize len);
+void diff_hunks_free(VCDiffHunks * hunks);
+guint diff_hunks_count_selected(const VCDiffHunks * hunks);
+gboolean diff_hunks_append_patch(const VCDiffHunks * hunks, GString * patch);
+
+#endif
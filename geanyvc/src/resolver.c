@@ -0,0 +1,391 @@
+/*
+ *      resolver.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Cache of which backend handles a directory, its base directory and whether
+ * files in it are under version control. Asking the backends is expensive:
+ * they stat every parent directory and most of them spawn a process per file.
+ * Entries are dropped when the metadata directory of their working copy
+ * changes. Directories outside of any working copy, and working copies whose
+ * metadata cannot be monitored, are only trusted for RESOLVER_TTL seconds. */
+
+#include <string.h>
+#include <time.h>
+#include <gio/gio.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+extern GeanyFunctions *geany_functions;
+
+#define RESOLVER_TTL 10
+
+typedef struct _VCWatch
+{
+	gchar *path;		/* metadata directory, e.g. /home/user/project/.git */
+	gchar *root;		/* directory containing it */
+	GSList *monitors;
+} VCWatch;
+
+typedef struct _VCCandidate
+{
+	const VC_RECORD *vc;
+	VCWatch *watch;		/* NULL if the metadata is not monitored */
+	GHashTable *tracked;	/* file name -> GINT_TO_POINTER(in_vc() + 1) */
+	GHashTable *base_dirs;	/* path -> base directory */
+} VCCandidate;
+
+typedef struct _VCDirEntry
+{
+	/* backends which claim the directory, in registration order */
+	GSList *candidates;
+	gboolean monitored;
+	time_t stamp;
+} VCDirEntry;
+
+static GSList *backends = NULL;
+static GHashTable *dirs = NULL;
+static GHashTable *watches = NULL;
+
+
+static void
+watch_free(gpointer data)
+{
+	VCWatch *watch = data;
+	GSList *tmp;
+
+	for (tmp = watch->monitors; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		g_file_monitor_cancel(tmp->data);
+		g_object_unref(tmp->data);
+	}
+	g_slist_free(watch->monitors);
+	g_free(watch->path);
+	g_free(watch->root);
+	g_free(watch);
+}
+
+static void
+dir_entry_free(gpointer data)
+{
+	VCDirEntry *entry = data;
+	VCCandidate *cand;
+	GSList *tmp;
+
+	for (tmp = entry->candidates; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		cand = tmp->data;
+		g_hash_table_destroy(cand->tracked);
+		g_hash_table_destroy(cand->base_dirs);
+		g_free(cand);
+	}
+	g_slist_free(entry->candidates);
+	g_free(entry);
+}
+
+static gboolean
+dir_entry_uses_watch(G_GNUC_UNUSED gpointer key, gpointer value, gpointer watch)
+{
+	VCDirEntry *entry = value;
+	GSList *tmp;
+
+	for (tmp = entry->candidates; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		if (((VCCandidate *) tmp->data)->watch == watch)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+on_metadata_changed(G_GNUC_UNUSED GFileMonitor * monitor, G_GNUC_UNUSED GFile * file,
+		    G_GNUC_UNUSED GFile * other_file, GFileMonitorEvent event_type, gpointer data)
+{
+	VCWatch *watch = data;
+
+	if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED ||
+	    event_type == G_FILE_MONITOR_EVENT_PRE_UNMOUNT)
+		return;
+
+	g_hash_table_foreach_remove(dirs, dir_entry_uses_watch, watch);
+	status_metadata_changed(watch->root);
+
+	/* a monitor on a removed directory would never fire again */
+	if (event_type == G_FILE_MONITOR_EVENT_DELETED &&
+	    !g_file_test(watch->path, G_FILE_TEST_IS_DIR))
+	{
+		g_hash_table_remove(watches, watch->path);
+	}
+}
+
+/* Monitor the metadata directories of the working copy of @dir. */
+static VCWatch *
+get_watch(const VC_RECORD * vc, const gchar * dir)
+{
+	VCWatch *watch;
+	GFileMonitor *monitor;
+	GFile *file;
+	gchar *root;
+	gchar *path;
+	gchar *locale_path;
+	gint i;
+
+	if (!vc->meta_dirs)
+		return NULL;
+
+	root = find_subdir_path(dir, vc->meta_dirs[0]);
+	if (!root)
+		return NULL;
+
+	path = g_build_filename(root, vc->meta_dirs[0], NULL);
+	watch = g_hash_table_lookup(watches, path);
+	if (watch)
+	{
+		g_free(path);
+		g_free(root);
+		return watch;
+	}
+
+	watch = g_new0(VCWatch, 1);
+	watch->path = path;
+	watch->root = g_strdup(root);
+	for (i = 0; vc->meta_dirs[i]; i++)
+	{
+		path = g_build_filename(root, vc->meta_dirs[i], NULL);
+		locale_path = utils_get_locale_from_utf8(path);
+		file = g_file_new_for_path(locale_path);
+		monitor = NULL;
+		if (i == 0 || g_file_test(locale_path, G_FILE_TEST_IS_DIR))
+			monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+		if (monitor)
+		{
+			g_signal_connect(monitor, "changed", G_CALLBACK(on_metadata_changed), watch);
+			watch->monitors = g_slist_prepend(watch->monitors, monitor);
+		}
+		g_object_unref(file);
+		g_free(locale_path);
+		g_free(path);
+
+		if (i == 0 && !monitor)
+		{
+			watch_free(watch);
+			g_free(root);
+			return NULL;
+		}
+	}
+	g_hash_table_insert(watches, watch->path, watch);
+	g_free(root);
+	return watch;
+}
+
+/* Return the cached entry for @dir, dropping it if it is too old to trust. */
+static VCDirEntry *
+peek_dir_entry(const gchar * dir)
+{
+	VCDirEntry *entry = g_hash_table_lookup(dirs, dir);
+
+	if (entry && !entry->monitored && time(NULL) - entry->stamp > RESOLVER_TTL)
+	{
+		g_hash_table_remove(dirs, dir);
+		entry = NULL;
+	}
+	return entry;
+}
+
+static VCDirEntry *
+get_dir_entry(const gchar * dir)
+{
+	VCDirEntry *entry = peek_dir_entry(dir);
+	VCCandidate *cand;
+	const VC_RECORD *vc;
+	GSList *tmp;
+
+	if (entry)
+		return entry;
+
+	entry = g_new0(VCDirEntry, 1);
+	entry->monitored = TRUE;
+	entry->stamp = time(NULL);
+
+	for (tmp = backends; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		vc = tmp->data;
+		if (!vc->in_vc(dir))
+			continue;
+
+		cand = g_new0(VCCandidate, 1);
+		cand->vc = vc;
+		cand->watch = get_watch(vc, dir);
+		cand->tracked = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		cand->base_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+		if (!cand->watch)
+			entry->monitored = FALSE;
+		entry->candidates = g_slist_append(entry->candidates, cand);
+	}
+	/* nothing tells us when a working copy is created around the directory */
+	if (!entry->candidates)
+		entry->monitored = FALSE;
+
+	g_hash_table_insert(dirs, g_strdup(dir), entry);
+	return entry;
+}
+
+static gboolean
+is_known_file(VCDirEntry * entry, const gchar * path)
+{
+	GSList *tmp;
+
+	for (tmp = entry->candidates; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		if (g_hash_table_lookup(((VCCandidate *) tmp->data)->tracked, path))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* Find the entry of @path if it is a directory or of its parent otherwise. */
+static VCDirEntry *
+resolve_dir_entry(const gchar * path, gboolean * is_dir)
+{
+	VCDirEntry *entry;
+	gchar *dir;
+
+	entry = peek_dir_entry(path);
+	if (entry)
+	{
+		*is_dir = TRUE;
+		return entry;
+	}
+
+	dir = g_path_get_dirname(path);
+	entry = peek_dir_entry(dir);
+	if (!(entry && is_known_file(entry, path)) && g_file_test(path, G_FILE_TEST_IS_DIR))
+	{
+		g_free(dir);
+		*is_dir = TRUE;
+		return get_dir_entry(path);
+	}
+
+	if (!entry)
+		entry = get_dir_entry(dir);
+	g_free(dir);
+	*is_dir = FALSE;
+	return entry;
+}
+
+static gboolean
+candidate_in_vc(VCCandidate * cand, const gchar * path)
+{
+	gpointer value = g_hash_table_lookup(cand->tracked, path);
+
+	if (!value)
+	{
+		value = GINT_TO_POINTER(cand->vc->in_vc(path) + 1);
+		g_hash_table_insert(cand->tracked, g_strdup(path), value);
+	}
+	return GPOINTER_TO_INT(value) - 1;
+}
+
+const VC_RECORD *
+resolver_find_vc(const gchar * path)
+{
+	VCDirEntry *entry;
+	VCCandidate *cand;
+	GSList *tmp;
+	gboolean is_dir;
+
+	if (!path)
+		return NULL;
+
+	entry = resolve_dir_entry(path, &is_dir);
+	for (tmp = entry->candidates; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		cand = tmp->data;
+		if (is_dir || candidate_in_vc(cand, path))
+			return cand->vc;
+	}
+	return NULL;
+}
+
+gchar *
+resolver_get_base_dir(const VC_RECORD * vc, const gchar * path)
+{
+	VCDirEntry *entry;
+	VCCandidate *cand;
+	GSList *tmp;
+	gchar *base;
+	gboolean is_dir;
+
+	g_return_val_if_fail(vc && path, NULL);
+
+	entry = resolve_dir_entry(path, &is_dir);
+	for (tmp = entry->candidates; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		cand = tmp->data;
+		if (cand->vc != vc)
+			continue;
+
+		if (!g_hash_table_lookup_extended(cand->base_dirs, path, NULL, (gpointer *) & base))
+		{
+			base = vc->get_base_dir(path);
+			g_hash_table_insert(cand->base_dirs, g_strdup(path), base);
+		}
+		return g_strdup(base);
+	}
+	return vc->get_base_dir(path);
+}
+
+/* Forget everything known about directories, e.g. after running a command which
+ * changes what is under version control. */
+void
+resolver_invalidate(void)
+{
+	if (dirs)
+		g_hash_table_remove_all(dirs);
+}
+
+void
+resolver_set_backends(GSList * list)
+{
+	backends = list;
+	if (dirs)
+	{
+		g_hash_table_remove_all(dirs);
+		g_hash_table_remove_all(watches);
+	}
+}
+
+void
+resolver_init(void)
+{
+	dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, dir_entry_free);
+	watches = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, watch_free);
+}
+
+void
+resolver_cleanup(void)
+{
+	g_hash_table_destroy(dirs);
+	g_hash_table_destroy(watches);
+	dirs = NULL;
+	watches = NULL;
+	backends = NULL;
+}
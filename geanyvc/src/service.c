@@ -0,0 +1,165 @@
+/*
+ *      service.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* File status of the status cache for other plugins, e.g. to decorate the files
+ * of a tree view. The service is an object stored in the data of the main window
+ * under VC_STATUS_SERVICE_KEY while geanyvc is loaded, and its signals are the
+ * whole interface, so that plugins need not link to geanyvc:
+ *
+ * "status-changed" (const gchar *base_dir): the status of the working copy at
+ *   base_dir was read again, base_dir is NULL if all statuses were forgotten.
+ * "get-status" (const gchar *path) -> gchar *: action signal returning the status
+ *   of the file or directory at path, "Modified", "Added", "Deleted" or "Unknown"
+ *   for untracked files, or NULL if it has no changes or its status is not known
+ *   yet. The status is read in the background then and "status-changed" follows.
+ *   A directory is "Modified" if files below it are changed. Free it with g_free().
+ *
+ * GObject *vc = g_object_get_data(G_OBJECT(geany->main_widgets->window),
+ *                                 "geanyvc-status-service");
+ * plugin_signal_connect(plugin, vc, "status-changed", FALSE, G_CALLBACK(cb), NULL);
+ * g_signal_emit_by_name(vc, "get-status", path, &status);
+ *
+ * The object is destroyed when geanyvc is unloaded, users should hold a weak
+ * reference to it. */
+
+#include <string.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+extern GeanyData *geany_data;
+extern GeanyFunctions *geany_functions;
+
+#define VC_TYPE_STATUS_SERVICE (vc_status_service_get_type())
+
+typedef struct _VCStatusService
+{
+	GObject parent;
+} VCStatusService;
+
+typedef struct _VCStatusServiceClass
+{
+	GObjectClass parent_class;
+
+	gchar *(*get_status) (VCStatusService * service, const gchar * path);
+} VCStatusServiceClass;
+
+enum
+{
+	SIGNAL_STATUS_CHANGED,
+	SIGNAL_GET_STATUS,
+	SIGNAL_COUNT
+};
+
+static guint signals[SIGNAL_COUNT];
+static VCStatusService *service = NULL;
+
+G_DEFINE_TYPE(VCStatusService, vc_status_service, G_TYPE_OBJECT)
+
+
+static gchar *
+service_get_status(G_GNUC_UNUSED VCStatusService * self, const gchar * path)
+{
+	const VC_RECORD *vc;
+	const gchar *status = NULL;
+	gboolean known = FALSE;
+	gchar *dir;
+	gchar *base_dir;
+
+	if (!path || !g_path_is_absolute(path))
+		return NULL;
+
+	/* The backend is resolved for the directory only: asking it about each file
+	 * would spawn a process per file not seen yet, while the status of the whole
+	 * working copy, untracked files included, is read at once anyway. */
+	if (g_file_test(path, G_FILE_TEST_IS_DIR))
+		dir = g_strdup(path);
+	else
+		dir = g_path_get_dirname(path);
+	vc = resolver_find_vc(dir);
+	base_dir = vc ? resolver_get_base_dir(vc, dir) : NULL;
+	if (base_dir)
+	{
+		status = status_get(vc, base_dir, path, &known);
+		if (!status && known)
+			status = status_get_below(vc, base_dir, path, &known);
+	}
+	g_free(base_dir);
+	g_free(dir);
+	return g_strdup(status);
+}
+
+static void
+vc_status_service_class_init(VCStatusServiceClass * klass)
+{
+	klass->get_status = service_get_status;
+
+	signals[SIGNAL_STATUS_CHANGED] = g_signal_new("status-changed",
+						      G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+						      0, NULL, NULL,
+						      g_cclosure_marshal_VOID__STRING,
+						      G_TYPE_NONE, 1, G_TYPE_STRING);
+	signals[SIGNAL_GET_STATUS] = g_signal_new("get-status",
+						  G_TYPE_FROM_CLASS(klass),
+						  G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+						  G_STRUCT_OFFSET(VCStatusServiceClass, get_status),
+						  g_signal_accumulator_first_wins, NULL, NULL,
+						  G_TYPE_STRING, 1, G_TYPE_STRING);
+}
+
+static void
+vc_status_service_init(G_GNUC_UNUSED VCStatusService * self)
+{
+}
+
+void
+status_service_init(void)
+{
+	service = g_object_new(VC_TYPE_STATUS_SERVICE, NULL);
+	g_object_set_data_full(G_OBJECT(geany->main_widgets->window), VC_STATUS_SERVICE_KEY,
+			       service, g_object_unref);
+}
+
+void
+status_service_cleanup(void)
+{
+	/* drops the last reference */
+	g_object_set_data(G_OBJECT(geany->main_widgets->window), VC_STATUS_SERVICE_KEY, NULL);
+	service = NULL;
+}
+
+/* whether a plugin listens to the service, whose statuses must then be kept current */
+gboolean
+status_service_is_used(void)
+{
+	return service && g_signal_has_handler_pending(service, signals[SIGNAL_STATUS_CHANGED],
+						       0, FALSE);
+}
+
+/* Tell the plugins that the status of the working copy at @base_dir, or of all
+ * working copies if it is NULL, was read again. */
+void
+status_service_changed(const gchar * base_dir)
+{
+	if (service)
+		g_signal_emit(service, signals[SIGNAL_STATUS_CHANGED], 0, base_dir);
+}
@@ -0,0 +1,441 @@
+/*
+ *      status.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Status of the changed files of each working copy, from one status command per
+ * working copy run in the background. Refreshes requested in a row, e.g. by the
+ * metadata monitors of the resolver, are coalesced into one command. */
+
+#include <string.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+extern GeanyFunctions *geany_functions;
+
+/* milliseconds to wait for more changes before running the status command */
+#define STATUS_REFRESH_DELAY 500
+
+typedef struct _VCRepoStatus
+{
+	const VC_RECORD *vc;
+	gchar *base_dir;
+	GHashTable *files;	/* file name -> FILE_STATUS_*, NULL until the first status arrived */
+	gboolean current;	/* no change since files was read */
+	gboolean rerun;		/* changed while the command was running */
+	guint refresh_source;
+	VCJob *job;
+	GString *output;
+} VCRepoStatus;
+
+static GHashTable *repos = NULL;
+static VCStatusChangedFunc changed_func = NULL;
+
+static void start_refresh(VCRepoStatus * repo);
+
+
+static gchar *
+get_repo_key(const VC_RECORD * vc, const gchar * base_dir)
+{
+	return g_strconcat(vc->program, ":", base_dir, NULL);
+}
+
+static void
+repo_free(gpointer data)
+{
+	VCRepoStatus *repo = data;
+
+	if (repo->refresh_source)
+		g_source_remove(repo->refresh_source);
+	if (repo->job)
+		vc_job_cancel(repo->job);
+	if (repo->files)
+		g_hash_table_destroy(repo->files);
+	g_string_free(repo->output, TRUE);
+	g_free(repo->base_dir);
+	g_free(repo);
+}
+
+static GHashTable *
+new_file_table(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+static void
+on_status_output(G_GNUC_UNUSED VCJob * job, const gchar * text, gsize len, gpointer data)
+{
+	VCRepoStatus *repo = data;
+
+	g_string_append_len(repo->output, text, len);
+}
+
+static void
+on_status_done(G_GNUC_UNUSED VCJob * job, gint exit_code, gboolean cancelled, gpointer data)
+{
+	VCRepoStatus *repo = data;
+
+	repo->job = NULL;
+	if (cancelled || exit_code != 0)
+	{
+		/* keep what was known before, it is still better than nothing, but
+		 * do not retry until something changes */
+		g_string_truncate(repo->output, 0);
+		repo->rerun = FALSE;
+		if (!repo->files)
+			repo->files = new_file_table();
+		if (changed_func)
+			changed_func(repo->vc, repo->base_dir);
+		return;
+	}
+
+	if (repo->files)
+		g_hash_table_destroy(repo->files);
+	repo->files = new_file_table();
+	repo->vc->parse_status(repo->files, repo->base_dir, repo->output->str);
+	g_string_truncate(repo->output, 0);
+
+	if (repo->rerun)
+	{
+		repo->rerun = FALSE;
+		start_refresh(repo);
+	}
+	else if (!repo->refresh_source)
+		repo->current = TRUE;
+
+	if (changed_func)
+		changed_func(repo->vc, repo->base_dir);
+}
+
+static void
+start_refresh(VCRepoStatus * repo)
+{
+	GSList *argvs;
+
+	if (repo->job)
+	{
+		repo->rerun = TRUE;
+		return;
+	}
+
+	argvs = g_slist_prepend(NULL, g_strdupv((gchar **) repo->vc->status_command));
+	repo->job = vc_job_start(repo->base_dir, argvs, repo->vc->status_env, 0,
+				 on_status_output, on_status_done, repo, NULL);
+}
+
+static gboolean
+on_refresh_timeout(gpointer data)
+{
+	VCRepoStatus *repo = data;
+
+	repo->refresh_source = 0;
+	start_refresh(repo);
+	return FALSE;
+}
+
+static VCRepoStatus *
+get_repo(const VC_RECORD * vc, const gchar * base_dir, gboolean create)
+{
+	VCRepoStatus *repo;
+	gchar *key = get_repo_key(vc, base_dir);
+
+	repo = g_hash_table_lookup(repos, key);
+	if (repo || !create)
+	{
+		g_free(key);
+		return repo;
+	}
+
+	repo = g_new0(VCRepoStatus, 1);
+	repo->vc = vc;
+	repo->base_dir = g_strdup(base_dir);
+	repo->output = g_string_new(NULL);
+	g_hash_table_insert(repos, key, repo);
+	return repo;
+}
+
+static void
+schedule_refresh(VCRepoStatus * repo)
+{
+	repo->current = FALSE;
+	if (!repo->refresh_source)
+		repo->refresh_source = g_timeout_add(STATUS_REFRESH_DELAY, on_refresh_timeout, repo);
+}
+
+/*
+ * Read the status of the working copy again, in the background
+ *
+ * @vc - backend of the working copy
+ * @base_dir - base directory of the working copy
+ */
+void
+status_refresh(const VC_RECORD * vc, const gchar * base_dir)
+{
+	g_return_if_fail(vc && base_dir);
+
+	if (!repos || !vc->status_command)
+		return;
+	schedule_refresh(get_repo(vc, base_dir, TRUE));
+}
+
+/*
+ * Mark the status of the working copy as outdated without reading it again. It is
+ * read the next time it is asked for.
+ *
+ * @vc - backend of the working copy
+ * @base_dir - base directory of the working copy
+ */
+void
+status_invalidate(const VC_RECORD * vc, const gchar * base_dir)
+{
+	VCRepoStatus *repo;
+
+	g_return_if_fail(vc && base_dir);
+
+	if (!repos || !vc->status_command)
+		return;
+	repo = get_repo(vc, base_dir, FALSE);
+	if (repo)
+		repo->current = FALSE;
+}
+
+/* Answer from the cached status, but read it again if it is outdated. */
+static gboolean
+check_current(VCRepoStatus * repo)
+{
+	if (!repo->current && !repo->job && !repo->refresh_source)
+		start_refresh(repo);
+	return repo->files != NULL;
+}
+
+static gboolean
+is_same_or_below(const gchar * path, const gchar * dir)
+{
+	gsize len = strlen(dir);
+
+	return strncmp(path, dir, len) == 0 &&
+		(path[len] == '\0' || G_IS_DIR_SEPARATOR(path[len]));
+}
+
+/* Refresh the working copies using the metadata of the working copy at @root. */
+void
+status_metadata_changed(const gchar * root)
+{
+	GHashTableIter iter;
+	VCRepoStatus *repo;
+
+	if (!repos)
+		return;
+
+	g_hash_table_iter_init(&iter, repos);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & repo))
+	{
+		if (is_same_or_below(repo->base_dir, root) || is_same_or_below(root, repo->base_dir))
+			schedule_refresh(repo);
+	}
+}
+
+/*
+ * Get the cached status of a file
+ *
+ * @vc - backend of the working copy
+ * @base_dir - base directory of the working copy
+ * @filename - file name
+ * @known - set to FALSE if the status of the working copy is not known yet, it is
+ *  read in the background then
+ *
+ * @return - one of FILE_STATUS_*, or NULL if the file has no changes
+ */
+const gchar *
+status_get(const VC_RECORD * vc, const gchar * base_dir, const gchar * filename,
+	   gboolean * known)
+{
+	VCRepoStatus *repo;
+	const gchar *status;
+	gchar *dir;
+	gchar *parent;
+	gsize base_len = strlen(base_dir);
+
+	*known = FALSE;
+	if (!repos || !vc->status_command)
+		return NULL;
+
+	repo = get_repo(vc, base_dir, TRUE);
+	if (!check_current(repo))
+		return NULL;
+
+	*known = TRUE;
+	status = g_hash_table_lookup(repo->files, filename);
+	if (status)
+		return status;
+
+	/* some backends list an untracked directory instead of the files in it */
+	dir = g_path_get_dirname(filename);
+	while (strlen(dir) > base_len)
+	{
+		if (g_hash_table_lookup(repo->files, dir) == FILE_STATUS_UNKNOWN)
+		{
+			status = FILE_STATUS_UNKNOWN;
+			break;
+		}
+		parent = g_path_get_dirname(dir);
+		if (strcmp(parent, dir) == 0)
+		{
+			g_free(parent);
+			break;
+		}
+		setptr(dir, parent);
+	}
+	g_free(dir);
+	return status;
+}
+
+/*
+ * Get the cached status of the files below a directory, like status_get()
+ *
+ * @dir - directory of the working copy
+ *
+ * @return - FILE_STATUS_MODIFIED if a file below @dir has changes, untracked
+ *  files ignored, or NULL
+ */
+const gchar *
+status_get_below(const VC_RECORD * vc, const gchar * base_dir, const gchar * dir,
+		 gboolean * known)
+{
+	VCRepoStatus *repo;
+	GHashTableIter iter;
+	const gchar *filename;
+	const gchar *status;
+
+	*known = FALSE;
+	if (!repos || !vc->status_command)
+		return NULL;
+
+	repo = get_repo(vc, base_dir, TRUE);
+	if (!check_current(repo))
+		return NULL;
+
+	*known = TRUE;
+	g_hash_table_iter_init(&iter, repo->files);
+	while (g_hash_table_iter_next(&iter, (gpointer *) & filename, (gpointer *) & status))
+	{
+		if (status != FILE_STATUS_UNKNOWN && is_same_or_below(filename, dir))
+			return FILE_STATUS_MODIFIED;
+	}
+	return NULL;
+}
+
+static gint
+compare_commit_items(gconstpointer a, gconstpointer b)
+{
+	return strcmp(((const CommitItem *) a)->path, ((const CommitItem *) b)->path);
+}
+
+/*
+ * Read the status of the working copy at once, in the background, as only the
+ * metadata of the working copies is monitored, not the files themselves
+ *
+ * @vc - backend of the working copy
+ * @base_dir - base directory of the working copy
+ */
+void
+status_read(const VC_RECORD * vc, const gchar * base_dir)
+{
+	VCRepoStatus *repo;
+
+	g_return_if_fail(vc && base_dir);
+
+	if (!repos || !vc->status_command)
+		return;
+	repo = get_repo(vc, base_dir, TRUE);
+	if (repo->refresh_source)
+	{
+		g_source_remove(repo->refresh_source);
+		repo->refresh_source = 0;
+	}
+	repo->current = FALSE;
+	start_refresh(repo);
+}
+
+/*
+ * Get the files to offer for a commit from the cached status, see status_read()
+ *
+ * @reading - set to TRUE if the status is being read, the changed function is
+ *  called when it arrived
+ *
+ * @return - list of CommitItem, sorted by path
+ */
+GSList *
+status_get_commit_files(const VC_RECORD * vc, const gchar * base_dir, gboolean * reading)
+{
+	VCRepoStatus *repo;
+	GHashTableIter iter;
+	gchar *filename;
+	const gchar *status;
+	CommitItem *item;
+	GSList *ret = NULL;
+
+	*reading = FALSE;
+	g_return_val_if_fail(repos && vc->status_command, NULL);
+
+	repo = get_repo(vc, base_dir, TRUE);
+	*reading = repo->job || repo->refresh_source;
+	if (!repo->files)
+		return NULL;
+
+	g_hash_table_iter_init(&iter, repo->files);
+	while (g_hash_table_iter_next(&iter, (gpointer *) & filename, (gpointer *) & status))
+	{
+		if (status == FILE_STATUS_UNKNOWN)
+			continue;
+		item = g_new(CommitItem, 1);
+		item->status = status;
+		item->path = g_strdup(filename);
+		ret = g_slist_prepend(ret, item);
+	}
+	return g_slist_sort(ret, compare_commit_items);
+}
+
+/* Forget the status of all working copies, e.g. when the backends changed. */
+void
+status_clear(void)
+{
+	if (repos)
+		g_hash_table_remove_all(repos);
+}
+
+/*
+ * @func - called when the status of a working copy was read, or reading it failed
+ */
+void
+status_init(VCStatusChangedFunc func)
+{
+	repos = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, repo_free);
+	changed_func = func;
+}
+
+void
+status_cleanup(void)
+{
+	changed_func = NULL;
+	g_hash_table_destroy(repos);
+	repos = NULL;
+}
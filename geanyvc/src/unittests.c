@@ -1,12 +1,657 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <check.h>
 #include <string.h>
 
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
 #include <gtk/gtk.h>
-#include "geany.h"
+#include <glib/gstdio.h>
+#include <geanyplugin.h>
+#include "geanyvc.h"
+
+/* Geany is not running, so the plugin is linked with replacements of the few
+ * functions of Geany used by the tested code */
+#undef utils_get_locale_from_utf8
+#undef utils_string_replace_all
+#undef utils_spawn_sync
+#undef utils_str_equal
+#undef ui_set_statusbar
+#undef encodings_convert_to_utf8
+
+/* files committed to the test repositories, and then changed */
+#define TEST_FILES 2000
+#define TEST_UNTRACKED_FILES 100
+#define TEST_DIRS 20
+/* seconds a status parser may need for the files of a test repository */
+#define TEST_MAX_PARSE_TIME 1.0
+/* runs of each command compared between git and libgit2 */
+#define TEST_GIT2_RUNS 20
 
 extern TCase *utils_test_case_create(void);
+extern TCase *patch_test_case_create(void);
+
+extern VC_RECORD VC_GIT;
+extern VC_RECORD VC_HG;
+extern VC_RECORD VC_SVN;
+extern VC_RECORD VC_BZR;
+
+static UtilsFuncs test_utils_funcs;
+static UIUtilsFuncs test_ui_funcs;
+static EncodingFuncs test_encoding_funcs;
+static GeanyFunctions test_functions;
+
+
+static gchar *
+test_get_locale_from_utf8(const gchar * utf8_text)
+{
+	return g_strdup(utf8_text);
+}
+
+static guint
+test_string_replace_all(GString * haystack, const gchar * needle, const gchar * replace)
+{
+	gchar **parts = g_strsplit(haystack->str, needle, -1);
+	guint count = g_strv_length(parts) - 1;
+	gchar *joined = g_strjoinv(replace, parts);
+
+	g_string_assign(haystack, joined);
+	g_free(joined);
+	g_strfreev(parts);
+	return count;
+}
+
+static gboolean
+test_spawn_sync(const gchar * dir, gchar ** argv, gchar ** env, GSpawnFlags flags,
+		GSpawnChildSetupFunc child_setup, gpointer user_data, gchar ** std_out,
+		gchar ** std_err, gint * exit_status, GError ** error)
+{
+	return g_spawn_sync(dir, argv, env, flags, child_setup, user_data, std_out, std_err,
+			    exit_status, error);
+}
+
+static gboolean
+test_str_equal(const gchar * a, const gchar * b)
+{
+	return g_strcmp0(a, b) == 0;
+}
+
+static void
+test_set_statusbar(G_GNUC_UNUSED gboolean log, const gchar * format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	g_logv(G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE, format, args);
+	va_end(args);
+}
+
+static gchar *
+test_convert_to_utf8(const gchar * buffer, gssize size, gchar ** used_encoding)
+{
+	if (used_encoding)
+		*used_encoding = NULL;
+	return g_convert(buffer, size, "UTF-8", "ISO-8859-1", NULL, NULL, NULL);
+}
+
+static void
+geany_functions_setup(void)
+{
+	test_utils_funcs.utils_get_locale_from_utf8 = test_get_locale_from_utf8;
+	test_utils_funcs.utils_string_replace_all = test_string_replace_all;
+	test_utils_funcs.utils_spawn_sync = test_spawn_sync;
+	test_utils_funcs.utils_str_equal = test_str_equal;
+	test_ui_funcs.ui_set_statusbar = test_set_statusbar;
+	test_encoding_funcs.encodings_convert_to_utf8 = test_convert_to_utf8;
+	test_functions.p_utils = &test_utils_funcs;
+	test_functions.p_ui = &test_ui_funcs;
+	test_functions.p_encodings = &test_encoding_funcs;
+	geany_functions = &test_functions;
+
+	/* identity of the commits of the test repositories */
+	g_setenv("BZR_EMAIL", "geanyvc <geanyvc@localhost>", TRUE);
+}
+
+
+/* Status parsers */
+
+typedef struct _ParserTest
+{
+	VC_RECORD *vc;
+	/* status line of a modified file, formatted with a directory and a file number */
+	const gchar *line_format;
+} ParserTest;
+
+static const ParserTest parser_tests[] = {
+	{&VC_GIT, " M d%02d/f%05d.txt\n"},
+	{&VC_HG, "M d%02d/f%05d.txt\n"},
+	{&VC_SVN, "M       d%02d/f%05d.txt\n"},
+	{&VC_BZR, " M  d%02d/f%05d.txt\n"},
+};
+
+/* Best time of a few runs of the status parser of @test for @count changed files */
+static gdouble
+time_parse_status(const ParserTest * test, gint count)
+{
+	GString *txt = g_string_new(NULL);
+	GHashTable *table;
+	GTimer *timer = g_timer_new();
+	gdouble best = G_MAXDOUBLE;
+	gint i;
+
+	for (i = 0; i < count; i++)
+		g_string_append_printf(txt, test->line_format, i % TEST_DIRS, i);
+
+	for (i = 0; i < 3; i++)
+	{
+		table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		g_timer_start(timer);
+		test->vc->parse_status(table, "/wc", txt->str);
+		best = MIN(best, g_timer_elapsed(timer, NULL));
+		fail_unless(g_hash_table_size(table) == (guint) count,
+			    "%s: expected %d files, get %u", test->vc->program, count,
+			    g_hash_table_size(table));
+		fail_unless(g_hash_table_lookup(table, "/wc/d01/f00001.txt") == FILE_STATUS_MODIFIED,
+			    "%s: d01/f00001.txt is not modified", test->vc->program);
+		g_hash_table_destroy(table);
+	}
+	g_timer_destroy(timer);
+	g_string_free(txt, TRUE);
+	return best;
+}
+
+START_TEST(test_parse_status_scaling)
+{
+	const gint count = 10000;
+	gsize i;
+	gdouble small, big;
+
+	for (i = 0; i < G_N_ELEMENTS(parser_tests); i++)
+	{
+		small = time_parse_status(&parser_tests[i], count);
+		big = time_parse_status(&parser_tests[i], count * 8);
+		printf("%s: status of %d files parsed in %.4f s, of %d files in %.4f s\n",
+		       parser_tests[i].vc->program, count, small, count * 8, big);
+		/* linear would be 8 times slower, quadratic 64 times */
+		fail_unless(big < 32 * MAX(small, 0.01), "%s: parsing the status is not linear",
+			    parser_tests[i].vc->program);
+	}
+}
+
+END_TEST;
+
+
+/* Backends against real repositories */
+
+typedef struct _BackendTest
+{
+	VC_RECORD *vc;
+	/* programs needed by the test, besides vc->program */
+	const gchar *tools[2];
+	/* run in the temporary directory, where they create the working copy "wc";
+	 * "@ROOT@" is replaced by the temporary directory */
+	const gchar *init[2][8];
+	/* run in the working copy to commit all files */
+	const gchar *add[8];
+	const gchar *commit[10];
+} BackendTest;
+
+static const BackendTest backend_tests[] = {
+	{&VC_GIT, {NULL},
+	 {{"git", "init", "-q", "wc", NULL}},
+	 {"git", "add", "-A", NULL},
+	 {"git", "-c", "user.name=geanyvc", "-c", "user.email=geanyvc@localhost", "commit", "-q",
+	  "-m", "init", NULL}},
+	{&VC_HG, {NULL},
+	 {{"hg", "init", "wc", NULL}},
+	 {"hg", "add", "-q", NULL},
+	 {"hg", "commit", "-q", "-u", "geanyvc", "-m", "init", NULL}},
+	{&VC_SVN, {"svnadmin", NULL},
+	 {{"svnadmin", "create", "repo", NULL},
+	  {"svn", "checkout", "-q", "file://@ROOT@/repo", "wc", NULL}},
+	 {"svn", "add", "-q", "--force", ".", NULL},
+	 {"svn", "commit", "-q", "-m", "init", NULL}},
+	{&VC_BZR, {NULL},
+	 {{"bzr", "init", "-q", "wc", NULL}},
+	 {"bzr", "add", "-q", NULL},
+	 {"bzr", "commit", "-q", "-m", "init", NULL}},
+};
+
+static void
+run_test_command(const gchar * dir, const gchar * const *argv, const gchar * root)
+{
+	gchar **real_argv = g_strdupv((gchar **) argv);
+	gchar **parts;
+	gchar *std_err = NULL;
+	GError *error = NULL;
+	gint status = -1;
+	gint i;
+
+	for (i = 0; real_argv[i] != NULL; i++)
+	{
+		parts = g_strsplit(real_argv[i], "@ROOT@", -1);
+		g_free(real_argv[i]);
+		real_argv[i] = g_strjoinv(root, parts);
+		g_strfreev(parts);
+	}
+	g_spawn_sync(dir, real_argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL, NULL,
+		     NULL, NULL, &std_err, &status, &error);
+	fail_unless(status == 0, "%s %s failed: %s", real_argv[0], real_argv[1],
+		    error ? error->message : std_err);
+	g_free(std_err);
+	g_strfreev(real_argv);
+}
+
+static void
+remove_tree(const gchar * path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const gchar *name;
+	gchar *child;
+
+	while (dir && (name = g_dir_read_name(dir)) != NULL)
+	{
+		child = g_build_filename(path, name, NULL);
+		if (g_file_test(child, G_FILE_TEST_IS_DIR) &&
+		    !g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+			remove_tree(child);
+		else
+			g_unlink(child);
+		g_free(child);
+	}
+	if (dir)
+		g_dir_close(dir);
+	g_rmdir(path);
+}
+
+static gchar *
+get_test_file(const gchar * wc, const gchar * prefix, gint i)
+{
+	gchar *name = g_strdup_printf("d%02d" G_DIR_SEPARATOR_S "%s%05d.txt", i % TEST_DIRS,
+				      prefix, i);
+	gchar *path = g_build_filename(wc, name, NULL);
+
+	g_free(name);
+	return path;
+}
+
+static void
+write_test_files(const gchar * wc, const gchar * prefix, gint count, const gchar * contents)
+{
+	gchar *path;
+	gchar *dir;
+	gint i;
+
+	for (i = 0; i < count; i++)
+	{
+		path = get_test_file(wc, prefix, i);
+		dir = g_path_get_dirname(path);
+		g_mkdir_with_parents(dir, 0755);
+		fail_unless(g_file_set_contents(path, contents, -1, NULL), "cannot write %s", path);
+		g_free(dir);
+		g_free(path);
+	}
+}
+
+static gboolean
+have_tool(const gchar * program)
+{
+	gchar *path = g_find_program_in_path(program);
+
+	g_free(path);
+	return path != NULL;
+}
+
+static gboolean
+have_tools(const BackendTest * test)
+{
+	gsize i;
+
+	if (!have_tool(test->vc->program))
+		return FALSE;
+	for (i = 0; i < G_N_ELEMENTS(test->tools) && test->tools[i]; i++)
+	{
+		if (!have_tool(test->tools[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static GMainLoop *status_loop = NULL;
+
+static void
+on_test_status_changed(G_GNUC_UNUSED const VC_RECORD * vc, G_GNUC_UNUSED const gchar * base_dir)
+{
+	if (status_loop)
+		g_main_loop_quit(status_loop);
+}
+
+/* Commit TEST_FILES files to a new repository of the backend of @test, change
+ * them all, add untracked files, and check what the backend finds. */
+static void
+check_backend(const BackendTest * test)
+{
+	VC_RECORD *vc = test->vc;
+	GHashTable *table;
+	GHashTableIter iter;
+	GTimer *timer;
+	GSList *items;
+	GSList *tmp;
+	const gchar *status;
+	gchar *root;
+	gchar *wc;
+	gchar *file;
+	gchar *first;
+	gchar *untracked;
+	gchar *base_dir;
+	gchar *txt = NULL;
+	gboolean reading;
+	gdouble command_time, parse_time, commit_files_time;
+	guint modified = 0, unknown = 0;
+	gsize i;
+
+	if (!have_tools(test))
+	{
+		printf("%s: not installed, skipped\n", vc->program);
+		return;
+	}
+
+	root = g_dir_make_tmp("geanyvc-XXXXXX", NULL);
+	fail_unless(root != NULL, "cannot create a temporary directory");
+	wc = g_build_filename(root, "wc", NULL);
+	for (i = 0; i < G_N_ELEMENTS(test->init) && test->init[i][0]; i++)
+		run_test_command(root, test->init[i], root);
+	write_test_files(wc, "f", TEST_FILES, "line\n");
+	run_test_command(wc, test->add, root);
+	run_test_command(wc, test->commit, root);
+	write_test_files(wc, "f", TEST_FILES, "line\nchanged\n");
+	write_test_files(wc, "u", TEST_UNTRACKED_FILES, "untracked\n");
+
+	file = get_test_file(wc, "f", 1);
+	untracked = get_test_file(wc, "u", 1);
+
+	base_dir = vc->get_base_dir(file);
+	fail_unless(g_strcmp0(base_dir, wc) == 0, "%s: expected base dir %s, get %s", vc->program,
+		    wc, base_dir);
+	g_free(base_dir);
+	fail_unless(vc->in_vc(file), "%s: %s is not in the working copy", vc->program, file);
+	fail_unless(!vc->in_vc(untracked), "%s: untracked %s is in the working copy",
+		    vc->program, untracked);
+	fail_unless(!vc->in_vc(root), "%s: %s is in the working copy", vc->program, root);
+
+	timer = g_timer_new();
+	execute_custom_command(wc, vc->status_command, vc->status_env, &txt, NULL, wc, NULL, NULL);
+	command_time = g_timer_elapsed(timer, NULL);
+	fail_unless(txt != NULL, "%s: the status command has no output", vc->program);
+
+	table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	g_timer_start(timer);
+	vc->parse_status(table, wc, txt);
+	parse_time = g_timer_elapsed(timer, NULL);
+	g_hash_table_iter_init(&iter, table);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & status))
+	{
+		if (status == FILE_STATUS_MODIFIED)
+			modified++;
+		else if (status == FILE_STATUS_UNKNOWN)
+			unknown++;
+	}
+	fail_unless(g_hash_table_lookup(table, file) == FILE_STATUS_MODIFIED,
+		    "%s: %s is not modified", vc->program, file);
+	fail_unless(g_hash_table_lookup(table, untracked) == FILE_STATUS_UNKNOWN,
+		    "%s: %s is not untracked", vc->program, untracked);
+	fail_unless(modified == TEST_FILES, "%s: expected %d modified files, get %u",
+		    vc->program, TEST_FILES, modified);
+	fail_unless(unknown == TEST_UNTRACKED_FILES, "%s: expected %d untracked files, get %u",
+		    vc->program, TEST_UNTRACKED_FILES, unknown);
+	g_hash_table_destroy(table);
+	g_free(txt);
+
+	status_init(on_test_status_changed);
+	status_loop = g_main_loop_new(NULL, FALSE);
+	g_timer_start(timer);
+	status_read(vc, wc);
+	items = status_get_commit_files(vc, wc, &reading);
+	while (reading)
+	{
+		/* nothing is cached before the status arrived */
+		fail_unless(items == NULL, "%s: files to commit before the status was read",
+			    vc->program);
+		g_main_loop_run(status_loop);
+		items = status_get_commit_files(vc, wc, &reading);
+	}
+	commit_files_time = g_timer_elapsed(timer, NULL);
+	g_main_loop_unref(status_loop);
+	status_loop = NULL;
+	fail_unless(g_slist_length(items) == TEST_FILES, "%s: expected %d files to commit, get %u",
+		    vc->program, TEST_FILES, g_slist_length(items));
+	first = get_test_file(wc, "f", 0);
+	fail_unless(strcmp(((CommitItem *) items->data)->path, first) == 0,
+		    "%s: the files to commit are not sorted", vc->program);
+	g_free(first);
+	for (tmp = items; tmp != NULL; tmp = g_slist_next(tmp))
+	{
+		g_free(((CommitItem *) tmp->data)->path);
+		g_free(tmp->data);
+	}
+	g_slist_free(items);
+	status_cleanup();
+
+	/* timing baselines */
+	printf("%s: %d changed files, status command %.3f s, parsed in %.4f s, "
+	       "commit files in %.3f s\n", vc->program, TEST_FILES, command_time, parse_time,
+	       commit_files_time);
+	fail_unless(parse_time < TEST_MAX_PARSE_TIME, "%s: parsing the status took %.3f s",
+		    vc->program, parse_time);
+
+	g_timer_destroy(timer);
+	g_free(untracked);
+	g_free(file);
+	remove_tree(root);
+	g_free(wc);
+	g_free(root);
+}
+
+START_TEST(test_backend)
+{
+	check_backend(&backend_tests[_i]);
+}
+
+END_TEST;
+
+
+#ifdef USE_LIBGIT2
+
+typedef gint(*Git2Func) (gchar ** std_out, const gchar * filename);
+
+static gint
+git2_status_func(gchar ** std_out, const gchar * filename)
+{
+	return git2_status(std_out, NULL, filename, NULL, NULL);
+}
+
+static gint
+git2_add_func(gchar ** std_out, const gchar * filename)
+{
+	return git2_add(std_out, NULL, filename, NULL, NULL);
+}
+
+static gint
+git2_revert_file_func(gchar ** std_out, const gchar * filename)
+{
+	return git2_revert_file(std_out, NULL, filename, NULL, NULL);
+}
+
+/* Seconds TEST_GIT2_RUNS runs of @argv take in @wc, checking it succeeds. */
+static gdouble
+time_git_command(const gchar * wc, const gchar ** argv, gchar ** std_out)
+{
+	GTimer *timer = g_timer_new();
+	gdouble elapsed;
+	gint i;
+
+	for (i = 0; i < TEST_GIT2_RUNS; i++)
+	{
+		g_free(*std_out);
+		*std_out = NULL;
+		fail_unless(execute_custom_command(wc, argv, NULL, std_out, NULL, wc, NULL, NULL) == 0,
+			    "git %s failed", argv[1]);
+	}
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	return elapsed;
+}
+
+/* Seconds TEST_GIT2_RUNS runs of @func on @filename take, checking it succeeds. */
+static gdouble
+time_git2_func(const gchar * name, Git2Func func, const gchar * filename, gchar ** std_out)
+{
+	GTimer *timer = g_timer_new();
+	gdouble elapsed;
+	gint i;
+
+	for (i = 0; i < TEST_GIT2_RUNS; i++)
+	{
+		g_free(*std_out);
+		*std_out = NULL;
+		fail_unless(func(std_out, filename) == 0, "libgit2 %s failed", name);
+	}
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	return elapsed;
+}
+
+static void
+print_git2_timing(const gchar * name, gdouble git_time, gdouble git2_time)
+{
+	printf("git2: %s %d times, git %.3f s, libgit2 %.3f s (%.1fx)\n", name, TEST_GIT2_RUNS,
+	       git_time, git2_time, git2_time > 0 ? git_time / git2_time : 0.0);
+}
+
+/* Run the commands done through libgit2 against a test repository, check that
+ * they do what git does and compare their speed with the one of git. */
+START_TEST(test_git2)
+{
+	const gchar *argv_status[] = { "git", "status", "--short", "--branch", NULL };
+	const gchar *argv_show[] = { "git", "show", NULL, NULL };
+	const gchar *argv_add[] = { "git", "add", "--", NULL, NULL };
+	const gchar *argv_checkout[] = { "git", "checkout", "--", NULL, NULL };
+	const gchar *argv_reset[] = { "git", "reset", "-q", "--", NULL, NULL };
+	const BackendTest *test = &backend_tests[0];
+	gchar *root;
+	gchar *wc;
+	gchar *file;
+	gchar *untracked;
+	gchar *relpath;
+	gchar *git_out = NULL;
+	gchar *git2_out = NULL;
+	gchar *line;
+	gchar *contents = NULL;
+	gdouble git_time, git2_time;
+	gsize i;
+
+	if (!have_tools(test))
+	{
+		printf("git2: git not installed, skipped\n");
+		return;
+	}
+
+	root = g_dir_make_tmp("geanyvc-XXXXXX", NULL);
+	fail_unless(root != NULL, "cannot create a temporary directory");
+	wc = g_build_filename(root, "wc", NULL);
+	for (i = 0; i < G_N_ELEMENTS(test->init) && test->init[i][0]; i++)
+		run_test_command(root, test->init[i], root);
+	write_test_files(wc, "f", TEST_FILES, "line\n");
+	run_test_command(wc, test->add, root);
+	run_test_command(wc, test->commit, root);
+	write_test_files(wc, "f", TEST_FILES, "line\nchanged\n");
+	write_test_files(wc, "u", TEST_UNTRACKED_FILES, "untracked\n");
+
+	file = get_test_file(wc, "f", 1);
+	untracked = get_test_file(wc, "u", 1);
+	relpath = g_strdup(file + strlen(wc) + 1);
+
+	/* status: the same changes are listed, maybe in another order */
+	git_time = time_git_command(wc, argv_status, &git_out);
+	git2_time = time_git2_func("status", git2_status_func, file, &git2_out);
+	print_git2_timing("status", git_time, git2_time);
+	fail_unless(git2_out != NULL && git_out != NULL, "no status output");
+	fail_unless(strlen(git2_out) == strlen(git_out), "libgit2 status differs from git:\n%s",
+		    git2_out);
+	line = g_strdup_printf(" M %s\n", relpath);
+	fail_unless(strstr(git2_out, line) != NULL, "libgit2 status has no \"%s\"", line);
+	g_free(line);
+	line = g_strdup_printf("?? %s\n", untracked + strlen(wc) + 1);
+	fail_unless(strstr(git2_out, line) != NULL, "libgit2 status has no \"%s\"", line);
+	g_free(line);
+
+	/* show: the committed contents */
+	argv_show[2] = line = g_strdup_printf("HEAD:%s", relpath);
+	git_time = time_git_command(wc, argv_show, &git_out);
+	git2_time = time_git2_func("show", git2_show, file, &git2_out);
+	print_git2_timing("show", git_time, git2_time);
+	fail_unless(g_strcmp0(git_out, git2_out) == 0, "libgit2 show gives \"%s\", git \"%s\"",
+		    git2_out, git_out);
+	g_free(line);
+
+	/* add: the file is staged */
+	argv_add[3] = relpath;
+	git_time = time_git_command(wc, argv_add, &git_out);
+	argv_reset[4] = relpath;
+	run_test_command(wc, argv_reset, root);
+	git2_time = time_git2_func("add", git2_add_func, file, &git2_out);
+	print_git2_timing("add", git_time, git2_time);
+	argv_status[2] = "--porcelain";
+	argv_status[3] = relpath;
+	g_free(git_out);
+	git_out = NULL;
+	execute_custom_command(wc, argv_status, NULL, &git_out, NULL, wc, NULL, NULL);
+	fail_unless(g_str_has_prefix(git_out, "M  "), "libgit2 did not stage %s: %s", relpath,
+		    git_out);
+
+	/* revert: the file is back to its staged contents */
+	git2_time = time_git2_func("revert", git2_revert_file_func, file, &git2_out);
+	argv_checkout[3] = relpath;
+	git_time = time_git_command(wc, argv_checkout, &git_out);
+	print_git2_timing("revert", git_time, git2_time);
+	write_test_files(wc, "f", 2, "line\nchanged again\n");
+	fail_unless(git2_revert_file(NULL, NULL, file, NULL, NULL) == 0, "libgit2 revert failed");
+	fail_unless(g_file_get_contents(file, &contents, NULL, NULL) &&
+		    strcmp(contents, "line\nchanged\n") == 0, "libgit2 did not revert %s", relpath);
+
+	git2_cleanup();
+	g_free(contents);
+	g_free(git_out);
+	g_free(git2_out);
+	g_free(relpath);
+	g_free(untracked);
+	g_free(file);
+	remove_tree(root);
+	g_free(wc);
+	g_free(root);
+}
+
+END_TEST;
+
+#endif
+
+
+static TCase *
+backends_test_case_create(void)
+{
+	TCase *tc_backends = tcase_create("backends");
+	/* the repositories take a while to set up */
+	tcase_set_timeout(tc_backends, 600);
+	tcase_add_unchecked_fixture(tc_backends, geany_functions_setup, NULL);
+	tcase_add_test(tc_backends, test_parse_status_scaling);
+	tcase_add_loop_test(tc_backends, test_backend, 0, G_N_ELEMENTS(backend_tests));
+#ifdef USE_LIBGIT2
+	tcase_add_test(tc_backends, test_git2);
+#endif
+	return tc_backends;
+}
 
 Suite *
 my_suite(void)
@@ -14,6 +659,8 @@ my_suite(void)
 	Suite *s = suite_create("VC");
 	TCase *tc_utils = utils_test_case_create();
 	suite_add_tcase(s, tc_utils);
+	suite_add_tcase(s, patch_test_case_create());
+	suite_add_tcase(s, backends_test_case_create());
 	return s;
 }
 
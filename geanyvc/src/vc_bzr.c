@@ -150,8 +150,8 @@ in_vc_bzr(const gchar * filename)
 }
 
 /* parse "bzr status --short" output, see "bzr help status-flags" for details */
-static GSList *
-get_commit_files_bzr(const gchar * dir)
+static void
+parse_bzr_status(GHashTable * table, const gchar * dir, const gchar * txt)
 {
 	enum
 	{
@@ -162,28 +162,13 @@ get_commit_files_bzr(const gchar * dir)
 		FILE_NAME,
 	};
 
-	gchar *txt = NULL;
-	GSList *ret = NULL;
 	gint pstatus = FIRST_CHAR;
 	const gchar *p;
 	gchar *base_name;
-	gchar *base_dir = find_subdir_path(dir, ".bzr");
 	const gchar *start = NULL;
-	CommitItem *item;
 
 	const gchar *status = NULL;
 	gchar *filename;
-	const char *argv[] = { "bzr", "status", "--short", NULL };
-
-	g_return_val_if_fail(base_dir, NULL);
-
-	execute_custom_command(base_dir, argv, NULL, &txt, NULL, base_dir, NULL, NULL);
-	if (EMPTY(txt))
-	{
-		g_free(base_dir);
-		g_free(txt);
-		return NULL;
-	}
 	p = txt;
 
 	while (*p)
@@ -230,31 +215,33 @@ get_commit_files_bzr(const gchar * dir)
 		{
 			if (*p == '\n')
 			{
-				if (status != FILE_STATUS_UNKNOWN)
-				{
-					base_name = g_malloc0(p - start + 1);
-					memcpy(base_name, start, p - start);
-					filename = g_build_filename(base_dir, base_name, NULL);
-					g_free(base_name);
-					item = g_new(CommitItem, 1);
-					item->status = status;
-					item->path = filename;
-					ret = g_slist_append(ret, item);
-				}
+				base_name = g_malloc0(p - start + 1);
+				memcpy(base_name, start, p - start);
+				filename = g_build_filename(dir, base_name, NULL);
+				g_free(base_name);
+				g_hash_table_insert(table, filename, (gpointer) status);
 				pstatus = FIRST_CHAR;
 			}
 		}
 		p++;
 	}
-	g_free(txt);
-	g_free(base_dir);
-	return ret;
 }
 
+static const gchar *BZR_META_DIRS[] = { ".bzr", ".bzr/checkout", NULL };
+
+static const gchar *BZR_CMD_STATUS_ALL[] = { "bzr", "status", "--short", NULL };
+
 VC_RECORD VC_BZR = {
 	commands,
 	"bzr",
 	get_base_dir,
 	in_vc_bzr,
-	get_commit_files_bzr,
+	BZR_CMD_STATUS_ALL,
+	NULL,
+	parse_bzr_status,
+	BZR_META_DIRS,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
 };
@@ -144,8 +144,8 @@ in_vc_cvs(const gchar * filename)
 	return find_dir(filename, "CVS", FALSE);
 }
 
-static GSList *
-get_commit_files_cvs(const gchar * dir)
+static void
+parse_cvs_status(GHashTable * table, const gchar * dir, const gchar * txt)
 {
 	enum
 	{
@@ -154,21 +154,13 @@ get_commit_files_cvs(const gchar * dir)
 		FILE_NAME,
 	};
 
-	gchar *txt;
-	GSList *ret = NULL;
 	gint pstatus = FIRST_CHAR;
 	const gchar *p;
 	gchar *base_name;
 	const gchar *start = NULL;
-	CommitItem *item;
 
 	const gchar *status = NULL;
 	gchar *filename;
-	const char *argv[] = { "cvs", "-nq", "update", NULL };
-
-	execute_custom_command(dir, argv, NULL, &txt, NULL, dir, NULL, NULL);
-	if (EMPTY(txt))
-		return NULL;
 	p = txt;
 
 	while (*p)
@@ -220,30 +212,33 @@ get_commit_files_cvs(const gchar * dir)
 		{
 			if (*p == '\n')
 			{
-				if (status != FILE_STATUS_UNKNOWN)
-				{
-					base_name = g_malloc0(p - start + 1);
-					memcpy(base_name, start, p - start);
-					filename = g_build_filename(dir, base_name, NULL);
-					g_free(base_name);
-					item = g_new(CommitItem, 1);
-					item->status = status;
-					item->path = filename;
-					ret = g_slist_append(ret, item);
-				}
+				base_name = g_malloc0(p - start + 1);
+				memcpy(base_name, start, p - start);
+				filename = g_build_filename(dir, base_name, NULL);
+				g_free(base_name);
+				g_hash_table_insert(table, filename, (gpointer) status);
 				pstatus = FIRST_CHAR;
 			}
 		}
 		p++;
 	}
-	g_free(txt);
-	return ret;
 }
 
+static const gchar *CVS_META_DIRS[] = { "CVS", NULL };
+
+static const gchar *CVS_CMD_STATUS_ALL[] = { "cvs", "-nq", "update", NULL };
+
 VC_RECORD VC_CVS = {
 	commands,
 	"cvs",
 	get_base_dir,
 	in_vc_cvs,
-	get_commit_files_cvs,
+	CVS_CMD_STATUS_ALL,
+	NULL,
+	parse_cvs_status,
+	CVS_META_DIRS,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
 };
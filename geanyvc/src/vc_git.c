@@ -20,10 +20,24 @@
  */
 
 #include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
 #include <geanyplugin.h>
+#include <glib/gstdio.h>
 #include "geanyvc.h"
 
 extern GeanyData *geany_data;
+extern GeanyFunctions *geany_functions;
+
+/* in-process implementation of a command, if libgit2 is available */
+#ifdef USE_LIBGIT2
+#define GIT2(func) func
+#else
+#define GIT2(func) NULL
+#endif
 
 static gchar *
 get_base_dir(const gchar * path)
@@ -68,6 +82,14 @@ git_show(gchar ** std_out, gchar ** std_err, const gchar * filename,
 
 	g_return_val_if_fail(base_dir, -1);
 
+#ifdef USE_LIBGIT2
+	if (git2_show(std_out, filename) == 0)
+	{
+		g_free(base_dir);
+		return 0;
+	}
+#endif
+
 	argv[2] = g_strdup_printf("HEAD:%s", filename + len + 1);
 
 	ret = execute_custom_command(base_dir, argv, GIT_ENV_SHOW, std_out, std_err, base_dir, list,
@@ -78,6 +100,122 @@ git_show(gchar ** std_out, gchar ** std_err, const gchar * filename,
 }
 
 
+/* the environment of geany with GIT_INDEX_FILE set to @index */
+static gchar **
+get_index_env(const gchar * index)
+{
+	gchar **names = g_listenv();
+	GPtrArray *env = g_ptr_array_new();
+	gint i;
+
+	for (i = 0; names[i] != NULL; i++)
+	{
+		if (!utils_str_equal(names[i], "GIT_INDEX_FILE"))
+			g_ptr_array_add(env, g_strconcat(names[i], "=", g_getenv(names[i]), NULL));
+	}
+	g_ptr_array_add(env, g_strconcat("GIT_INDEX_FILE=", index, NULL));
+	g_ptr_array_add(env, NULL);
+	g_strfreev(names);
+	return (gchar **) g_ptr_array_free(env, FALSE);
+}
+
+static GSList *
+get_relative_list(const gchar * base_dir, GSList * list, GSList * relative)
+{
+	gint len = strlen(base_dir);
+
+	for (; list != NULL; list = g_slist_next(list))
+		relative = g_slist_prepend(relative, (gchar *) list->data + len + 1);
+	return relative;
+}
+
+/* Commit @files and the hunks of @patched in @patch. They are staged in a
+ * temporary index made from HEAD, which leaves alone what is staged in the real
+ * index for the other files, like "git commit -- paths" does. */
+static gint
+git_commit_patch(const gchar * base_dir, GSList * files, GSList * patched, const GString * patch,
+		 const gchar * message, gchar ** std_err)
+{
+	const gchar *argv_read[] = { "git", "read-tree", "HEAD", NULL };
+	const gchar *argv_add[] = { "git", "add", "-A", "--", FILE_LIST, NULL };
+	const gchar *argv_apply[] = { "git", "apply", "--cached", NULL, NULL };
+	const gchar *argv_commit[] = { "git", "commit", "-m", MESSAGE, NULL };
+	const gchar *argv_reset[] = { "git", "reset", "-q", "--", FILE_LIST, NULL };
+	gchar *index_file = NULL;
+	gchar *patch_file = NULL;
+	gchar **env = NULL;
+	GSList *relative;
+	GError *error = NULL;
+	gint fd;
+	gint ret = -1;
+
+	g_return_val_if_fail(base_dir, -1);
+
+	fd = g_file_open_tmp("geanyvc-index-XXXXXX", &index_file, &error);
+	if (fd != -1)
+	{
+		/* git refuses an empty index file, read-tree creates it */
+		close(fd);
+		g_unlink(index_file);
+		fd = g_file_open_tmp("geanyvc-patch-XXXXXX", &patch_file, &error);
+	}
+	if (fd == -1)
+	{
+		*std_err = g_strdup(error->message);
+		g_error_free(error);
+		g_free(index_file);
+		return -1;
+	}
+	close(fd);
+	if (!g_file_set_contents(patch_file, patch->str, patch->len, &error))
+	{
+		*std_err = g_strdup(error->message);
+		g_error_free(error);
+		goto out;
+	}
+	argv_apply[3] = patch_file;
+	env = get_index_env(index_file);
+
+	/* fails on an unborn branch, whose commit starts from an empty index */
+	execute_custom_command(base_dir, argv_read, (const gchar **) env, NULL, NULL, base_dir,
+			       NULL, NULL);
+	relative = get_relative_list(base_dir, files, NULL);
+	if (relative)
+		ret = execute_custom_command(base_dir, argv_add, (const gchar **) env, NULL, std_err,
+					     base_dir, relative, NULL);
+	else
+		ret = 0;
+	if (ret == 0 && patch->len > 0)
+	{
+		g_free(*std_err);
+		ret = execute_custom_command(base_dir, argv_apply, (const gchar **) env, NULL,
+					     std_err, base_dir, NULL, NULL);
+	}
+	if (ret == 0)
+	{
+		g_free(*std_err);
+		ret = execute_custom_command(base_dir, argv_commit, (const gchar **) env, NULL,
+					     std_err, base_dir, NULL, message);
+	}
+	if (ret == 0)
+	{
+		/* bring the real index of the committed files up to the new HEAD */
+		relative = get_relative_list(base_dir, patched, relative);
+		execute_custom_command(base_dir, argv_reset, NULL, NULL, NULL, base_dir, relative,
+				       NULL);
+	}
+	g_slist_free(relative);
+
+      out:
+	g_unlink(index_file);
+	g_unlink(patch_file);
+	g_free(index_file);
+	g_free(patch_file);
+	g_strfreev(env);
+	return ret;
+}
+
+
 
 static const gchar *GIT_CMD_DIFF_FILE[] = { "git", "diff", "HEAD", "--", BASENAME, NULL };
 static const gchar *GIT_CMD_DIFF_DIR[] = { "git", "diff", "HEAD", NULL };
@@ -86,7 +224,8 @@ static const gchar *GIT_CMD_REVERT_FILE[] = { "git", "checkout", "--", BASENAME,
 static const gchar *GIT_CMD_REVERT_DIR[] = { "git", "reset", "--", BASE_DIRNAME,
 	CMD_SEPARATOR, "git", "checkout", "HEAD", "--", BASE_DIRNAME, NULL
 };
-static const gchar *GIT_CMD_STATUS[] = { "git", "status", NULL };
+/* the format git2_status() produces when libgit2 is used */
+static const gchar *GIT_CMD_STATUS[] = { "git", "status", "--short", "--branch", NULL };
 static const gchar *GIT_CMD_ADD[] = { "git", "add", "--", BASENAME, NULL };
 
 static const gchar *GIT_CMD_REMOVE[] =
@@ -125,27 +264,27 @@ static const VC_COMMAND commands[VC_COMMAND_COUNT] = {
 		VC_COMMAND_STARTDIR_FILE,
 		GIT_CMD_REVERT_FILE,
 		GIT_ENV_REVERT_FILE,
-		NULL},
+		GIT2(git2_revert_file)},
 	{
 		VC_COMMAND_STARTDIR_BASE,
 		GIT_CMD_REVERT_DIR,
 		GIT_ENV_REVERT_DIR,
-		NULL},
+		GIT2(git2_revert_dir)},
 	{
 		VC_COMMAND_STARTDIR_FILE,
 		GIT_CMD_STATUS,
 		GIT_ENV_STATUS,
-		NULL},
+		GIT2(git2_status)},
 	{
 		VC_COMMAND_STARTDIR_FILE,
 		GIT_CMD_ADD,
 		GIT_ENV_ADD,
-		NULL},
+		GIT2(git2_add)},
 	{
 		VC_COMMAND_STARTDIR_FILE,
 		GIT_CMD_REMOVE,
 		GIT_ENV_REMOVE,
-		NULL},
+		GIT2(git2_remove)},
 	{
 		VC_COMMAND_STARTDIR_FILE,
 		GIT_CMD_LOG_FILE,
@@ -211,72 +350,145 @@ in_vc_git(const gchar * filename)
 	return ret;
 }
 
-static GSList *
-parse_git_status(GSList * lst, const gchar * base_dir, const gchar * txt, const gchar * s_out,
-		 const gchar * status)
+/* Get a file name of git status --porcelain, which quotes unusual names like C strings. */
+static gchar *
+get_porcelain_path(const gchar * start, const gchar * end)
 {
-	gchar *start, *end;
-	gchar *base_name;
-	gchar *filename;
-	CommitItem *item;
+	gchar *quoted;
+	gchar *path;
 
-	start = strstr(txt, s_out);
-	while (start)
+	if (end - start >= 2 && *start == '"' && end[-1] == '"')
 	{
-		start += strlen(s_out);
-		while (*start == ' ' || *start == '\t')
-		{
-			start++;
-		}
-		g_return_val_if_fail(*start, NULL);
+		quoted = g_strndup(start + 1, end - start - 2);
+		path = g_strcompress(quoted);
+		g_free(quoted);
+		return path;
+	}
+	return g_strndup(start, end - start);
+}
 
-		end = strchr(start, '\n');
-		g_return_val_if_fail(start, NULL);
+static void
+add_porcelain_file(GHashTable * table, const gchar * base_dir, const gchar * start,
+		   const gchar * end, const gchar * status)
+{
+	gchar *base_name = get_porcelain_path(start, end);
+	gsize len = strlen(base_name);
 
-		base_name = g_malloc0(end - start + 1);
-		memcpy(base_name, start, end - start);
-		filename = g_build_filename(base_dir, base_name, NULL);
-		g_free(base_name);
+	/* untracked directories are listed instead of the files in them */
+	if (len > 1 && base_name[len - 1] == '/')
+		base_name[len - 1] = '\0';
+	g_hash_table_insert(table, g_build_filename(base_dir, base_name, NULL), (gpointer) status);
+	g_free(base_name);
+}
 
-		item = g_new(CommitItem, 1);
-		item->status = status;
-		item->path = filename;
+static void
+parse_git_status(GHashTable * table, const gchar * base_dir, const gchar * txt)
+{
+	const gchar *line;
+	const gchar *end;
+	const gchar *arrow;
+	const gchar *status;
 
-		lst = g_slist_append(lst, item);
-		start = strstr(start, s_out);
+	for (line = txt; *line; line = *end ? end + 1 : end)
+	{
+		end = strchr(line, '\n');
+		if (!end)
+			end = line + strlen(line);
+		if (end - line < 4)
+			continue;
+
+		if (line[0] == '!')
+			continue;
+		else if (line[0] == '?')
+			status = FILE_STATUS_UNKNOWN;
+		else if (line[0] == 'D' || line[1] == 'D')
+			status = FILE_STATUS_DELETED;
+		else if (line[0] == 'A' || line[0] == 'R' || line[0] == 'C')
+			status = FILE_STATUS_ADDED;
+		else
+			status = FILE_STATUS_MODIFIED;
+
+		/* renames and copies are listed as "old -> new" */
+		arrow = NULL;
+		if (line[0] == 'R' || line[0] == 'C')
+			arrow = g_strstr_len(line + 3, end - line - 3, " -> ");
+		if (arrow)
+		{
+			if (line[0] == 'R')
+				add_porcelain_file(table, base_dir, line + 3, arrow, FILE_STATUS_DELETED);
+			add_porcelain_file(table, base_dir, arrow + 4, end, status);
+		}
+		else
+			add_porcelain_file(table, base_dir, line + 3, end, status);
 	}
-	return lst;
 }
 
-static GSList *
-get_commit_files_git(const gchar * file)
+static gchar **
+get_log_page_argv(const gchar * path, gint skip, gint count)
 {
-	const gchar *argv[] = { "git", "status", NULL };
-	const gchar *env[] = { "PAGES=cat", NULL };
-	gchar *std_out = NULL;
-	gchar *base_dir = find_subdir_path(file, ".git");
-	GSList *ret = NULL;
+	GPtrArray *argv = g_ptr_array_new();
+
+	g_ptr_array_add(argv, g_strdup("git"));
+	g_ptr_array_add(argv, g_strdup("log"));
+	g_ptr_array_add(argv, g_strdup("--date=iso"));
+	g_ptr_array_add(argv, g_strdup("--format=%H%x09%ad%x09%an%x09%s"));
+	g_ptr_array_add(argv, g_strdup_printf("--skip=%d", skip));
+	g_ptr_array_add(argv, g_strdup_printf("--max-count=%d", count));
+	if (path)
+	{
+		g_ptr_array_add(argv, g_strdup("--"));
+		g_ptr_array_add(argv, utils_get_locale_from_utf8(path));
+	}
+	g_ptr_array_add(argv, NULL);
+	return (gchar **) g_ptr_array_free(argv, FALSE);
+}
 
-	g_return_val_if_fail(base_dir, NULL);
+static gchar **
+get_log_show_argv(const gchar * id, const gchar * path)
+{
+	GPtrArray *argv = g_ptr_array_new();
 
-	execute_custom_command(base_dir, (const gchar **) argv, (const gchar **) env,
-			       &std_out, NULL, base_dir, NULL, NULL);
-	g_return_val_if_fail(std_out, NULL);
+	g_ptr_array_add(argv, g_strdup("git"));
+	g_ptr_array_add(argv, g_strdup("show"));
+	g_ptr_array_add(argv, g_strdup("--date=iso"));
+	g_ptr_array_add(argv, g_strdup(id));
+	if (path)
+	{
+		g_ptr_array_add(argv, g_strdup("--"));
+		g_ptr_array_add(argv, utils_get_locale_from_utf8(path));
+	}
+	g_ptr_array_add(argv, NULL);
+	return (gchar **) g_ptr_array_free(argv, FALSE);
+}
 
-	ret = parse_git_status(ret, base_dir, std_out, "modified:", FILE_STATUS_MODIFIED);
-	ret = parse_git_status(ret, base_dir, std_out, "deleted:", FILE_STATUS_DELETED);
-	ret = parse_git_status(ret, base_dir, std_out, "new file:", FILE_STATUS_ADDED);
+static const gchar *GIT_ENV_LOG[] = { "PAGER=cat", NULL };
 
-	g_free(std_out);
-	g_free(base_dir);
+static const VC_LOG log_browser = {
+	get_log_page_argv,
+	get_log_show_argv,
+	GIT_ENV_LOG
+};
 
-	return ret;
-}
+static const gchar *GIT_META_DIRS[] = { ".git", NULL };
+
+static const gchar *GIT_CMD_ANNOTATE[] = { "git", "blame", "--porcelain", "--", BASE_FILENAME, NULL };
+static const gchar *GIT_ENV_ANNOTATE[] = { "PAGER=cat", NULL };
+
+static const gchar *GIT_CMD_STATUS_ALL[] = { "git", "status", "--porcelain", NULL };
+/* do not let git refresh the index, that would wake up the metadata monitors */
+static const gchar *GIT_ENV_STATUS_ALL[] = { "PAGER=cat", "GIT_OPTIONAL_LOCKS=0", NULL };
 
 VC_RECORD VC_GIT = {
 	commands,
 	"git",
 	get_base_dir,
 	in_vc_git,
-	get_commit_files_git,
+	GIT_CMD_STATUS_ALL,
+	GIT_ENV_STATUS_ALL,
+	parse_git_status,
+	GIT_META_DIRS,
+	&log_browser,
+	GIT_CMD_ANNOTATE,
+	GIT_ENV_ANNOTATE,
+	git_commit_patch,
 };
@@ -0,0 +1,453 @@
+/*
+ *      vc_git2.c - Plugin to geany light IDE to work with vc
+ *
+ *      Copyright 2007-2011 Frank Lanitz <frank(at)frank(dot)uvena(dot)de>
+ *      Copyright 2007-2009 Enrico Tröger <enrico.troeger@uvena.de>
+ *      Copyright 2007 Nick Treleaven <nick.treleaven@btinternet.com>
+ *      Copyright 2007-2009 Yura Siamashka <yurand2@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Git commands run in-process with libgit2, without spawning git and without
+ * discovering the repository again for every command. Each of them returns
+ * VC_COMMAND_FALLBACK if libgit2 fails, the git command is run then. Their
+ * output mimics the one of the git commands they replace.
+ *
+ * Only the commands which are quick whatever the size of the history are done
+ * here, as they run on the main thread. Diffs, logs and blames stay with git,
+ * whose output is read while it arrives and can be cancelled, and so do commits
+ * so that hooks, signing and the message cleanup of git apply. */
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "geanyvc.h"
+
+#ifdef USE_LIBGIT2
+
+#include <git2.h>
+
+#if ! defined (LIBGIT2_SOVERSION) || LIBGIT2_SOVERSION < 22
+# define git_libgit2_init     git_threads_init
+# define git_libgit2_shutdown git_threads_shutdown
+#endif
+
+extern GeanyFunctions *geany_functions;
+
+static GHashTable *repositories = NULL;	/* work tree -> git_repository */
+
+/* Convert a file name to the encoding libgit2 expects */
+static gchar *
+get_git_path(const gchar * path)
+{
+#ifdef G_OS_WIN32
+	gchar *ret = g_strdup(path);
+
+	g_strdelimit(ret, "\\", '/');
+	return ret;
+#else
+	return utils_get_locale_from_utf8(path);
+#endif
+}
+
+/*
+ * Get the repository of a file
+ *
+ * @filename - file or directory in the work tree
+ * @relpath - if not NULL, set to @filename relative to the work tree, "" for the
+ *  work tree itself
+ *
+ * @return - the repository, owned by the cache, or NULL
+ */
+static git_repository *
+get_repository(const gchar * filename, gchar ** relpath)
+{
+	git_repository *repo;
+	gchar *base_dir;
+	gchar *path;
+
+	base_dir = find_subdir_path(filename, ".git");
+	if (!base_dir)
+		return NULL;
+
+	if (!repositories)
+	{
+		git_libgit2_init();
+		repositories = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+						     (GDestroyNotify) git_repository_free);
+	}
+
+	repo = g_hash_table_lookup(repositories, base_dir);
+	if (!repo)
+	{
+		path = get_git_path(base_dir);
+		if (git_repository_open(&repo, path) != 0)
+			repo = NULL;
+		g_free(path);
+		if (!repo)
+		{
+			g_free(base_dir);
+			return NULL;
+		}
+		g_hash_table_insert(repositories, g_strdup(base_dir), repo);
+	}
+
+	if (relpath)
+	{
+		path = get_relative_path(base_dir, filename);
+		if (!path || utils_str_equal(path, "."))
+			setptr(path, g_strdup(""));
+		*relpath = get_git_path(path);
+		g_free(path);
+	}
+	g_free(base_dir);
+	return repo;
+}
+
+/* Get the tree of HEAD, NULL on an unborn branch. */
+static gboolean
+get_head_tree(git_repository * repo, git_tree ** tree)
+{
+	git_object *obj;
+
+	*tree = NULL;
+	if (git_repository_head_unborn(repo) == 1)
+		return TRUE;
+	if (git_revparse_single(&obj, repo, "HEAD^{tree}") != 0)
+		return FALSE;
+	*tree = (git_tree *) obj;
+	return TRUE;
+}
+
+static gboolean
+get_head_commit(git_repository * repo, git_object ** commit)
+{
+	return git_revparse_single(commit, repo, "HEAD^{commit}") == 0;
+}
+
+/* Hand out @str like execute_custom_command() hands out the output of a command. */
+static void
+set_output(gchar ** std_out, GString * str)
+{
+	gchar *text;
+
+	if (!std_out)
+	{
+		g_string_free(str, TRUE);
+		return;
+	}
+
+	utils_string_replace_all(str, "\r\n", "\n");
+	utils_string_replace_all(str, "\r", "\n");
+	text = g_string_free(str, FALSE);
+	if (!g_utf8_validate(text, -1, NULL))
+		setptr(text, encodings_convert_to_utf8(text, strlen(text), NULL));
+	if (EMPTY(text))
+	{
+		g_free(text);
+		text = NULL;
+	}
+	*std_out = text;
+}
+
+static void
+set_single_path(git_strarray * array, gchar ** path)
+{
+	array->strings = path;
+	array->count = 1;
+}
+
+static gchar
+get_status_char(guint flags, gboolean index)
+{
+	if (index)
+	{
+		if (flags & GIT_STATUS_INDEX_NEW)
+			return 'A';
+		if (flags & GIT_STATUS_INDEX_MODIFIED)
+			return 'M';
+		if (flags & GIT_STATUS_INDEX_DELETED)
+			return 'D';
+		if (flags & GIT_STATUS_INDEX_RENAMED)
+			return 'R';
+		if (flags & GIT_STATUS_INDEX_TYPECHANGE)
+			return 'T';
+	}
+	else
+	{
+		if (flags & GIT_STATUS_WT_MODIFIED)
+			return 'M';
+		if (flags & GIT_STATUS_WT_DELETED)
+			return 'D';
+		if (flags & GIT_STATUS_WT_TYPECHANGE)
+			return 'T';
+	}
+	return ' ';
+}
+
+/* git status, in the format of git status --short --branch */
+gint
+git2_status(gchar ** std_out, G_GNUC_UNUSED gchar ** std_err, const gchar * filename,
+	    G_GNUC_UNUSED GSList * list, G_GNUC_UNUSED const gchar * message)
+{
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	git_repository *repo;
+	git_status_list *status;
+	git_reference *head;
+	const git_status_entry *entry;
+	const git_diff_delta *delta;
+	GString *str;
+	gsize count;
+	gsize i;
+
+	repo = get_repository(filename, NULL);
+	if (!repo)
+		return VC_COMMAND_FALLBACK;
+
+	opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+	opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX;
+	if (git_status_list_new(&status, repo, &opts) != 0)
+		return VC_COMMAND_FALLBACK;
+
+	str = g_string_new("## ");
+	if (git_repository_head_detached(repo) == 1)
+		g_string_append(str, "HEAD (no branch)");
+	else if (git_repository_head(&head, repo) == 0)
+	{
+		g_string_append(str, git_reference_shorthand(head));
+		git_reference_free(head);
+	}
+	else
+		g_string_append(str, "Initial commit");
+	g_string_append_c(str, '\n');
+
+	count = git_status_entrycount(status);
+	for (i = 0; i < count; i++)
+	{
+		entry = git_status_byindex(status, i);
+		if (entry->status & GIT_STATUS_IGNORED)
+			continue;
+		if (entry->status & GIT_STATUS_WT_NEW)
+		{
+			g_string_append_printf(str, "?? %s\n", entry->index_to_workdir->old_file.path);
+			continue;
+		}
+
+		delta = entry->head_to_index ? entry->head_to_index : entry->index_to_workdir;
+		g_string_append_printf(str, "%c%c ", get_status_char(entry->status, TRUE),
+				       get_status_char(entry->status, FALSE));
+		if (entry->status & GIT_STATUS_INDEX_RENAMED)
+			g_string_append_printf(str, "%s -> ", delta->old_file.path);
+		g_string_append_printf(str, "%s\n", delta->new_file.path);
+	}
+	git_status_list_free(status);
+
+	set_output(std_out, str);
+	return 0;
+}
+
+/* git add -- file */
+gint
+git2_add(G_GNUC_UNUSED gchar ** std_out, G_GNUC_UNUSED gchar ** std_err, const gchar * filename,
+	 G_GNUC_UNUSED GSList * list, G_GNUC_UNUSED const gchar * message)
+{
+	git_repository *repo;
+	git_index *index;
+	gchar *path = NULL;
+	gint ret = VC_COMMAND_FALLBACK;
+
+	/* adding a directory needs a walk of the work tree, leave it to git */
+	if (g_file_test(filename, G_FILE_TEST_IS_DIR))
+		return VC_COMMAND_FALLBACK;
+
+	repo = get_repository(filename, &path);
+	if (!repo)
+		return VC_COMMAND_FALLBACK;
+
+	if (git_repository_index(&index, repo) == 0)
+	{
+		if (git_index_read(index, FALSE) == 0 &&
+		    git_index_add_bypath(index, path) == 0 && git_index_write(index) == 0)
+			ret = 0;
+		else
+			git_index_read(index, TRUE);
+		git_index_free(index);
+	}
+	g_free(path);
+	return ret;
+}
+
+/* git rm -f -- file, git reset HEAD -- file */
+gint
+git2_remove(G_GNUC_UNUSED gchar ** std_out, G_GNUC_UNUSED gchar ** std_err, const gchar * filename,
+	    G_GNUC_UNUSED GSList * list, G_GNUC_UNUSED const gchar * message)
+{
+	git_strarray paths;
+	git_repository *repo;
+	git_object *head;
+	gchar *path = NULL;
+	gchar *locale_filename;
+	gint ret = VC_COMMAND_FALLBACK;
+
+	if (g_file_test(filename, G_FILE_TEST_IS_DIR))
+		return VC_COMMAND_FALLBACK;
+
+	repo = get_repository(filename, &path);
+	if (!repo)
+		return VC_COMMAND_FALLBACK;
+
+	set_single_path(&paths, &path);
+	if (get_head_commit(repo, &head))
+	{
+		if (git_reset_default(repo, head, &paths) == 0)
+		{
+			locale_filename = utils_get_locale_from_utf8(filename);
+			g_unlink(locale_filename);
+			g_free(locale_filename);
+			ret = 0;
+		}
+		git_object_free(head);
+	}
+	g_free(path);
+	return ret;
+}
+
+/* git checkout -- file */
+gint
+git2_revert_file(G_GNUC_UNUSED gchar ** std_out, G_GNUC_UNUSED gchar ** std_err,
+		 const gchar * filename, G_GNUC_UNUSED GSList * list,
+		 G_GNUC_UNUSED const gchar * message)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_repository *repo;
+	gchar *path = NULL;
+	gint ret = VC_COMMAND_FALLBACK;
+
+	repo = get_repository(filename, &path);
+	if (!repo)
+		return VC_COMMAND_FALLBACK;
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	if (*path)
+	{
+		set_single_path(&opts.paths, &path);
+		if (!g_file_test(filename, G_FILE_TEST_IS_DIR))
+			opts.checkout_strategy |= GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+	}
+	if (git_checkout_index(repo, NULL, &opts) == 0)
+		ret = 0;
+	g_free(path);
+	return ret;
+}
+
+/* git reset -- dir, git checkout HEAD -- dir */
+gint
+git2_revert_dir(G_GNUC_UNUSED gchar ** std_out, G_GNUC_UNUSED gchar ** std_err,
+		const gchar * filename, G_GNUC_UNUSED GSList * list,
+		G_GNUC_UNUSED const gchar * message)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_repository *repo;
+	git_object *head;
+	git_tree *tree = NULL;
+	git_index *index;
+	gchar *path = NULL;
+	gboolean ok = FALSE;
+
+	repo = get_repository(filename, &path);
+	if (!repo)
+		return VC_COMMAND_FALLBACK;
+	if (!get_head_commit(repo, &head))
+	{
+		g_free(path);
+		return VC_COMMAND_FALLBACK;
+	}
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	if (*path)
+	{
+		set_single_path(&opts.paths, &path);
+		ok = git_reset_default(repo, head, &opts.paths) == 0;
+	}
+	else if (git_repository_index(&index, repo) == 0)
+	{
+		/* no path at all resets the whole index */
+		if (git_commit_tree(&tree, (git_commit *) head) == 0)
+		{
+			ok = git_index_read_tree(index, tree) == 0 && git_index_write(index) == 0;
+			if (!ok)
+				git_index_read(index, TRUE);
+			git_tree_free(tree);
+		}
+		git_index_free(index);
+	}
+	if (ok)
+		ok = git_checkout_tree(repo, head, &opts) == 0;
+
+	git_object_free(head);
+	g_free(path);
+	return ok ? 0 : VC_COMMAND_FALLBACK;
+}
+
+/* git show HEAD:file */
+gint
+git2_show(gchar ** std_out, const gchar * filename)
+{
+	git_repository *repo;
+	git_tree *tree = NULL;
+	git_tree_entry *entry;
+	git_blob *blob;
+	gchar *path = NULL;
+	gint ret = VC_COMMAND_FALLBACK;
+
+	repo = get_repository(filename, &path);
+	if (!repo)
+		return VC_COMMAND_FALLBACK;
+
+	if (get_head_tree(repo, &tree) && tree && git_tree_entry_bypath(&entry, tree, path) == 0)
+	{
+		if (git_blob_lookup(&blob, repo, git_tree_entry_id(entry)) == 0)
+		{
+			set_output(std_out, g_string_new_len(git_blob_rawcontent(blob),
+							     git_blob_rawsize(blob)));
+			git_blob_free(blob);
+			ret = 0;
+		}
+		git_tree_entry_free(entry);
+	}
+	git_tree_free(tree);
+	g_free(path);
+	return ret;
+}
+
+void
+git2_cleanup(void)
+{
+	if (!repositories)
+		return;
+
+	g_hash_table_destroy(repositories);
+	repositories = NULL;
+	git_libgit2_shutdown();
+}
+
+#endif /* USE_LIBGIT2 */
@@ -200,8 +200,8 @@ in_vc_svn(const gchar * filename)
 	return ret;
 }
 
-static GSList *
-get_commit_files_svn(const gchar * dir)
+static void
+parse_svn_status(GHashTable * table, const gchar * dir, const gchar * txt)
 {
 	enum
 	{
@@ -210,21 +210,13 @@ get_commit_files_svn(const gchar * dir)
 		FILE_NAME,
 	};
 
-	gchar *txt;
-	GSList *ret = NULL;
 	gint pstatus = FIRST_CHAR;
 	const gchar *p;
 	gchar *base_name;
 	const gchar *start = NULL;
-	CommitItem *item;
 
 	const gchar *status = NULL;
 	gchar *filename;
-	const char *argv[] = { "svn", "status", NULL };
-
-	execute_custom_command(dir, argv, NULL, &txt, NULL, dir, NULL, NULL);
-	if (EMPTY(txt))
-		return NULL;
 	p = txt;
 
 	while (*p)
@@ -276,30 +268,33 @@ get_commit_files_svn(const gchar * dir)
 		{
 			if (*p == '\n')
 			{
-				if (status != FILE_STATUS_UNKNOWN)
-				{
-					base_name = g_malloc0(p - start + 1);
-					memcpy(base_name, start, p - start);
-					filename = g_build_filename(dir, base_name, NULL);
-					g_free(base_name);
-					item = g_new(CommitItem, 1);
-					item->status = status;
-					item->path = filename;
-					ret = g_slist_append(ret, item);
-				}
+				base_name = g_malloc0(p - start + 1);
+				memcpy(base_name, start, p - start);
+				filename = g_build_filename(dir, base_name, NULL);
+				g_free(base_name);
+				g_hash_table_insert(table, filename, (gpointer) status);
 				pstatus = FIRST_CHAR;
 			}
 		}
 		p++;
 	}
-	g_free(txt);
-	return ret;
 }
 
+static const gchar *SVN_META_DIRS[] = { ".svn", NULL };
+
+static const gchar *SVN_CMD_STATUS_ALL[] = { "svn", "status", NULL };
+
 VC_RECORD VC_SVN = {
 	commands,
 	"svn",
 	get_base_dir,
 	in_vc_svn,
-	get_commit_files_svn,
+	SVN_CMD_STATUS_ALL,
+	NULL,
+	parse_svn_status,
+	SVN_META_DIRS,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
 };
@@ -36,15 +36,6 @@
 # define git_libgit2_init     git_threads_init
 # define git_libgit2_shutdown git_threads_shutdown
 #endif
-#if ! defined (LIBGIT2_SOVERSION) || LIBGIT2_SOVERSION < 23
-/* 0.23 added @p binary_cb */
-# define git_diff_buffers(old_buffer, old_len, old_as_path, \
-                          new_buffer, new_len, new_as_path, options, \
-                          file_cb, binary_cb, hunk_cb, line_cb, payload) \
-  git_diff_buffers (old_buffer, old_len, old_as_path, \
-                    new_buffer, new_len, new_as_path, options, \
-                    file_cb, hunk_cb, line_cb, payload)
-#endif
 
 
 GeanyPlugin      *geany_plugin;
@@ -70,6 +61,19 @@ PLUGIN_SET_TRANSLATABLE_INFO (
 #define RESOURCES_ALLOCATED_QTAG \
   (g_quark_from_string (PLUGIN"/git-resources-allocated"))
 
+/* limits of the worker's blob cache.  it should be able to hold the HEAD
+ * contents of all open documents, but not grow indefinitely */
+#define BLOB_CACHE_MAX_ENTRIES  64
+#define BLOB_CACHE_MAX_SIZE     (32 * 1024 * 1024)
+
+/* maximum number of edits searched for when splitting a region to diff.
+ * Regions that differ more than that are split at the furthest point reached
+ * instead, which bounds the cost of diffing huge rewritten files */
+#define DIFF_MAX_COST           1024
+
+/* width of the hunk map drawn next to the vertical scrollbar */
+#define HUNK_MAP_WIDTH          6
+
 
 enum {
   MARKER_LINE_ADDED,
@@ -84,41 +88,143 @@ enum {
   KB_COUNT
 };
 
+/* first member of the jobs pushed to the worker */
+typedef enum {
+  JOB_BLOB_CONTENTS,
+  JOB_DIFF
+} JobType;
+
 typedef void (*BlobContentsReadyFunc) (const gchar *path,
                                        git_buf     *buf,
                                        gpointer     data);
 
+/* HEAD contents of a file, shared between the worker's cache and the UI */
+typedef struct BlobContents BlobContents;
+struct BlobContents {
+  volatile gint ref_count;
+  gchar        *key;  /* key in the worker's cache */
+  git_buf       buf;  /* ptr is NULL if the file isn't in HEAD */
+};
+
 typedef struct AsyncBlobContentsJob AsyncBlobContentsJob;
 struct AsyncBlobContentsJob {
+  JobType               type;
   gboolean              force;
   guint                 tag;
   gchar                *path;
-  git_buf               buf;
+  BlobContents         *contents;
   BlobContentsReadyFunc callback;
   gpointer              user_data;
 };
 
-typedef struct TooltipHunkData TooltipHunkData;
-struct TooltipHunkData {
-  gint            line;
-  gboolean        found;
-  GeanyDocument  *doc;
-  const git_buf  *buf;
-  GtkTooltip     *tooltip;
+/* a repository opened by the worker, kept open until it gets invalidated */
+typedef struct RepoEntry RepoEntry;
+struct RepoEntry {
+  git_repository *repo;
+  GFileMonitor   *monitors[2];
+  gboolean        monitored;        /* G_monitoring_enabled when opened */
+  gboolean        has_head_tree;
+  gint            head_generation;  /* G_repo_generation of head_tree */
+  git_oid         head_tree;
+};
+
+/* state of the worker thread, only ever accessed from it */
+typedef struct WorkerCache WorkerCache;
+struct WorkerCache {
+  GHashTable *repos;      /* workdir -> RepoEntry */
+  GHashTable *dirs;       /* directory -> RepoEntry */
+  GHashTable *blobs;      /* BlobContents::key -> link in blob_lru */
+  GQueue      blob_lru;   /* BlobContents, most recently used first */
+  gsize       blob_size;  /* total size of the blobs in the cache */
+};
+
+/* a difference between HEAD and the buffer, with 0-based line numbers.  For
+ * removals (new_lines == 0) new_start is the line before which old lines got
+ * removed */
+typedef struct Hunk Hunk;
+struct Hunk {
+  gint old_start;
+  gint old_lines;
+  gint new_start;
+  gint new_lines;
+};
+
+/* incremental diff of a document against its HEAD contents.  Lines are
+ * compared by hash and then by contents, and the buffer hashes are kept in sync with edits so that
+ * only the region between the first and last modified line needs to be
+ * diffed again.  Only one diff is computed at a time, and the lines modified
+ * while it is are tracked separately so its result can still be used */
+typedef struct DiffState DiffState;
+struct DiffState {
+  guint         doc_id;
+  BlobContents *contents;
+  gchar        *encoding;
+  gchar        *old_text;     /* HEAD contents in UTF-8 if they needed a
+                                 conversion, NULL to use contents */
+  GArray       *old_offsets;  /* gsize for each HEAD line, and its end */
+  GArray       *old_hashes;   /* guint32 for each HEAD line */
+  GArray       *new_hashes;   /* guint32 for each buffer line */
+  GArray       *hunks;        /* Hunk, sorted */
+  gint          diffed_lines; /* number of buffer lines at the last diff */
+  gint          dirty_start;  /* first line modified since the last diff */
+  gint          dirty_tail;   /* number of unmodified lines at the end */
+  gint          job_dirty_start; /* same, since the pending request */
+  gint          job_dirty_tail;
+  guint         generation;   /* bumped on each request and reset */
+  guint         pending;      /* generation of the pending request, or 0 */
+};
+
+/* a diff computed by the worker, either of the whole document or of the
+ * region modified since the last diff */
+typedef struct AsyncDiffJob AsyncDiffJob;
+struct AsyncDiffJob {
+  JobType       type;
+  guint         doc_id;
+  guint         generation;
+  /* whole document: HEAD contents and a snapshot of the buffer */
+  BlobContents *contents;
+  gchar        *encoding;
+  gchar        *text;
+  gsize         length;
+  /* region: hunks it replaces, and where it lies */
+  guint         first_hunk;
+  guint         last_hunk;
+  gint          old_start;
+  gint          new_start;
+  gint          new_end;      /* end in the coordinates of the last diff */
+  gint          n_lines;
+  /* text of the lines (of the region) for the region, and converted HEAD
+   * contents for the whole document */
+  gchar        *old_text;
+  /* offsets of the lines in their text, hashes and resulting hunks */
+  GArray       *old_offsets;
+  GArray       *new_offsets;
+  GArray       *old_hashes;
+  GArray       *new_hashes;
+  GArray       *hunks;
 };
 
-#define TOOLTIP_HUNK_DATA_INIT(line, doc, buf, tooltip) \
-  { line, FALSE, doc, buf, tooltip }
+/* lines of one side of a diff, line i being text[offsets[i], offsets[i + 1]) */
+typedef struct DiffSide DiffSide;
+struct DiffSide {
+  const guint32  *hashes;
+  const gchar    *text;
+  const gsize    *offsets;
+};
 
-typedef struct GotoNextHunkData GotoNextHunkData;
-struct GotoNextHunkData {
-  guint kb;
-  guint doc_id;
-  gint  line;
-  gint  next_line;
+/* state for diffing two sides */
+typedef struct DiffContext DiffContext;
+struct DiffContext {
+  DiffSide        a;
+  DiffSide        b;
+  guint8         *changed_a;
+  guint8         *changed_b;
+  gint           *v1;
+  gint           *v2;
 };
 
 
+static void         worker_do_diff_job          (AsyncDiffJob *job);
 static void         on_git_repo_changed         (GFileMonitor     *monitor,
                                                  GFile            *file,
                                                  GFile            *other_file,
@@ -130,6 +236,22 @@ static gboolean     on_sci_query_tooltip        (GtkWidget   *widget,
                                                  gboolean     keyboard_mode,
                                                  GtkTooltip  *tooltip,
                                                  gpointer     user_data);
+#if GTK_CHECK_VERSION (3, 0, 0)
+static gboolean     on_hunk_map_draw            (GtkWidget   *widget,
+                                                 cairo_t     *cr,
+                                                 gpointer     user_data);
+#else
+static gboolean     on_hunk_map_draw            (GtkWidget      *widget,
+                                                 GdkEventExpose *event,
+                                                 gpointer        user_data);
+#endif
+static gboolean     on_hunk_map_button_press    (GtkWidget      *widget,
+                                                 GdkEventButton *event,
+                                                 gpointer        user_data);
+static GtkWidget   *get_sci_text_widget         (ScintillaObject *sci);
+static void         queue_hunk_map_draw         (ScintillaObject *sci);
+static void         update_diff_push            (GeanyDocument *doc,
+                                                 gboolean       force);
 static void         read_setting_color          (GKeyFile    *kf,
                                                  const gchar *group,
                                                  const gchar *key,
@@ -149,13 +271,19 @@ static void         write_setting_boolean       (GKeyFile      *kf,
 
 
 /* cache */
-static git_buf          G_blob_contents       = { 0 };
+static BlobContents    *G_blob_contents       = NULL;
 static guint            G_blob_contents_tag   = 0;
+/* bumped whenever a monitored ref changes, so the worker knows HEAD might have
+ * moved.  accessed atomically */
+static volatile gint    G_repo_generation     = 0;
+static DiffState        G_diff                = { 0 };
 /* global state */
 static GAsyncQueue     *G_queue               = NULL;
 static GThread         *G_thread              = NULL;
 static gulong           G_source_id           = 0;
+static guint            G_source_doc_id       = 0;
 static gboolean         G_monitoring_enabled  = TRUE;
+static gboolean         G_hunk_map_enabled    = TRUE;
 static struct {
   gint    num;
   gint    style;
@@ -181,6 +309,8 @@ static const struct {
 } G_settings_desc[] = {
   { "general", "monitor-repository", &G_monitoring_enabled,
     read_setting_boolean, write_setting_boolean },
+  { "general", "show-hunk-map", &G_hunk_map_enabled,
+    read_setting_boolean, write_setting_boolean },
   { "colors", "line-added", &G_markers[MARKER_LINE_ADDED].color,
     read_setting_color, write_setting_color },
   { "colors", "line-changed", &G_markers[MARKER_LINE_CHANGED].color,
@@ -217,66 +347,117 @@ buf_zero (git_buf *buf)
   }
 }
 
+static BlobContents *
+blob_contents_ref (BlobContents *contents)
+{
+  g_atomic_int_inc (&contents->ref_count);
+  
+  return contents;
+}
+
+static void
+blob_contents_unref (BlobContents *contents)
+{
+  if (g_atomic_int_dec_and_test (&contents->ref_count)) {
+    if (contents->buf.ptr) {
+      git_buf_free (&contents->buf);
+    }
+    g_free (contents->key);
+    g_slice_free1 (sizeof *contents, contents);
+  }
+}
+
+/* gets the buffer to pass to a BlobContentsReadyFunc */
+static git_buf *
+blob_contents_get_buf (BlobContents *contents)
+{
+  return (contents && contents->buf.ptr) ? &contents->buf : NULL;
+}
+
 static void
 clear_cached_blob_contents (void)
 {
-  if (G_blob_contents.ptr) {
-    git_buf_free (&G_blob_contents);
-    buf_zero (&G_blob_contents);
+  if (G_blob_contents) {
+    blob_contents_unref (G_blob_contents);
+    G_blob_contents = NULL;
   }
   G_blob_contents_tag = 0;
 }
 
-/* get the file blob for @relpath at HEAD */
+/* get the file blob for @relpath in the tree @tree_id */
 static gboolean
 repo_get_file_blob_contents (git_repository  *repo,
+                             const git_oid   *tree_id,
                              const gchar     *relpath,
                              git_buf         *contents,
                              int              check_for_binary_data)
 {
-  git_reference  *head    = NULL;
-  gboolean        success = FALSE;
+  git_tree *tree    = NULL;
+  gboolean  success = FALSE;
   
-  if (git_repository_head (&head, repo) == 0) {
-    git_commit *commit = NULL;
+  if (git_tree_lookup (&tree, repo, tree_id) == 0) {
+    git_tree_entry *entry = NULL;
     
-    if (git_commit_lookup (&commit, repo, git_reference_target (head)) == 0) {
-      git_tree *tree = NULL;
+    if (git_tree_entry_bypath (&entry, tree, relpath) == 0) {
+      git_blob *blob;
       
-      if (git_commit_tree (&tree, commit) == 0) {
-        git_tree_entry *entry = NULL;
-        
-        if (git_tree_entry_bypath (&entry, tree, relpath) == 0) {
-          git_blob *blob;
-          
-          if (git_blob_lookup (&blob, repo, git_tree_entry_id (entry)) == 0) {
-            if (git_blob_filtered_content (contents, blob, relpath,
-                                           check_for_binary_data) == 0 &&
-                git_buf_grow (contents, 0) == 0) {
-              success = TRUE;
-            }
-            git_blob_free (blob);
-          }
-          git_tree_entry_free (entry);
+      if (git_blob_lookup (&blob, repo, git_tree_entry_id (entry)) == 0) {
+        if (git_blob_filtered_content (contents, blob, relpath,
+                                       check_for_binary_data) == 0 &&
+            git_buf_grow (contents, 0) == 0) {
+          success = TRUE;
         }
-        git_tree_free (tree);
+        git_blob_free (blob);
       }
-      git_commit_free (commit);
+      git_tree_entry_free (entry);
     }
-    git_reference_free (head);
+    git_tree_free (tree);
   }
   
   return success;
 }
 
+/* gets the ID of the tree HEAD points to.  It is only resolved again after
+ * a monitored ref changed, so repeated calls don't hit the object database */
+static gboolean
+repo_entry_get_head_tree (RepoEntry *entry,
+                          git_oid   *tree_id)
+{
+  gint generation = g_atomic_int_get (&G_repo_generation);
+  
+  if (! entry->has_head_tree || entry->head_generation != generation) {
+    git_reference *head = NULL;
+    
+    entry->has_head_tree = FALSE;
+    entry->head_generation = generation;
+    if (git_repository_head (&head, entry->repo) == 0) {
+      git_commit *commit = NULL;
+      
+      if (git_commit_lookup (&commit, entry->repo,
+                             git_reference_target (head)) == 0) {
+        git_oid_cpy (&entry->head_tree, git_commit_tree_id (commit));
+        entry->has_head_tree = TRUE;
+        git_commit_free (commit);
+      }
+      git_reference_free (head);
+    }
+  }
+  
+  if (entry->has_head_tree) {
+    git_oid_cpy (tree_id, &entry->head_tree);
+  }
+  
+  return entry->has_head_tree;
+}
+
 static void
 free_job (gpointer data)
 {
   AsyncBlobContentsJob *job = data;
   
-  /* unlikely, but if we still have the buffer, free it */
-  if (job->buf.ptr) {
-    git_buf_free (&job->buf);
+  /* unlikely, but if we still have the contents, release them */
+  if (job->contents) {
+    blob_contents_unref (job->contents);
   }
   g_free (job->path);
   g_slice_free1 (sizeof *job, job);
@@ -289,12 +470,12 @@ report_work_in_idle (gpointer data)
   
   /* update cached blob */
   clear_cached_blob_contents ();
-  G_blob_contents = job->buf;
-  G_blob_contents_tag = job->buf.ptr ? job->tag : 0;
+  G_blob_contents = job->contents;
+  G_blob_contents_tag = blob_contents_get_buf (job->contents) ? job->tag : 0;
+  job->contents = NULL;
   
-  job->callback (job->path, job->buf.ptr ? &job->buf : NULL, job->user_data);
-  
-  buf_zero (&job->buf);
+  job->callback (job->path, blob_contents_get_buf (G_blob_contents),
+                 job->user_data);
   
   return FALSE;
 }
@@ -396,76 +577,257 @@ get_path_in_repository (git_repository *repo,
 #endif
 }
 
-static gpointer
-worker_thread (gpointer data)
+static void
+repo_entry_free (gpointer data)
 {
-  GAsyncQueue          *queue       = data;
-  git_repository       *repo        = NULL;
-  GFileMonitor         *monitors[2] = { NULL, NULL };
-  AsyncBlobContentsJob *job;
-  guint                 i;
+  RepoEntry  *entry = data;
+  guint       i;
   
-  while ((job = g_async_queue_pop (queue)) != QUIT_THREAD_JOB) {
-    const gchar *path = job->path;
-    
-    if (repo && (job->force ||
-                 ! path_dir_contains (path, git_repository_workdir (repo)))) {
-      /* FIXME: this can fail with nested repositories */
+  for (i = 0; i < G_N_ELEMENTS (entry->monitors); i++) {
+    if (entry->monitors[i]) {
+      g_object_unref (entry->monitors[i]);
+    }
+  }
+  git_repository_free (entry->repo);
+  g_slice_free1 (sizeof *entry, entry);
+}
+
+static RepoEntry *
+repo_entry_new (git_repository *repo)
+{
+  RepoEntry *entry = g_slice_alloc0 (sizeof *entry);
+  
+  entry->repo = repo;
+  entry->monitored = G_monitoring_enabled;
+  if (entry->monitored) {
+    /* we need to monitor HEAD, in case of e.g. branch switch (e.g.
+     * git checkout -b will switch the ref we need to watch) */
+    entry->monitors[0] = monitor_repo_file (repo, "HEAD",
+                                            G_CALLBACK (on_git_repo_changed),
+                                            GINT_TO_POINTER (TRUE));
+    /* and of course the real ref (branch) for when changes get committed */
+    entry->monitors[1] = monitor_head_ref (repo,
+                                           G_CALLBACK (on_git_repo_changed),
+                                           GINT_TO_POINTER (FALSE));
+  }
+  
+  return entry;
+}
+
+static gboolean
+dir_entry_is (gpointer key,
+              gpointer value,
+              gpointer entry)
+{
+  return value == entry;
+}
+
+static void
+worker_cache_init (WorkerCache *cache)
+{
+  cache->repos = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, repo_entry_free);
+  cache->dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  cache->blobs = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&cache->blob_lru);
+  cache->blob_size = 0;
+}
+
+static void
+worker_cache_destroy (WorkerCache *cache)
+{
+  BlobContents *contents;
+  
+  while ((contents = g_queue_pop_head (&cache->blob_lru))) {
+    blob_contents_unref (contents);
+  }
+  g_hash_table_destroy (cache->blobs);
+  g_hash_table_destroy (cache->dirs);
+  g_hash_table_destroy (cache->repos);
+}
+
+static void
+worker_cache_drop_repo (WorkerCache  *cache,
+                        RepoEntry    *entry)
+{
+  g_hash_table_foreach_remove (cache->dirs, dir_entry_is, entry);
+  g_hash_table_remove (cache->repos, git_repository_workdir (entry->repo));
+}
+
+/* gets the repository @path belongs to, opening it if it isn't yet.  The
+ * lookup is cached by directory, so nested repositories are handled properly
+ * and we don't need to discover the repository again for each file.
+ * If @force is set, the repository is re-opened. */
+static RepoEntry *
+worker_cache_get_repo (WorkerCache *cache,
+                       const gchar *path,
+                       gboolean     force)
+{
+  gchar          *dir   = g_path_get_dirname (path);
+  RepoEntry      *entry = g_hash_table_lookup (cache->dirs, dir);
+  git_repository *repo  = NULL;
+  
+  if (entry) {
+    /* also re-open if the monitoring setting changed since it was opened */
+    if (! force && entry->monitored == G_monitoring_enabled) {
+      g_free (dir);
+      return entry;
+    }
+    worker_cache_drop_repo (cache, entry);
+    force = TRUE;
+  }
+  
+  entry = NULL;
+  if (git_repository_open_ext (&repo, path, 0, NULL) == 0) {
+    if (git_repository_is_bare (repo)) {
       git_repository_free (repo);
-      repo = NULL;
-      for (i = 0; i < G_N_ELEMENTS (monitors); i++) {
-        if (monitors[i]) {
-          g_object_unref (monitors[i]);
-          monitors[i] = NULL;
-        }
+    } else {
+      const gchar *workdir = git_repository_workdir (repo);
+      
+      entry = g_hash_table_lookup (cache->repos, workdir);
+      if (entry && force) {
+        worker_cache_drop_repo (cache, entry);
+        entry = NULL;
       }
-    }
-    if (! repo && git_repository_open_ext (&repo, path, 0, NULL) == 0) {
-      if (git_repository_is_bare (repo)) {
+      if (entry) {
         git_repository_free (repo);
-        repo = NULL;
-      } else if (G_monitoring_enabled) {
-        /* we need to monitor HEAD, in case of e.g. branch switch (e.g.
-         * git checkout -b will switch the ref we need to watch) */
-        monitors[0] = monitor_repo_file (repo, "HEAD",
-                                         G_CALLBACK (on_git_repo_changed),
-                                         GINT_TO_POINTER (TRUE));
-        /* and of course the real ref (branch) for when changes get committed */
-        monitors[1] = monitor_head_ref (repo, G_CALLBACK (on_git_repo_changed),
-                                        GINT_TO_POINTER (FALSE));
+      } else {
+        entry = repo_entry_new (repo);
+        g_hash_table_insert (cache->repos, g_strdup (workdir), entry);
       }
     }
+  }
+  if (entry) {
+    g_hash_table_insert (cache->dirs, dir, entry);
+  } else {
+    g_free (dir);
+  }
+  
+  return entry;
+}
+
+/* gets a new reference to the HEAD contents of @relpath in @entry */
+static BlobContents *
+worker_cache_get_blob (WorkerCache *cache,
+                       RepoEntry   *entry,
+                       const gchar *relpath)
+{
+  git_oid       tree_id;
+  gchar         tree_str[GIT_OID_HEXSZ + 1];
+  gchar        *key;
+  GList        *link;
+  BlobContents *contents;
+  
+  /* without monitors we can't know whether HEAD moved */
+  if (! entry->monitored) {
+    entry->has_head_tree = FALSE;
+  }
+  if (! repo_entry_get_head_tree (entry, &tree_id)) {
+    return NULL;
+  }
+  
+  git_oid_tostr (tree_str, sizeof tree_str, &tree_id);
+  key = g_strconcat (git_repository_workdir (entry->repo), "\n",
+                     relpath, "\n", tree_str, NULL);
+  
+  link = g_hash_table_lookup (cache->blobs, key);
+  if (link) {
+    g_free (key);
+    g_queue_unlink (&cache->blob_lru, link);
+    g_queue_push_head_link (&cache->blob_lru, link);
     
-    buf_zero (&job->buf);
-    if (repo) {
-      gchar *relpath = get_path_in_repository (repo, path);
-      
-      if (relpath) {
-        if (! repo_get_file_blob_contents (repo, relpath, &job->buf, 0)) {
-          git_buf_free (&job->buf);
-          buf_zero (&job->buf);
-        }
-        
-        g_free (relpath);
-      }
-    }
+    return blob_contents_ref (link->data);
+  }
+  
+  contents = g_slice_alloc (sizeof *contents);
+  contents->ref_count = 1;
+  contents->key = key;
+  buf_zero (&contents->buf);
+  /* also cache failures, so files not in HEAD don't hit the database again */
+  if (! repo_get_file_blob_contents (entry->repo, &tree_id, relpath,
+                                     &contents->buf, 0)) {
+    git_buf_free (&contents->buf);
+    buf_zero (&contents->buf);
+  }
+  
+  g_queue_push_head (&cache->blob_lru, contents);
+  g_hash_table_insert (cache->blobs, contents->key, cache->blob_lru.head);
+  cache->blob_size += contents->buf.size;
+  
+  /* evict the least recently used entries, but always keep the new one */
+  while (cache->blob_lru.length > 1 &&
+         (cache->blob_lru.length > BLOB_CACHE_MAX_ENTRIES ||
+          cache->blob_size > BLOB_CACHE_MAX_SIZE)) {
+    BlobContents *old = g_queue_pop_tail (&cache->blob_lru);
     
-    g_idle_add_full (G_PRIORITY_LOW, report_work_in_idle, job, free_job);
+    g_hash_table_remove (cache->blobs, old->key);
+    cache->blob_size -= old->buf.size;
+    blob_contents_unref (old);
   }
   
-  for (i = 0; i < G_N_ELEMENTS (monitors); i++) {
-    if (monitors[i]) {
-      g_object_unref (monitors[i]);
-      monitors[i] = NULL;
+  return blob_contents_ref (contents);
+}
+
+static void
+worker_do_blob_job (WorkerCache          *cache,
+                    AsyncBlobContentsJob *job)
+{
+  RepoEntry *entry = worker_cache_get_repo (cache, job->path, job->force);
+  
+  job->contents = NULL;
+  if (entry) {
+    gchar *relpath = get_path_in_repository (entry->repo, job->path);
+    
+    if (relpath) {
+      job->contents = worker_cache_get_blob (cache, entry, relpath);
+      g_free (relpath);
     }
   }
-  if (repo) {
-    git_repository_free (repo);
+  
+  g_idle_add_full (G_PRIORITY_LOW, report_work_in_idle, job, free_job);
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+  GAsyncQueue  *queue = data;
+  WorkerCache   cache;
+  gpointer      job;
+  
+  worker_cache_init (&cache);
+  
+  while ((job = g_async_queue_pop (queue)) != QUIT_THREAD_JOB) {
+    switch (*(JobType *) job) {
+      case JOB_BLOB_CONTENTS:
+        worker_do_blob_job (&cache, job);
+        break;
+      
+      case JOB_DIFF:
+        worker_do_diff_job (job);
+        break;
+    }
   }
   
+  worker_cache_destroy (&cache);
+  
   return NULL;
 }
 
+static void
+push_job (gpointer job)
+{
+  if (! G_thread) {
+    G_queue = g_async_queue_new ();
+#if GLIB_CHECK_VERSION (2, 32, 0)
+    G_thread = g_thread_new (PLUGIN"/blob-worker", worker_thread, G_queue);
+#else
+    G_thread = g_thread_create (worker_thread, G_queue, FALSE, NULL);
+#endif
+  }
+  
+  g_async_queue_push (G_queue, job);
+}
+
 static void
 get_cached_blob_contents_async (const gchar          *path,
                                 guint                 tag,
@@ -473,29 +835,21 @@ get_cached_blob_contents_async (const gchar          *path,
                                 BlobContentsReadyFunc callback,
                                 gpointer              user_data)
 {
-  if ((! force && G_blob_contents.ptr && tag == G_blob_contents_tag) ||
+  if ((! force && G_blob_contents && tag == G_blob_contents_tag) ||
       ! path) {
-    callback (path, &G_blob_contents, user_data);
+    callback (path, blob_contents_get_buf (G_blob_contents), user_data);
   } else {
     AsyncBlobContentsJob *job = g_slice_alloc (sizeof *job);
     
+    job->type       = JOB_BLOB_CONTENTS;
     job->force      = force;
     job->tag        = tag;
     job->path       = g_strdup (path);
+    job->contents   = NULL;
     job->callback   = callback;
     job->user_data  = user_data;
-    buf_zero (&job->buf);
-    
-    if (! G_thread) {
-      G_queue = g_async_queue_new ();
-#if GLIB_CHECK_VERSION (2, 32, 0)
-      G_thread = g_thread_new (PLUGIN"/blob-worker", worker_thread, G_queue);
-#else
-      G_thread = g_thread_create (worker_thread, G_queue, FALSE, NULL);
-#endif
-    }
     
-    g_async_queue_push (G_queue, job);
+    push_job (job);
   }
 }
 
@@ -534,7 +888,8 @@ allocate_marker (ScintillaObject *sci,
 static gboolean
 allocate_resources (ScintillaObject *sci)
 {
-  guint i;
+  guint       i;
+  GtkWidget  *text;
   
   if (g_object_get_qdata (G_OBJECT (sci), RESOURCES_ALLOCATED_QTAG)) {
     return TRUE;
@@ -563,6 +918,20 @@ allocate_resources (ScintillaObject *sci)
   g_signal_connect (sci, "query-tooltip",
                     G_CALLBACK (on_sci_query_tooltip), NULL);
   
+  /* setup the hunk map */
+  text = get_sci_text_widget (sci);
+  if (text) {
+#if GTK_CHECK_VERSION (3, 0, 0)
+    g_signal_connect_after (text, "draw",
+                            G_CALLBACK (on_hunk_map_draw), sci);
+#else
+    g_signal_connect_after (text, "expose-event",
+                            G_CALLBACK (on_hunk_map_draw), sci);
+#endif
+    g_signal_connect (text, "button-press-event",
+                      G_CALLBACK (on_hunk_map_button_press), sci);
+  }
+  
   g_object_set_qdata (G_OBJECT (sci), RESOURCES_ALLOCATED_QTAG,
                       sci /* anything non-NULL */);
   
@@ -573,7 +942,8 @@ static void
 release_resources (ScintillaObject *sci)
 {
   if (g_object_get_qdata (G_OBJECT (sci), RESOURCES_ALLOCATED_QTAG)) {
-    guint j;
+    guint       j;
+    GtkWidget  *text;
     
     for (j = 0; j < MARKER_COUNT; j++) {
       if (G_markers[j].num >= 0) {
@@ -582,6 +952,13 @@ release_resources (ScintillaObject *sci)
       }
     }
     g_signal_handlers_disconnect_by_func (sci, on_sci_query_tooltip, NULL);
+    text = get_sci_text_widget (sci);
+    if (text) {
+      g_signal_handlers_disconnect_by_func (text, on_hunk_map_draw, sci);
+      g_signal_handlers_disconnect_by_func (text, on_hunk_map_button_press,
+                                            sci);
+      queue_hunk_map_draw (sci);
+    }
     g_object_set_qdata (G_OBJECT (sci), RESOURCES_ALLOCATED_QTAG, NULL);
   }
 }
@@ -638,168 +1015,1011 @@ convert_encoding_inplace (gchar       **buffer,
   return tmp_buf != NULL;
 }
 
-static int
-diff_buf_to_doc (const git_buf   *old_buf,
-                 GeanyDocument   *doc,
-                 git_diff_hunk_cb hunk_cb,
-                 void            *payload)
+/* FNV-1a */
+static guint32
+hash_line (const gchar *line,
+           gsize        len)
 {
-  ScintillaObject  *sci = doc->editor->sci;
-  git_diff_options  opts = GIT_DIFF_OPTIONS_INIT;
-  gchar            *buf;
-  size_t            len;
-  gboolean          free_buf = FALSE;
-  int               ret;
-  
-  buf = (gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0);
-  len = sci_get_length (sci);
-  
-  /* convert the buffer back to in-file encoding if necessary */
-  if (encoding_needs_coversion (doc->encoding)) {
-    free_buf = convert_encoding_inplace (&buf, &len, doc->encoding, "UTF-8",
-                                         NULL);
-  }
-  
-  /* no context lines, and no need to bother about binary checks */
-  opts.context_lines = 0;
-  opts.flags = GIT_DIFF_FORCE_TEXT;
+  guint32 hash = 2166136261u;
+  gsize   i;
   
-  ret = git_diff_buffers (old_buf->ptr, old_buf->size, NULL,
-                          buf, len, NULL, &opts, NULL, NULL, hunk_cb, NULL,
-                          payload);
-  
-  if (free_buf) {
-    g_free (buf);
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (guchar) line[i]) * 16777619u;
   }
   
-  return ret;
+  return hash;
 }
 
-static int
-diff_hunk_cb (const git_diff_delta *delta,
-              const git_diff_hunk  *hunk,
-              void                 *data)
+/* splits @buf into lines the same way Scintilla does, e.g. there always is
+ * one more line than line endings, and hashes them.  @offsets gets the start
+ * of each line and the end of the last one */
+static void
+hash_buf_lines (const gchar *buf,
+                gsize        len,
+                GArray      *hashes,
+                GArray      *offsets)
 {
-  ScintillaObject *sci = data;
-  
-  if (hunk->new_lines > 0) {
-    gint  line;
-    guint marker = hunk->old_lines > 0 ? MARKER_LINE_CHANGED : MARKER_LINE_ADDED;
-    
-    for (line = hunk->new_start; line < hunk->new_start + hunk->new_lines; line++) {
-      scintilla_send_message (sci, SCI_MARKERADD, line - 1, G_markers[marker].num);
+  gsize start = 0;
+  gsize i;
+  
+  g_array_set_size (hashes, 0);
+  g_array_set_size (offsets, 0);
+  for (i = 0; i < len; i++) {
+    if (buf[i] == '\n' ||
+        (buf[i] == '\r' && (i + 1 >= len || buf[i + 1] != '\n'))) {
+      guint32 hash = hash_line (&buf[start], i + 1 - start);
+      
+      g_array_append_val (hashes, hash);
+      g_array_append_val (offsets, start);
+      start = i + 1;
     }
-  } else {
-    scintilla_send_message (sci, SCI_MARKERADD, hunk->new_start - 1,
-                            G_markers[MARKER_LINE_REMOVED].num);
   }
-  
-  return 0;
+  {
+    guint32 hash = hash_line (&buf[start], len - start);
+    
+    g_array_append_val (hashes, hash);
+    g_array_append_val (offsets, start);
+    g_array_append_val (offsets, len);
+  }
 }
 
-static GtkWidget *
-get_widget_for_buf_range (GeanyDocument *doc,
-                          const git_buf *contents,
-                          gint           line_start,
-                          gint           n_lines)
+/* hashes the buffer lines [@start, @end) into @hashes, which should already
+ * have the right size */
+static void
+hash_sci_lines (ScintillaObject *sci,
+                gint             start,
+                gint             end,
+                GArray          *hashes)
 {
-  ScintillaObject        *sci     = editor_create_widget (doc->editor);
-  const GeanyIndentPrefs *iprefs  = editor_get_indent_prefs (doc->editor);
-  gint                    width   = 0;
-  gint                    height  = 0;
-  gint                    zoom;
-  gint                    i;
-  GtkAllocation           alloc;
-  gchar                  *buf       = contents->ptr;
-  gsize                   buf_len   = contents->size;
-  gboolean                free_buf  = FALSE;
-  
-  gtk_widget_get_allocation (GTK_WIDGET (doc->editor->sci), &alloc);
-  
-  highlighting_set_styles (sci, doc->file_type);
-  if (iprefs->type == GEANY_INDENT_TYPE_BOTH) {
-    scintilla_send_message (sci, SCI_SETTABWIDTH, iprefs->hard_tab_width, 0);
-  } else {
-    scintilla_send_message (sci, SCI_SETTABWIDTH, iprefs->width, 0);
+  gint line_count = sci_get_line_count (sci);
+  gint pos        = sci_get_position_from_line (sci, start);
+  gint line;
+  
+  for (line = start; line < end; line++) {
+    gint          next = (line + 1 < line_count
+                          ? sci_get_position_from_line (sci, line + 1)
+                          : sci_get_length (sci));
+    const gchar  *text = (const gchar *) scintilla_send_message (
+                          sci, SCI_GETRANGEPOINTER, pos, next - pos);
+    
+    g_array_index (hashes, guint32, line) = hash_line (text, next - pos);
+    pos = next;
   }
-  scintilla_send_message (sci, SCI_SETINDENT, iprefs->width, 0);
-  zoom = scintilla_send_message (doc->editor->sci, SCI_GETZOOM, 0, 0);
-  scintilla_send_message (sci, SCI_SETZOOM, zoom, 0);
-  
-  /* hide stuff we don't wanna see */
-  scintilla_send_message (sci, SCI_SETHSCROLLBAR, 0, 0);
-  scintilla_send_message (sci, SCI_SETVSCROLLBAR, 0, 0);
-  for (i = 0; i < SC_MAX_MARGIN; i++) {
-    scintilla_send_message (sci, SCI_SETMARGINWIDTHN, i, 0);
+}
+
+/* copies the text of the buffer lines [@start, @end), with the offsets of
+ * the lines in the copy and of its end into @offsets */
+static gchar *
+copy_sci_lines (ScintillaObject *sci,
+                gint             start,
+                gint             end,
+                GArray          *offsets)
+{
+  gint    line_count  = sci_get_line_count (sci);
+  gint    first       = sci_get_position_from_line (sci, start);
+  gsize   length;
+  gchar  *text;
+  gint    line;
+  
+  g_array_set_size (offsets, 0);
+  for (line = start; line <= end; line++) {
+    gsize offset = (gsize) ((line < line_count
+                             ? sci_get_position_from_line (sci, line)
+                             : sci_get_length (sci)) - first);
+    
+    g_array_append_val (offsets, offset);
   }
   
-  /* convert the buffer to UTF-8 if necessary */
-  if (encoding_needs_coversion (doc->encoding)) {
-    free_buf = convert_encoding_inplace (&buf, &buf_len, "UTF-8", doc->encoding,
-                                         NULL);
-  }
+  length = g_array_index (offsets, gsize, end - start);
+  text = g_malloc (length + 1);
+  memcpy (text,
+          (const gchar *) scintilla_send_message (sci, SCI_GETRANGEPOINTER,
+                                                  first, length),
+          length);
+  text[length] = 0;
   
-  scintilla_send_message (sci, SCI_ADDTEXT, buf_len, (glong) buf);
+  return text;
+}
+
+/* whether line @i of the first side is the same as line @j of the second */
+static gboolean
+diff_lines_equal (const DiffContext *ctx,
+                  gint               i,
+                  gint               j)
+{
+  gsize a_len;
+  gsize b_len;
   
-  if (free_buf) {
-    g_free (buf);
+  if (ctx->a.hashes[i] != ctx->b.hashes[j]) {
+    return FALSE;
   }
   
-  /* we need to enable extra scroll after last line so that SETFIRSTVISIBLELINE
-   * really places the line we want on top of the view, even if the line is
-   * close to the end and wouldn't possibly end on top otherwise */
-  scintilla_send_message (sci, SCI_SETENDATLASTLINE, 0, 0);
-  scintilla_send_message (sci, SCI_SETFIRSTVISIBLELINE, line_start, 0);
-  
-  /* compute the size of the area we want to see */
-  for (i = line_start; i < line_start + n_lines; i++) {
-    gint pos    = sci_get_line_end_position (sci, i);
-    gint end_x  = scintilla_send_message (sci, SCI_POINTXFROMPOSITION, 0, pos);
-    
-    height += scintilla_send_message (sci, SCI_TEXTHEIGHT, i, 0);
-    width = MAX (width, end_x);
-    
-    if (height > alloc.height) {
-      break;
-    }
-  }
-  gtk_widget_set_size_request (GTK_WIDGET (sci),
-                               MIN (width, alloc.width),
-                               MIN (height + 1, alloc.height));
+  /* the hashes can collide */
+  a_len = ctx->a.offsets[i + 1] - ctx->a.offsets[i];
+  b_len = ctx->b.offsets[j + 1] - ctx->b.offsets[j];
   
-  return GTK_WIDGET (sci);
+  return (a_len == b_len &&
+          (a_len == 0 ||
+           memcmp (ctx->a.text + ctx->a.offsets[i],
+                   ctx->b.text + ctx->b.offsets[j], a_len) == 0));
 }
 
-static int
-tooltip_diff_hunk_cb (const git_diff_delta *delta,
-                      const git_diff_hunk  *hunk,
-                      void                 *data)
+/* finds the furthest reaching point of either path after @max_d steps, to
+ * split the regions when the middle snake is too costly to find.  Like xdiff
+ * does, this gives up on a minimal diff but not on a valid one */
+static gboolean
+diff_bisect_best (DiffContext *ctx,
+                  gint         n,
+                  gint         m,
+                  gint         max_d,
+                  gint        *x_out,
+                  gint        *y_out)
 {
-  TooltipHunkData *thd = data;
+  gint  v_offset  = max_d;
+  gint  best      = 0;
+  gint  k;
   
-  if (thd->found) {
-    return 1;
-  }
-  
-  if (hunk->old_lines > 0 &&
-      thd->line >= hunk->new_start &&
-      thd->line < hunk->new_start + MAX (1, hunk->new_lines)) {
-    GtkWidget *old = get_widget_for_buf_range (thd->doc, thd->buf,
-                                               hunk->old_start - 1,
-                                               hunk->old_lines);
+  for (k = -max_d + 1; k < max_d; k++) {
+    gint x1 = ctx->v1[v_offset + k];
+    gint x2 = ctx->v2[v_offset + k];
     
-    gtk_tooltip_set_custom (thd->tooltip, old);
-    thd->found = old != NULL;
+    if (x1 >= 0 && x1 <= n && x1 - k >= 0 && x1 - k <= m &&
+        2 * x1 - k > best) {
+      best = 2 * x1 - k;
+      *x_out = x1;
+      *y_out = x1 - k;
+    }
+    if (x2 >= 0 && x2 <= n && x2 - k >= 0 && x2 - k <= m &&
+        2 * x2 - k > best) {
+      best = 2 * x2 - k;
+      *x_out = n - x2;
+      *y_out = m - (x2 - k);
+    }
   }
   
-  return thd->found;
+  /* the split has to make progress on both sides */
+  return best > 0 && best < n + m;
 }
 
+/* finds the middle snake of the regions @n lines at @a_off and @m lines at
+ * @b_off, using the linear space variant of Myers' algorithm.  If it can't be
+ * found within DIFF_MAX_COST edits, gives a heuristic split point instead.
+ * Returns FALSE if there is no split point that makes progress */
 static gboolean
-on_sci_query_tooltip (GtkWidget  *widget,
-                      gint        x,
-                      gint        y,
-                      gboolean    keyboard_mode,
+diff_bisect (DiffContext *ctx,
+             gint         a_off,
+             gint         n,
+             gint         b_off,
+             gint         m,
+             gint        *x_out,
+             gint        *y_out)
+{
+  gint           *v1        = ctx->v1;
+  gint           *v2        = ctx->v2;
+  gint            max_d     = MIN ((n + m + 1) / 2, DIFF_MAX_COST);
+  gint            v_offset  = max_d;
+  gint            v_length  = 2 * max_d;
+  gint            delta     = n - m;
+  gboolean        front     = (delta % 2 != 0);
+  gint            k1start   = 0;
+  gint            k1end     = 0;
+  gint            k2start   = 0;
+  gint            k2end     = 0;
+  gint            d;
+  gint            i;
+  
+  for (i = 0; i < v_length; i++) {
+    v1[i] = -1;
+    v2[i] = -1;
+  }
+  v1[v_offset + 1] = 0;
+  v2[v_offset + 1] = 0;
+  
+  for (d = 0; d < max_d; d++) {
+    gint k1;
+    gint k2;
+    
+    /* walk the front path one step */
+    for (k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+      gint k1_offset = v_offset + k1;
+      gint x1;
+      gint y1;
+      
+      if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1])) {
+        x1 = v1[k1_offset + 1];
+      } else {
+        x1 = v1[k1_offset - 1] + 1;
+      }
+      y1 = x1 - k1;
+      while (x1 < n && y1 < m &&
+             diff_lines_equal (ctx, a_off + x1, b_off + y1)) {
+        x1++, y1++;
+      }
+      v1[k1_offset] = x1;
+      if (x1 > n) {
+        k1end += 2;
+      } else if (y1 > m) {
+        k1start += 2;
+      } else if (front) {
+        gint k2_offset = v_offset + delta - k1;
+        
+        if (k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1 &&
+            x1 >= n - v2[k2_offset]) {
+          *x_out = x1;
+          *y_out = y1;
+          return TRUE;
+        }
+      }
+    }
+    
+    /* walk the reverse path one step */
+    for (k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+      gint k2_offset = v_offset + k2;
+      gint x2;
+      gint y2;
+      
+      if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1])) {
+        x2 = v2[k2_offset + 1];
+      } else {
+        x2 = v2[k2_offset - 1] + 1;
+      }
+      y2 = x2 - k2;
+      while (x2 < n && y2 < m &&
+             diff_lines_equal (ctx, a_off + n - x2 - 1, b_off + m - y2 - 1)) {
+        x2++, y2++;
+      }
+      v2[k2_offset] = x2;
+      if (x2 > n) {
+        k2end += 2;
+      } else if (y2 > m) {
+        k2start += 2;
+      } else if (! front) {
+        gint k1_offset = v_offset + delta - k2;
+        
+        if (k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
+          gint x1 = v1[k1_offset];
+          
+          if (x1 >= n - x2) {
+            *x_out = x1;
+            *y_out = v_offset + x1 - k1_offset;
+            return TRUE;
+          }
+        }
+      }
+    }
+  }
+  
+  return diff_bisect_best (ctx, n, m, max_d, x_out, y_out);
+}
+
+/* marks the lines that differ between the given regions */
+static void
+diff_mark_changes (DiffContext *ctx,
+                   gint         a_start,
+                   gint         a_end,
+                   gint         b_start,
+                   gint         b_end)
+{
+  gint x;
+  gint y;
+  
+  /* skip the common prefix and suffix */
+  while (a_start < a_end && b_start < b_end &&
+         diff_lines_equal (ctx, a_start, b_start)) {
+    a_start++, b_start++;
+  }
+  while (a_start < a_end && b_start < b_end &&
+         diff_lines_equal (ctx, a_end - 1, b_end - 1)) {
+    a_end--, b_end--;
+  }
+  
+  /* only lines without any counterpart left get marked, as every split point
+   * keeps the lines before and after it apart */
+  if (a_start == a_end || b_start == b_end ||
+      ! diff_bisect (ctx, a_start, a_end - a_start, b_start, b_end - b_start,
+                     &x, &y)) {
+    memset (&ctx->changed_a[a_start], 1, a_end - a_start);
+    memset (&ctx->changed_b[b_start], 1, b_end - b_start);
+  } else {
+    diff_mark_changes (ctx, a_start, a_start + x, b_start, b_start + y);
+    diff_mark_changes (ctx, a_start + x, a_end, b_start + y, b_end);
+  }
+}
+
+/* diffs the @n lines of @a against the @m lines of @b and appends the
+ * resulting hunks to @hunks */
+static void
+diff_lines (const DiffSide *a,
+            gint            n,
+            const DiffSide *b,
+            gint            m,
+            GArray         *hunks)
+{
+  DiffContext ctx;
+  gint        max_d = MIN ((n + m + 1) / 2, DIFF_MAX_COST);
+  gint        i     = 0;
+  gint        j     = 0;
+  
+  ctx.a = *a;
+  ctx.b = *b;
+  ctx.changed_a = g_malloc0 (n + 1);
+  ctx.changed_b = g_malloc0 (m + 1);
+  ctx.v1 = g_new (gint, 2 * max_d + 2);
+  ctx.v2 = g_new (gint, 2 * max_d + 2);
+  
+  diff_mark_changes (&ctx, 0, n, 0, m);
+  
+  /* unchanged lines match each other in order, so group the changed ones in
+   * between into hunks */
+  while (i < n || j < m) {
+    if (ctx.changed_a[i] || ctx.changed_b[j]) {
+      Hunk hunk;
+      
+      hunk.old_start = i;
+      hunk.new_start = j;
+      while (i < n && ctx.changed_a[i]) {
+        i++;
+      }
+      while (j < m && ctx.changed_b[j]) {
+        j++;
+      }
+      hunk.old_lines = i - hunk.old_start;
+      hunk.new_lines = j - hunk.new_start;
+      g_array_append_val (hunks, hunk);
+    } else {
+      i++, j++;
+    }
+  }
+  
+  g_free (ctx.changed_a);
+  g_free (ctx.changed_b);
+  g_free (ctx.v1);
+  g_free (ctx.v2);
+}
+
+/* gets the index of the first hunk that ends at or after @line */
+static guint
+hunks_lookup (GArray *hunks,
+              gint    line)
+{
+  guint lo = 0;
+  guint hi = hunks->len;
+  
+  while (lo < hi) {
+    guint       mid   = lo + (hi - lo) / 2;
+    const Hunk *hunk  = &g_array_index (hunks, Hunk, mid);
+    
+    if (hunk->new_start + hunk->new_lines < line) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  return lo;
+}
+
+/* gets the first line the markers of @hunk are on */
+static gint
+hunk_first_line (const Hunk *hunk)
+{
+  return hunk->new_lines > 0 ? hunk->new_start : MAX (hunk->new_start - 1, 0);
+}
+
+/* gets the last line the markers of @hunk are on */
+static gint
+hunk_last_line (const Hunk *hunk)
+{
+  return (hunk->new_lines > 0
+          ? hunk->new_start + hunk->new_lines - 1
+          : hunk_first_line (hunk));
+}
+
+static guint
+hunk_get_marker (const Hunk *hunk)
+{
+  if (hunk->new_lines == 0) {
+    return MARKER_LINE_REMOVED;
+  } else if (hunk->old_lines == 0) {
+    return MARKER_LINE_ADDED;
+  } else {
+    return MARKER_LINE_CHANGED;
+  }
+}
+
+/* gets the index of the first hunk which markers end at or after @line */
+static guint
+hunks_lookup_line (GArray *hunks,
+                   gint    line)
+{
+  guint lo = 0;
+  guint hi = hunks->len;
+  
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    
+    if (hunk_last_line (&g_array_index (hunks, Hunk, mid)) < line) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  return lo;
+}
+
+/* updates the markers of the lines [@start, @end) to match @hunks, only
+ * touching the lines which state changed */
+static void
+update_markers (ScintillaObject *sci,
+                GArray          *hunks,
+                gint             start,
+                gint             end)
+{
+  gint  *masks;
+  gint   all_mask = 0;
+  gint   line;
+  guint  i;
+  
+  start = MAX (start, 0);
+  end = MIN (end, sci_get_line_count (sci));
+  if (start >= end) {
+    return;
+  }
+  
+  for (i = 0; i < MARKER_COUNT; i++) {
+    all_mask |= 1 << G_markers[i].num;
+  }
+  
+  masks = g_new0 (gint, end - start);
+  for (i = hunks_lookup (hunks, start); i < hunks->len; i++) {
+    const Hunk *hunk = &g_array_index (hunks, Hunk, i);
+    
+    if (hunk->new_start - 1 >= end) {
+      break;
+    } else if (hunk->new_lines > 0) {
+      guint marker = hunk->old_lines > 0 ? MARKER_LINE_CHANGED : MARKER_LINE_ADDED;
+      
+      for (line = MAX (start, hunk->new_start);
+           line < MIN (end, hunk->new_start + hunk->new_lines); line++) {
+        masks[line - start] |= 1 << G_markers[marker].num;
+      }
+    } else if (hunk->new_start - 1 >= start) {
+      masks[hunk->new_start - 1 - start] |= 1 << G_markers[MARKER_LINE_REMOVED].num;
+    }
+  }
+  
+  for (line = start; line < end; line++) {
+    gint current  = scintilla_send_message (sci, SCI_MARKERGET, line, 0);
+    gint changes  = (current ^ masks[line - start]) & all_mask;
+    
+    for (i = 0; changes && i < MARKER_COUNT; i++) {
+      if (changes & (1 << G_markers[i].num)) {
+        scintilla_send_message (sci,
+                                (masks[line - start] & (1 << G_markers[i].num))
+                                ? SCI_MARKERADD : SCI_MARKERDELETE,
+                                line, G_markers[i].num);
+      }
+    }
+  }
+  
+  g_free (masks);
+}
+
+static void
+diff_state_clear (void)
+{
+  guint generation = G_diff.generation;
+  
+  if (G_diff.contents) {
+    blob_contents_unref (G_diff.contents);
+  }
+  g_free (G_diff.encoding);
+  g_free (G_diff.old_text);
+  if (G_diff.old_offsets) {
+    g_array_free (G_diff.old_offsets, TRUE);
+  }
+  if (G_diff.old_hashes) {
+    g_array_free (G_diff.old_hashes, TRUE);
+  }
+  if (G_diff.new_hashes) {
+    g_array_free (G_diff.new_hashes, TRUE);
+  }
+  if (G_diff.hunks) {
+    g_array_free (G_diff.hunks, TRUE);
+  }
+  memset (&G_diff, 0, sizeof G_diff);
+  /* keep the generation growing so pending results get dropped */
+  G_diff.generation = generation + 1;
+}
+
+static void
+free_diff_job (gpointer data)
+{
+  AsyncDiffJob *job = data;
+  
+  if (job->contents) {
+    blob_contents_unref (job->contents);
+  }
+  g_free (job->encoding);
+  g_free (job->text);
+  g_free (job->old_text);
+  if (job->old_offsets) {
+    g_array_free (job->old_offsets, TRUE);
+  }
+  if (job->new_offsets) {
+    g_array_free (job->new_offsets, TRUE);
+  }
+  if (job->old_hashes) {
+    g_array_free (job->old_hashes, TRUE);
+  }
+  if (job->new_hashes) {
+    g_array_free (job->new_hashes, TRUE);
+  }
+  if (job->hunks) {
+    g_array_free (job->hunks, TRUE);
+  }
+  g_slice_free1 (sizeof *job, job);
+}
+
+/* updates the markers of the lines [@start, @end) of the buffer as it was when
+ * the pending diff was requested, skipping the lines modified since then */
+static void
+update_markers_since_request (ScintillaObject *sci,
+                              GArray          *hunks,
+                              gint             start,
+                              gint             end,
+                              gint             n_lines)
+{
+  gint    head  = MIN (G_diff.job_dirty_start, n_lines);
+  gint    tail  = MIN (G_diff.job_dirty_tail, n_lines - head);
+  gint    delta = sci_get_line_count (sci) - n_lines;
+  GArray *shifted;
+  guint   i;
+  
+  if (head == n_lines) {
+    update_markers (sci, hunks, start, end);
+    return;
+  }
+  
+  /* lines before the first modification didn't move */
+  update_markers (sci, hunks, start, MIN (end, head));
+  
+  /* and the ones after the last one moved by the number of lines added */
+  if (end > n_lines - tail) {
+    shifted = g_array_new (FALSE, FALSE, sizeof (Hunk));
+    for (i = hunks_lookup (hunks, n_lines - tail); i < hunks->len; i++) {
+      Hunk hunk = g_array_index (hunks, Hunk, i);
+      
+      hunk.new_start += delta;
+      g_array_append_val (shifted, hunk);
+    }
+    update_markers (sci, shifted, MAX (start, n_lines - tail) + delta,
+                    end + delta);
+    g_array_free (shifted, TRUE);
+  }
+}
+
+/* gets the hashes of the buffer from the @hashes of the lines it had when the
+ * pending diff was requested, leaving the lines modified since then to be
+ * hashed again */
+static GArray *
+hashes_since_request (ScintillaObject *sci,
+                      GArray          *hashes)
+{
+  gint    n_lines = hashes->len;
+  gint    head    = MIN (G_diff.job_dirty_start, n_lines);
+  gint    tail    = MIN (G_diff.job_dirty_tail, n_lines - head);
+  gint    current = sci_get_line_count (sci);
+  GArray *result;
+  
+  if (head == n_lines && current == n_lines) {
+    return hashes;
+  }
+  
+  result = g_array_sized_new (FALSE, TRUE, sizeof (guint32), current);
+  g_array_append_vals (result, hashes->data, head);
+  g_array_set_size (result, current - tail);
+  g_array_append_vals (result, &g_array_index (hashes, guint32, n_lines - tail),
+                       tail);
+  g_array_free (hashes, TRUE);
+  
+  return result;
+}
+
+/* applies the result of a diff job.  If the document was modified since it
+ * was requested, the lines modified in the meantime are left to the next diff
+ * and the result is shifted to match the others */
+static gboolean
+report_diff_in_idle (gpointer data)
+{
+  AsyncDiffJob     *job = data;
+  GeanyDocument    *doc = document_get_current ();
+  ScintillaObject  *sci;
+  
+  if (job->generation != G_diff.pending || job->doc_id != G_diff.doc_id) {
+    return FALSE;
+  }
+  G_diff.pending = 0;
+  if (! doc || doc->id != job->doc_id) {
+    return FALSE;
+  }
+  
+  sci = doc->editor->sci;
+  if (job->contents) {
+    G_diff.old_text = job->old_text;
+    G_diff.old_offsets = job->old_offsets;
+    G_diff.old_hashes = job->old_hashes;
+    G_diff.new_hashes = hashes_since_request (sci, job->new_hashes);
+    G_diff.hunks = job->hunks;
+    job->old_text = NULL;
+    job->old_offsets = NULL;
+    job->old_hashes = NULL;
+    job->new_hashes = NULL;
+    job->hunks = NULL;
+    
+    update_markers_since_request (sci, G_diff.hunks, 0, job->n_lines,
+                                  job->n_lines);
+  } else {
+    gint    delta = job->n_lines - G_diff.diffed_lines;
+    GArray *hunks = g_array_sized_new (FALSE, FALSE, sizeof (Hunk),
+                                       G_diff.hunks->len + job->hunks->len);
+    guint   i;
+    
+    g_array_append_vals (hunks, G_diff.hunks->data, job->first_hunk);
+    g_array_append_vals (hunks, job->hunks->data, job->hunks->len);
+    for (i = job->last_hunk; i < G_diff.hunks->len; i++) {
+      Hunk hunk = g_array_index (G_diff.hunks, Hunk, i);
+      
+      hunk.new_start += delta;
+      g_array_append_val (hunks, hunk);
+    }
+    g_array_free (G_diff.hunks, TRUE);
+    G_diff.hunks = hunks;
+    
+    /* the removal marker of a hunk starting the region goes on the line
+     * before it */
+    update_markers_since_request (sci, G_diff.hunks, job->new_start - 1,
+                                  job->new_end + delta + 1, job->n_lines);
+  }
+  
+  /* the hunks are now those of the buffer as it was on request */
+  G_diff.diffed_lines = job->n_lines;
+  G_diff.dirty_start = G_diff.job_dirty_start;
+  G_diff.dirty_tail = G_diff.job_dirty_tail;
+  
+  queue_hunk_map_draw (sci);
+  
+  /* catch up with the modifications made in the meantime */
+  if (G_diff.dirty_start != G_MAXINT) {
+    update_diff_push (doc, FALSE);
+  }
+  
+  return FALSE;
+}
+
+/* runs in the worker thread */
+static void
+worker_do_diff_job (AsyncDiffJob *job)
+{
+  DiffSide  old_side;
+  DiffSide  new_side;
+  
+  job->hunks = g_array_new (FALSE, FALSE, sizeof (Hunk));
+  
+  if (job->contents) {
+    gchar    *buf       = job->contents->buf.ptr;
+    gsize     len       = job->contents->buf.size;
+    
+    /* convert the HEAD contents to the buffer encoding, it's only done once
+     * for all the following updates */
+    if (encoding_needs_coversion (job->encoding) &&
+        convert_encoding_inplace (&buf, &len, "UTF-8", job->encoding, NULL)) {
+      job->old_text = buf;
+    }
+    job->old_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+    job->old_hashes = g_array_new (FALSE, FALSE, sizeof (guint32));
+    hash_buf_lines (buf, len, job->old_hashes, job->old_offsets);
+    
+    job->new_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+    job->new_hashes = g_array_new (FALSE, FALSE, sizeof (guint32));
+    hash_buf_lines (job->text, job->length, job->new_hashes, job->new_offsets);
+    job->n_lines = job->new_hashes->len;
+    
+    old_side.text = buf;
+    new_side.text = job->text;
+  } else {
+    old_side.text = job->old_text;
+    new_side.text = job->text;
+  }
+  
+  old_side.hashes = (const guint32 *) job->old_hashes->data;
+  old_side.offsets = (const gsize *) job->old_offsets->data;
+  new_side.hashes = (const guint32 *) job->new_hashes->data;
+  new_side.offsets = (const gsize *) job->new_offsets->data;
+  diff_lines (&old_side, job->old_hashes->len,
+              &new_side, job->new_hashes->len, job->hunks);
+  
+  if (! job->contents) {
+    guint i;
+    
+    for (i = 0; i < job->hunks->len; i++) {
+      Hunk *hunk = &g_array_index (job->hunks, Hunk, i);
+      
+      hunk->old_start += job->old_start;
+      hunk->new_start += job->new_start;
+    }
+  }
+  
+  g_idle_add_full (G_PRIORITY_LOW, report_diff_in_idle, job, free_diff_job);
+}
+
+static AsyncDiffJob *
+diff_job_new (void)
+{
+  AsyncDiffJob *job = g_slice_alloc0 (sizeof *job);
+  
+  job->type = JOB_DIFF;
+  job->doc_id = G_diff.doc_id;
+  job->generation = ++G_diff.generation;
+  G_diff.pending = job->generation;
+  G_diff.job_dirty_start = G_MAXINT;
+  G_diff.job_dirty_tail = G_MAXINT;
+  
+  return job;
+}
+
+/* starts tracking @doc against @contents, and requests a full diff of a
+ * snapshot of the buffer */
+static void
+diff_state_request_full (GeanyDocument *doc,
+                         BlobContents  *contents)
+{
+  ScintillaObject  *sci = doc->editor->sci;
+  AsyncDiffJob     *job;
+  
+  diff_state_clear ();
+  G_diff.doc_id = doc->id;
+  G_diff.contents = blob_contents_ref (contents);
+  G_diff.encoding = g_strdup (doc->encoding);
+  
+  job = diff_job_new ();
+  job->contents = blob_contents_ref (contents);
+  job->encoding = g_strdup (doc->encoding);
+  job->length = sci_get_length (sci);
+  job->text = g_malloc (job->length + 1);
+  memcpy (job->text,
+          (const gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER,
+                                                  0, 0),
+          job->length + 1);
+  
+  push_job (job);
+}
+
+/* requests a diff of the region of the tracked document modified since the
+ * last diff.  The region is extended to the hunks it touches, so it is
+ * delimited by lines that are known to match */
+static void
+diff_state_request_update (ScintillaObject *sci)
+{
+  gint          n_lines = G_diff.new_hashes->len;
+  gint          head    = MIN (G_diff.dirty_start, n_lines);
+  gint          tail    = MIN (G_diff.dirty_tail, n_lines - head);
+  gint          new_start;
+  gint          new_end;
+  gint          old_start;
+  gint          old_end;
+  guint         first;
+  guint         last;
+  AsyncDiffJob *job;
+  
+  if (G_diff.dirty_start == G_MAXINT) {
+    return;
+  }
+  
+  tail = MIN (tail, G_diff.diffed_lines - head);
+  hash_sci_lines (sci, head, n_lines - tail, G_diff.new_hashes);
+  
+  /* extend the region to the hunks it touches (in the coordinates of the last
+   * diff) */
+  new_start = head;
+  new_end = G_diff.diffed_lines - tail;
+  first = hunks_lookup (G_diff.hunks, new_start);
+  for (last = first; last < G_diff.hunks->len; last++) {
+    const Hunk *hunk = &g_array_index (G_diff.hunks, Hunk, last);
+    
+    if (hunk->new_start > new_end) {
+      break;
+    }
+    new_start = MIN (new_start, hunk->new_start);
+    new_end = MAX (new_end, hunk->new_start + hunk->new_lines);
+  }
+  
+  /* find the matching region in HEAD, lines outside of it being aligned */
+  if (first > 0) {
+    const Hunk *prev = &g_array_index (G_diff.hunks, Hunk, first - 1);
+    
+    old_start = (prev->old_start + prev->old_lines +
+                 new_start - (prev->new_start + prev->new_lines));
+  } else {
+    old_start = new_start;
+  }
+  if (last < G_diff.hunks->len) {
+    const Hunk *next = &g_array_index (G_diff.hunks, Hunk, last);
+    
+    old_end = next->old_start - (next->new_start - new_end);
+  } else {
+    old_end = G_diff.old_hashes->len - (G_diff.diffed_lines - new_end);
+  }
+  
+  job = diff_job_new ();
+  job->first_hunk = first;
+  job->last_hunk = last;
+  job->old_start = old_start;
+  job->new_start = new_start;
+  job->new_end = new_end;
+  job->n_lines = n_lines;
+  job->old_hashes = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+                                       old_end - old_start);
+  g_array_append_vals (job->old_hashes,
+                       &g_array_index (G_diff.old_hashes, guint32, old_start),
+                       old_end - old_start);
+  job->new_hashes = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+                                       new_end + n_lines - G_diff.diffed_lines -
+                                       new_start);
+  g_array_append_vals (job->new_hashes,
+                       &g_array_index (G_diff.new_hashes, guint32, new_start),
+                       new_end + n_lines - G_diff.diffed_lines - new_start);
+  
+  /* the worker compares lines of equal hash by their text, so give it copies
+   * of the lines of the region */
+  {
+    const gchar  *old_text  = (G_diff.old_text ? G_diff.old_text
+                                               : G_diff.contents->buf.ptr);
+    gsize         old_base  = g_array_index (G_diff.old_offsets, gsize,
+                                             old_start);
+    gsize         old_length;
+    gint          i;
+    
+    job->old_offsets = g_array_sized_new (FALSE, FALSE, sizeof (gsize),
+                                          old_end - old_start + 1);
+    for (i = old_start; i <= old_end; i++) {
+      gsize offset = g_array_index (G_diff.old_offsets, gsize, i) - old_base;
+      
+      g_array_append_val (job->old_offsets, offset);
+    }
+    old_length = g_array_index (job->old_offsets, gsize, old_end - old_start);
+    job->old_text = g_malloc (old_length + 1);
+    if (old_length > 0) {
+      memcpy (job->old_text, old_text + old_base, old_length);
+    }
+    job->new_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+    job->text = copy_sci_lines (sci, new_start,
+                                new_end + n_lines - G_diff.diffed_lines,
+                                job->new_offsets);
+  }
+  
+  push_job (job);
+}
+
+/* updates the buffer line hashes of the tracked document after a
+ * modification, and extends the regions to diff again */
+static void
+diff_state_track_change (ScintillaObject      *sci,
+                         const SCNotification *nt)
+{
+  GArray *hashes  = G_diff.new_hashes;
+  gint    line    = sci_get_line_from_position (sci, nt->position);
+  gint    n_lines = sci_get_line_count (sci);
+  gint    tail    = n_lines - (line + MAX (nt->linesAdded, 0) + 1);
+  gint    len;
+  
+  /* the result of the pending diff gets shifted by the modifications made
+   * while it is computed */
+  if (G_diff.pending) {
+    G_diff.job_dirty_start = MIN (G_diff.job_dirty_start, line);
+    G_diff.job_dirty_tail = MIN (G_diff.job_dirty_tail, tail);
+  }
+  if (! hashes) {
+    return;
+  }
+  
+  len = hashes->len;
+  if (nt->linesAdded > 0 && line < len) {
+    g_array_set_size (hashes, len + nt->linesAdded);
+    memmove (&g_array_index (hashes, guint32, line + 1 + nt->linesAdded),
+             &g_array_index (hashes, guint32, line + 1),
+             (len - line - 1) * sizeof (guint32));
+  } else if (nt->linesAdded < 0 && line + 1 - nt->linesAdded <= len) {
+    g_array_remove_range (hashes, line + 1, - nt->linesAdded);
+  } else if (nt->linesAdded != 0 || line >= len) {
+    /* we missed something, start over */
+    diff_state_clear ();
+    return;
+  }
+  
+  G_diff.dirty_start = MIN (G_diff.dirty_start, line);
+  G_diff.dirty_tail = MIN (G_diff.dirty_tail, tail);
+}
+
+static GtkWidget *
+get_widget_for_buf_range (GeanyDocument *doc,
+                          const git_buf *contents,
+                          gint           line_start,
+                          gint           n_lines)
+{
+  ScintillaObject        *sci     = editor_create_widget (doc->editor);
+  const GeanyIndentPrefs *iprefs  = editor_get_indent_prefs (doc->editor);
+  gint                    width   = 0;
+  gint                    height  = 0;
+  gint                    zoom;
+  gint                    i;
+  GtkAllocation           alloc;
+  gchar                  *buf       = contents->ptr;
+  gsize                   buf_len   = contents->size;
+  gboolean                free_buf  = FALSE;
+  
+  gtk_widget_get_allocation (GTK_WIDGET (doc->editor->sci), &alloc);
+  
+  highlighting_set_styles (sci, doc->file_type);
+  if (iprefs->type == GEANY_INDENT_TYPE_BOTH) {
+    scintilla_send_message (sci, SCI_SETTABWIDTH, iprefs->hard_tab_width, 0);
+  } else {
+    scintilla_send_message (sci, SCI_SETTABWIDTH, iprefs->width, 0);
+  }
+  scintilla_send_message (sci, SCI_SETINDENT, iprefs->width, 0);
+  zoom = scintilla_send_message (doc->editor->sci, SCI_GETZOOM, 0, 0);
+  scintilla_send_message (sci, SCI_SETZOOM, zoom, 0);
+  
+  /* hide stuff we don't wanna see */
+  scintilla_send_message (sci, SCI_SETHSCROLLBAR, 0, 0);
+  scintilla_send_message (sci, SCI_SETVSCROLLBAR, 0, 0);
+  for (i = 0; i < SC_MAX_MARGIN; i++) {
+    scintilla_send_message (sci, SCI_SETMARGINWIDTHN, i, 0);
+  }
+  
+  /* convert the buffer to UTF-8 if necessary */
+  if (encoding_needs_coversion (doc->encoding)) {
+    free_buf = convert_encoding_inplace (&buf, &buf_len, "UTF-8", doc->encoding,
+                                         NULL);
+  }
+  
+  scintilla_send_message (sci, SCI_ADDTEXT, buf_len, (glong) buf);
+  
+  if (free_buf) {
+    g_free (buf);
+  }
+  
+  /* we need to enable extra scroll after last line so that SETFIRSTVISIBLELINE
+   * really places the line we want on top of the view, even if the line is
+   * close to the end and wouldn't possibly end on top otherwise */
+  scintilla_send_message (sci, SCI_SETENDATLASTLINE, 0, 0);
+  scintilla_send_message (sci, SCI_SETFIRSTVISIBLELINE, line_start, 0);
+  
+  /* compute the size of the area we want to see */
+  for (i = line_start; i < line_start + n_lines; i++) {
+    gint pos    = sci_get_line_end_position (sci, i);
+    gint end_x  = scintilla_send_message (sci, SCI_POINTXFROMPOSITION, 0, pos);
+    
+    height += scintilla_send_message (sci, SCI_TEXTHEIGHT, i, 0);
+    width = MAX (width, end_x);
+    
+    if (height > alloc.height) {
+      break;
+    }
+  }
+  gtk_widget_set_size_request (GTK_WIDGET (sci),
+                               MIN (width, alloc.width),
+                               MIN (height + 1, alloc.height));
+  
+  return GTK_WIDGET (sci);
+}
+
+static gboolean
+on_sci_query_tooltip (GtkWidget  *widget,
+                      gint        x,
+                      gint        y,
+                      gboolean    keyboard_mode,
                       GtkTooltip *tooltip,
                       gpointer    user_data)
 {
@@ -818,25 +2038,177 @@ on_sci_query_tooltip (GtkWidget  *widget,
   min_x = scintilla_send_message (sci, SCI_GETMARGINWIDTHN, 0, 0);
   max_x = min_x + scintilla_send_message (sci, SCI_GETMARGINWIDTHN, 1, 0);
   
+  /* only use the hunks if they are up to date */
   if (x >= min_x && x <= max_x &&
-      G_blob_contents.ptr && G_blob_contents_tag == doc->id) {
-    gint pos  = scintilla_send_message (sci, SCI_POSITIONFROMPOINT, x, y);
-    gint line = sci_get_line_from_position (sci, pos);
-    gint mask = scintilla_send_message (sci, SCI_MARKERGET, line, 0);
+      G_diff.doc_id == doc->id && G_diff.hunks &&
+      G_diff.dirty_start == G_MAXINT) {
+    gint  pos   = scintilla_send_message (sci, SCI_POSITIONFROMPOINT, x, y);
+    gint  line  = sci_get_line_from_position (sci, pos);
+    guint i     = hunks_lookup_line (G_diff.hunks, line);
     
-    if (mask & ((1 << G_markers[MARKER_LINE_CHANGED].num) |
-                (1 << G_markers[MARKER_LINE_REMOVED].num))) {
-      TooltipHunkData thd = TOOLTIP_HUNK_DATA_INIT (line + 1, doc,
-                                                    &G_blob_contents, tooltip);
+    if (i < G_diff.hunks->len) {
+      const Hunk *hunk = &g_array_index (G_diff.hunks, Hunk, i);
       
-      diff_buf_to_doc (&G_blob_contents, doc, tooltip_diff_hunk_cb, &thd);
-      has_tooltip = thd.found;
+      if (hunk->old_lines > 0 && hunk_first_line (hunk) <= line) {
+        GtkWidget *old = get_widget_for_buf_range (doc, &G_diff.contents->buf,
+                                                   hunk->old_start,
+                                                   hunk->old_lines);
+        
+        gtk_tooltip_set_custom (tooltip, old);
+        has_tooltip = old != NULL;
+      }
     }
   }
   
   return has_tooltip;
 }
 
+/* gets Scintilla's text area, on which the hunk map is drawn */
+static void
+find_drawing_area_cb (GtkWidget *widget,
+                      gpointer   data)
+{
+  if (GTK_IS_DRAWING_AREA (widget)) {
+    *(GtkWidget **) data = widget;
+  }
+}
+
+static GtkWidget *
+get_sci_text_widget (ScintillaObject *sci)
+{
+  GtkWidget *widget = NULL;
+  
+  gtk_container_forall (GTK_CONTAINER (sci), find_drawing_area_cb, &widget);
+  
+  return widget;
+}
+
+static void
+queue_hunk_map_draw (ScintillaObject *sci)
+{
+  GtkWidget *widget = get_sci_text_widget (sci);
+  
+  if (widget) {
+    GtkAllocation alloc;
+    
+    gtk_widget_get_allocation (widget, &alloc);
+    gtk_widget_queue_draw_area (widget, alloc.width - HUNK_MAP_WIDTH, 0,
+                                HUNK_MAP_WIDTH, alloc.height);
+  }
+}
+
+/* checks whether the hunk map should be shown for @sci */
+static gboolean
+hunk_map_is_visible (ScintillaObject *sci)
+{
+  GeanyDocument *doc = document_get_current ();
+  
+  return (G_hunk_map_enabled && doc && doc->editor->sci == sci &&
+          G_diff.doc_id == doc->id && G_diff.hunks && G_diff.hunks->len > 0);
+}
+
+/* draws the hunk map along the right edge of @widget.  Each row shows the
+ * first hunk of the lines it covers, so drawing doesn't depend on the number
+ * of hunks */
+static void
+draw_hunk_map (GtkWidget       *widget,
+               ScintillaObject *sci,
+               cairo_t         *cr)
+{
+  GtkAllocation alloc;
+  gint          n_lines;
+  gint          y;
+  
+  if (! hunk_map_is_visible (sci)) {
+    return;
+  }
+  
+  gtk_widget_get_allocation (widget, &alloc);
+  n_lines = sci_get_line_count (sci);
+  for (y = 0; y < alloc.height; y++) {
+    gint  start = (gint) ((gint64) y * n_lines / alloc.height);
+    gint  end   = (gint) ((gint64) (y + 1) * n_lines / alloc.height);
+    guint i     = hunks_lookup_line (G_diff.hunks, start);
+    
+    if (i < G_diff.hunks->len &&
+        hunk_first_line (&g_array_index (G_diff.hunks, Hunk, i)) < MAX (end, start + 1)) {
+      const Hunk *hunk  = &g_array_index (G_diff.hunks, Hunk, i);
+      guint32     color = G_markers[hunk_get_marker (hunk)].color;
+      
+      cairo_set_source_rgb (cr,
+                            ((color & 0xff0000) >> 16) / 255.0,
+                            ((color & 0x00ff00) >>  8) / 255.0,
+                            ((color & 0x0000ff) >>  0) / 255.0);
+      cairo_rectangle (cr, alloc.width - HUNK_MAP_WIDTH, y, HUNK_MAP_WIDTH, 1);
+      cairo_fill (cr);
+    }
+  }
+}
+
+#if GTK_CHECK_VERSION (3, 0, 0)
+static gboolean
+on_hunk_map_draw (GtkWidget  *widget,
+                  cairo_t    *cr,
+                  gpointer    user_data)
+{
+  draw_hunk_map (widget, user_data, cr);
+  
+  return FALSE;
+}
+#else
+static gboolean
+on_hunk_map_draw (GtkWidget      *widget,
+                  GdkEventExpose *event,
+                  gpointer        user_data)
+{
+  cairo_t *cr = gdk_cairo_create (event->window);
+  
+  gdk_cairo_region (cr, event->region);
+  cairo_clip (cr);
+  draw_hunk_map (widget, user_data, cr);
+  cairo_destroy (cr);
+  
+  return FALSE;
+}
+#endif
+
+/* jumps to the hunk closest to the clicked location of the hunk map */
+static gboolean
+on_hunk_map_button_press (GtkWidget      *widget,
+                          GdkEventButton *event,
+                          gpointer        user_data)
+{
+  ScintillaObject  *sci = user_data;
+  GtkAllocation     alloc;
+  
+  gtk_widget_get_allocation (widget, &alloc);
+  if (event->button == 1 && event->type == GDK_BUTTON_PRESS &&
+      event->x >= alloc.width - HUNK_MAP_WIDTH && alloc.height > 0 &&
+      hunk_map_is_visible (sci)) {
+    GeanyDocument  *doc   = document_get_current ();
+    gint            line  = (gint) (event->y * sci_get_line_count (sci) /
+                                    alloc.height);
+    guint           i     = hunks_lookup_line (G_diff.hunks, line);
+    const Hunk     *hunk;
+    
+    /* pick the closest of the hunks around the line */
+    if (i >= G_diff.hunks->len ||
+        (i > 0 &&
+         line - hunk_last_line (&g_array_index (G_diff.hunks, Hunk, i - 1)) <
+         hunk_first_line (&g_array_index (G_diff.hunks, Hunk, i)) - line)) {
+      i--;
+    }
+    hunk = &g_array_index (G_diff.hunks, Hunk, i);
+    editor_goto_pos (doc->editor,
+                     sci_get_position_from_line (sci, hunk_first_line (hunk)),
+                     FALSE);
+    
+    return TRUE;
+  }
+  
+  return FALSE;
+}
+
 static void
 update_diff (const gchar *path,
              git_buf     *contents,
@@ -849,22 +2221,30 @@ update_diff (const gchar *path,
     gboolean    allocated = !! g_object_get_qdata (G_OBJECT (sci),
                                                    RESOURCES_ALLOCATED_QTAG);
     
-    if (allocated) {
-      guint i;
-      
-      /* clear previous markers */
-      for (i = 0; i < MARKER_COUNT; i++) {
-        scintilla_send_message (sci, SCI_MARKERDELETEALL, G_markers[i].num, 0);
-      }
-    }
-    
     if (contents && (allocated || allocate_resources (sci))) {
-      diff_buf_to_doc (contents, doc, diff_hunk_cb, sci);
+      /* @contents are the ones of G_blob_contents.  Only diff the modified
+       * lines if we are already tracking this document against them */
+      if (! allocated || G_diff.doc_id != doc->id ||
+          G_diff.contents != G_blob_contents ||
+          g_strcmp0 (G_diff.encoding, doc->encoding) != 0) {
+        diff_state_request_full (doc, G_blob_contents);
+      } else if (! G_diff.pending) {
+        /* (if not, this is done again when the pending result comes in) */
+        if (! G_diff.new_hashes ||
+            (gint) G_diff.new_hashes->len != sci_get_line_count (sci)) {
+          diff_state_request_full (doc, G_blob_contents);
+        } else {
+          diff_state_request_update (sci);
+        }
+      }
     } else if (! contents && allocated) {
       /* if we don't have contents, it probably means the document doesn't
        * match any object known by Git, so next attempts will fail just the
        * same.  So, drop allocated resources if any (if it used to be a valid
        * object, e.g. the document was renamed to something unknown to Git) */
+      if (G_diff.doc_id == doc->id) {
+        diff_state_clear ();
+      }
       release_resources (sci);
     }
   }
@@ -908,6 +2288,10 @@ update_diff_force_idle (gpointer id)
  * Pushes a request for updating the diff.  Typically this should be called
  * after the user modified the buffer to keep the diff in sync.
  * 
+ * Requests made while one is already scheduled for the same document are
+ * merged into it rather than postponing it, so the diff keeps up while the
+ * user is typing.
+ * 
  * Pass @c TRUE to @p force if the repository might have changed in a way that
  * requires reloading it.  Note that generally you don't need to do so when the
  * file might have changed in the repository (e.g. when the user checked out
@@ -920,11 +2304,15 @@ update_diff_push (GeanyDocument  *doc,
 {
   g_return_if_fail (DOC_VALID (doc));
   
+  if (G_source_id && ! force && G_source_doc_id == doc->id) {
+    return;
+  }
   if (G_source_id) {
     g_source_remove (G_source_id);
     G_source_id = 0;
   }
   if (doc->real_path) {
+    G_source_doc_id = doc->id;
     G_source_id = g_timeout_add_full (G_PRIORITY_LOW, 100,
                                       force ? update_diff_force_idle
                                             : update_diff_idle,
@@ -938,11 +2326,21 @@ on_editor_notify (GObject        *obj,
                   SCNotification *nt,
                   gpointer        user_data)
 {
+  if (nt->nmhdr.code == SCN_MODIFIED &&
+      nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT) &&
+      G_diff.doc_id == editor->document->id) {
+    diff_state_track_change (editor->sci, nt);
+  }
   if (nt->nmhdr.code == SCN_CHARADDED ||
       (nt->nmhdr.code == SCN_MODIFIED &&
        nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))) {
     update_diff_push (editor->document, FALSE);
   }
+  /* the hunk map scrolls along with the text */
+  if (nt->nmhdr.code == SCN_UPDATEUI && nt->updated & SC_UPDATE_V_SCROLL &&
+      G_diff.doc_id == editor->document->id) {
+    queue_hunk_map_draw (editor->sci);
+  }
   
   return FALSE;
 }
@@ -976,74 +2374,49 @@ on_git_repo_changed (GFileMonitor     *monitor,
 {
   GeanyDocument *doc = document_get_current ();
   
+  /* let the worker know HEAD might have moved */
+  g_atomic_int_inc (&G_repo_generation);
+  
   if (doc) {
     clear_cached_blob_contents ();
     update_diff_push (doc, GPOINTER_TO_INT (force));
   }
 }
 
-static int
-goto_next_hunk_diff_hunk_cb (const git_diff_delta *delta,
-                             const git_diff_hunk  *hunk,
-                             void                 *udata)
-{
-  GotoNextHunkData *data = udata;
-  
-  switch (data->kb) {
-    case KB_GOTO_NEXT_HUNK:
-      if (data->next_line >= 0) {
-        return 1;
-      } else if (data->line < hunk->new_start - 1) {
-        data->next_line = hunk->new_start - 1;
-      }
-      break;
-    
-    case KB_GOTO_PREV_HUNK:
-      if (data->line > hunk->new_start - 1 + MAX (hunk->new_lines - 1, 0)) {
-        data->next_line = hunk->new_start - 1;
-      }
-      break;
-  }
-  
-  return 0;
-}
-
 static void
-goto_next_hunk_cb (const gchar *path,
-                   git_buf     *contents,
-                   gpointer     udata)
+on_kb_goto_next_hunk (guint kb)
 {
-  GotoNextHunkData *data  = udata;
-  GeanyDocument    *doc   = document_get_current ();
+  GeanyDocument *doc = document_get_current ();
   
-  if (doc && doc->id == data->doc_id && contents) {
-    diff_buf_to_doc (contents, doc, goto_next_hunk_diff_hunk_cb, data);
+  if (doc && G_diff.doc_id == doc->id && G_diff.hunks) {
+    ScintillaObject  *sci   = doc->editor->sci;
+    gint              line  = sci_get_current_line (sci);
+    guint             i     = hunks_lookup_line (G_diff.hunks, line);
+    const Hunk       *hunk  = NULL;
     
-    if (data->next_line >= 0) {
-      gint pos = sci_get_position_from_line (doc->editor->sci, data->next_line);
+    switch (kb) {
+      case KB_GOTO_NEXT_HUNK:
+        if (i < G_diff.hunks->len &&
+            hunk_first_line (&g_array_index (G_diff.hunks, Hunk, i)) <= line) {
+          i++;
+        }
+        if (i < G_diff.hunks->len) {
+          hunk = &g_array_index (G_diff.hunks, Hunk, i);
+        }
+        break;
       
-      editor_goto_pos (doc->editor, pos, FALSE);
+      case KB_GOTO_PREV_HUNK:
+        if (i > 0) {
+          hunk = &g_array_index (G_diff.hunks, Hunk, i - 1);
+        }
+        break;
     }
-  }
-  
-  g_slice_free1 (sizeof *data, data);
-}
-
-static void
-on_kb_goto_next_hunk (guint kb)
-{
-  GeanyDocument *doc = document_get_current ();
-  
-  if (doc) {
-    GotoNextHunkData *data = g_slice_alloc (sizeof *data);
-  
-    data->kb        = kb;
-    data->doc_id    = doc->id;
-    data->line      = sci_get_current_line (doc->editor->sci);
-    data->next_line = -1;
     
-    get_cached_blob_contents_async (doc->real_path, doc->id, FALSE,
-                                    goto_next_hunk_cb, data);
+    if (hunk) {
+      gint pos = sci_get_position_from_line (sci, hunk_first_line (hunk));
+      
+      editor_goto_pos (doc->editor, pos, FALSE);
+    }
   }
 }
 
@@ -1214,8 +2587,9 @@ plugin_init (GeanyData *data)
 {
   GeanyKeyGroup *kb_group;
   
-  buf_zero (&G_blob_contents);
+  G_blob_contents     = NULL;
   G_blob_contents_tag = 0;
+  G_repo_generation   = 0;
   G_source_id         = 0;
   G_thread            = NULL;
   G_queue             = NULL;
@@ -1269,6 +2643,7 @@ plugin_cleanup (void)
     G_queue = NULL;
   }
   clear_cached_blob_contents ();
+  diff_state_clear ();
   
   foreach_document (i) {
     release_resources (documents[i]->editor->sci);
@@ -1285,6 +2660,7 @@ typedef struct ConfigureWidgets ConfigureWidgets;
 struct ConfigureWidgets {
   GtkWidget  *base;
   GtkWidget  *monitoring_check;
+  GtkWidget  *hunk_map_check;
   GtkWidget  *added_color_button;
   GtkWidget  *changed_color_button;
   GtkWidget  *removed_color_button;
@@ -1326,6 +2702,7 @@ on_plugin_configure_response (GtkDialog        *dialog,
       GeanyDocument  *doc = document_get_current ();
       
       G_monitoring_enabled = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (cw->monitoring_check));
+      G_hunk_map_enabled = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (cw->hunk_map_check));
       gtk_color_button_get_color (GTK_COLOR_BUTTON (cw->added_color_button),
                                   &color);
       G_markers[MARKER_LINE_ADDED].color = color_to_int (&color);
@@ -1369,6 +2746,7 @@ plugin_configure (GtkDialog *dialog)
     } map[] = {
       { "base",                 &cw->base },
       { "monitoring-check",     &cw->monitoring_check },
+      { "hunk-map-check",       &cw->hunk_map_check },
       { "added-color-button",   &cw->added_color_button },
       { "changed-color-button", &cw->changed_color_button },
       { "removed-color-button", &cw->removed_color_button },
@@ -1381,6 +2759,8 @@ plugin_configure (GtkDialog *dialog)
     
     gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (cw->monitoring_check),
                                   G_monitoring_enabled);
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (cw->hunk_map_check),
+                                  G_hunk_map_enabled);
     color_from_int (&color, G_markers[MARKER_LINE_ADDED].color);
     gtk_color_button_set_color (GTK_COLOR_BUTTON (cw->added_color_button),
                                 &color);
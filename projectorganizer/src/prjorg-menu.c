@@ -50,7 +50,7 @@ enum
 static GtkWidget *s_fif_item, *s_ff_item, *s_ft_item, *s_shs_item, *s_sep_item, *s_context_osf_item, *s_context_sep_item;
 
 
-static gboolean try_swap_header_source(gchar *utf8_file_name, gboolean is_header, GSList *file_list, GSList *header_patterns, GSList *source_patterns)
+static gboolean try_swap_header_source(gchar *utf8_file_name, gboolean is_header, GSList *file_list, PrjOrgPatterns *header_patterns, PrjOrgPatterns *source_patterns)
 {
 	gchar *name_pattern;
 	GSList *elem;
@@ -90,7 +90,7 @@ static gboolean try_swap_header_source(gchar *utf8_file_name, gboolean is_header
 
 static void on_swap_header_source(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer user_data)
 {
-	GSList *header_patterns, *source_patterns;
+	PrjOrgPatterns *header_patterns, *source_patterns;
 	GeanyDocument *doc;
 	gboolean known_type = TRUE;
 	gboolean is_header;
@@ -177,10 +177,8 @@ static void on_swap_header_source(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_U
 
 	g_free(doc_basename);
 
-	g_slist_foreach(header_patterns, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(header_patterns);
-	g_slist_foreach(source_patterns, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(source_patterns);
+	patterns_free(header_patterns);
+	patterns_free(source_patterns);
 }
 
 
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Pattern matcher benchmark
+ *
+ * Classifies a synthetic corpus of path components (1M by default, the count
+ * can be given as the first argument) the way a project scan does - against
+ * the file, ignored-file and ignored-dir patterns - once with a GPatternSpec
+ * per pattern matched one by one and once with the compiled PrjOrgPatterns.
+ * Fails if the two disagree on any name, so it also runs under "make check". */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "prjorg-patterns.h"
+
+enum
+{
+	PATTERN_FILE = 1 << 0,
+	PATTERN_IGNORED_FILE = 1 << 1,
+	PATTERN_IGNORED_DIR = 1 << 2
+};
+
+static const gchar *file_patterns =
+	"*.c *.C *.cpp *.cxx *.c++ *.cc *.m *.h *.H *.hpp *.hxx *.h++ *.hh *.mm "
+	"*.py *.pl *.rb *.java *.js *.ts *.go *.rs *.vala *.vapi *.sh *.lua "
+	"*.xml *.html *.css *.txt *.md *.rst *.in *.am *.ac *.m4 *.cmake "
+	"Makefile* CMakeLists.txt README* ChangeLog NEWS AUTHORS COPYING* *rc";
+static const gchar *ignored_file_patterns =
+	"*.o *.obj *.a *.lib *.so *.dll *.lo *.la *.class *.jar *.pyc *.mo *.gmo "
+	"*~ *.bak *.sw? .#* core.*";
+static const gchar *ignored_dir_patterns = ".* CVS _build build-*";
+
+static const gchar *stems[] = {
+	"main", "utils", "parser", "lexer", "widget", "config", "Makefile", "README",
+	"test_io", "CMakeLists", "ChangeLog", "index", "core", "build-aux", "CVS", ".git",
+	"foo_bar_baz", "a", "x11-compat", "vimrc", "_build", "NEWS", "COPYING", "doc"
+};
+static const gchar *exts[] = {
+	"", "", ".c", ".h", ".cpp", ".hpp", ".o", ".lo", ".la", ".py", ".pyc", ".txt",
+	".am", ".in", ".md", ".so", ".swp", ".swx", "~", ".bak", ".js", ".json", ".png",
+	".1234", ".rs", ".tar.gz"
+};
+
+
+typedef struct
+{
+	GSList *file;
+	GSList *ignored_file;
+	GSList *ignored_dir;
+} NaivePatterns;
+
+
+static GSList *naive_compile(const gchar *patterns)
+{
+	gchar **strv = g_strsplit(patterns, " ", -1);
+	GSList *list = NULL;
+	gchar **str;
+
+	for (str = strv; *str; str++)
+	{
+		if (**str)
+			list = g_slist_prepend(list, g_pattern_spec_new(*str));
+	}
+	g_strfreev(strv);
+	return g_slist_reverse(list);
+}
+
+
+static gboolean naive_match(GSList *list, const gchar *str)
+{
+	GSList *elem;
+	guint len = strlen(str);
+
+	for (elem = list; elem; elem = elem->next)
+	{
+		if (g_pattern_match(elem->data, len, str, NULL))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+static guint naive_match_flags(NaivePatterns *naive, const gchar *str)
+{
+	guint flags = 0;
+
+	if (naive_match(naive->file, str))
+		flags |= PATTERN_FILE;
+	if (naive_match(naive->ignored_file, str))
+		flags |= PATTERN_IGNORED_FILE;
+	if (naive_match(naive->ignored_dir, str))
+		flags |= PATTERN_IGNORED_DIR;
+	return flags;
+}
+
+
+static void naive_free(GSList *list)
+{
+	g_slist_free_full(list, (GDestroyNotify)g_pattern_spec_free);
+}
+
+
+static void add_patterns(PrjOrgPatterns *patterns, const gchar *str, guint value)
+{
+	gchar **strv = g_strsplit(str, " ", -1);
+
+	patterns_add(patterns, strv, value);
+	g_strfreev(strv);
+}
+
+
+static GPtrArray *make_corpus(GStringChunk *chunk, guint count)
+{
+	GPtrArray *corpus = g_ptr_array_sized_new(count);
+	GRand *rand = g_rand_new_with_seed(4242);
+	guint i;
+
+	for (i = 0; i < count; i++)
+	{
+		const gchar *stem = stems[g_rand_int_range(rand, 0, G_N_ELEMENTS(stems))];
+		const gchar *ext = exts[g_rand_int_range(rand, 0, G_N_ELEMENTS(exts))];
+		gchar *name;
+
+		/* mostly unique names so nothing can be cached by the matchers */
+		if (g_rand_int_range(rand, 0, 8) == 0)
+			name = g_strconcat(stem, ext, NULL);
+		else
+			name = g_strdup_printf("%s%u%s", stem, g_rand_int_range(rand, 0, 100000), ext);
+		g_ptr_array_add(corpus, g_string_chunk_insert(chunk, name));
+		g_free(name);
+	}
+
+	g_rand_free(rand);
+	return corpus;
+}
+
+
+int main(int argc, char **argv)
+{
+	guint count = argc > 1 ? (guint)strtoul(argv[1], NULL, 10) : 1000000;
+	GStringChunk *chunk = g_string_chunk_new(1024 * 1024);
+	GPtrArray *corpus = make_corpus(chunk, count);
+	NaivePatterns naive;
+	PrjOrgPatterns *compiled;
+	guint *expected = g_new(guint, count);
+	guint i, mismatches = 0, matched = 0;
+	gdouble naive_time, compiled_time;
+	GTimer *timer;
+
+	naive.file = naive_compile(file_patterns);
+	naive.ignored_file = naive_compile(ignored_file_patterns);
+	naive.ignored_dir = naive_compile(ignored_dir_patterns);
+
+	compiled = patterns_new();
+	add_patterns(compiled, file_patterns, PATTERN_FILE);
+	add_patterns(compiled, ignored_file_patterns, PATTERN_IGNORED_FILE);
+	add_patterns(compiled, ignored_dir_patterns, PATTERN_IGNORED_DIR);
+
+	timer = g_timer_new();
+	for (i = 0; i < count; i++)
+		expected[i] = naive_match_flags(&naive, corpus->pdata[i]);
+	naive_time = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	for (i = 0; i < count; i++)
+	{
+		guint flags = patterns_match_flags(compiled, corpus->pdata[i]);
+
+		if (flags != expected[i])
+		{
+			if (mismatches++ < 10)
+				g_printerr("mismatch for \"%s\": %u, expected %u\n",
+					(gchar *)corpus->pdata[i], flags, expected[i]);
+		}
+		if (flags & PATTERN_FILE)
+			matched++;
+	}
+	compiled_time = g_timer_elapsed(timer, NULL);
+
+	g_print("%u names, %u project files\n", count, matched);
+	g_print("GPatternSpec list: %.3f s\n", naive_time);
+	g_print("PrjOrgPatterns:    %.3f s\n", compiled_time);
+	if (compiled_time > 0)
+		g_print("speedup:           %.1fx\n", naive_time / compiled_time);
+
+	g_timer_destroy(timer);
+	patterns_free(compiled);
+	naive_free(naive.file);
+	naive_free(naive.ignored_file);
+	naive_free(naive.ignored_dir);
+	g_free(expected);
+	g_ptr_array_free(corpus, TRUE);
+	g_string_chunk_free(chunk);
+
+	if (mismatches > 0)
+	{
+		g_printerr("%u mismatches\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "prjorg-patterns.h"
+
+
+/* Compiled patterns
+ *
+ * Most patterns are of the form *.ext, prefix* or a plain name. Those are put
+ * into hash tables so matching a name costs a few hash lookups no matter how
+ * many patterns there are - one per distinct suffix and prefix length. Only the
+ * remaining patterns (e.g. *foo*bar or a?c) are matched one by one. Every
+ * pattern carries a value so several pattern lists can be compiled together and
+ * a single lookup tells which of them matched. */
+
+typedef struct
+{
+	guint flags;  /* values of all matching patterns or-ed together */
+	guint first;  /* the lowest value of the matching patterns, 0 if none */
+} PatternValue;
+
+typedef struct
+{
+	GPatternSpec *spec;
+	PatternValue value;
+} GenericPattern;
+
+struct PrjOrgPatterns
+{
+	PatternValue any;  /* "*" */
+	GHashTable *literals;  /* name -> PatternValue */
+	GHashTable *suffixes;  /* suffix -> PatternValue */
+	GHashTable *prefixes;  /* prefix -> PatternValue */
+	GArray *suffix_lengths;  /* distinct lengths of the keys in suffixes */
+	GArray *prefix_lengths;
+	GPtrArray *generic;  /* GenericPattern */
+};
+
+
+static void value_merge(PatternValue *value, const PatternValue *other)
+{
+	value->flags |= other->flags;
+	if (other->first != 0 && (value->first == 0 || other->first < value->first))
+		value->first = other->first;
+}
+
+
+static void generic_pattern_free(GenericPattern *pattern)
+{
+	g_pattern_spec_free(pattern->spec);
+	g_free(pattern);
+}
+
+
+PrjOrgPatterns *patterns_new(void)
+{
+	PrjOrgPatterns *patterns = g_new0(PrjOrgPatterns, 1);
+
+	patterns->literals = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	patterns->suffixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	patterns->prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	patterns->suffix_lengths = g_array_new(FALSE, FALSE, sizeof(gsize));
+	patterns->prefix_lengths = g_array_new(FALSE, FALSE, sizeof(gsize));
+	patterns->generic = g_ptr_array_new_with_free_func((GDestroyNotify)generic_pattern_free);
+	return patterns;
+}
+
+
+void patterns_free(PrjOrgPatterns *patterns)
+{
+	if (!patterns)
+		return;
+
+	g_hash_table_destroy(patterns->literals);
+	g_hash_table_destroy(patterns->suffixes);
+	g_hash_table_destroy(patterns->prefixes);
+	g_array_free(patterns->suffix_lengths, TRUE);
+	g_array_free(patterns->prefix_lengths, TRUE);
+	g_ptr_array_free(patterns->generic, TRUE);
+	g_free(patterns);
+}
+
+
+static void table_add(GHashTable *table, GArray *lengths, const gchar *key, gsize len,
+	const PatternValue *value)
+{
+	PatternValue *old_value = g_hash_table_lookup(table, key);
+	guint i;
+
+	if (old_value)
+	{
+		value_merge(old_value, value);
+		return;
+	}
+
+	g_hash_table_insert(table, g_strndup(key, len), g_memdup(value, sizeof(PatternValue)));
+
+	if (!lengths)
+		return;
+	for (i = 0; i < lengths->len; i++)
+	{
+		if (g_array_index(lengths, gsize, i) == len)
+			return;
+	}
+	g_array_append_val(lengths, len);
+}
+
+
+void patterns_add(PrjOrgPatterns *patterns, gchar **strv, guint value)
+{
+	PatternValue pattern_value = {value, value};
+	gchar **str;
+
+	if (!strv)
+		return;
+
+	for (str = strv; *str; str++)
+	{
+		const gchar *pattern = *str;
+		gsize len = strlen(pattern);
+		const gchar *wildcard = strpbrk(pattern, "*?");
+
+		if (!wildcard)
+			table_add(patterns->literals, NULL, pattern, len, &pattern_value);
+		else if (strcmp(pattern, "*") == 0)
+			value_merge(&patterns->any, &pattern_value);
+		else if (pattern[0] == '*' && !strpbrk(pattern + 1, "*?"))
+			table_add(patterns->suffixes, patterns->suffix_lengths, pattern + 1, len - 1, &pattern_value);
+		else if (wildcard == pattern + len - 1 && *wildcard == '*')
+		{
+			gchar *prefix = g_strndup(pattern, len - 1);
+
+			table_add(patterns->prefixes, patterns->prefix_lengths, prefix, len - 1, &pattern_value);
+			g_free(prefix);
+		}
+		else
+		{
+			GenericPattern *generic = g_new0(GenericPattern, 1);
+
+			generic->spec = g_pattern_spec_new(pattern);
+			generic->value = pattern_value;
+			g_ptr_array_add(patterns->generic, generic);
+		}
+	}
+}
+
+
+static void patterns_lookup(PrjOrgPatterns *patterns, const gchar *str, PatternValue *result)
+{
+	gsize len = strlen(str);
+	PatternValue *value;
+	gchar prefix_buf[256];
+	guint i;
+
+	*result = patterns->any;
+
+	value = g_hash_table_lookup(patterns->literals, str);
+	if (value)
+		value_merge(result, value);
+
+	for (i = 0; i < patterns->suffix_lengths->len; i++)
+	{
+		gsize suffix_len = g_array_index(patterns->suffix_lengths, gsize, i);
+
+		if (suffix_len <= len && (value = g_hash_table_lookup(patterns->suffixes, str + len - suffix_len)))
+			value_merge(result, value);
+	}
+
+	for (i = 0; i < patterns->prefix_lengths->len; i++)
+	{
+		gsize prefix_len = g_array_index(patterns->prefix_lengths, gsize, i);
+		gchar *prefix;
+
+		if (prefix_len > len)
+			continue;
+
+		prefix = prefix_len < sizeof(prefix_buf) ? prefix_buf : g_malloc(prefix_len + 1);
+		memcpy(prefix, str, prefix_len);
+		prefix[prefix_len] = '\0';
+		if ((value = g_hash_table_lookup(patterns->prefixes, prefix)))
+			value_merge(result, value);
+		if (prefix != prefix_buf)
+			g_free(prefix);
+	}
+
+	for (i = 0; i < patterns->generic->len; i++)
+	{
+		GenericPattern *generic = patterns->generic->pdata[i];
+
+		if (g_pattern_match(generic->spec, len, str, NULL))
+			value_merge(result, &generic->value);
+	}
+}
+
+
+/* returns the values of all matching patterns or-ed together */
+guint patterns_match_flags(PrjOrgPatterns *patterns, const gchar *str)
+{
+	PatternValue result;
+
+	if (!patterns)
+		return 0;
+
+	patterns_lookup(patterns, str, &result);
+	return result.flags;
+}
+
+
+/* returns the lowest value of the matching patterns or 0 */
+guint patterns_match_first(PrjOrgPatterns *patterns, const gchar *str)
+{
+	PatternValue result;
+
+	if (!patterns)
+		return 0;
+
+	patterns_lookup(patterns, str, &result);
+	return result.first;
+}
+
+
+PrjOrgPatterns *get_precompiled_patterns(gchar **patterns)
+{
+	PrjOrgPatterns *compiled;
+
+	if (!patterns)
+		return NULL;
+
+	compiled = patterns_new();
+	patterns_add(compiled, patterns, 1);
+	return compiled;
+}
+
+
+gboolean patterns_match(PrjOrgPatterns *patterns, const gchar *str)
+{
+	return patterns_match_flags(patterns, str) != 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_PATTERNS_H__
+#define __PRJORG_PATTERNS_H__
+
+#include <glib.h>
+
+typedef struct PrjOrgPatterns PrjOrgPatterns;
+
+PrjOrgPatterns *patterns_new(void);
+void patterns_add(PrjOrgPatterns *patterns, gchar **strv, guint value);
+guint patterns_match_flags(PrjOrgPatterns *patterns, const gchar *str);
+guint patterns_match_first(PrjOrgPatterns *patterns, const gchar *str);
+void patterns_free(PrjOrgPatterns *patterns);
+
+gboolean patterns_match(PrjOrgPatterns *patterns, const gchar *str);
+PrjOrgPatterns *get_precompiled_patterns(gchar **patterns);
+
+#endif
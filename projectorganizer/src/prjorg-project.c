@@ -17,8 +17,14 @@
  */
 
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
 #include <gdk/gdkkeysyms.h>
 #include <glib/gstdio.h>
+#ifndef G_OS_WIN32
+	#include <dirent.h>
+#endif
 
 #ifdef HAVE_CONFIG_H
 	#include "config.h"
@@ -27,6 +33,9 @@
 
 #include "prjorg-utils.h"
 #include "prjorg-project.h"
+#include "prjorg-sidebar.h"
+#include "prjorg-watch.h"
+#include "prjorg-tags.h"
 
 extern GeanyPlugin *geany_plugin;
 extern GeanyData *geany_data;
@@ -41,288 +50,1373 @@ typedef struct
 	GtkWidget *generate_tag_prefs;
 } PropertyDialogElements;
 
-PrjOrg *prj_org = NULL;
+PrjOrg *prj_org = NULL;
+
+static PropertyDialogElements *e;
+
+static GSList *s_idle_add_funcs;
+static GSList *s_idle_remove_funcs;
+
+
+static void clear_idle_queue(GSList **queue)
+{
+	GSList *elem;
+
+	foreach_slist(elem, *queue)
+		g_free(elem->data);
+	g_slist_free(*queue);
+	*queue = NULL;
+}
+
+
+static void collect_source_files(gchar *filename, TMSourceFile *sf, gpointer user_data)
+{
+	GPtrArray *array = user_data;
+
+	if (sf != NULL)
+		g_ptr_array_add(array, sf);
+}
+
+
+/* File type detection
+ *
+ * The patterns of all file types are compiled into a single matcher so the
+ * detection by file name is one lookup and can run in the scanning threads. */
+
+typedef struct
+{
+	volatile gint ref_count;
+	GPtrArray *filetypes;  /* pattern value - 1 -> GeanyFiletype */
+	PrjOrgPatterns *patterns;
+} FiletypePatterns;
+
+
+static FiletypePatterns *filetype_patterns_ref(FiletypePatterns *ftp)
+{
+	g_atomic_int_inc(&ftp->ref_count);
+	return ftp;
+}
+
+
+static void filetype_patterns_unref(FiletypePatterns *ftp)
+{
+	if (!g_atomic_int_dec_and_test(&ftp->ref_count))
+		return;
+
+	g_ptr_array_free(ftp->filetypes, TRUE);
+	patterns_free(ftp->patterns);
+	g_free(ftp);
+}
+
+
+static FiletypePatterns *get_filetype_patterns(void)
+{
+	FiletypePatterns *ftp = g_new0(FiletypePatterns, 1);
+	guint i;
+
+	ftp->ref_count = 1;
+	ftp->filetypes = g_ptr_array_new();
+	ftp->patterns = patterns_new();
+
+	/* the value is the position of the file type so the first matching
+	 * file type wins, like when looping over the file types */
+	for (i = 0; i < geany_data->filetypes_array->len; i++)
+	{
+		GeanyFiletype *ft = filetypes[i];
+
+		if (G_UNLIKELY(ft->id == GEANY_FILETYPES_NONE))
+			continue;
+
+		g_ptr_array_add(ftp->filetypes, ft);
+		patterns_add(ftp->patterns, ft->pattern, ftp->filetypes->len);
+	}
+
+	return ftp;
+}
+
+
+/* returns NULL if no file type pattern matches */
+static GeanyFiletype *filetypes_detect_by_name(FiletypePatterns *filetype_patterns, const gchar *utf8_filename)
+{
+	GeanyFiletype *ft = NULL;
+	gchar *utf8_base_filename;
+	guint value;
+
+	/* to match against the basename of the file (because of Makefile*) */
+	utf8_base_filename = g_path_get_basename(utf8_filename);
+#ifdef G_OS_WIN32
+	/* use lower case basename */
+	SETPTR(utf8_base_filename, g_utf8_strdown(utf8_base_filename, -1));
+#endif
+
+	value = patterns_match_first(filetype_patterns->patterns, utf8_base_filename);
+	if (value > 0)
+		ft = filetype_patterns->filetypes->pdata[value - 1];
+
+	g_free(utf8_base_filename);
+
+	return ft;
+}
+
+
+/* Stolen and modified version from Geany. The only difference is that Geany
+ * first looks at shebang inside the file and then, if it fails, checks the
+ * file extension. Opening every file is too expensive so instead check just
+ * extension (@name_ft, possibly detected in advance) and only if this fails,
+ * look at the shebang */
+static GeanyFiletype *filetypes_detect(const gchar *utf8_filename, GeanyFiletype *name_ft)
+{
+	struct stat s;
+	GeanyFiletype *ft;
+	gchar *locale_filename;
+
+	locale_filename = utils_get_locale_from_utf8(utf8_filename);
+	if (g_stat(locale_filename, &s) != 0 || s.st_size > 10*1024*1024)
+		ft = filetypes[GEANY_FILETYPES_NONE];
+	else if (name_ft)
+		ft = name_ft;
+	else
+		ft = filetypes_detect_from_file(utf8_filename);
+
+	g_free(locale_filename);
+
+	return ft;
+}
+
+
+/* Directory scanning
+ *
+ * Project roots are scanned on a thread pool - each directory subtree near the
+ * top of the root gets its own job and the jobs post their results to an
+ * async queue which is drained from the main loop. Directory listings are
+ * stored in an on-disk index keyed by the directory modification time (in
+ * microseconds) and size so directories which didn't change since the last scan
+ * don't have to be read again. The index contains all entries regardless of the
+ * patterns so it stays valid when the patterns change. */
+
+/* subdirectories up to this depth are scanned by separate jobs */
+#define SCAN_SPLIT_DEPTH 2
+#define SCAN_INDEX_VERSION "2"
+/* directories modified less than this before they were read may change again
+ * without a visible change of their timestamp (coarse file system timestamps),
+ * they are read again by the next scan */
+#define SCAN_RACY_USEC (2 * G_USEC_PER_SEC)
+
+typedef struct
+{
+	gint64 mtime;  /* microseconds, 0 if the listing must be read again */
+	gint64 size;
+	gboolean racy;  /* stored with a zero mtime */
+	gchar **files;  /* locale names of regular files */
+	gchar **dirs;   /* locale names of subdirectories (symlink cycles excluded) */
+} IndexEntry;
+
+typedef struct
+{
+	PrjOrgRoot *root;  /* only touched from the main thread */
+	volatile gint pending;
+} ScanRoot;
+
+typedef struct
+{
+	volatile gint ref_count;
+	volatile gint pending;  /* number of jobs whose results haven't been merged yet */
+	volatile gint cancelled;
+
+	PrjOrgPatterns *patterns;  /* read-only, see get_scan_patterns() */
+	FiletypePatterns *filetype_patterns;
+
+	GHashTable *old_index;  /* read-only while the scan runs */
+	GHashTable *new_index;  /* main thread only */
+
+	GAsyncQueue *results;
+	ScanRoot *roots;
+	guint root_num;
+	guint source_id;
+} ScanContext;
+
+typedef struct
+{
+	ScanContext *ctx;
+	ScanRoot *scan_root;
+	gchar *locale_dir;
+	gchar *utf8_dir;
+	gint depth;
+
+	GPtrArray *files;  /* utf8 paths of matching files */
+	GPtrArray *filetypes;  /* file types detected by name, parallel to files */
+	GPtrArray *index_dirs;  /* locale paths, parallel to index_entries */
+	GPtrArray *index_entries;
+} ScanJob;
+
+
+static GThreadPool *s_scan_pool = NULL;
+static ScanContext *s_scan = NULL;
+static GHashTable *s_scan_changes = NULL;  /* locale paths changed during the scan -> NULL */
+static GHashTable *s_index = NULL;
+static FiletypePatterns *s_filetype_patterns = NULL;
+static gboolean s_tags_enabled = FALSE;
+
+
+static void tag_queue_push(PrjOrgRoot *root, const gchar *utf8_path, GeanyFiletype *name_ft);
+
+
+static void index_entry_free(IndexEntry *entry)
+{
+	if (!entry)
+		return;
+
+	g_strfreev(entry->files);
+	g_strfreev(entry->dirs);
+	g_free(entry);
+}
+
+
+static GHashTable *index_new(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)index_entry_free);
+}
+
+
+static gchar *get_index_filename(void)
+{
+	gchar *checksum, *name, *ret;
+
+	if (!geany_data->app->project || !geany_data->app->project->file_name)
+		return NULL;
+
+	checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, geany_data->app->project->file_name, -1);
+	name = g_strconcat(checksum, ".index", NULL);
+	ret = g_build_filename(geany_data->app->configdir, "plugins", "projectorganizer", name, NULL);
+	g_free(checksum);
+	g_free(name);
+	return ret;
+}
+
+
+/* index format: a version header followed by "D <mtime> <size> <dir>" lines, each
+ * followed by "f <name>" lines for its files and "d <name>" lines for its subdirectories */
+static GHashTable *index_load(void)
+{
+	GHashTable *index = index_new();
+	gchar *filename = get_index_filename();
+	gchar *contents = NULL;
+	gchar **lines, **line;
+	IndexEntry *entry = NULL;
+	GPtrArray *files = NULL, *dirs = NULL;
+
+	if (!filename || !g_file_get_contents(filename, &contents, NULL, NULL))
+	{
+		g_free(filename);
+		return index;
+	}
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	g_free(filename);
+
+	if (g_strcmp0(lines[0], "PRJORG-INDEX " SCAN_INDEX_VERSION) != 0)
+	{
+		g_strfreev(lines);
+		return index;
+	}
+
+	for (line = lines + 1; ; line++)
+	{
+		gboolean end = *line == NULL;
+
+		if ((end || (*line)[0] == 'D') && entry)
+		{
+			g_ptr_array_add(files, NULL);
+			g_ptr_array_add(dirs, NULL);
+			entry->files = (gchar **) g_ptr_array_free(files, FALSE);
+			entry->dirs = (gchar **) g_ptr_array_free(dirs, FALSE);
+			entry = NULL;
+		}
+		if (end)
+			break;
+
+		if ((*line)[0] == 'D' && (*line)[1] == ' ')
+		{
+			gchar *endptr;
+			gint64 mtime, size;
+
+			mtime = g_ascii_strtoll(*line + 2, &endptr, 10);
+			if (*endptr != ' ')
+				continue;
+			size = g_ascii_strtoll(endptr + 1, &endptr, 10);
+			if (*endptr != ' ')
+				continue;
+
+			entry = g_new0(IndexEntry, 1);
+			entry->mtime = mtime;
+			entry->size = size;
+			files = g_ptr_array_new();
+			dirs = g_ptr_array_new();
+			g_hash_table_insert(index, g_strdup(endptr + 1), entry);
+		}
+		else if (entry && (*line)[0] == 'f' && (*line)[1] == ' ')
+			g_ptr_array_add(files, g_strdup(*line + 2));
+		else if (entry && (*line)[0] == 'd' && (*line)[1] == ' ')
+			g_ptr_array_add(dirs, g_strdup(*line + 2));
+	}
+
+	g_strfreev(lines);
+	return index;
+}
+
+
+static void index_save(GHashTable *index)
+{
+	gchar *filename = get_index_filename();
+	gchar *dirname;
+	GHashTableIter iter;
+	gpointer key, value;
+	GString *str;
+
+	if (!filename)
+		return;
+
+	str = g_string_new("PRJORG-INDEX " SCAN_INDEX_VERSION "\n");
+	g_hash_table_iter_init(&iter, index);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		IndexEntry *entry = value;
+		gchar **name;
+
+		g_string_append_printf(str, "D %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %s\n",
+			entry->racy ? 0 : entry->mtime, entry->size, (gchar *)key);
+		foreach_strv (name, entry->files)
+			g_string_append_printf(str, "f %s\n", *name);
+		foreach_strv (name, entry->dirs)
+			g_string_append_printf(str, "d %s\n", *name);
+	}
+
+	dirname = g_path_get_dirname(filename);
+	if (utils_mkdir(dirname, TRUE) == 0)
+		g_file_set_contents(filename, str->str, str->len, NULL);
+
+	g_free(dirname);
+	g_free(filename);
+	g_string_free(str, TRUE);
+}
+
+
+/* checks whether the directory behind a symlink lies within its parent directory -
+ * symlink cycle avoidance */
+static gboolean symlink_dir_valid(const gchar *locale_parent_realpath, const gchar *locale_filename)
+{
+	gchar *locale_child_realpath = tm_get_real_path(locale_filename);
+	gboolean ret = FALSE;
+
+	if (locale_parent_realpath && locale_child_realpath &&
+		g_str_has_prefix(locale_child_realpath, locale_parent_realpath))
+	{
+		gsize len = strlen(locale_parent_realpath);
+
+		if (len > 0 && G_IS_DIR_SEPARATOR(locale_parent_realpath[len - 1]))
+			ret = locale_child_realpath[len] != '\0';
+		else
+			ret = G_IS_DIR_SEPARATOR(locale_child_realpath[len]);
+	}
+
+	g_free(locale_child_realpath);
+	return ret;
+}
+
+
+/* gets the modification time in microseconds and the size of the directory -
+ * st_mtime has only a second granularity which misses changes made within the
+ * second the directory was read */
+static gboolean get_dir_stamp(const gchar *locale_path, gint64 *mtime, gint64 *size)
+{
+	GFile *file = g_file_new_for_path(locale_path);
+	GFileInfo *info;
+
+	info = g_file_query_info(file,
+		G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," G_FILE_ATTRIBUTE_STANDARD_SIZE,
+		G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	g_object_unref(file);
+	if (!info)
+		return FALSE;
+
+	*mtime = (gint64) g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	*size = g_file_info_get_size(info);
+
+	g_object_unref(info);
+	return TRUE;
+}
+
+
+/* reads the directory listing; names containing newlines can't be stored in the
+ * index so they are skipped */
+static IndexEntry *read_dir(const gchar *locale_path, gint64 mtime, gint64 size)
+{
+	GPtrArray *files = g_ptr_array_new();
+	GPtrArray *dirs = g_ptr_array_new();
+	gchar *locale_realpath = NULL;
+	IndexEntry *entry;
+#ifdef G_OS_WIN32
+	GDir *dir;
+	const gchar *locale_name;
+
+	dir = g_dir_open(locale_path, 0, NULL);
+	while (dir && (locale_name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *locale_filename = g_build_filename(locale_path, locale_name, NULL);
+
+		if (g_file_test(locale_filename, G_FILE_TEST_IS_DIR))
+			g_ptr_array_add(dirs, g_strdup(locale_name));
+		else if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
+			g_ptr_array_add(files, g_strdup(locale_name));
+		g_free(locale_filename);
+	}
+	if (dir)
+		g_dir_close(dir);
+#else
+	DIR *dir;
+	struct dirent *dent;
+
+	dir = opendir(locale_path);
+	while (dir && (dent = readdir(dir)) != NULL)
+	{
+		const gchar *locale_name = dent->d_name;
+		gboolean is_dir = FALSE, is_reg = FALSE, is_link = FALSE;
+
+		if (strcmp(locale_name, ".") == 0 || strcmp(locale_name, "..") == 0 ||
+			strchr(locale_name, '\n') != NULL)
+			continue;
+
+#ifdef DT_DIR
+		/* most file systems tell us the type directly - only symlinks and
+		 * unknown types need a stat() */
+		is_dir = dent->d_type == DT_DIR;
+		is_reg = dent->d_type == DT_REG;
+		is_link = dent->d_type == DT_LNK;
+		if (dent->d_type == DT_UNKNOWN)
+#endif
+		{
+			gchar *locale_filename = g_build_filename(locale_path, locale_name, NULL);
+			GStatBuf st;
+
+			if (g_lstat(locale_filename, &st) == 0)
+			{
+				is_dir = S_ISDIR(st.st_mode);
+				is_reg = S_ISREG(st.st_mode);
+				is_link = S_ISLNK(st.st_mode);
+			}
+			g_free(locale_filename);
+		}
+
+		if (is_link)
+		{
+			gchar *locale_filename = g_build_filename(locale_path, locale_name, NULL);
+			GStatBuf st;
+
+			if (g_stat(locale_filename, &st) == 0)
+			{
+				is_reg = S_ISREG(st.st_mode);
+				if (S_ISDIR(st.st_mode))
+				{
+					if (!locale_realpath)
+						locale_realpath = tm_get_real_path(locale_path);
+					is_dir = symlink_dir_valid(locale_realpath, locale_filename);
+				}
+			}
+			g_free(locale_filename);
+		}
+
+		if (is_dir)
+			g_ptr_array_add(dirs, g_strdup(locale_name));
+		else if (is_reg)
+			g_ptr_array_add(files, g_strdup(locale_name));
+	}
+	if (dir)
+		closedir(dir);
+#endif
+
+	g_ptr_array_add(files, NULL);
+	g_ptr_array_add(dirs, NULL);
+
+	entry = g_new0(IndexEntry, 1);
+	entry->mtime = mtime;
+	entry->size = size;
+	entry->files = (gchar **) g_ptr_array_free(files, FALSE);
+	entry->dirs = (gchar **) g_ptr_array_free(dirs, FALSE);
+
+	g_free(locale_realpath);
+	return entry;
+}
+
+
+/* values of the patterns compiled by get_scan_patterns() */
+enum
+{
+	PATTERN_FILE = 1 << 0,
+	PATTERN_IGNORED_FILE = 1 << 1,
+	PATTERN_IGNORED_DIR = 1 << 2
+};
+
+
+/* The project file patterns and both ignore pattern lists compiled together so
+ * every scanned name is matched once. Empty project file patterns match everything. */
+static PrjOrgPatterns *get_scan_patterns(void)
+{
+	PrjOrgPatterns *patterns = patterns_new();
+
+	if (!geany_data->app->project->file_patterns || !geany_data->app->project->file_patterns[0])
+	{
+		gchar **all_pattern = g_strsplit ("*", " ", -1);
+		patterns_add(patterns, all_pattern, PATTERN_FILE);
+		g_strfreev(all_pattern);
+	}
+	else
+		patterns_add(patterns, geany_data->app->project->file_patterns, PATTERN_FILE);
+
+	patterns_add(patterns, prj_org->ignored_file_patterns, PATTERN_IGNORED_FILE);
+	patterns_add(patterns, prj_org->ignored_dirs_patterns, PATTERN_IGNORED_DIR);
+
+	return patterns;
+}
+
+
+static gboolean is_project_file(PrjOrgPatterns *patterns, const gchar *utf8_name)
+{
+	guint flags = patterns_match_flags(patterns, utf8_name);
+
+	return (flags & (PATTERN_FILE | PATTERN_IGNORED_FILE)) == PATTERN_FILE;
+}
+
+
+static gboolean is_ignored_dir(PrjOrgPatterns *patterns, const gchar *utf8_name)
+{
+	return (patterns_match_flags(patterns, utf8_name) & PATTERN_IGNORED_DIR) != 0;
+}
+
+
+static ScanContext *scan_context_ref(ScanContext *ctx)
+{
+	g_atomic_int_inc(&ctx->ref_count);
+	return ctx;
+}
+
+
+static void scan_context_unref(ScanContext *ctx)
+{
+	if (!g_atomic_int_dec_and_test(&ctx->ref_count))
+		return;
+
+	patterns_free(ctx->patterns);
+	filetype_patterns_unref(ctx->filetype_patterns);
+	if (ctx->old_index)
+		g_hash_table_unref(ctx->old_index);
+	if (ctx->new_index)
+		g_hash_table_unref(ctx->new_index);
+	g_async_queue_unref(ctx->results);
+	g_free(ctx->roots);
+	g_free(ctx);
+}
+
+
+static ScanJob *scan_job_new(ScanContext *ctx, ScanRoot *scan_root, gchar *locale_dir, gchar *utf8_dir, gint depth)
+{
+	ScanJob *job = g_new0(ScanJob, 1);
+
+	job->ctx = scan_context_ref(ctx);
+	job->scan_root = scan_root;
+	job->locale_dir = locale_dir;
+	job->utf8_dir = utf8_dir;
+	job->depth = depth;
+	job->files = g_ptr_array_new_with_free_func(g_free);
+	job->filetypes = g_ptr_array_new();
+	job->index_dirs = g_ptr_array_new_with_free_func(g_free);
+	job->index_entries = g_ptr_array_new_with_free_func((GDestroyNotify)index_entry_free);
+
+	g_atomic_int_inc(&ctx->pending);
+	g_atomic_int_inc(&scan_root->pending);
+
+	return job;
+}
+
+
+static void scan_job_free(ScanJob *job)
+{
+	g_ptr_array_free(job->files, TRUE);
+	g_ptr_array_free(job->filetypes, TRUE);
+	g_ptr_array_free(job->index_dirs, TRUE);
+	g_ptr_array_free(job->index_entries, TRUE);
+	g_free(job->locale_dir);
+	g_free(job->utf8_dir);
+	scan_context_unref(job->ctx);
+	g_free(job);
+}
+
+
+/* Jobs may be pushed from the workers - the queue lock makes sure nothing is
+ * pushed after scan_cancel() so the pool can be freed safely afterwards */
+static void scan_push_job(ScanJob *job)
+{
+	GAsyncQueue *queue = job->ctx->results;
+	gboolean cancelled;
+
+	g_async_queue_lock(queue);
+	cancelled = g_atomic_int_get(&job->ctx->cancelled);
+	if (!cancelled)
+		g_thread_pool_push(s_scan_pool, job, NULL);
+	g_async_queue_unlock(queue);
+
+	if (cancelled)
+		scan_job_free(job);
+}
+
+
+static void scan_dir(ScanJob *job, const gchar *locale_path, const gchar *utf8_path, gint depth)
+{
+	ScanContext *ctx = job->ctx;
+	IndexEntry *cached, *entry;
+	gint64 mtime, size;
+	gchar **name;
+
+	if (g_atomic_int_get(&ctx->cancelled) || !get_dir_stamp(locale_path, &mtime, &size))
+		return;
+
+	cached = g_hash_table_lookup(ctx->old_index, locale_path);
+	if (cached && cached->mtime != 0 && cached->mtime == mtime && cached->size == size)
+	{
+		entry = g_new0(IndexEntry, 1);
+		entry->mtime = cached->mtime;
+		entry->size = cached->size;
+		entry->files = g_strdupv(cached->files);
+		entry->dirs = g_strdupv(cached->dirs);
+	}
+	else
+	{
+		gint64 now = g_get_real_time();
+
+		entry = read_dir(locale_path, mtime, size);
+		/* a change right after the read could keep the same timestamp */
+		entry->racy = mtime + SCAN_RACY_USEC > now;
+	}
+
+	g_ptr_array_add(job->index_dirs, g_strdup(locale_path));
+	g_ptr_array_add(job->index_entries, entry);
+
+	foreach_strv (name, entry->files)
+	{
+		gchar *utf8_name = utils_get_utf8_from_locale(*name);
+
+		if (is_project_file(ctx->patterns, utf8_name))
+		{
+			g_ptr_array_add(job->files, g_build_filename(utf8_path, utf8_name, NULL));
+			g_ptr_array_add(job->filetypes, filetypes_detect_by_name(ctx->filetype_patterns, utf8_name));
+		}
+		g_free(utf8_name);
+	}
+
+	foreach_strv (name, entry->dirs)
+	{
+		gchar *utf8_name = utils_get_utf8_from_locale(*name);
+
+		if (!is_ignored_dir(ctx->patterns, utf8_name))
+		{
+			gchar *locale_filename = g_build_filename(locale_path, *name, NULL);
+			gchar *utf8_filename = g_build_filename(utf8_path, utf8_name, NULL);
+
+			if (depth < SCAN_SPLIT_DEPTH)
+			{
+				/* hand the subtree over to another worker */
+				scan_push_job(scan_job_new(ctx, job->scan_root, locale_filename, utf8_filename, depth + 1));
+			}
+			else
+			{
+				scan_dir(job, locale_filename, utf8_filename, depth + 1);
+				g_free(locale_filename);
+				g_free(utf8_filename);
+			}
+		}
+		g_free(utf8_name);
+	}
+}
+
+
+static void scan_worker(gpointer data, gpointer user_data)
+{
+	ScanJob *job = data;
+	GAsyncQueue *queue = job->ctx->results;
+	gboolean cancelled;
+
+	scan_dir(job, job->locale_dir, job->utf8_dir, job->depth);
+
+	/* the job can't get into the queue after it was flushed by scan_cancel() */
+	g_async_queue_lock(queue);
+	cancelled = g_atomic_int_get(&job->ctx->cancelled);
+	if (!cancelled)
+		g_async_queue_push_unlocked(queue, job);
+	g_async_queue_unlock(queue);
+
+	if (cancelled)
+		scan_job_free(job);
+}
+
+
+static void scan_cancel(void)
+{
+	ScanContext *ctx = s_scan;
+	GSList *jobs = NULL;
+	gpointer job;
+
+	if (!ctx)
+		return;
+
+	s_scan = NULL;
+	if (ctx->source_id)
+		g_source_remove(ctx->source_id);
+
+	g_async_queue_lock(ctx->results);
+	g_atomic_int_set(&ctx->cancelled, TRUE);
+	while ((job = g_async_queue_try_pop_unlocked(ctx->results)) != NULL)
+		jobs = g_slist_prepend(jobs, job);
+	g_async_queue_unlock(ctx->results);
+
+	g_slist_foreach(jobs, (GFunc)scan_job_free, NULL);
+	g_slist_free(jobs);
+
+	scan_context_unref(ctx);
+}
+
+
+static void scan_finished(ScanContext *ctx);
+
+
+static void scan_changes_add(const gchar *locale_path)
+{
+	if (!s_scan_changes)
+		s_scan_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	g_hash_table_insert(s_scan_changes, g_strdup(locale_path), NULL);
+}
+
+
+static void scan_changes_add_names(const gchar *locale_dir, gchar **names)
+{
+	gchar **name;
+
+	foreach_strv (name, names)
+	{
+		gchar *locale_path = g_build_filename(locale_dir, *name, NULL);
+
+		scan_changes_add(locale_path);
+		g_free(locale_path);
+	}
+}
+
+
+static void scan_changes_clear(void)
+{
+	if (s_scan_changes)
+		g_hash_table_destroy(s_scan_changes);
+	s_scan_changes = NULL;
+}
+
+
+/* Directories are watched as soon as their listing reaches the main thread so
+ * changes made while the rest of the project is scanned are noticed. A change
+ * between the read of the listing and the start of the watch shows up as a
+ * different stamp - all old and new entries of the directory are then checked
+ * again when the scan finishes. */
+static void watch_scanned_dir(const gchar *locale_dir, IndexEntry *entry)
+{
+	gint64 mtime, size;
+
+	prjorg_watch_add_dir(locale_dir);
+
+	if (!get_dir_stamp(locale_dir, &mtime, &size))
+		scan_changes_add(locale_dir);
+	else if (mtime != entry->mtime || size != entry->size)
+	{
+		IndexEntry *current = read_dir(locale_dir, 0, 0);
+
+		scan_changes_add_names(locale_dir, entry->files);
+		scan_changes_add_names(locale_dir, entry->dirs);
+		scan_changes_add_names(locale_dir, current->files);
+		scan_changes_add_names(locale_dir, current->dirs);
+		index_entry_free(current);
+
+		/* read the listing again next time */
+		entry->racy = TRUE;
+	}
+}
+
 
-static PropertyDialogElements *e;
+/* merges results of finished jobs into the file tables */
+static gboolean drain_scan_results(gpointer user_data)
+{
+	ScanContext *ctx = s_scan;
+	ScanJob *job;
+	gboolean root_finished = FALSE;
+	gboolean all_finished = FALSE;
 
-static GSList *s_idle_add_funcs;
-static GSList *s_idle_remove_funcs;
+	if (!ctx)
+		return FALSE;
 
+	while ((job = g_async_queue_try_pop(ctx->results)) != NULL)
+	{
+		PrjOrgRoot *root = job->scan_root->root;
+		guint i;
 
-static void clear_idle_queue(GSList **queue)
-{
-	GSList *elem;
+		for (i = 0; i < job->files->len; i++)
+		{
+			if (s_tags_enabled)
+				tag_queue_push(root, job->files->pdata[i], job->filetypes->pdata[i]);
+			g_hash_table_insert(root->file_table, job->files->pdata[i], NULL);
+			job->files->pdata[i] = NULL;  /* ownership passed to the table */
+		}
 
-	foreach_slist(elem, *queue)
-		g_free(elem->data);
-	g_slist_free(*queue);
-	*queue = NULL;
-}
+		for (i = 0; i < job->index_entries->len; i++)
+		{
+			watch_scanned_dir(job->index_dirs->pdata[i], job->index_entries->pdata[i]);
+			g_hash_table_insert(ctx->new_index, job->index_dirs->pdata[i], job->index_entries->pdata[i]);
+			job->index_dirs->pdata[i] = NULL;
+			job->index_entries->pdata[i] = NULL;
+		}
 
+		if (g_atomic_int_dec_and_test(&job->scan_root->pending))
+			root_finished = TRUE;
+		if (g_atomic_int_dec_and_test(&ctx->pending))
+			all_finished = TRUE;
 
-static void collect_source_files(gchar *filename, TMSourceFile *sf, gpointer user_data)
-{
-	GPtrArray *array = user_data;
+		scan_job_free(job);
+	}
 
-	if (sf != NULL)
-		g_ptr_array_add(array, sf);
+	if (all_finished)
+	{
+		ctx->source_id = 0;
+		scan_finished(ctx);
+		return FALSE;
+	}
+
+	/* fill the sidebar progressively, one root at a time */
+	if (root_finished)
+		prjorg_sidebar_update(TRUE);
+
+	return TRUE;
 }
 
 
-/* path - absolute path in locale, returned list in locale */
-static GSList *get_file_list(const gchar *utf8_path, GSList *patterns, GSList *ignored_dirs_patterns, GSList *ignored_file_patterns)
+static void scan_start(void)
 {
-	GSList *list = NULL;
-	GDir *dir;
-	gchar *locale_path = utils_get_locale_from_utf8(utf8_path);
+	ScanContext *ctx;
+	GSList *elem;
+	guint i = 0;
 
-	dir = g_dir_open(locale_path, 0, NULL);
-	if (!dir)
-	{
-		g_free(locale_path);
-		return NULL;
-	}
+	scan_cancel();
 
-	while (TRUE)
+	if (!s_scan_pool)
 	{
-		const gchar *locale_name;
-		gchar *locale_filename, *utf8_filename, *utf8_name;
+		gint threads = 4;
 
-		locale_name = g_dir_read_name(dir);
-		if (!locale_name)
-			break;
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		threads = MAX(2, (gint) g_get_num_processors());
+#endif
+		s_scan_pool = g_thread_pool_new(scan_worker, NULL, threads, FALSE, NULL);
+	}
 
-		utf8_name = utils_get_utf8_from_locale(locale_name);
-		locale_filename = g_build_filename(locale_path, locale_name, NULL);
-		utf8_filename = utils_get_utf8_from_locale(locale_filename);
+	if (!s_index)
+		s_index = index_load();
 
-		if (g_file_test(locale_filename, G_FILE_TEST_IS_DIR))
-		{
-			GSList *lst;
-			gchar *relative, *locale_parent_realpath, *locale_child_realpath,
-				*utf8_parent_realpath, *utf8_child_realpath;
+	if (s_filetype_patterns)
+		filetype_patterns_unref(s_filetype_patterns);
+	s_filetype_patterns = get_filetype_patterns();
 
-			/* symlink cycle avoidance - test if directory within parent directory */
-			locale_parent_realpath = tm_get_real_path(locale_path);
-			locale_child_realpath = tm_get_real_path(locale_filename);
-			utf8_parent_realpath = utils_get_utf8_from_locale(locale_parent_realpath);
-			utf8_child_realpath = utils_get_utf8_from_locale(locale_child_realpath);
+	s_tags_enabled = prj_org->generate_tag_prefs != PrjOrgTagNo;
 
-			relative = get_relative_path(utf8_parent_realpath, utf8_child_realpath);
+	ctx = g_new0(ScanContext, 1);
+	ctx->ref_count = 1;
+	ctx->results = g_async_queue_new();
+	ctx->old_index = g_hash_table_ref(s_index);
+	ctx->new_index = index_new();
+	ctx->filetype_patterns = filetype_patterns_ref(s_filetype_patterns);
+	ctx->patterns = get_scan_patterns();
 
-			g_free(locale_parent_realpath);
-			g_free(locale_child_realpath);
-			g_free(utf8_parent_realpath);
-			g_free(utf8_child_realpath);
+	ctx->root_num = g_slist_length(prj_org->roots);
+	ctx->roots = g_new0(ScanRoot, ctx->root_num);
 
-			if (relative)
-			{
-				g_free(relative);
+	s_scan = ctx;
+	/* keep the context pending until all root jobs are pushed */
+	g_atomic_int_inc(&ctx->pending);
 
-				if (!patterns_match(ignored_dirs_patterns, utf8_name))
-				{
-					lst = get_file_list(utf8_filename, patterns, ignored_dirs_patterns, ignored_file_patterns);
-					if (lst)
-						list = g_slist_concat(list, lst);
-				}
-			}
-		}
-		else if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
-		{
-			if (patterns_match(patterns, utf8_name) && !patterns_match(ignored_file_patterns, utf8_name))
-				list = g_slist_prepend(list, g_strdup(utf8_filename));
-		}
+	foreach_slist(elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		ScanRoot *scan_root = &ctx->roots[i++];
 
-		g_free(utf8_filename);
-		g_free(locale_filename);
-		g_free(utf8_name);
+		scan_root->root = root;
+		scan_push_job(scan_job_new(ctx, scan_root,
+			utils_get_locale_from_utf8(root->base_dir), g_strdup(root->base_dir), 0));
 	}
 
-	g_dir_close(dir);
-	g_free(locale_path);
+	if (g_atomic_int_dec_and_test(&ctx->pending))
+		scan_finished(ctx);  /* no roots */
+	else
+		ctx->source_id = plugin_timeout_add(geany_plugin, 100, drain_scan_results, NULL);
+}
+
 
-	return list;
+gboolean prjorg_project_is_scanning(void)
+{
+	return s_scan != NULL;
 }
 
 
-static gint prjorg_project_rescan_root(PrjOrgRoot *root)
+static void clear_root(PrjOrgRoot *root, gpointer user_data)
 {
 	GPtrArray *source_files;
-	GSList *pattern_list = NULL;
-	GSList *ignored_dirs_list = NULL;
-	GSList *ignored_file_list = NULL;
-	GSList *lst;
-	GSList *elem;
-	gint filenum = 0;
 
 	source_files = g_ptr_array_new();
 	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
+	prjorg_tags_remove_source_files(source_files);
 	tm_workspace_remove_source_files(source_files);
 	g_ptr_array_free(source_files, TRUE);
 	g_hash_table_remove_all(root->file_table);
+}
 
-	if (!geany_data->app->project->file_patterns || !geany_data->app->project->file_patterns[0])
-	{
-		gchar **all_pattern = g_strsplit ("*", " ", -1);
-		pattern_list = get_precompiled_patterns(all_pattern);
-		g_strfreev(all_pattern);
-	}
-	else
-		pattern_list = get_precompiled_patterns(geany_data->app->project->file_patterns);
 
-	ignored_dirs_list = get_precompiled_patterns(prj_org->ignored_dirs_patterns);
-	ignored_file_list = get_precompiled_patterns(prj_org->ignored_file_patterns);
+/* Tag generation
+ *
+ * Files found by the scan are queued and their tags are generated from an idle
+ * callback which parses files only until its time budget is used up, so the main
+ * loop is never blocked for longer than that and a single file. The files are
+ * added one by one with tm_workspace_add_source_file() which merges the sorted
+ * tags of the file into the workspace - tm_workspace_add_source_files() would
+ * re-sort all the workspace tags on every call, which takes seconds for big
+ * projects. The parsing has to stay on the main thread, the tag manager parses
+ * files only when they are added and the parsers aren't thread safe. The file
+ * type detection by name was already done by the scan. */
+
+/* time one idle call may spend parsing files, in seconds */
+#define TAG_IDLE_BUDGET 0.05
+
+typedef struct
+{
+	PrjOrgRoot *root;
+	gchar *utf8_path;
+	GeanyFiletype *name_ft;
+} TagItem;
+
+static GQueue s_tag_queue = G_QUEUE_INIT;
+static gboolean s_tag_idle_added = FALSE;
+
+
+static void tag_item_free(TagItem *item)
+{
+	g_free(item->utf8_path);
+	g_free(item);
+}
+
 
-	lst = get_file_list(root->base_dir, pattern_list, ignored_dirs_list, ignored_file_list);
+static void tag_queue_clear(void)
+{
+	TagItem *item;
+
+	while ((item = g_queue_pop_head(&s_tag_queue)) != NULL)
+		tag_item_free(item);
+}
+
+
+static gboolean generate_tags_idle(gpointer user_data)
+{
+	GPtrArray *source_files;
+	GTimer *timer;
+	TagItem *item;
+
+	if (!prj_org || g_queue_is_empty(&s_tag_queue))
+	{
+		s_tag_idle_added = FALSE;
+		return FALSE;
+	}
 
-	foreach_slist(elem, lst)
+	source_files = g_ptr_array_new();
+	timer = g_timer_new();
+	/* at least one file is parsed per call */
+	while (g_timer_elapsed(timer, NULL) < TAG_IDLE_BUDGET &&
+		(item = g_queue_pop_head(&s_tag_queue)) != NULL)
 	{
-		char *path = elem->data;
+		gpointer value;
 
-		if (path)
+		/* the file might have been removed in the meantime */
+		if (g_hash_table_lookup_extended(item->root->file_table, item->utf8_path, NULL, &value) && !value)
 		{
-			g_hash_table_insert(root->file_table, g_strdup(path), NULL);
-			filenum++;
+			gchar *locale_path = utils_get_locale_from_utf8(item->utf8_path);
+			TMSourceFile *sf;
+
+			sf = tm_source_file_new(locale_path, filetypes_detect(item->utf8_path, item->name_ft)->name);
+			if (sf && !document_find_by_filename(item->utf8_path))
+			{
+				tm_workspace_add_source_file(sf);
+				g_ptr_array_add(source_files, sf);
+			}
+
+			g_hash_table_insert(item->root->file_table, g_strdup(item->utf8_path), sf);
+			g_free(locale_path);
 		}
+
+		tag_item_free(item);
 	}
+	g_timer_destroy(timer);
+
+	if (source_files->len > 0)
+		prjorg_tags_add_source_files(source_files);
+	g_ptr_array_free(source_files, TRUE);
 
-	g_slist_foreach(lst, (GFunc) g_free, NULL);
-	g_slist_free(lst);
+	return TRUE;
+}
+
+
+static void tag_queue_start(void)
+{
+	if (!s_tag_idle_added && !g_queue_is_empty(&s_tag_queue))
+	{
+		s_tag_idle_added = TRUE;
+		plugin_idle_add(geany_plugin, (GSourceFunc)generate_tags_idle, NULL);
+	}
+}
 
-	g_slist_foreach(pattern_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(pattern_list);
 
-	g_slist_foreach(ignored_dirs_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(ignored_dirs_list);
+static void tag_queue_push(PrjOrgRoot *root, const gchar *utf8_path, GeanyFiletype *name_ft)
+{
+	TagItem *item = g_new0(TagItem, 1);
 
-	g_slist_foreach(ignored_file_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(ignored_file_list);
+	item->root = root;
+	item->utf8_path = g_strdup(utf8_path);
+	item->name_ft = name_ft;
+	g_queue_push_tail(&s_tag_queue, item);
 
-	return filenum;
+	/* with Auto, the parsing doesn't slow down the scan */
+	if (!s_scan || prj_org->generate_tag_prefs == PrjOrgTagYes)
+		tag_queue_start();
 }
 
 
-static gboolean match_basename(gconstpointer pft, gconstpointer user_data)
+/* Live updates
+ *
+ * The directories found by the scan are watched and the reported paths are
+ * compared against the file tables - files which appeared are added, files
+ * which disappeared are removed, together with their tags and sidebar rows. */
+
+/* above this number of changes reloading the whole sidebar is faster */
+#define MAX_SIDEBAR_CHANGES 500
+
+typedef struct
+{
+	PrjOrgRoot *root;
+	gchar *utf8_path;
+	gboolean added;
+} FileChange;
+
+typedef struct
 {
-	const GeanyFiletype *ft = pft;
-	const gchar *utf8_base_filename = user_data;
-	gint j;
-	gboolean ret = FALSE;
+	PrjOrgPatterns *patterns;
+
+	GPtrArray *removed_source_files;
+	GPtrArray *changes;
+
+	/* deleted directories, their files are removed at once after the batch */
+	GHashTable *removed_dirs;  /* utf8 dir -> NULL */
+	GHashTable *removed_locale_dirs;  /* locale dir -> NULL */
+	GSList *removed_dir_roots;
+} ChangeSet;
+
+
+/* utf8 - TRUE if @path lies inside @dir */
+static gboolean path_in_dir(const gchar *dir, const gchar *path)
+{
+	gsize len = strlen(dir);
 
-	if (G_UNLIKELY(ft->id == GEANY_FILETYPES_NONE))
+	if (strncmp(dir, path, len) != 0)
 		return FALSE;
+	if (len > 0 && G_IS_DIR_SEPARATOR(dir[len - 1]))
+		return path[len] != '\0';
+	return G_IS_DIR_SEPARATOR(path[len]);
+}
+
+
+static void file_change_free(FileChange *change)
+{
+	g_free(change->utf8_path);
+	g_free(change);
+}
+
+
+static void add_change(ChangeSet *set, PrjOrgRoot *root, const gchar *utf8_path, gboolean added)
+{
+	FileChange *change = g_new0(FileChange, 1);
+
+	change->root = root;
+	change->utf8_path = g_strdup(utf8_path);
+	change->added = added;
+	g_ptr_array_add(set->changes, change);
+}
+
+
+/* the tags are generated by the tag queue like those of the scanned files */
+static void add_file(ChangeSet *set, PrjOrgRoot *root, const gchar *utf8_path)
+{
+	g_hash_table_insert(root->file_table, g_strdup(utf8_path), NULL);
+	if (s_tags_enabled)
+		tag_queue_push(root, utf8_path, filetypes_detect_by_name(s_filetype_patterns, utf8_path));
+	add_change(set, root, utf8_path, TRUE);
+}
+
+
+/* the TMSourceFile is freed only after it's removed from the workspace */
+static void remove_file(ChangeSet *set, PrjOrgRoot *root, const gchar *utf8_path)
+{
+	gpointer key, value;
+
+	if (!g_hash_table_lookup_extended(root->file_table, utf8_path, &key, &value))
+		return;
+
+	add_change(set, root, utf8_path, FALSE);
+	g_hash_table_steal(root->file_table, utf8_path);
+	g_free(key);
+	if (value)
+		g_ptr_array_add(set->removed_source_files, value);
+}
+
 
-	for (j = 0; ft->pattern[j] != NULL; j++)
+/* removes the files of all the deleted directories of the batch in a single
+ * pass over each file table - a branch switch can delete hundreds of them */
+static void remove_dirs(ChangeSet *set)
+{
+	GSList *elem;
+
+	prjorg_watch_remove_dirs(set->removed_locale_dirs);
+
+	foreach_slist (elem, set->removed_dir_roots)
 	{
-		GPatternSpec *pattern = g_pattern_spec_new(ft->pattern[j]);
+		PrjOrgRoot *root = elem->data;
+		GHashTableIter iter;
+		gpointer key, value;
 
-		if (g_pattern_match_string(pattern, utf8_base_filename))
+		g_hash_table_iter_init(&iter, root->file_table);
+		while (g_hash_table_iter_next(&iter, &key, &value))
 		{
-			ret = TRUE;
-			g_pattern_spec_free(pattern);
-			break;
+			if (path_in_dirs(set->removed_dirs, key))
+			{
+				add_change(set, root, key, FALSE);
+				g_hash_table_iter_steal(&iter);
+				g_free(key);
+				if (value)
+					g_ptr_array_add(set->removed_source_files, value);
+			}
 		}
-		g_pattern_spec_free(pattern);
 	}
-	return ret;
 }
 
 
-/* Stolen and modified version from Geany. The only difference is that Geany
- * first looks at shebang inside the file and then, if it fails, checks the
- * file extension. Opening every file is too expensive so instead check just
- * extension and only if this fails, look at the shebang */
-static GeanyFiletype *filetypes_detect(const gchar *utf8_filename)
+static void add_dir(ChangeSet *set, PrjOrgRoot *root, const gchar *locale_dir, const gchar *utf8_dir)
 {
-	struct stat s;
-	GeanyFiletype *ft = NULL;
-	gchar *locale_filename;
+	IndexEntry *entry = read_dir(locale_dir, 0, 0);
+	gchar **name;
 
-	locale_filename = utils_get_locale_from_utf8(utf8_filename);
-	if (g_stat(locale_filename, &s) != 0 || s.st_size > 10*1024*1024)
-		ft = filetypes[GEANY_FILETYPES_NONE];
-	else
+	prjorg_watch_add_dir(locale_dir);
+
+	foreach_strv (name, entry->files)
 	{
-		guint i;
-		gchar *utf8_base_filename;
+		gchar *utf8_name = utils_get_utf8_from_locale(*name);
+		gchar *utf8_path = g_build_filename(utf8_dir, utf8_name, NULL);
 
-		/* to match against the basename of the file (because of Makefile*) */
-		utf8_base_filename = g_path_get_basename(utf8_filename);
-#ifdef G_OS_WIN32
-		/* use lower case basename */
-		SETPTR(utf8_base_filename, g_utf8_strdown(utf8_base_filename, -1));
-#endif
+		if (is_project_file(set->patterns, utf8_name) &&
+			!g_hash_table_lookup_extended(root->file_table, utf8_path, NULL, NULL))
+			add_file(set, root, utf8_path);
+		g_free(utf8_path);
+		g_free(utf8_name);
+	}
+
+	foreach_strv (name, entry->dirs)
+	{
+		gchar *utf8_name = utils_get_utf8_from_locale(*name);
 
-		for (i = 0; i < geany_data->filetypes_array->len; i++)
+		if (!is_ignored_dir(set->patterns, utf8_name))
 		{
-			GeanyFiletype *ftype = filetypes[i];
+			gchar *locale_path = g_build_filename(locale_dir, *name, NULL);
+			gchar *utf8_path = g_build_filename(utf8_dir, utf8_name, NULL);
 
-			if (match_basename(ftype, utf8_base_filename))
-			{
-				ft = ftype;
-				break;
-			}
+			add_dir(set, root, locale_path, utf8_path);
+			g_free(locale_path);
+			g_free(utf8_path);
 		}
+		g_free(utf8_name);
+	}
+
+	index_entry_free(entry);
+}
+
 
-		if (ft == NULL)
-			ft = filetypes_detect_from_file(utf8_filename);
+static void apply_change(ChangeSet *set, PrjOrgRoot *root, const gchar *locale_path, const gchar *utf8_path)
+{
+	gchar *utf8_name = g_path_get_basename(utf8_path);
+	GStatBuf st;
 
-		g_free(utf8_base_filename);
+	if (g_stat(locale_path, &st) != 0)
+	{
+		remove_file(set, root, utf8_path);
+		if (prjorg_watch_is_watched(locale_path))
+		{
+			g_hash_table_insert(set->removed_dirs, g_strdup(utf8_path), NULL);
+			g_hash_table_insert(set->removed_locale_dirs, g_strdup(locale_path), NULL);
+			if (!g_slist_find(set->removed_dir_roots, root))
+				set->removed_dir_roots = g_slist_prepend(set->removed_dir_roots, root);
+		}
+	}
+	else if (S_ISREG(st.st_mode))
+	{
+		if (!g_hash_table_lookup_extended(root->file_table, utf8_path, NULL, NULL) &&
+			is_project_file(set->patterns, utf8_name))
+			add_file(set, root, utf8_path);
 	}
+	else if (S_ISDIR(st.st_mode) && !prjorg_watch_is_watched(locale_path) &&
+		!is_ignored_dir(set->patterns, utf8_name))
+	{
+		gboolean valid = TRUE;
+#ifndef G_OS_WIN32
+		if (g_lstat(locale_path, &st) == 0 && S_ISLNK(st.st_mode))
+		{
+			gchar *locale_parent = g_path_get_dirname(locale_path);
+			gchar *locale_parent_realpath = tm_get_real_path(locale_parent);
 
-	g_free(locale_filename);
+			valid = symlink_dir_valid(locale_parent_realpath, locale_path);
+			g_free(locale_parent_realpath);
+			g_free(locale_parent);
+		}
+#endif
+		if (valid)
+			add_dir(set, root, locale_path, utf8_path);
+	}
 
-	return ft;
+	g_free(utf8_name);
 }
 
 
-static void regenerate_tags(PrjOrgRoot *root, gpointer user_data)
+/* Called by the watcher with the paths (in locale) of created, deleted and
+ * moved files and directories */
+void prjorg_project_apply_changes(GPtrArray *locale_paths)
 {
-	GHashTableIter iter;
-	gpointer key, value;
-	GPtrArray *source_files;
-	GHashTable *file_table;
+	ChangeSet set;
+	guint i;
 
-	source_files = g_ptr_array_new();
-	file_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GFreeFunc)tm_source_file_free);
-	g_hash_table_iter_init(&iter, root->file_table);
-	while (g_hash_table_iter_next(&iter, &key, &value))
+	if (!prj_org)
+		return;
+
+	if (s_scan)
 	{
-		TMSourceFile *sf;
-		gchar *utf8_path = key;
-		gchar *locale_path = utils_get_locale_from_utf8(utf8_path);
+		/* the file tables aren't complete yet, replayed by scan_finished() */
+		for (i = 0; i < locale_paths->len; i++)
+			scan_changes_add(locale_paths->pdata[i]);
+		return;
+	}
 
-		sf = tm_source_file_new(locale_path, filetypes_detect(utf8_path)->name);
-		if (sf && !document_find_by_filename(utf8_path))
-			g_ptr_array_add(source_files, sf);
+	set.patterns = get_scan_patterns();
+	set.removed_source_files = g_ptr_array_new_with_free_func((GDestroyNotify)tm_source_file_free);
+	set.changes = g_ptr_array_new_with_free_func((GDestroyNotify)file_change_free);
+	set.removed_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	set.removed_locale_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	set.removed_dir_roots = NULL;
 
-		g_hash_table_insert(file_table, g_strdup(utf8_path), sf);
-		g_free(locale_path);
+	for (i = 0; i < locale_paths->len; i++)
+	{
+		const gchar *locale_path = locale_paths->pdata[i];
+		gchar *utf8_path = utils_get_utf8_from_locale(locale_path);
+		GSList *elem;
+
+		foreach_slist (elem, prj_org->roots)
+		{
+			PrjOrgRoot *root = elem->data;
+
+			if (path_in_dir(root->base_dir, utf8_path))
+				apply_change(&set, root, locale_path, utf8_path);
+		}
+		g_free(utf8_path);
 	}
-	g_hash_table_destroy(root->file_table);
-	root->file_table = file_table;
+	remove_dirs(&set);
 
-	tm_workspace_add_source_files(source_files);
-	g_ptr_array_free(source_files, TRUE);
+	/* removed files must leave the workspace before they are freed */
+	prjorg_tags_remove_source_files(set.removed_source_files);
+	tm_workspace_remove_source_files(set.removed_source_files);
+
+	if (set.changes->len > MAX_SIDEBAR_CHANGES)
+		prjorg_sidebar_update(TRUE);
+	else
+	{
+		for (i = 0; i < set.changes->len; i++)
+		{
+			FileChange *change = set.changes->pdata[i];
+
+			if (change->added)
+				prjorg_sidebar_add_file(change->root, change->utf8_path);
+			else
+				prjorg_sidebar_remove_file(change->root, change->utf8_path);
+		}
+	}
+
+	patterns_free(set.patterns);
+	g_ptr_array_free(set.removed_source_files, TRUE);
+	g_ptr_array_free(set.changes, TRUE);
+	g_hash_table_destroy(set.removed_dirs);
+	g_hash_table_destroy(set.removed_locale_dirs);
+	g_slist_free(set.removed_dir_roots);
 }
 
 
-void prjorg_project_rescan(void)
+static void scan_finished(ScanContext *ctx)
 {
-	GSList *elem;
-	gint filenum = 0;
+	s_scan = NULL;
+
+	tag_queue_start();
 
+	g_hash_table_unref(s_index);
+	s_index = g_hash_table_ref(ctx->new_index);
+	index_save(s_index);
+	scan_context_unref(ctx);
+
+	prjorg_sidebar_update(TRUE);
+
+	/* apply the changes reported while the scan was running */
+	if (s_scan_changes)
+	{
+		GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+		GHashTableIter iter;
+		gpointer key;
+
+		g_hash_table_iter_init(&iter, s_scan_changes);
+		while (g_hash_table_iter_next(&iter, &key, NULL))
+		{
+			g_ptr_array_add(paths, key);
+			g_hash_table_iter_steal(&iter);
+		}
+		scan_changes_clear();
+
+		prjorg_project_apply_changes(paths);
+		g_ptr_array_free(paths, TRUE);
+	}
+}
+
+
+/* The scan runs in the background - the file tables get filled when it finishes */
+void prjorg_project_rescan(void)
+{
 	if (!prj_org)
 		return;
 
 	clear_idle_queue(&s_idle_add_funcs);
 	clear_idle_queue(&s_idle_remove_funcs);
 
-	foreach_slist(elem, prj_org->roots)
-		filenum += prjorg_project_rescan_root(elem->data);
-
-	if (prj_org->generate_tag_prefs == PrjOrgTagYes || (prj_org->generate_tag_prefs == PrjOrgTagAuto && filenum < 300))
-		g_slist_foreach(prj_org->roots, (GFunc)regenerate_tags, NULL);
+	scan_cancel();
+	scan_changes_clear();
+	prjorg_watch_clear();
+	tag_queue_clear();
+	g_slist_foreach(prj_org->roots, (GFunc)clear_root, NULL);
+	scan_start();
 }
 
 
@@ -396,12 +1490,7 @@ static PrjOrgRoot *create_root(const gchar *utf8_base_dir)
 
 static void close_root(PrjOrgRoot *root, gpointer user_data)
 {
-	GPtrArray *source_files;
-
-	source_files = g_ptr_array_new();
-	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
-	tm_workspace_remove_source_files(source_files);
-	g_ptr_array_free(source_files, TRUE);
+	clear_root(root, NULL);
 
 	g_hash_table_destroy(root->file_table);
 	g_free(root->base_dir);
@@ -456,6 +1545,8 @@ void prjorg_project_remove_external_dir(const gchar *utf8_dirname)
 	{
 		PrjOrgRoot *found_root = found->data;
 
+		scan_cancel();
+		tag_queue_clear();
 		prj_org->roots = g_slist_remove(prj_org->roots, found_root);
 		close_root(found_root, NULL);
 		prjorg_project_rescan();
@@ -634,14 +1725,14 @@ gint prjorg_project_add_properties_tab(GtkWidget *notebook)
 	label = gtk_label_new(_("Generate tags for all project files:"));
 	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
 	e->generate_tag_prefs = gtk_combo_box_text_new();
-	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("Auto (generate if less than 300 files)"));
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("Auto (generate in the background)"));
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("Yes"));
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("No"));
 	gtk_combo_box_set_active(GTK_COMBO_BOX(e->generate_tag_prefs), prj_org->generate_tag_prefs);
 	ui_table_add_row(GTK_TABLE(table), 4, label, e->generate_tag_prefs, NULL);
 	ui_widget_set_tooltip_text(e->generate_tag_prefs,
 		_("Generate tag list for all project files instead of only for the currently opened files. "
-		  "Might be slow for big projects."));
+		  "Tags are generated in the background and become available gradually."));
 
 	gtk_box_pack_start(GTK_BOX(vbox), table, FALSE, FALSE, 6);
 
@@ -672,8 +1763,30 @@ void prjorg_project_close(void)
 	clear_idle_queue(&s_idle_add_funcs);
 	clear_idle_queue(&s_idle_remove_funcs);
 
+	scan_cancel();
+	scan_changes_clear();
+	prjorg_watch_clear();
+	tag_queue_clear();
+	if (s_scan_pool)
+	{
+		/* cancelled jobs return immediately, wait for the running ones */
+		g_thread_pool_free(s_scan_pool, FALSE, TRUE);
+		s_scan_pool = NULL;
+	}
+	if (s_index)
+	{
+		g_hash_table_unref(s_index);
+		s_index = NULL;
+	}
+	if (s_filetype_patterns)
+	{
+		filetype_patterns_unref(s_filetype_patterns);
+		s_filetype_patterns = NULL;
+	}
+
 	g_slist_foreach(prj_org->roots, (GFunc)close_root, NULL);
 	g_slist_free(prj_org->roots);
+	prjorg_tags_clear();
 
 	g_strfreev(prj_org->source_patterns);
 	g_strfreev(prj_org->header_patterns);
@@ -722,7 +1835,12 @@ static gboolean add_tm_idle(gpointer foo)
 
 			if (sf != NULL && !document_find_by_filename(utf8_fname))
 			{
+				GPtrArray *source_files = g_ptr_array_new();
+
+				g_ptr_array_add(source_files, sf);
 				tm_workspace_add_source_file(sf);
+				prjorg_tags_add_source_files(source_files);
+				g_ptr_array_free(source_files, TRUE);
 				break;  /* single file representation in TM is enough */
 			}
 		}
@@ -768,7 +1886,14 @@ static gboolean remove_tm_idle(gpointer foo)
 			TMSourceFile *sf = g_hash_table_lookup(root->file_table, utf8_fname);
 
 			if (sf != NULL)
+			{
+				GPtrArray *source_files = g_ptr_array_new();
+
+				g_ptr_array_add(source_files, sf);
+				prjorg_tags_remove_source_files(source_files);
 				tm_workspace_remove_source_file(sf);
+				g_ptr_array_free(source_files, TRUE);
+			}
 		}
 	}
 
@@ -54,6 +54,8 @@ void prjorg_project_close(void);
 void prjorg_project_save(GKeyFile * key_file);
 void prjorg_project_read_properties_tab(void);
 void prjorg_project_rescan(void);
+gboolean prjorg_project_is_scanning(void);
+void prjorg_project_apply_changes(GPtrArray *locale_paths);
 
 void prjorg_project_add_external_dir(const gchar *utf8_dirname);
 void prjorg_project_remove_external_dir(const gchar *utf8_dirname);
@@ -29,33 +29,23 @@
 #include "prjorg-utils.h"
 #include "prjorg-project.h"
 #include "prjorg-sidebar.h"
+#include "prjorg-tags.h"
+#include "prjorg-tree.h"
 
 extern GeanyPlugin *geany_plugin;
 extern GeanyData *geany_data;
 extern GeanyFunctions *geany_functions;
 
-enum
-{
-	FILEVIEW_COLUMN_ICON,
-	FILEVIEW_COLUMN_NAME,
-	FILEVIEW_COLUMN_COLOR,
-	FILEVIEW_N_COLUMNS,
-};
-
-typedef enum
-{
-	MATCH_FULL,
-	MATCH_PREFIX,
-	MATCH_PATTERN
-} MatchType;
-
 static GdkColor s_external_color;
 static GtkWidget *s_toolbar = NULL;
 static gboolean s_pending_reload = FALSE;
 
 static GtkWidget *s_file_view_vbox = NULL;
 static GtkWidget *s_file_view = NULL;
-static GtkTreeStore *s_file_store = NULL;
+static PrjOrgTreeModel *s_file_store = NULL;
+static GHashTable *s_root_iters = NULL;  /* PrjOrgRoot -> GtkTreeIter of its row */
+static PrjOrgPatterns *s_header_patterns = NULL;
+static PrjOrgPatterns *s_source_patterns = NULL;
 static gboolean s_follow_editor = TRUE;
 
 static struct
@@ -540,96 +530,131 @@ static const char *tm_tag_type_name(const TMTag *tag)
 }
 
 
-static gboolean match(TMTag *tag, const gchar *name, gboolean declaration, gboolean case_sensitive,
-	MatchType match_type, GPatternSpec *pspec, gchar *utf8_path)
+/* number of Find Tag results written to the message window per idle call */
+#define FIND_TAG_BATCH_SIZE 200
+
+static GPtrArray *s_tag_results = NULL;
+static guint s_tag_results_pos = 0;
+static gboolean s_tag_results_idle_added = FALSE;
+
+
+static void free_tag_results(void)
 {
-	const gint forward_types = tm_tag_prototype_t | tm_tag_externvar_t;
-	gboolean matches = FALSE;
-	gint type;
+	if (s_tag_results)
+		g_ptr_array_free(s_tag_results, TRUE);
+	s_tag_results = NULL;
+	s_tag_results_pos = 0;
+}
 
-	type = declaration ? forward_types : tm_tag_max_t - forward_types;
-	matches = tag->type & type;
 
-	if (matches)
-	{
-		gchar *name_case;
+/* returns TRUE when there are more results to write */
+static gboolean write_tag_results(void)
+{
+	guint i;
 
-		if (case_sensitive)
-			name_case = g_strdup(tag->name);
-		else
-			name_case = g_utf8_strdown(tag->name, -1);
+	if (!s_tag_results)
+		return FALSE;
 
-		switch (match_type)
-		{
-			case MATCH_FULL:
-				matches = g_strcmp0(name_case, name) == 0;
-				break;
-			case MATCH_PATTERN:
-				matches = g_pattern_match_string(pspec, name_case);
-				break;
-			case MATCH_PREFIX:
-				matches = g_str_has_prefix(name_case, name);
-				break;
-		}
-		g_free(name_case);
-	}
+	for (i = 0; i < FIND_TAG_BATCH_SIZE && s_tag_results_pos < s_tag_results->len; i++)
+		msgwin_msg_add(COLOR_BLACK, -1, NULL, "%s", (gchar *)s_tag_results->pdata[s_tag_results_pos++]);
 
-	if (matches && utf8_path)
-	{
-		gchar *utf8_file_name = utils_get_utf8_from_locale(tag->file->file_name);
-		gchar *relpath;
+	if (s_tag_results_pos < s_tag_results->len)
+		return TRUE;
+
+	free_tag_results();
+	return FALSE;
+}
+
+
+static gboolean write_tag_results_idle(gpointer user_data)
+{
+	if (write_tag_results())
+		return TRUE;
+
+	s_tag_results_idle_added = FALSE;
+	return FALSE;
+}
+
+
+/* Returns the path of the file relative to the project base path or NULL when the
+ * file shouldn't be listed. Computed once per file. */
+static const gchar *get_tag_relpath(GHashTable *relpaths, TMSourceFile *sf,
+	const gchar *utf8_base_path, const gchar *utf8_path)
+{
+	gchar *relpath = NULL;
+	gchar *utf8_fname;
+
+	if (g_hash_table_lookup_extended(relpaths, sf, NULL, (gpointer *)&relpath))
+		return relpath;
 
-		relpath = get_relative_path(utf8_path, utf8_file_name);
-		matches = relpath != NULL;
+	utf8_fname = utils_get_utf8_from_locale(sf->file_name);
+	if (utf8_path)
+		relpath = get_relative_path(utf8_path, utf8_fname);
+	if (!utf8_path || relpath)
+	{
 		g_free(relpath);
-		g_free(utf8_file_name);
+		relpath = get_relative_path(utf8_base_path, utf8_fname);
 	}
+	g_hash_table_insert(relpaths, sf, relpath);
+	g_free(utf8_fname);
 
-	return matches;
+	return relpath;
 }
 
 
 static void find_tags(const gchar *name, gboolean declaration, gboolean case_sensitive, MatchType match_type, gchar *utf8_path)
 {
+	const gint forward_types = tm_tag_prototype_t | tm_tag_externvar_t;
 	gchar *utf8_base_path = get_project_base_path();
 	gchar *locale_base_path = utils_get_locale_from_utf8(utf8_base_path);
-	GPtrArray *tags_array = geany_data->app->tm_workspace->tags_array;
+	GHashTable *relpaths;
+	GPtrArray *tags;
+	gint type;
 	guint i;
-	gchar *name_case;
-	GPatternSpec *pspec;
-
-	if (case_sensitive)
-		name_case = g_strdup(name);
-	else
-		name_case = g_utf8_strdown(name, -1);
 
-	pspec = g_pattern_spec_new(name_case);
+	type = declaration ? forward_types : tm_tag_max_t - forward_types;
+	tags = prjorg_tags_find(name, case_sensitive, match_type);
+	relpaths = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
 
-	msgwin_set_messages_dir(locale_base_path);
-	msgwin_clear_tab(MSG_MESSAGE);
-	for (i = 0; i < tags_array->len; i++) /* TODO: binary search */
+	free_tag_results();
+	s_tag_results = g_ptr_array_new_with_free_func(g_free);
+	for (i = 0; i < tags->len; i++)
 	{
-		TMTag *tag = tags_array->pdata[i];
+		TMTag *tag = tags->pdata[i];
+		const gchar *relpath;
+
+		if (!(tag->type & type))
+			continue;
 
-		if (match(tag, name_case, declaration, case_sensitive, match_type, pspec, utf8_path))
+		/* global tags have no source file - list them without a location */
+		relpath = tag->file ? get_tag_relpath(relpaths, tag->file, utf8_base_path, utf8_path) : NULL;
+		if (relpath || !tag->file)
 		{
 			gchar *scopestr = tag->scope ? g_strconcat(tag->scope, "::", NULL) : g_strdup("");
-			gchar *utf8_fname = utils_get_utf8_from_locale(tag->file->file_name);
-			gchar *relpath;
 
-			relpath = get_relative_path(utf8_base_path, utf8_fname);
 			if (relpath)
-				msgwin_msg_add(COLOR_BLACK, -1, NULL, "%s:%lu:\n\t[%s]\t %s%s%s", relpath,
-					tag->line, tm_tag_type_name(tag), scopestr, tag->name, tag->arglist ? tag->arglist : "");
+				g_ptr_array_add(s_tag_results, g_strdup_printf("%s:%lu:\n\t[%s]\t %s%s%s", relpath,
+					tag->line, tm_tag_type_name(tag), scopestr, tag->name, tag->arglist ? tag->arglist : ""));
+			else
+				g_ptr_array_add(s_tag_results, g_strdup_printf("[%s]\t %s%s%s",
+					tm_tag_type_name(tag), scopestr, tag->name, tag->arglist ? tag->arglist : ""));
 			g_free(scopestr);
-			g_free(relpath);
-			g_free(utf8_fname);
 		}
 	}
+
+	msgwin_set_messages_dir(locale_base_path);
+	msgwin_clear_tab(MSG_MESSAGE);
 	msgwin_switch_tab(MSG_MESSAGE, TRUE);
 
-	g_free(name_case);
-	g_pattern_spec_free(pspec);
+	/* show the first results right away, the rest from idle */
+	if (write_tag_results() && !s_tag_results_idle_added)
+	{
+		plugin_idle_add(geany_plugin, write_tag_results_idle, NULL);
+		s_tag_results_idle_added = TRUE;
+	}
+
+	g_hash_table_destroy(relpaths);
+	g_ptr_array_free(tags, TRUE);
 	g_free(utf8_base_path);
 	g_free(locale_base_path);
 }
@@ -873,140 +898,44 @@ static void on_find_in_files(G_GNUC_UNUSED GtkMenuItem *menuitem, G_GNUC_UNUSED
 }
 
 
-static void create_branch(gint level, GSList *leaf_list, GtkTreeIter *parent,
-	GSList *header_patterns, GSList *source_patterns, gboolean project)
+static GIcon *get_file_icon(const gchar *utf8_name, const gchar *content_type,
+	PrjOrgPatterns *header_patterns, PrjOrgPatterns *source_patterns)
 {
-	GSList *dir_list = NULL;
-	GSList *file_list = NULL;
-	GSList *elem;
-
-	foreach_slist (elem, leaf_list)
-	{
-		gchar **path_arr = elem->data;
+	GIcon *icon = NULL;
 
-		if (path_arr[level+1] != NULL)
-			dir_list = g_slist_prepend(dir_list, path_arr);
-		else
-			file_list = g_slist_prepend(file_list, path_arr);
-	}
-
-	foreach_slist (elem, file_list)
+	if (content_type)
 	{
-		GtkTreeIter iter;
-		gchar **path_arr = elem->data;
-		GIcon *icon = NULL;
-		gchar *content_type = g_content_type_guess(path_arr[level], NULL, 0, NULL);
-
-		if (content_type)
-		{
-			icon = g_content_type_get_icon(content_type);
-			if (icon)
-			{
-				GtkIconInfo *icon_info;
-
-				icon_info = gtk_icon_theme_lookup_by_gicon(gtk_icon_theme_get_default(), icon, 16, 0);
-				if (!icon_info)
-				{
-					g_object_unref(icon);
-					icon = NULL;
-				}
-				else
-					gtk_icon_info_free(icon_info);
-			}
-			g_free(content_type);
-		}
-
-		if (patterns_match(header_patterns, path_arr[level]))
-		{
-			if (! icon)
-				icon = g_icon_new_for_string("prjorg-header", NULL);
-
-			gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-				FILEVIEW_COLUMN_ICON, icon,
-				FILEVIEW_COLUMN_NAME, path_arr[level],
-				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-		}
-		else if (patterns_match(source_patterns, path_arr[level]))
-		{
-			if (! icon)
-				icon = g_icon_new_for_string("prjorg-source", NULL);
-
-			gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-				FILEVIEW_COLUMN_ICON, icon,
-				FILEVIEW_COLUMN_NAME, path_arr[level],
-				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-		}
-		else
-		{
-			if (! icon)
-				icon = g_icon_new_for_string("prjorg-file", NULL);
-
-			gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-				FILEVIEW_COLUMN_ICON, icon,
-				FILEVIEW_COLUMN_NAME, path_arr[level],
-				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-		}
-
+		icon = g_content_type_get_icon(content_type);
 		if (icon)
-			g_object_unref(icon);
-	}
-
-	if (dir_list)
-	{
-		GSList *tmp_list = NULL;
-		GtkTreeIter iter;
-		gchar **path_arr = dir_list->data;
-		gchar *last_dir_name;
-		GIcon *icon_dir = g_icon_new_for_string("folder", NULL);
-
-		last_dir_name = path_arr[level];
-
-		foreach_slist (elem, dir_list)
 		{
-			gboolean dir_changed;
+			GtkIconInfo *icon_info;
 
-			path_arr = (gchar **) elem->data;
-			dir_changed = g_strcmp0(last_dir_name, path_arr[level]) != 0;
-
-			if (dir_changed)
+			icon_info = gtk_icon_theme_lookup_by_gicon(gtk_icon_theme_get_default(), icon, 16, 0);
+			if (!icon_info)
 			{
-				gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-					FILEVIEW_COLUMN_ICON, icon_dir,
-					FILEVIEW_COLUMN_NAME, last_dir_name,
-					FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-
-				create_branch(level+1, tmp_list, &iter, header_patterns, source_patterns, project);
-
-				g_slist_free(tmp_list);
-				tmp_list = NULL;
-				last_dir_name = path_arr[level];
+				g_object_unref(icon);
+				icon = NULL;
 			}
-
-			tmp_list = g_slist_prepend(tmp_list, path_arr);
+			else
+				gtk_icon_info_free(icon_info);
 		}
+	}
 
-		gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-			FILEVIEW_COLUMN_ICON, icon_dir,
-			FILEVIEW_COLUMN_NAME, last_dir_name,
-			FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-
-		create_branch(level+1, tmp_list, &iter, header_patterns, source_patterns, project);
+	if (icon)
+		return icon;
 
-		g_slist_free(tmp_list);
-		g_slist_free(dir_list);
-		g_object_unref(icon_dir);
-	}
+	if (patterns_match(header_patterns, utf8_name))
+		return g_icon_new_for_string("prjorg-header", NULL);
+	else if (patterns_match(source_patterns, utf8_name))
+		return g_icon_new_for_string("prjorg-source", NULL);
 
-	g_slist_free(file_list);
+	return g_icon_new_for_string("prjorg-file", NULL);
 }
 
 
 static void set_intro_message(const gchar *msg)
 {
-	GtkTreeIter iter;
-
-	gtk_tree_store_insert_with_values(s_file_store, &iter, NULL, -1,
-		FILEVIEW_COLUMN_NAME, msg, -1);
+	prjorg_tree_model_append(s_file_store, NULL, msg, FALSE, FALSE);
 
 	gtk_widget_set_sensitive(s_project_toolbar.expand, FALSE);
 	gtk_widget_set_sensitive(s_project_toolbar.collapse, FALSE);
@@ -1015,80 +944,87 @@ static void set_intro_message(const gchar *msg)
 }
 
 
-static int rev_strcmp(const char *str1, const char *str2)
+/* Returns the path relative to the root directory pointing into utf8_path or NULL. */
+static const gchar *get_root_relative_path(PrjOrgRoot *root, const gchar *utf8_path)
 {
-	return strcmp(str2, str1);
+	gsize len = strlen(root->base_dir);
+
+	if (strncmp(root->base_dir, utf8_path, len) != 0)
+		return NULL;
+	if (len > 0 && !G_IS_DIR_SEPARATOR(root->base_dir[len - 1]))
+	{
+		if (!G_IS_DIR_SEPARATOR(utf8_path[len]))
+			return NULL;
+		len++;
+	}
+	return utf8_path[len] != '\0' ? utf8_path + len : NULL;
 }
 
 
-static void load_project_root(PrjOrgRoot *root, GtkTreeIter *parent, GSList *header_patterns, GSList *source_patterns, gboolean project)
+static GIcon *get_tree_icon(const gchar *utf8_name, const gchar *content_type, gpointer user_data)
+{
+	return get_file_icon(utf8_name, content_type, s_header_patterns, s_source_patterns);
+}
+
+
+static void free_icon_patterns(void)
+{
+	patterns_free(s_header_patterns);
+	patterns_free(s_source_patterns);
+	s_header_patterns = NULL;
+	s_source_patterns = NULL;
+}
+
+
+static void load_project_root(PrjOrgRoot *root, GtkTreeIter *parent, gboolean project)
 {
-	GSList *lst = NULL;
-	GSList *path_list = NULL;
-	GSList *elem;
 	GHashTableIter iter;
 	gpointer key, value;
 
+	/* the model sorts the directory contents only when they are shown */
 	g_hash_table_iter_init(&iter, root->file_table);
 	while (g_hash_table_iter_next(&iter, &key, &value))
 	{
-		gchar *path = get_relative_path(root->base_dir, key);
-		lst = g_slist_prepend(lst, path);
-	}
-	/* sort in reverse order so we can prepend nodes to the tree store -
-	 * the store behaves as a linked list and prepending is faster */
-	lst = g_slist_sort(lst, (GCompareFunc) rev_strcmp);
-
-	foreach_slist (elem, lst)
-	{
-		gchar **path_split;
+		const gchar *rel_path = get_root_relative_path(root, key);
 
-		path_split = g_strsplit_set(elem->data, "/\\", 0);
-		path_list = g_slist_prepend(path_list, path_split);
+		if (rel_path)
+			prjorg_tree_model_add_file(s_file_store, parent, rel_path);
 	}
 
-	if (path_list != NULL)
-		create_branch(0, path_list, parent, header_patterns, source_patterns, project);
-
 	if (project)
 	{
-		if (path_list != NULL)
+		if (g_hash_table_size(root->file_table) > 0)
 		{
 			gtk_widget_set_sensitive(s_project_toolbar.expand, TRUE);
 			gtk_widget_set_sensitive(s_project_toolbar.collapse, TRUE);
 			gtk_widget_set_sensitive(s_project_toolbar.follow, TRUE);
 			gtk_widget_set_sensitive(s_project_toolbar.add, TRUE);
 		}
-		else
+		else if (!prjorg_project_is_scanning())
 			set_intro_message(_("Set file patterns under Project->Properties"));
 	}
-
-	g_slist_foreach(lst, (GFunc) g_free, NULL);
-	g_slist_free(lst);
-	g_slist_foreach(path_list, (GFunc) g_strfreev, NULL);
-	g_slist_free(path_list);
 }
 
 
 static void load_project(void)
 {
-	GSList *elem, *header_patterns, *source_patterns;
+	GSList *elem;
 	GtkTreeIter iter;
 	gboolean first = TRUE;
-	GIcon *icon_dir;
 
-	gtk_tree_store_clear(s_file_store);
+	prjorg_tree_model_clear(s_file_store);
+	g_hash_table_remove_all(s_root_iters);
+	free_icon_patterns();
 
 	if (!prj_org || !geany_data->app->project)
 		return;
 
-	icon_dir = g_icon_new_for_string("folder", NULL);
-
-	header_patterns = get_precompiled_patterns(prj_org->header_patterns);
-	source_patterns = get_precompiled_patterns(prj_org->source_patterns);
+	s_header_patterns = get_precompiled_patterns(prj_org->header_patterns);
+	s_source_patterns = get_precompiled_patterns(prj_org->source_patterns);
 
 	/* reload on every refresh to update the color e.g. when the theme changes */
 	s_external_color = gtk_widget_get_style(s_toolbar)->bg[GTK_STATE_NORMAL];
+	prjorg_tree_model_set_external_color(s_file_store, &s_external_color);
 
 	foreach_slist (elem, prj_org->roots)
 	{
@@ -1100,119 +1036,92 @@ static void load_project(void)
 		else
 			name = g_strdup(root->base_dir);
 
-		gtk_tree_store_insert_with_values(s_file_store, &iter, NULL, -1,
-			FILEVIEW_COLUMN_ICON, icon_dir,
-			FILEVIEW_COLUMN_NAME, name,
-			FILEVIEW_COLUMN_COLOR, first ? NULL : &s_external_color, -1);
-
-		load_project_root(root, &iter, header_patterns, source_patterns, first);
+		prjorg_tree_model_append(s_file_store, &iter, name, TRUE, !first);
+		g_hash_table_insert(s_root_iters, root, g_memdup(&iter, sizeof(GtkTreeIter)));
+		load_project_root(root, &iter, first);
 
 		first = FALSE;
 		g_free(name);
 	}
 
 	collapse();
-
-	g_slist_foreach(header_patterns, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(header_patterns);
-	g_slist_foreach(source_patterns, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(source_patterns);
-	g_object_unref(icon_dir);
 }
 
 
-static gboolean find_in_tree(GtkTreeIter *parent, gchar **path_split, gint level, GtkTreeIter *ret)
+/* The model iters persist so the root rows are remembered when they are
+ * created - their position isn't usable because of the intro message row. */
+static gboolean get_root_iter(PrjOrgRoot *root, GtkTreeIter *root_iter)
 {
-	GtkTreeModel *model;
-	GtkTreeIter iter;
-	gboolean iterate;
-
-	model = GTK_TREE_MODEL(s_file_store);
+	GtkTreeIter *iter;
 
-	iterate = gtk_tree_model_iter_children(model, &iter, parent);
-	while (iterate)
-	{
-		gchar *name;
-		gint cmpres;
-
-		gtk_tree_model_get(model, &iter, FILEVIEW_COLUMN_NAME, &name, -1);
-
-		cmpres = g_strcmp0(name, path_split[level]);
-		g_free(name);
-		if (cmpres == 0)
-		{
-			GtkTreeIter foo;
-			if (path_split[level+1] == NULL && !gtk_tree_model_iter_children (model, &foo, &iter))
-			{
-				*ret = iter;
-				return TRUE;
-			}
-			else
-				return find_in_tree(&iter, path_split, level + 1, ret);
-		}
+	if (!prj_org || !geany_data->app->project)
+		return FALSE;
 
-		iterate = gtk_tree_model_iter_next(model, &iter);
-	}
+	iter = g_hash_table_lookup(s_root_iters, root);
+	if (!iter)
+		return FALSE;
 
-	return FALSE;
+	*root_iter = *iter;
+	return TRUE;
 }
 
 
 static gboolean follow_editor_on_idle(gpointer foo)
 {
 	GtkTreeIter root_iter, found_iter;
-	gchar *utf8_path = NULL;
-	gchar **path_split;
 	GeanyDocument *doc;
 	GSList *elem;
-	GtkTreeModel *model;
 
 	doc = document_get_current();
 
 	if (!doc || !doc->file_name || !geany_data->app->project || !prj_org)
 		return FALSE;
 
-	model = GTK_TREE_MODEL(s_file_store);
-	gtk_tree_model_iter_children(model, &root_iter, NULL);
 	foreach_slist (elem, prj_org->roots)
 	{
 		PrjOrgRoot *root = elem->data;
+		const gchar *rel_path = get_root_relative_path(root, doc->file_name);
 
-		utf8_path = get_relative_path(root->base_dir, doc->file_name);
-		if (utf8_path)
-			break;
+		if (rel_path && get_root_iter(root, &root_iter) &&
+			prjorg_tree_model_find_file(s_file_store, &root_iter, rel_path, &found_iter))
+		{
+			GtkTreePath *tree_path;
+			GtkTreeSelection *treesel;
+
+			tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(s_file_store), &found_iter);
+
+			gtk_tree_view_expand_to_path(GTK_TREE_VIEW(s_file_view), tree_path);
+			gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(s_file_view), tree_path,
+				NULL, FALSE, 0.0, 0.0);
 
-		g_free(utf8_path);
-		utf8_path = NULL;
-		if (!gtk_tree_model_iter_next(model, &root_iter))
+			treesel = gtk_tree_view_get_selection(GTK_TREE_VIEW(s_file_view));
+			gtk_tree_selection_select_iter(treesel, &found_iter);
+			gtk_tree_path_free(tree_path);
 			break;
+		}
 	}
 
-	if (!utf8_path)
-		return FALSE;
+	return FALSE;
+}
 
-	path_split = g_strsplit_set(utf8_path, "/\\", 0);
 
-	if (find_in_tree(&root_iter, path_split, 0, &found_iter))
-	{
-		GtkTreePath *tree_path;
-		GtkTreeSelection *treesel;
+void prjorg_sidebar_add_file(PrjOrgRoot *root, const gchar *utf8_filename)
+{
+	GtkTreeIter root_iter;
+	const gchar *rel_path = get_root_relative_path(root, utf8_filename);
 
-		tree_path = gtk_tree_model_get_path (model, &found_iter);
+	if (rel_path && get_root_iter(root, &root_iter))
+		prjorg_tree_model_add_file(s_file_store, &root_iter, rel_path);
+}
 
-		gtk_tree_view_expand_to_path(GTK_TREE_VIEW(s_file_view), tree_path);
-		gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(s_file_view), tree_path,
-			NULL, FALSE, 0.0, 0.0);
 
-		treesel = gtk_tree_view_get_selection(GTK_TREE_VIEW(s_file_view));
-		gtk_tree_selection_select_iter(treesel, &found_iter);
-		gtk_tree_path_free(tree_path);
-	}
-
-	g_free(utf8_path);
-	g_strfreev(path_split);
+void prjorg_sidebar_remove_file(PrjOrgRoot *root, const gchar *utf8_filename)
+{
+	GtkTreeIter root_iter;
+	const gchar *rel_path = get_root_relative_path(root, utf8_filename);
 
-	return FALSE;
+	if (rel_path && get_root_iter(root, &root_iter))
+		prjorg_tree_model_remove_file(s_file_store, &root_iter, rel_path);
 }
 
 
@@ -1319,7 +1228,8 @@ void prjorg_sidebar_init(void)
 
 	s_file_view = gtk_tree_view_new();
 
-	s_file_store = gtk_tree_store_new(FILEVIEW_N_COLUMNS, G_TYPE_ICON, G_TYPE_STRING, GDK_TYPE_COLOR);
+	s_file_store = prjorg_tree_model_new(get_tree_icon, NULL);
+	s_root_iters = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
 	gtk_tree_view_set_model(GTK_TREE_VIEW(s_file_view), GTK_TREE_MODEL(s_file_store));
 
 	renderer = gtk_cell_renderer_pixbuf_new();
@@ -1448,5 +1358,10 @@ void prjorg_sidebar_activate(gboolean activate)
 
 void prjorg_sidebar_cleanup(void)
 {
+	free_tag_results();
 	gtk_widget_destroy(s_file_view_vbox);
+	g_object_unref(s_file_store);
+	g_hash_table_destroy(s_root_iters);
+	s_root_iters = NULL;
+	free_icon_patterns();
 }
@@ -29,6 +29,9 @@ void prjorg_sidebar_find_tag_in_active(void);
 
 void prjorg_sidebar_update(gboolean reload);
 
+void prjorg_sidebar_add_file(PrjOrgRoot *root, const gchar *utf8_filename);
+void prjorg_sidebar_remove_file(PrjOrgRoot *root, const gchar *utf8_filename);
+
 
 
 #endif
@@ -0,0 +1,501 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Tag index
+ *
+ * The tags of the project source files are kept in an array sorted by their
+ * case-insensitive name so exact and prefix lookups are a binary search. Pattern
+ * lookups use a trigram index over the distinct names to get a short list of
+ * candidates. Removed files are dropped from the index immediately because their
+ * tags are freed together with the source file; added files are merged into the
+ * sorted array on the next lookup. Tags of open documents belong to Geany and
+ * are matched directly. Names found in neither fall back to a linear search of
+ * the workspace tag arrays so tags of other TM files and the global tags are
+ * still found. */
+
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "prjorg-tags.h"
+
+extern GeanyPlugin *geany_plugin;
+extern GeanyData *geany_data;
+extern GeanyFunctions *geany_functions;
+
+typedef struct
+{
+	TMTag *tag;
+	/* stored separately so the entry can be dropped without touching the tag */
+	TMSourceFile *sf;
+} TagEntry;
+
+/* TagEntry sorted by tag_entry_cmp() */
+static GArray *s_entries = NULL;
+/* TagEntry of added files, not merged into s_entries yet */
+static GArray *s_pending = NULL;
+/* set of the indexed TMSourceFiles */
+static GHashTable *s_files = NULL;
+/* trigram -> GArray of s_entries indices where a group of equally named tags starts;
+ * NULL when it has to be rebuilt */
+static GHashTable *s_trigrams = NULL;
+
+
+#define ENTRY(i) (&g_array_index(s_entries, TagEntry, (i)))
+
+
+static void tags_init(void)
+{
+	if (s_entries)
+		return;
+
+	s_entries = g_array_new(FALSE, FALSE, sizeof(TagEntry));
+	s_pending = g_array_new(FALSE, FALSE, sizeof(TagEntry));
+	s_files = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+
+static void trigrams_invalidate(void)
+{
+	if (s_trigrams)
+		g_hash_table_destroy(s_trigrams);
+	s_trigrams = NULL;
+}
+
+
+static gint tag_entry_cmp(gconstpointer a, gconstpointer b)
+{
+	const TagEntry *e1 = a;
+	const TagEntry *e2 = b;
+	gint res;
+
+	res = g_ascii_strcasecmp(e1->tag->name, e2->tag->name);
+	if (res == 0)
+		res = strcmp(e1->tag->name, e2->tag->name);
+	return res;
+}
+
+
+static void filter_entries(GArray *entries, GHashTable *removed_files)
+{
+	guint i, j = 0;
+
+	for (i = 0; i < entries->len; i++)
+	{
+		TagEntry *entry = &g_array_index(entries, TagEntry, i);
+
+		if (!g_hash_table_lookup(removed_files, entry->sf))
+		{
+			if (i != j)
+				g_array_index(entries, TagEntry, j) = *entry;
+			j++;
+		}
+	}
+	g_array_set_size(entries, j);
+}
+
+
+/* Has to be called before the source files are freed or re-parsed. */
+void prjorg_tags_remove_source_files(GPtrArray *source_files)
+{
+	GHashTable *removed_files;
+	guint i;
+
+	if (!s_entries)
+		return;
+
+	removed_files = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0; i < source_files->len; i++)
+	{
+		TMSourceFile *sf = source_files->pdata[i];
+
+		if (g_hash_table_remove(s_files, sf))
+			g_hash_table_insert(removed_files, sf, sf);
+	}
+
+	if (g_hash_table_size(removed_files) > 0)
+	{
+		guint len = s_entries->len;
+
+		filter_entries(s_entries, removed_files);
+		filter_entries(s_pending, removed_files);
+		if (s_entries->len != len)
+			trigrams_invalidate();
+	}
+
+	g_hash_table_destroy(removed_files);
+}
+
+
+/* Has to be called after the source files were parsed. */
+void prjorg_tags_add_source_files(GPtrArray *source_files)
+{
+	GPtrArray *reparsed;
+	guint i, j;
+
+	tags_init();
+
+	/* files added again carry new tags - the old entries have to go first */
+	reparsed = g_ptr_array_new();
+	for (i = 0; i < source_files->len; i++)
+	{
+		if (g_hash_table_lookup(s_files, source_files->pdata[i]))
+			g_ptr_array_add(reparsed, source_files->pdata[i]);
+	}
+	if (reparsed->len > 0)
+		prjorg_tags_remove_source_files(reparsed);
+	g_ptr_array_free(reparsed, TRUE);
+
+	for (i = 0; i < source_files->len; i++)
+	{
+		TMSourceFile *sf = source_files->pdata[i];
+
+		g_hash_table_insert(s_files, sf, sf);
+		if (!sf->tags_array)
+			continue;
+
+		for (j = 0; j < sf->tags_array->len; j++)
+		{
+			TagEntry entry = {sf->tags_array->pdata[j], sf};
+
+			g_array_append_val(s_pending, entry);
+		}
+	}
+}
+
+
+void prjorg_tags_clear(void)
+{
+	if (!s_entries)
+		return;
+
+	trigrams_invalidate();
+	g_array_free(s_entries, TRUE);
+	g_array_free(s_pending, TRUE);
+	g_hash_table_destroy(s_files);
+	s_entries = NULL;
+	s_pending = NULL;
+	s_files = NULL;
+}
+
+
+static void merge_pending(void)
+{
+	GArray *merged;
+	guint i = 0, j = 0;
+
+	if (s_pending->len == 0)
+		return;
+
+	g_array_sort(s_pending, tag_entry_cmp);
+
+	merged = g_array_sized_new(FALSE, FALSE, sizeof(TagEntry), s_entries->len + s_pending->len);
+	while (i < s_entries->len && j < s_pending->len)
+	{
+		TagEntry *e1 = ENTRY(i);
+		TagEntry *e2 = &g_array_index(s_pending, TagEntry, j);
+
+		if (tag_entry_cmp(e1, e2) <= 0)
+		{
+			g_array_append_val(merged, *e1);
+			i++;
+		}
+		else
+		{
+			g_array_append_val(merged, *e2);
+			j++;
+		}
+	}
+	if (i < s_entries->len)
+		g_array_append_vals(merged, ENTRY(i), s_entries->len - i);
+	if (j < s_pending->len)
+		g_array_append_vals(merged, &g_array_index(s_pending, TagEntry, j), s_pending->len - j);
+
+	g_array_free(s_entries, TRUE);
+	s_entries = merged;
+	g_array_set_size(s_pending, 0);
+	trigrams_invalidate();
+}
+
+
+static gboolean is_trigram(const gchar *str)
+{
+	/* non-ASCII characters aren't case-folded the same way by the pattern
+	 * matching so they can't be used to rule out candidates */
+	return str[0] && str[1] && str[2] &&
+		!(str[0] & 0x80) && !(str[1] & 0x80) && !(str[2] & 0x80);
+}
+
+
+static gpointer get_trigram(const gchar *str)
+{
+	return GUINT_TO_POINTER((guint)g_ascii_tolower(str[0]) << 16 |
+		(guint)g_ascii_tolower(str[1]) << 8 | (guint)g_ascii_tolower(str[2]));
+}
+
+
+static void build_trigrams(void)
+{
+	guint i;
+
+	s_trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+
+	for (i = 0; i < s_entries->len; i++)
+	{
+		const gchar *name = ENTRY(i)->tag->name;
+		const gchar *p;
+
+		/* only the first tag of a group with the same name is indexed */
+		if (i > 0 && g_ascii_strcasecmp(name, ENTRY(i - 1)->tag->name) == 0)
+			continue;
+
+		for (p = name; p[0] && p[1] && p[2]; p++)
+		{
+			gpointer trigram;
+			GArray *postings;
+
+			if (!is_trigram(p))
+				continue;
+
+			trigram = get_trigram(p);
+			postings = g_hash_table_lookup(s_trigrams, trigram);
+			if (!postings)
+			{
+				postings = g_array_new(FALSE, FALSE, sizeof(guint));
+				g_hash_table_insert(s_trigrams, trigram, postings);
+			}
+			if (postings->len == 0 || g_array_index(postings, guint, postings->len - 1) != i)
+				g_array_append_val(postings, i);
+		}
+	}
+}
+
+
+/* Returns the postings of the pattern's rarest trigram, NULL when the pattern
+ * contains no trigram. Sets no_match when some trigram doesn't occur at all. */
+static GArray *get_pattern_postings(const gchar *pattern, gboolean *no_match)
+{
+	GArray *best = NULL;
+	const gchar *p;
+
+	*no_match = FALSE;
+
+	for (p = pattern; p[0] && p[1] && p[2]; p++)
+	{
+		GArray *postings;
+
+		if (!is_trigram(p) || strchr("*?", p[0]) || strchr("*?", p[1]) || strchr("*?", p[2]))
+			continue;
+
+		postings = g_hash_table_lookup(s_trigrams, get_trigram(p));
+		if (!postings)
+		{
+			*no_match = TRUE;
+			return NULL;
+		}
+		if (!best || postings->len < best->len)
+			best = postings;
+	}
+
+	return best;
+}
+
+
+static gboolean name_matches(const gchar *tag_name, const gchar *name, gboolean case_sensitive,
+	MatchType match_type, GPatternSpec *pspec)
+{
+	switch (match_type)
+	{
+		case MATCH_FULL:
+			if (case_sensitive)
+				return strcmp(tag_name, name) == 0;
+			return g_ascii_strcasecmp(tag_name, name) == 0;
+		case MATCH_PREFIX:
+			if (case_sensitive)
+				return strncmp(tag_name, name, strlen(name)) == 0;
+			return g_ascii_strncasecmp(tag_name, name, strlen(name)) == 0;
+		case MATCH_PATTERN:
+		{
+			gchar *name_case;
+			gboolean matches;
+
+			if (case_sensitive)
+				return g_pattern_match_string(pspec, tag_name);
+
+			name_case = g_utf8_strdown(tag_name, -1);
+			matches = g_pattern_match_string(pspec, name_case);
+			g_free(name_case);
+			return matches;
+		}
+	}
+	return FALSE;
+}
+
+
+static gint name_cmp(const gchar *tag_name, const gchar *name, MatchType match_type)
+{
+	if (match_type == MATCH_PREFIX)
+		return g_ascii_strncasecmp(tag_name, name, strlen(name));
+	return g_ascii_strcasecmp(tag_name, name);
+}
+
+
+/* index of the first entry whose name compares greater or equal (or greater
+ * when upper is set) to the searched name */
+static guint bisect(const gchar *name, MatchType match_type, gboolean upper)
+{
+	guint lo = 0, hi = s_entries->len;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+		gint cmp = name_cmp(ENTRY(mid)->tag->name, name, match_type);
+
+		if (cmp < 0 || (upper && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static void find_in_range(GPtrArray *result, guint start, guint end, const gchar *name,
+	gboolean case_sensitive, MatchType match_type, GPatternSpec *pspec)
+{
+	guint i;
+
+	for (i = start; i < end; i++)
+	{
+		TMTag *tag = ENTRY(i)->tag;
+
+		if (name_matches(tag->name, name, case_sensitive, match_type, pspec))
+			g_ptr_array_add(result, tag);
+	}
+}
+
+
+static void find_pattern(GPtrArray *result, const gchar *name, gboolean case_sensitive, GPatternSpec *pspec)
+{
+	GArray *postings;
+	gboolean no_match;
+	guint i;
+
+	if (!s_trigrams)
+		build_trigrams();
+
+	postings = get_pattern_postings(name, &no_match);
+	if (no_match)
+		return;
+
+	if (!postings)
+	{
+		/* too short for trigrams - check everything */
+		find_in_range(result, 0, s_entries->len, name, case_sensitive, MATCH_PATTERN, pspec);
+		return;
+	}
+
+	for (i = 0; i < postings->len; i++)
+	{
+		guint start = g_array_index(postings, guint, i);
+		guint end;
+
+		for (end = start + 1; end < s_entries->len; end++)
+		{
+			if (g_ascii_strcasecmp(ENTRY(end)->tag->name, ENTRY(start)->tag->name) != 0)
+				break;
+		}
+		find_in_range(result, start, end, name, case_sensitive, MATCH_PATTERN, pspec);
+	}
+}
+
+
+/* Returns the tags of the project files and of the open documents whose name
+ * matches. The tags are valid until the workspace changes. */
+GPtrArray *prjorg_tags_find(const gchar *name, gboolean case_sensitive, MatchType match_type)
+{
+	GPtrArray *result = g_ptr_array_new();
+	GPatternSpec *pspec = NULL;
+	gchar *name_case = NULL;
+	guint i, j;
+
+	if (match_type == MATCH_PATTERN)
+	{
+		name_case = case_sensitive ? g_strdup(name) : g_utf8_strdown(name, -1);
+		pspec = g_pattern_spec_new(name_case);
+	}
+
+	if (s_entries)
+	{
+		merge_pending();
+
+		if (match_type == MATCH_PATTERN)
+			find_pattern(result, name_case, case_sensitive, pspec);
+		else
+			find_in_range(result, bisect(name, match_type, FALSE), bisect(name, match_type, TRUE),
+				name, case_sensitive, match_type, pspec);
+	}
+
+	foreach_document(i)
+	{
+		TMSourceFile *sf = documents[i]->tm_file;
+
+		if (!sf || !sf->tags_array)
+			continue;
+
+		for (j = 0; j < sf->tags_array->len; j++)
+		{
+			TMTag *tag = sf->tags_array->pdata[j];
+
+			if (name_matches(tag->name, match_type == MATCH_PATTERN ? name_case : name,
+					case_sensitive, match_type, pspec))
+				g_ptr_array_add(result, tag);
+		}
+	}
+
+	if (result->len == 0)
+	{
+		GPtrArray *arrays[2];
+
+		arrays[0] = geany_data->app->tm_workspace->tags_array;
+		arrays[1] = geany_data->app->tm_workspace->global_tags;
+		for (i = 0; i < G_N_ELEMENTS(arrays); i++)
+		{
+			if (!arrays[i])
+				continue;
+
+			for (j = 0; j < arrays[i]->len; j++)
+			{
+				TMTag *tag = arrays[i]->pdata[j];
+
+				if (name_matches(tag->name, match_type == MATCH_PATTERN ? name_case : name,
+						case_sensitive, match_type, pspec))
+					g_ptr_array_add(result, tag);
+			}
+		}
+	}
+
+	if (pspec)
+		g_pattern_spec_free(pspec);
+	g_free(name_case);
+
+	return result;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_TAGS_H__
+#define __PRJORG_TAGS_H__
+
+typedef enum
+{
+	MATCH_FULL,
+	MATCH_PREFIX,
+	MATCH_PATTERN
+} MatchType;
+
+void prjorg_tags_add_source_files(GPtrArray *source_files);
+void prjorg_tags_remove_source_files(GPtrArray *source_files);
+void prjorg_tags_clear(void);
+
+GPtrArray *prjorg_tags_find(const gchar *name, gboolean case_sensitive, MatchType match_type);
+
+#endif
@@ -0,0 +1,641 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Sidebar tree model
+ *
+ * A GtkTreeModel on top of a directory trie. Nodes only store an interned name,
+ * so e.g. thousands of Makefile.am share a single string, and the icons are
+ * looked up per content type when a row gets drawn. Children of a directory
+ * are kept in insertion order until the view asks for them the first time
+ * (usually when the row is expanded) - only then they are sorted and get their
+ * row indices. Rows which were never seen by the view don't emit any signals,
+ * which makes loading a big project cheap. Every directory has a hash table of
+ * its children so a path is resolved to its row in O(depth). */
+
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "prjorg-tree.h"
+
+typedef struct _TreeNode TreeNode;
+
+struct _TreeNode
+{
+	const gchar *name;  /* interned */
+	TreeNode *parent;
+	GPtrArray *children;  /* NULL for files */
+	GHashTable *child_table;  /* name -> TreeNode, NULL for files */
+	guint index;  /* position in parent->children when the parent is sorted */
+	guint is_sorted : 1;
+	guint is_external : 1;
+};
+
+struct _PrjOrgTreeModel
+{
+	GObject parent;
+
+	gint stamp;
+	TreeNode *root;  /* invisible, its children are the top-level rows */
+	GStringChunk *names;
+
+	GIcon *dir_icon;
+	GHashTable *icon_cache;  /* content type -> GIcon */
+	GHashTable *name_icon_cache;  /* interned name -> GIcon, for unknown content types */
+	PrjOrgTreeIconFunc icon_func;
+	gpointer icon_func_data;
+
+	GdkColor external_color;
+};
+
+struct _PrjOrgTreeModelClass
+{
+	GObjectClass parent_class;
+};
+
+
+static void prjorg_tree_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(PrjOrgTreeModel, prjorg_tree_model, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, prjorg_tree_model_tree_model_init));
+
+
+#define NODE(iter) ((TreeNode *)(iter)->user_data)
+
+
+static TreeNode *node_new(TreeNode *parent, const gchar *name, gboolean is_dir)
+{
+	TreeNode *node = g_slice_new0(TreeNode);
+
+	node->name = name;
+	node->parent = parent;
+	if (is_dir)
+	{
+		node->children = g_ptr_array_new();
+		node->child_table = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+	if (parent)
+		node->is_external = parent->is_external;
+	return node;
+}
+
+
+static void node_free(TreeNode *node)
+{
+	if (node->children)
+	{
+		guint i;
+
+		for (i = 0; i < node->children->len; i++)
+			node_free(node->children->pdata[i]);
+		g_ptr_array_free(node->children, TRUE);
+		g_hash_table_destroy(node->child_table);
+	}
+	g_slice_free(TreeNode, node);
+}
+
+
+/* directories first, both parts sorted by name */
+static gint node_cmp(gconstpointer a, gconstpointer b)
+{
+	const TreeNode *n1 = *(const TreeNode **)a;
+	const TreeNode *n2 = *(const TreeNode **)b;
+
+	if ((n1->children != NULL) != (n2->children != NULL))
+		return n1->children ? -1 : 1;
+	return strcmp(n1->name, n2->name);
+}
+
+
+static void update_indices(TreeNode *node, guint start)
+{
+	guint i;
+
+	for (i = start; i < node->children->len; i++)
+		((TreeNode *)node->children->pdata[i])->index = i;
+}
+
+
+/* Sorts the children of the node when they are requested for the first time. */
+static void materialize(TreeNode *node)
+{
+	if (node->is_sorted || !node->children)
+		return;
+
+	/* row indices are only meaningful when the parent is sorted as well */
+	if (node->parent)
+		materialize(node->parent);
+
+	g_ptr_array_sort(node->children, node_cmp);
+	update_indices(node, 0);
+	node->is_sorted = TRUE;
+}
+
+
+static void fill_iter(PrjOrgTreeModel *model, TreeNode *node, GtkTreeIter *iter)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = node;
+	iter->user_data2 = NULL;
+	iter->user_data3 = NULL;
+}
+
+
+static GtkTreePath *node_get_path(PrjOrgTreeModel *model, TreeNode *node)
+{
+	GtkTreePath *path = gtk_tree_path_new();
+
+	for (; node != model->root; node = node->parent)
+	{
+		materialize(node->parent);
+		gtk_tree_path_prepend_index(path, node->index);
+	}
+	return path;
+}
+
+
+/* whether the view may know the row of the node */
+static gboolean node_is_visible(PrjOrgTreeModel *model, TreeNode *node)
+{
+	return node != model->root && node->parent->is_sorted;
+}
+
+
+static void emit_has_child_toggled(PrjOrgTreeModel *model, TreeNode *node)
+{
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	if (!node_is_visible(model, node))
+		return;
+
+	path = node_get_path(model, node);
+	fill_iter(model, node, &iter);
+	gtk_tree_model_row_has_child_toggled(GTK_TREE_MODEL(model), path, &iter);
+	gtk_tree_path_free(path);
+}
+
+
+static TreeNode *insert_child(PrjOrgTreeModel *model, TreeNode *parent, const gchar *name,
+	gboolean is_dir)
+{
+	TreeNode *node;
+
+	node = node_new(parent, g_string_chunk_insert_const(model->names, name), is_dir);
+	g_hash_table_insert(parent->child_table, (gpointer)node->name, node);
+
+	if (parent->is_sorted)
+	{
+		GtkTreePath *path;
+		GtkTreeIter iter;
+		guint lo = 0, hi = parent->children->len;
+
+		/* the top-level rows keep the order in which they were added */
+		if (parent == model->root)
+			lo = hi;
+		else
+		{
+			while (lo < hi)
+			{
+				guint mid = lo + (hi - lo) / 2;
+
+				if (node_cmp(&parent->children->pdata[mid], &node) < 0)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+		}
+
+		g_ptr_array_add(parent->children, NULL);
+		memmove(parent->children->pdata + lo + 1, parent->children->pdata + lo,
+			(parent->children->len - lo - 1) * sizeof(gpointer));
+		parent->children->pdata[lo] = node;
+		update_indices(parent, lo);
+
+		path = node_get_path(model, node);
+		fill_iter(model, node, &iter);
+		gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+		gtk_tree_path_free(path);
+	}
+	else
+		g_ptr_array_add(parent->children, node);
+
+	if (parent->children->len == 1)
+		emit_has_child_toggled(model, parent);
+
+	return node;
+}
+
+
+static void remove_node(PrjOrgTreeModel *model, TreeNode *node)
+{
+	TreeNode *parent = node->parent;
+
+	g_hash_table_remove(parent->child_table, node->name);
+
+	if (parent->is_sorted)
+	{
+		GtkTreePath *path = node_get_path(model, node);
+
+		g_ptr_array_remove_index(parent->children, node->index);
+		update_indices(parent, node->index);
+		gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+		gtk_tree_path_free(path);
+	}
+	else
+		g_ptr_array_remove(parent->children, node);
+
+	node_free(node);
+
+	if (parent->children->len == 0)
+		emit_has_child_toggled(model, parent);
+}
+
+
+static TreeNode *find_node(TreeNode *root, gchar **path_split)
+{
+	TreeNode *node = root;
+	gint i;
+
+	for (i = 0; path_split[i] != NULL; i++)
+	{
+		if (!node->children)
+			return NULL;
+		node = g_hash_table_lookup(node->child_table, path_split[i]);
+		if (!node)
+			return NULL;
+	}
+	return node;
+}
+
+
+static GIcon *get_file_icon(PrjOrgTreeModel *model, const gchar *name)
+{
+	gchar *content_type = g_content_type_guess(name, NULL, 0, NULL);
+	GHashTable *cache;
+	gpointer key;
+	GIcon *icon;
+
+	/* the icon of an unknown type depends on the name only (e.g. the
+	 * header/source patterns), the names are interned so use them directly */
+	if (!content_type || g_content_type_is_unknown(content_type))
+	{
+		cache = model->name_icon_cache;
+		key = (gpointer)name;
+	}
+	else
+	{
+		cache = model->icon_cache;
+		key = content_type;
+	}
+
+	icon = g_hash_table_lookup(cache, key);
+	if (!icon)
+	{
+		icon = model->icon_func(name, content_type, model->icon_func_data);
+		if (icon)
+			g_hash_table_insert(cache, cache == model->icon_cache ? g_strdup(key) : key, icon);
+	}
+	g_free(content_type);
+	return icon;
+}
+
+
+/* GtkTreeModel implementation */
+
+static GtkTreeModelFlags tree_model_get_flags(GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+
+static gint tree_model_get_n_columns(GtkTreeModel *tree_model)
+{
+	return FILEVIEW_N_COLUMNS;
+}
+
+
+static GType tree_model_get_column_type(GtkTreeModel *tree_model, gint column)
+{
+	switch (column)
+	{
+		case FILEVIEW_COLUMN_ICON:
+			return G_TYPE_ICON;
+		case FILEVIEW_COLUMN_NAME:
+			return G_TYPE_STRING;
+		case FILEVIEW_COLUMN_COLOR:
+			return GDK_TYPE_COLOR;
+	}
+	return G_TYPE_INVALID;
+}
+
+
+static gboolean tree_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+	gint *indices = gtk_tree_path_get_indices(path);
+	gint depth = gtk_tree_path_get_depth(path);
+	TreeNode *node = model->root;
+	gint i;
+
+	for (i = 0; i < depth; i++)
+	{
+		if (!node->children || indices[i] < 0 || (guint)indices[i] >= node->children->len)
+			return FALSE;
+		materialize(node);
+		node = node->children->pdata[indices[i]];
+	}
+
+	fill_iter(model, node, iter);
+	return depth > 0;
+}
+
+
+static GtkTreePath *tree_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+
+	g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+
+	return node_get_path(model, NODE(iter));
+}
+
+
+static void tree_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+	TreeNode *node = NODE(iter);
+
+	g_return_if_fail(iter->stamp == model->stamp);
+
+	g_value_init(value, tree_model_get_column_type(tree_model, column));
+	switch (column)
+	{
+		case FILEVIEW_COLUMN_ICON:
+			if (node->children)
+				g_value_set_object(value, model->dir_icon);
+			else if (node->parent != model->root)  /* top-level files are messages */
+				g_value_set_object(value, get_file_icon(model, node->name));
+			break;
+		case FILEVIEW_COLUMN_NAME:
+			g_value_set_string(value, node->name);
+			break;
+		case FILEVIEW_COLUMN_COLOR:
+			if (node->is_external)
+				g_value_set_boxed(value, &model->external_color);
+			break;
+	}
+}
+
+
+static gboolean tree_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+	TreeNode *node = NODE(iter);
+	TreeNode *parent = node->parent;
+
+	g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+
+	materialize(parent);
+	if (node->index + 1 >= parent->children->len)
+		return FALSE;
+
+	iter->user_data = parent->children->pdata[node->index + 1];
+	return TRUE;
+}
+
+
+static gboolean tree_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+	GtkTreeIter *parent, gint n)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+	TreeNode *node = parent ? NODE(parent) : model->root;
+
+	if (!node->children || n < 0 || (guint)n >= node->children->len)
+		return FALSE;
+
+	materialize(node);
+	fill_iter(model, node->children->pdata[n], iter);
+	return TRUE;
+}
+
+
+static gboolean tree_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return tree_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+
+static gboolean tree_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	TreeNode *node = NODE(iter);
+
+	return node->children && node->children->len > 0;
+}
+
+
+static gint tree_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+	TreeNode *node = iter ? NODE(iter) : model->root;
+
+	return node->children ? (gint)node->children->len : 0;
+}
+
+
+static gboolean tree_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(tree_model);
+	TreeNode *node = NODE(child);
+
+	if (node->parent == model->root)
+		return FALSE;
+
+	fill_iter(model, node->parent, iter);
+	return TRUE;
+}
+
+
+static void prjorg_tree_model_tree_model_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags = tree_model_get_flags;
+	iface->get_n_columns = tree_model_get_n_columns;
+	iface->get_column_type = tree_model_get_column_type;
+	iface->get_iter = tree_model_get_iter;
+	iface->get_path = tree_model_get_path;
+	iface->get_value = tree_model_get_value;
+	iface->iter_next = tree_model_iter_next;
+	iface->iter_children = tree_model_iter_children;
+	iface->iter_has_child = tree_model_iter_has_child;
+	iface->iter_n_children = tree_model_iter_n_children;
+	iface->iter_nth_child = tree_model_iter_nth_child;
+	iface->iter_parent = tree_model_iter_parent;
+}
+
+
+static void prjorg_tree_model_finalize(GObject *object)
+{
+	PrjOrgTreeModel *model = PRJORG_TREE_MODEL(object);
+
+	node_free(model->root);
+	g_string_chunk_free(model->names);
+	g_hash_table_destroy(model->icon_cache);
+	g_hash_table_destroy(model->name_icon_cache);
+	g_object_unref(model->dir_icon);
+
+	G_OBJECT_CLASS(prjorg_tree_model_parent_class)->finalize(object);
+}
+
+
+static void prjorg_tree_model_class_init(PrjOrgTreeModelClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+	object_class->finalize = prjorg_tree_model_finalize;
+}
+
+
+static void prjorg_tree_model_init(PrjOrgTreeModel *model)
+{
+	do
+		model->stamp = g_random_int();
+	while (model->stamp == 0);
+
+	model->root = node_new(NULL, NULL, TRUE);
+	model->root->is_sorted = TRUE;
+	model->names = g_string_chunk_new(64 * 1024);
+	model->dir_icon = g_icon_new_for_string("folder", NULL);
+	model->icon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+	model->name_icon_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_object_unref);
+}
+
+
+/* public API */
+
+PrjOrgTreeModel *prjorg_tree_model_new(PrjOrgTreeIconFunc icon_func, gpointer user_data)
+{
+	PrjOrgTreeModel *model = g_object_new(PRJORG_TYPE_TREE_MODEL, NULL);
+
+	model->icon_func = icon_func;
+	model->icon_func_data = user_data;
+	return model;
+}
+
+
+void prjorg_tree_model_clear(PrjOrgTreeModel *model)
+{
+	while (model->root->children->len > 0)
+		remove_node(model, model->root->children->pdata[model->root->children->len - 1]);
+
+	/* nothing refers to the names anymore; the icons depend on the project patterns */
+	g_string_chunk_clear(model->names);
+	g_hash_table_remove_all(model->icon_cache);
+	g_hash_table_remove_all(model->name_icon_cache);
+}
+
+
+void prjorg_tree_model_set_external_color(PrjOrgTreeModel *model, const GdkColor *color)
+{
+	model->external_color = *color;
+}
+
+
+/* Appends a top-level row - either a root directory or a message. */
+void prjorg_tree_model_append(PrjOrgTreeModel *model, GtkTreeIter *iter, const gchar *name,
+	gboolean is_dir, gboolean external)
+{
+	TreeNode *node;
+
+	/* set before the row gets inserted so the view gets the right color */
+	model->root->is_external = external;
+	node = insert_child(model, model->root, name, is_dir);
+	model->root->is_external = FALSE;
+
+	if (iter)
+		fill_iter(model, node, iter);
+}
+
+
+void prjorg_tree_model_add_file(PrjOrgTreeModel *model, GtkTreeIter *root, const gchar *rel_path)
+{
+	TreeNode *node = NODE(root);
+	gchar **path_split;
+	gint i;
+
+	g_return_if_fail(root->stamp == model->stamp);
+
+	path_split = g_strsplit_set(rel_path, "/\\", 0);
+	for (i = 0; path_split[i] != NULL && node->children; i++)
+	{
+		gboolean is_dir = path_split[i+1] != NULL;
+		TreeNode *child = g_hash_table_lookup(node->child_table, path_split[i]);
+
+		/* a file and a directory of the same name can't both exist */
+		if (child && (child->children != NULL) != is_dir)
+			break;
+		if (!child)
+			child = insert_child(model, node, path_split[i], is_dir);
+		node = child;
+	}
+	g_strfreev(path_split);
+}
+
+
+/* Removes the file and the directories which became empty (but not the root). */
+void prjorg_tree_model_remove_file(PrjOrgTreeModel *model, GtkTreeIter *root, const gchar *rel_path)
+{
+	GtkTreeIter iter;
+	TreeNode *node;
+
+	if (!prjorg_tree_model_find_file(model, root, rel_path, &iter))
+		return;
+
+	node = NODE(&iter);
+	while (TRUE)
+	{
+		TreeNode *parent = node->parent;
+
+		remove_node(model, node);
+		if (parent == NODE(root) || parent->children->len > 0)
+			break;
+		node = parent;
+	}
+}
+
+
+gboolean prjorg_tree_model_find_file(PrjOrgTreeModel *model, GtkTreeIter *root, const gchar *rel_path,
+	GtkTreeIter *iter)
+{
+	gchar **path_split;
+	TreeNode *node;
+
+	g_return_val_if_fail(root->stamp == model->stamp, FALSE);
+
+	path_split = g_strsplit_set(rel_path, "/\\", 0);
+	node = find_node(NODE(root), path_split);
+	g_strfreev(path_split);
+
+	if (!node || node->children || node == NODE(root))
+		return FALSE;
+
+	fill_iter(model, node, iter);
+	return TRUE;
+}
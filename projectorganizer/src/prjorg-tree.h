@@ -0,0 +1,55 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_TREE_H__
+#define __PRJORG_TREE_H__
+
+enum
+{
+	FILEVIEW_COLUMN_ICON,
+	FILEVIEW_COLUMN_NAME,
+	FILEVIEW_COLUMN_COLOR,
+	FILEVIEW_N_COLUMNS,
+};
+
+#define PRJORG_TYPE_TREE_MODEL (prjorg_tree_model_get_type())
+#define PRJORG_TREE_MODEL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), PRJORG_TYPE_TREE_MODEL, PrjOrgTreeModel))
+#define PRJORG_IS_TREE_MODEL(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), PRJORG_TYPE_TREE_MODEL))
+
+typedef struct _PrjOrgTreeModel PrjOrgTreeModel;
+typedef struct _PrjOrgTreeModelClass PrjOrgTreeModelClass;
+
+/* returns a new reference to the icon of the file with the given name and
+ * guessed content type (which may be NULL) */
+typedef GIcon *(*PrjOrgTreeIconFunc)(const gchar *name, const gchar *content_type,
+	gpointer user_data);
+
+GType prjorg_tree_model_get_type(void);
+PrjOrgTreeModel *prjorg_tree_model_new(PrjOrgTreeIconFunc icon_func, gpointer user_data);
+
+void prjorg_tree_model_clear(PrjOrgTreeModel *model);
+void prjorg_tree_model_set_external_color(PrjOrgTreeModel *model, const GdkColor *color);
+
+void prjorg_tree_model_append(PrjOrgTreeModel *model, GtkTreeIter *iter, const gchar *name,
+	gboolean is_dir, gboolean external);
+void prjorg_tree_model_add_file(PrjOrgTreeModel *model, GtkTreeIter *root, const gchar *rel_path);
+void prjorg_tree_model_remove_file(PrjOrgTreeModel *model, GtkTreeIter *root, const gchar *rel_path);
+gboolean prjorg_tree_model_find_file(PrjOrgTreeModel *model, GtkTreeIter *root, const gchar *rel_path,
+	GtkTreeIter *iter);
+
+#endif
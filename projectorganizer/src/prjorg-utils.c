@@ -52,33 +52,22 @@ gchar *get_relative_path(const gchar *utf8_parent, const gchar *utf8_descendant)
 }
 
 
-GSList *get_precompiled_patterns(gchar **patterns)
+/* TRUE if one of the directories containing @path is a key of @dirs, the cost
+ * doesn't depend on the number of directories */
+gboolean path_in_dirs(GHashTable *dirs, const gchar *path)
 {
-	guint i;
-	GSList *pattern_list = NULL;
+	gchar *dir = g_strdup(path);
+	gchar *sep;
+	gboolean found = FALSE;
 
-	if (!patterns)
-		return NULL;
-
-	for (i = 0; patterns[i] != NULL; i++)
+	while (!found && (sep = strrchr(dir, G_DIR_SEPARATOR)) != NULL)
 	{
-		GPatternSpec *pattern_spec = g_pattern_spec_new(patterns[i]);
-		pattern_list = g_slist_prepend(pattern_list, pattern_spec);
+		*sep = '\0';
+		found = g_hash_table_lookup_extended(dirs, dir, NULL, NULL);
 	}
-	return pattern_list;
-}
-
 
-gboolean patterns_match(GSList *patterns, const gchar *str)
-{
-	GSList *elem;
-	foreach_slist (elem, patterns)
-	{
-		GPatternSpec *pattern = elem->data;
-		if (g_pattern_match_string(pattern, str))
-			return TRUE;
-	}
-	return FALSE;
+	g_free(dir);
+	return found;
 }
 
 
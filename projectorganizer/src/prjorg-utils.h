@@ -19,10 +19,10 @@
 #ifndef __PRJORG_UTILS_H__
 #define __PRJORG_UTILS_H__
 
-gchar *get_relative_path(const gchar *utf8_parent, const gchar *utf8_descendant);
+#include "prjorg-patterns.h"
 
-gboolean patterns_match(GSList *patterns, const gchar *str);
-GSList *get_precompiled_patterns(gchar **patterns);
+gchar *get_relative_path(const gchar *utf8_parent, const gchar *utf8_descendant);
+gboolean path_in_dirs(GHashTable *dirs, const gchar *path);
 
 void open_file(gchar *utf8_name);
 gchar *get_selection(void);
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Directory watching
+ *
+ * Every scanned directory gets a GFileMonitor. The reported paths are collected
+ * and passed to the project in batches so event storms like a branch switch
+ * result in a single update of the file tables, tag manager and sidebar. */
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "prjorg-project.h"
+#include "prjorg-watch.h"
+#include "prjorg-utils.h"
+
+extern GeanyPlugin *geany_plugin;
+extern GeanyData *geany_data;
+extern GeanyFunctions *geany_functions;
+
+/* inotify watches are a limited resource - don't take them all */
+#define WATCH_MAX_DIRS 16384
+/* delay between the first event and the batch processing */
+#define WATCH_BATCH_DELAY 250
+
+static GHashTable *s_monitors = NULL;  /* locale dir -> GFileMonitor */
+static GHashTable *s_pending = NULL;  /* locale path -> NULL */
+static guint s_batch_source_id = 0;
+static gboolean s_limit_reached = FALSE;
+
+
+static gboolean process_pending(gpointer user_data)
+{
+	GPtrArray *paths;
+	GHashTableIter iter;
+	gpointer key;
+
+	s_batch_source_id = 0;
+	if (!s_pending)
+		return FALSE;
+
+	paths = g_ptr_array_new_with_free_func(g_free);
+	g_hash_table_iter_init(&iter, s_pending);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		g_ptr_array_add(paths, key);
+		g_hash_table_iter_steal(&iter);
+	}
+
+	prjorg_project_apply_changes(paths);
+
+	g_ptr_array_free(paths, TRUE);
+	return FALSE;
+}
+
+
+static void add_pending(GFile *file)
+{
+	gchar *locale_path;
+
+	if (!file)
+		return;
+
+	locale_path = g_file_get_path(file);
+	if (!locale_path)
+		return;
+
+	if (!s_pending)
+		s_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	g_hash_table_insert(s_pending, locale_path, NULL);
+
+	/* not restarted by further events so long storms still get processed */
+	if (!s_batch_source_id)
+		s_batch_source_id = plugin_timeout_add(geany_plugin, WATCH_BATCH_DELAY, process_pending, NULL);
+}
+
+
+static void on_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+	GFileMonitorEvent event_type, gpointer user_data)
+{
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CREATED:
+		case G_FILE_MONITOR_EVENT_DELETED:
+			add_pending(file);
+			break;
+		case G_FILE_MONITOR_EVENT_MOVED:
+			add_pending(file);
+			add_pending(other_file);
+			break;
+		default:
+			break;
+	}
+}
+
+
+static void free_monitor(GFileMonitor *monitor)
+{
+	g_signal_handlers_disconnect_by_func(monitor, on_dir_changed, NULL);
+	g_file_monitor_cancel(monitor);
+	g_object_unref(monitor);
+}
+
+
+void prjorg_watch_add_dir(const gchar *locale_dir)
+{
+	GFileMonitor *monitor;
+	GFile *file;
+
+	if (!s_monitors)
+		s_monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_monitor);
+
+	if (g_hash_table_lookup(s_monitors, locale_dir))
+		return;
+
+	if (g_hash_table_size(s_monitors) >= WATCH_MAX_DIRS)
+	{
+		if (!s_limit_reached)
+			g_warning("Too many project directories, changes in some of them won't be noticed until reload");
+		s_limit_reached = TRUE;
+		return;
+	}
+
+	file = g_file_new_for_path(locale_dir);
+	monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	if (monitor)
+	{
+		g_signal_connect(monitor, "changed", G_CALLBACK(on_dir_changed), NULL);
+		g_hash_table_insert(s_monitors, g_strdup(locale_dir), monitor);
+	}
+	g_object_unref(file);
+}
+
+
+/* removes the monitors of the directories (locale dir -> NULL) and all their
+ * subdirectories in a single pass over the monitors */
+void prjorg_watch_remove_dirs(GHashTable *locale_dirs)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	if (!s_monitors || g_hash_table_size(locale_dirs) == 0)
+		return;
+
+	g_hash_table_iter_init(&iter, s_monitors);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		if (g_hash_table_lookup_extended(locale_dirs, key, NULL, NULL) ||
+			path_in_dirs(locale_dirs, key))
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+
+gboolean prjorg_watch_is_watched(const gchar *locale_dir)
+{
+	return s_monitors && g_hash_table_lookup(s_monitors, locale_dir) != NULL;
+}
+
+
+void prjorg_watch_clear(void)
+{
+	if (s_batch_source_id)
+		g_source_remove(s_batch_source_id);
+	s_batch_source_id = 0;
+
+	if (s_monitors)
+		g_hash_table_destroy(s_monitors);
+	s_monitors = NULL;
+
+	if (s_pending)
+		g_hash_table_destroy(s_pending);
+	s_pending = NULL;
+
+	s_limit_reached = FALSE;
+}
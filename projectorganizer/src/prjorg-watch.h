@@ -0,0 +1,27 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_WATCH_H__
+#define __PRJORG_WATCH_H__
+
+void prjorg_watch_add_dir(const gchar *locale_dir);
+void prjorg_watch_remove_dirs(GHashTable *locale_dirs);
+gboolean prjorg_watch_is_watched(const gchar *locale_dir);
+void prjorg_watch_clear(void);
+
+#endif